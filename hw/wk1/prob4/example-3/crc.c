@@ -22,7 +22,7 @@
  * Derive parameters from the standard-specific parameters in crc.h.
  */
 #define WIDTH    (8 * sizeof(crc))
-#define TOPBIT   (1 << (WIDTH - 1))
+#define TOPBIT   ((crc) 1 << (WIDTH - 1))
 
 #if (REFLECT_DATA == TRUE)
 #undef  REFLECT_DATA
@@ -168,7 +168,7 @@ crcInit(void)
         /*
          * Start with the dividend followed by zeros.
          */
-        remainder = dividend << (WIDTH - 8);
+        remainder = (crc) dividend << (WIDTH - 8);
 
         /*
          * Perform modulo-2 division, a bit at a time.
@@ -0,0 +1,931 @@
+/**********************************************************************
+ *
+ * Filename:    crc_engine.c
+ *
+ * Description: Table-driven (byte-wise, slicing-by-8, slicing-by-16)
+ *				and hardware-accelerated (SSE4.2 crc32, PCLMULQDQ)
+ *				implementations of the CRC standards in crc_engine.h.
+ *
+ * Notes:       Internally every implementation works on the raw
+ *				remainder register.  Reflected standards keep the
+ *				register in the low 'width' bits, LSB first, the same
+ *				way crcFast() does with REFLECT_DATA.  Normal (MSB
+ *				first) standards keep the register left-aligned in 32
+ *				bits so one set of table code covers every width.
+ *
+ *				The slicing tables follow the usual construction:
+ *				table[k][n] is the remainder of byte n followed by k
+ *				zero bytes, so 8 (or 16) input bytes can be folded
+ *				into the register with 8 (or 16) independent lookups.
+ *
+ *				The PCLMULQDQ path folds four 128-bit lanes forward by
+ *				64 bytes per iteration with carry-less multiplies by
+ *				x^k mod P, then folds the lanes into one and hands the
+ *				last 16 bytes to the slicing code.  The constants are
+ *				computed in crcEngineInit() from the polynomial, so the
+ *				same code serves CRC-32, CRC-32C and CRC-16.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "crc_engine.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC_ENGINE_X86
+#include <immintrin.h>
+#endif
+
+#define CRC_PCLMUL_MIN_BYTES	(128)
+#define CRC_SSE42_BLOCK			(2048)
+#define CRC_PARALLEL_MAX		(64)
+
+
+static const struct
+{
+	const char	*name;
+	int			 width;
+	uint32_t	 polynomial;
+	uint32_t	 initial;
+	uint32_t	 finalXor;
+	int			 reflected;
+	uint32_t	 check;
+} crcStandards[CRC_STD_COUNT] =
+{
+	{ "CRC-32",    32, 0x04C11DB7, 0xFFFFFFFF, 0xFFFFFFFF, 1, 0xCBF43926 },
+	{ "CRC-32C",   32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF, 1, 0xE3069283 },
+	{ "CRC-16",    16, 0x8005,     0x0000,     0x0000,     1, 0xBB3D     },
+	{ "CRC-CCITT", 16, 0x1021,     0xFFFF,     0x0000,     0, 0x29B1     },
+};
+
+static const char *crcImplNames[CRC_IMPL_COUNT] =
+{
+	"auto", "bytewise", "slice8", "slice16", "sse4.2", "pclmul"
+};
+
+
+/*********************************************************************
+ *
+ * Function:    reflect32()
+ *
+ * Description: Reflect the low nBits of data about the center bit.
+ *
+ * Returns:		The reflection of the original data.
+ *
+ *********************************************************************/
+static uint32_t
+reflect32(uint32_t data, int nBits)
+{
+	uint32_t  reflection = 0;
+	int		  bit;
+
+	for (bit = 0; bit < nBits; ++bit)
+	{
+		if (data & 0x01)
+		{
+			reflection |= ((uint32_t) 1 << ((nBits - 1) - bit));
+		}
+		data >>= 1;
+	}
+
+	return (reflection);
+
+}	/* reflect32() */
+
+
+static uint32_t
+widthMask(int width)
+{
+	return (width == 32) ? 0xFFFFFFFF : (((uint32_t) 1 << width) - 1);
+}
+
+
+static uint32_t
+loadLE32(unsigned char const *p)
+{
+	return ((uint32_t) p[0]) | ((uint32_t) p[1] << 8) |
+		   ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+
+static uint32_t
+loadBE32(unsigned char const *p)
+{
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+		   ((uint32_t) p[2] << 8) | ((uint32_t) p[3]);
+}
+
+
+/*********************************************************************
+ *
+ * Function:    mulMod()
+ *
+ * Description: Multiply two polynomials held in remainder-register
+ *				form, modulo the engine's CRC polynomial.
+ *
+ * Notes:		Used by crcEngineCombine() and to stitch together the
+ *				interleaved SSE4.2 streams.  Bit-serial, so it is only
+ *				called O(log n) times per combine.
+ *
+ * Returns:		a * b mod P, in register form.
+ *
+ *********************************************************************/
+static uint32_t
+mulMod(const crcEngine *engine, uint32_t a, uint32_t b)
+{
+	uint32_t  product = 0;
+	uint32_t  mask = widthMask(engine->width);
+
+	if (engine->reflected)
+	{
+		uint32_t  rpoly = reflect32(engine->polynomial, engine->width);
+		uint32_t  m = (uint32_t) 1 << (engine->width - 1);
+
+		if (a == 0)
+		{
+			return (0);
+		}
+
+		for (;;)
+		{
+			if (a & m)
+			{
+				product ^= b;
+				if ((a & (m - 1)) == 0)
+				{
+					break;
+				}
+			}
+			m >>= 1;
+			b = (b & 1) ? ((b >> 1) ^ rpoly) : (b >> 1);
+		}
+	}
+	else
+	{
+		uint32_t  top = (uint32_t) 1 << (engine->width - 1);
+
+		while (a)
+		{
+			if (a & 1)
+			{
+				product ^= b;
+			}
+			a >>= 1;
+			b = (b & top) ? (((b << 1) ^ engine->polynomial) & mask)
+						  : ((b << 1) & mask);
+		}
+	}
+
+	return (product);
+
+}	/* mulMod() */
+
+
+/*********************************************************************
+ *
+ * Function:    xPow8n()
+ *
+ * Description: Compute x^(8 * nBytes) mod P in register form, from the
+ *				x^(2^k) table built by crcEngineInit().
+ *
+ *********************************************************************/
+static uint32_t
+xPow8n(const crcEngine *engine, uint64_t nBytes)
+{
+	uint32_t  result = engine->reflected ? ((uint32_t) 1 << (engine->width - 1)) : 1;
+	int		  k = 3;
+
+	while (nBytes && k < 64)
+	{
+		if (nBytes & 1)
+		{
+			result = mulMod(engine, result, engine->xpow2[k]);
+		}
+		nBytes >>= 1;
+		++k;
+	}
+
+	return (result);
+
+}	/* xPow8n() */
+
+
+/*********************************************************************
+ *
+ * Function:    crcBytewise()
+ *
+ * Description: One table lookup per byte, as in crcFast().
+ *
+ *********************************************************************/
+static uint32_t
+crcBytewise(const crcEngine *engine, uint32_t remainder,
+			unsigned char const *message, size_t nBytes)
+{
+	const uint32_t  *t0 = engine->table[0];
+
+	if (engine->reflected)
+	{
+		while (nBytes--)
+		{
+			remainder = t0[(remainder ^ *message++) & 0xFF] ^ (remainder >> 8);
+		}
+	}
+	else
+	{
+		while (nBytes--)
+		{
+			remainder = t0[(remainder >> 24) ^ *message++] ^ (remainder << 8);
+		}
+	}
+
+	return (remainder);
+
+}	/* crcBytewise() */
+
+
+/*********************************************************************
+ *
+ * Function:    crcSlice8()
+ *
+ * Description: Slicing-by-8: fold 8 message bytes per iteration using
+ *				8 independent table lookups.
+ *
+ *********************************************************************/
+static uint32_t
+crcSlice8(const crcEngine *engine, uint32_t remainder,
+		  unsigned char const *message, size_t nBytes)
+{
+	const uint32_t  (*t)[256] = engine->table;
+
+	if (engine->reflected)
+	{
+		while (nBytes >= 8)
+		{
+			remainder ^= loadLE32(message);
+			remainder = t[7][remainder & 0xFF] ^
+						t[6][(remainder >> 8) & 0xFF] ^
+						t[5][(remainder >> 16) & 0xFF] ^
+						t[4][remainder >> 24] ^
+						t[3][message[4]] ^ t[2][message[5]] ^
+						t[1][message[6]] ^ t[0][message[7]];
+			message += 8;
+			nBytes -= 8;
+		}
+	}
+	else
+	{
+		while (nBytes >= 8)
+		{
+			remainder ^= loadBE32(message);
+			remainder = t[7][remainder >> 24] ^
+						t[6][(remainder >> 16) & 0xFF] ^
+						t[5][(remainder >> 8) & 0xFF] ^
+						t[4][remainder & 0xFF] ^
+						t[3][message[4]] ^ t[2][message[5]] ^
+						t[1][message[6]] ^ t[0][message[7]];
+			message += 8;
+			nBytes -= 8;
+		}
+	}
+
+	return (crcBytewise(engine, remainder, message, nBytes));
+
+}	/* crcSlice8() */
+
+
+/*********************************************************************
+ *
+ * Function:    crcSlice16()
+ *
+ * Description: Slicing-by-16: as crcSlice8(), 16 bytes per iteration.
+ *
+ *********************************************************************/
+static uint32_t
+crcSlice16(const crcEngine *engine, uint32_t remainder,
+		   unsigned char const *message, size_t nBytes)
+{
+	const uint32_t  (*t)[256] = engine->table;
+
+	if (engine->reflected)
+	{
+		while (nBytes >= 16)
+		{
+			remainder ^= loadLE32(message);
+			remainder = t[15][remainder & 0xFF] ^
+						t[14][(remainder >> 8) & 0xFF] ^
+						t[13][(remainder >> 16) & 0xFF] ^
+						t[12][remainder >> 24] ^
+						t[11][message[4]]  ^ t[10][message[5]] ^
+						t[9][message[6]]   ^ t[8][message[7]] ^
+						t[7][message[8]]   ^ t[6][message[9]] ^
+						t[5][message[10]]  ^ t[4][message[11]] ^
+						t[3][message[12]]  ^ t[2][message[13]] ^
+						t[1][message[14]]  ^ t[0][message[15]];
+			message += 16;
+			nBytes -= 16;
+		}
+	}
+	else
+	{
+		while (nBytes >= 16)
+		{
+			remainder ^= loadBE32(message);
+			remainder = t[15][remainder >> 24] ^
+						t[14][(remainder >> 16) & 0xFF] ^
+						t[13][(remainder >> 8) & 0xFF] ^
+						t[12][remainder & 0xFF] ^
+						t[11][message[4]]  ^ t[10][message[5]] ^
+						t[9][message[6]]   ^ t[8][message[7]] ^
+						t[7][message[8]]   ^ t[6][message[9]] ^
+						t[5][message[10]]  ^ t[4][message[11]] ^
+						t[3][message[12]]  ^ t[2][message[13]] ^
+						t[1][message[14]]  ^ t[0][message[15]];
+			message += 16;
+			nBytes -= 16;
+		}
+	}
+
+	return (crcSlice8(engine, remainder, message, nBytes));
+
+}	/* crcSlice16() */
+
+
+#if defined(CRC_ENGINE_X86)
+
+/*********************************************************************
+ *
+ * Function:    crcSse42()
+ *
+ * Description: CRC-32C using the SSE4.2 crc32 instruction.
+ *
+ * Notes:		The instruction has a 3 cycle latency but a throughput
+ *				of one per cycle, so large buffers are split into three
+ *				independent streams that are joined with mulMod().
+ *
+ *********************************************************************/
+__attribute__((target("sse4.2")))
+static uint32_t
+crcSse42(const crcEngine *engine, uint32_t remainder,
+		 unsigned char const *message, size_t nBytes)
+{
+	uint32_t  shift = 0;
+
+	while (nBytes && ((uintptr_t) message & 7))
+	{
+		remainder = _mm_crc32_u8(remainder, *message++);
+		--nBytes;
+	}
+
+	if (nBytes >= 3 * CRC_SSE42_BLOCK)
+	{
+		shift = xPow8n(engine, CRC_SSE42_BLOCK);
+	}
+
+	while (nBytes >= 3 * CRC_SSE42_BLOCK)
+	{
+		uint32_t			  crcA = remainder, crcB = 0, crcC = 0;
+		unsigned char const	 *end = message + CRC_SSE42_BLOCK;
+
+		while (message < end)
+		{
+#if defined(__x86_64__)
+			uint64_t  a, b, c;
+
+			memcpy(&a, message, 8);
+			memcpy(&b, message + CRC_SSE42_BLOCK, 8);
+			memcpy(&c, message + 2 * CRC_SSE42_BLOCK, 8);
+			crcA = (uint32_t) _mm_crc32_u64(crcA, a);
+			crcB = (uint32_t) _mm_crc32_u64(crcB, b);
+			crcC = (uint32_t) _mm_crc32_u64(crcC, c);
+			message += 8;
+#else
+			uint32_t  a, b, c;
+
+			memcpy(&a, message, 4);
+			memcpy(&b, message + CRC_SSE42_BLOCK, 4);
+			memcpy(&c, message + 2 * CRC_SSE42_BLOCK, 4);
+			crcA = _mm_crc32_u32(crcA, a);
+			crcB = _mm_crc32_u32(crcB, b);
+			crcC = _mm_crc32_u32(crcC, c);
+			message += 4;
+#endif
+		}
+
+		remainder = mulMod(engine, crcA, shift) ^ crcB;
+		remainder = mulMod(engine, remainder, shift) ^ crcC;
+		message += 2 * CRC_SSE42_BLOCK;
+		nBytes -= 3 * CRC_SSE42_BLOCK;
+	}
+
+#if defined(__x86_64__)
+	while (nBytes >= 8)
+	{
+		uint64_t  v;
+
+		memcpy(&v, message, 8);
+		remainder = (uint32_t) _mm_crc32_u64(remainder, v);
+		message += 8;
+		nBytes -= 8;
+	}
+#endif
+
+	while (nBytes--)
+	{
+		remainder = _mm_crc32_u8(remainder, *message++);
+	}
+
+	return (remainder);
+
+}	/* crcSse42() */
+
+
+__attribute__((target("pclmul,sse2")))
+static inline __m128i
+foldLane(__m128i lane, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(lane, k, 0x00),
+						 _mm_clmulepi64_si128(lane, k, 0x11));
+}
+
+
+/*********************************************************************
+ *
+ * Function:    crcPclmul()
+ *
+ * Description: Reflected CRC using PCLMULQDQ folding.
+ *
+ * Notes:		Each 128-bit lane L = A*x^64 + B (A = low quadword,
+ *				which holds the earlier, higher-order message bits) is
+ *				moved forward by D bits as A*(x^(D+64) mod P) +
+ *				B*(x^D mod P).  The result is congruent to L*x^D and
+ *				at most 96 bits wide, so it can simply be XOR'd into
+ *				the lane D bits further on.  See crcEngineInit() for
+ *				the constants.
+ *
+ *********************************************************************/
+__attribute__((target("pclmul,sse2")))
+static uint32_t
+crcPclmul(const crcEngine *engine, uint32_t remainder,
+		  unsigned char const *message, size_t nBytes)
+{
+	__m128i			x0, x1, x2, x3, k;
+	unsigned char	last[16];
+
+	if (nBytes < CRC_PCLMUL_MIN_BYTES)
+	{
+		return (crcSlice16(engine, remainder, message, nBytes));
+	}
+
+	/*
+	 * Bring the remainder into the first message bytes.
+	 */
+	x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) message),
+					   _mm_cvtsi32_si128((int) remainder));
+	x1 = _mm_loadu_si128((const __m128i *) (message + 16));
+	x2 = _mm_loadu_si128((const __m128i *) (message + 32));
+	x3 = _mm_loadu_si128((const __m128i *) (message + 48));
+	message += 64;
+	nBytes -= 64;
+
+	k = _mm_set_epi64x((long long) engine->fold512[1], (long long) engine->fold512[0]);
+	while (nBytes >= 64)
+	{
+		x0 = _mm_xor_si128(foldLane(x0, k), _mm_loadu_si128((const __m128i *) message));
+		x1 = _mm_xor_si128(foldLane(x1, k), _mm_loadu_si128((const __m128i *) (message + 16)));
+		x2 = _mm_xor_si128(foldLane(x2, k), _mm_loadu_si128((const __m128i *) (message + 32)));
+		x3 = _mm_xor_si128(foldLane(x3, k), _mm_loadu_si128((const __m128i *) (message + 48)));
+		message += 64;
+		nBytes -= 64;
+	}
+
+	k = _mm_set_epi64x((long long) engine->fold128[1], (long long) engine->fold128[0]);
+	x0 = _mm_xor_si128(foldLane(x0, k), x1);
+	x0 = _mm_xor_si128(foldLane(x0, k), x2);
+	x0 = _mm_xor_si128(foldLane(x0, k), x3);
+	while (nBytes >= 16)
+	{
+		x0 = _mm_xor_si128(foldLane(x0, k), _mm_loadu_si128((const __m128i *) message));
+		message += 16;
+		nBytes -= 16;
+	}
+
+	/*
+	 * The folded lane is congruent to everything seen so far, so its
+	 * CRC from a zero remainder continues the original computation.
+	 */
+	_mm_storeu_si128((__m128i *) last, x0);
+	remainder = crcSlice16(engine, 0, last, sizeof(last));
+
+	return (crcSlice16(engine, remainder, message, nBytes));
+
+}	/* crcPclmul() */
+
+#endif /* CRC_ENGINE_X86 */
+
+
+/*********************************************************************
+ *
+ * Function:    crcEngineSupported()
+ *
+ * Description: Check whether an implementation can run the given
+ *				standard on this CPU.
+ *
+ * Returns:		TRUE (1) if supported, otherwise 0.
+ *
+ *********************************************************************/
+int
+crcEngineSupported(crcStandard standard, crcImpl impl)
+{
+	if (standard < 0 || standard >= CRC_STD_COUNT)
+	{
+		return (0);
+	}
+
+	switch (impl)
+	{
+	case CRC_IMPL_AUTO:
+	case CRC_IMPL_BYTEWISE:
+	case CRC_IMPL_SLICE8:
+	case CRC_IMPL_SLICE16:
+		return (1);
+
+#if defined(CRC_ENGINE_X86)
+	case CRC_IMPL_SSE42:
+		return (standard == CRC_STD_CRC32C && __builtin_cpu_supports("sse4.2"));
+
+	case CRC_IMPL_PCLMUL:
+		return (crcStandards[standard].reflected && __builtin_cpu_supports("pclmul"));
+#endif
+
+	default:
+		return (0);
+	}
+
+}	/* crcEngineSupported() */
+
+
+const char *
+crcEngineImplName(crcImpl impl)
+{
+	return (impl >= 0 && impl < CRC_IMPL_COUNT) ? crcImplNames[impl] : "unknown";
+}
+
+
+/*********************************************************************
+ *
+ * Function:    crcEngineInit()
+ *
+ * Description: Populate the lookup tables and folding constants for a
+ *				CRC standard and select the implementation.
+ *
+ * Notes:		Like crcInit(), the tables could be computed offline
+ *				and stored in ROM; the engine itself is read-only after
+ *				this call and may be shared between threads.
+ *
+ * Returns:		0 on success, -1 if the standard or implementation is
+ *				not supported on this CPU.
+ *
+ *********************************************************************/
+int
+crcEngineInit(crcEngine *engine, crcStandard standard, crcImpl impl)
+{
+	uint32_t  remainder;
+	int		  width, dividend, bit, k;
+
+	if (engine == NULL || !crcEngineSupported(standard, impl))
+	{
+		return (-1);
+	}
+
+	memset(engine, 0, sizeof(*engine));
+	engine->name       = crcStandards[standard].name;
+	engine->width      = width = crcStandards[standard].width;
+	engine->polynomial = crcStandards[standard].polynomial;
+	engine->initial    = crcStandards[standard].initial;
+	engine->finalXor   = crcStandards[standard].finalXor;
+	engine->reflected  = crcStandards[standard].reflected;
+	engine->check      = crcStandards[standard].check;
+
+	if (impl == CRC_IMPL_AUTO)
+	{
+		if (crcEngineSupported(standard, CRC_IMPL_SSE42))
+		{
+			impl = CRC_IMPL_SSE42;
+		}
+		else if (crcEngineSupported(standard, CRC_IMPL_PCLMUL))
+		{
+			impl = CRC_IMPL_PCLMUL;
+		}
+		else
+		{
+			impl = CRC_IMPL_SLICE16;
+		}
+	}
+	engine->impl = impl;
+
+	/*
+	 * Compute the remainder of each possible dividend, then extend
+	 * each one by a zero byte per additional slicing table.
+	 */
+	for (dividend = 0; dividend < 256; ++dividend)
+	{
+		if (engine->reflected)
+		{
+			uint32_t  rpoly = reflect32(engine->polynomial, width);
+
+			remainder = (uint32_t) dividend;
+			for (bit = 8; bit > 0; --bit)
+			{
+				remainder = (remainder & 1) ? ((remainder >> 1) ^ rpoly) : (remainder >> 1);
+			}
+		}
+		else
+		{
+			uint32_t  apoly = engine->polynomial << (32 - width);
+
+			remainder = (uint32_t) dividend << 24;
+			for (bit = 8; bit > 0; --bit)
+			{
+				remainder = (remainder & 0x80000000) ? ((remainder << 1) ^ apoly) : (remainder << 1);
+			}
+		}
+		engine->table[0][dividend] = remainder;
+	}
+
+	for (k = 1; k < 16; ++k)
+	{
+		for (dividend = 0; dividend < 256; ++dividend)
+		{
+			uint32_t  prev = engine->table[k - 1][dividend];
+
+			if (engine->reflected)
+			{
+				engine->table[k][dividend] = (prev >> 8) ^ engine->table[0][prev & 0xFF];
+			}
+			else
+			{
+				engine->table[k][dividend] = (prev << 8) ^ engine->table[0][prev >> 24];
+			}
+		}
+	}
+
+	/*
+	 * x^(2^k) mod P, for combining and for the SSE4.2 stream joins.
+	 */
+	engine->xpow2[0] = engine->reflected ? ((uint32_t) 1 << (width - 2)) : 2;
+	for (k = 1; k < 64; ++k)
+	{
+		engine->xpow2[k] = mulMod(engine, engine->xpow2[k - 1], engine->xpow2[k - 1]);
+	}
+
+	/*
+	 * PCLMULQDQ folding constants.  In a reflected 64-bit quadword bit
+	 * j holds the coefficient of x^(63-j), so a carry-less product
+	 * lands one bit short of the lane layout; the constants absorb the
+	 * extra factor of x: fold by D bits uses x^(D+63) and x^(D-1).
+	 */
+	if (engine->reflected)
+	{
+		static const int  distance[2] = { 512, 128 };
+		uint64_t		  *constants[2];
+		int				  d, half;
+
+		constants[0] = engine->fold512;
+		constants[1] = engine->fold128;
+
+		for (d = 0; d < 2; ++d)
+		{
+			for (half = 0; half < 2; ++half)
+			{
+				int		  power = half ? (distance[d] - 1) : (distance[d] + 63);
+				uint64_t  r = 1;
+				uint64_t  encoded = 0;
+
+				for (k = 0; k < power; ++k)
+				{
+					r <<= 1;
+					if (r & ((uint64_t) 1 << width))
+					{
+						r ^= ((uint64_t) 1 << width) | engine->polynomial;
+					}
+				}
+				for (bit = 0; bit < width; ++bit)
+				{
+					if (r & ((uint64_t) 1 << bit))
+					{
+						encoded |= (uint64_t) 1 << (63 - bit);
+					}
+				}
+				constants[d][half] = encoded;
+			}
+		}
+	}
+
+	return (0);
+
+}	/* crcEngineInit() */
+
+
+/*********************************************************************
+ *
+ * Function:    crcEngineStart()
+ *
+ * Description: The CRC value of an empty message; pass it to the
+ *				first crcEngineUpdate() of a piecewise computation.
+ *
+ *********************************************************************/
+uint32_t
+crcEngineStart(const crcEngine *engine)
+{
+	return (engine->initial ^ engine->finalXor);
+
+}	/* crcEngineStart() */
+
+
+/*********************************************************************
+ *
+ * Function:    crcEngineUpdate()
+ *
+ * Description: Extend the CRC of a message by nBytes more bytes.
+ *
+ * Returns:		The CRC of the message so far.
+ *
+ *********************************************************************/
+uint32_t
+crcEngineUpdate(const crcEngine *engine, uint32_t crc,
+				unsigned char const message[], size_t nBytes)
+{
+	uint32_t  remainder = crc ^ engine->finalXor;
+
+	if (!engine->reflected)
+	{
+		remainder <<= (32 - engine->width);
+	}
+
+	switch (engine->impl)
+	{
+	case CRC_IMPL_BYTEWISE:
+		remainder = crcBytewise(engine, remainder, message, nBytes);
+		break;
+
+	case CRC_IMPL_SLICE8:
+		remainder = crcSlice8(engine, remainder, message, nBytes);
+		break;
+
+#if defined(CRC_ENGINE_X86)
+	case CRC_IMPL_SSE42:
+		remainder = crcSse42(engine, remainder, message, nBytes);
+		break;
+
+	case CRC_IMPL_PCLMUL:
+		remainder = crcPclmul(engine, remainder, message, nBytes);
+		break;
+#endif
+
+	default:
+		remainder = crcSlice16(engine, remainder, message, nBytes);
+		break;
+	}
+
+	if (!engine->reflected)
+	{
+		remainder >>= (32 - engine->width);
+	}
+
+	return (remainder ^ engine->finalXor);
+
+}	/* crcEngineUpdate() */
+
+
+uint32_t
+crcEngineCompute(const crcEngine *engine, unsigned char const message[], size_t nBytes)
+{
+	return (crcEngineUpdate(engine, crcEngineStart(engine), message, nBytes));
+}
+
+
+/*********************************************************************
+ *
+ * Function:    crcEngineCombine()
+ *
+ * Description: Compute CRC(A || B) from CRC(A), CRC(B) and the length
+ *				of B, without touching the message bytes.
+ *
+ * Notes:		Both CRCs must have been computed from the standard's
+ *				initial value (crcEngineStart()).  The remainder of A
+ *				is shifted past B by a multiplication with x^(8n) mod P;
+ *				the initial value's contribution to CRC(B) cancels with
+ *				the XOR of 'initial' below.
+ *
+ * Returns:		The CRC of the concatenated message.
+ *
+ *********************************************************************/
+uint32_t
+crcEngineCombine(const crcEngine *engine, uint32_t crcA, uint32_t crcB, size_t nBytesB)
+{
+	uint32_t  shifted;
+
+	if (nBytesB == 0)
+	{
+		return (crcA);
+	}
+
+	shifted = mulMod(engine, crcA ^ engine->finalXor ^ engine->initial,
+					 xPow8n(engine, nBytesB));
+
+	return (shifted ^ crcB);
+
+}	/* crcEngineCombine() */
+
+
+typedef struct
+{
+	const crcEngine		 *engine;
+	unsigned char const	 *message;
+	size_t				  nBytes;
+	uint32_t			  crc;
+} crcSlice;
+
+
+static void *
+crcSliceThread(void *arg)
+{
+	crcSlice  *slice = (crcSlice *) arg;
+
+	slice->crc = crcEngineCompute(slice->engine, slice->message, slice->nBytes);
+
+	return (NULL);
+}
+
+
+/*********************************************************************
+ *
+ * Function:    crcEngineParallel()
+ *
+ * Description: Checksum a large buffer on nThreads threads and join
+ *				the partial results with crcEngineCombine().
+ *
+ * Notes:		The calling thread computes the first slice.  If a
+ *				thread cannot be created its slice is computed inline,
+ *				so the result never depends on thread availability.
+ *
+ * Returns:		The CRC of the message.
+ *
+ *********************************************************************/
+uint32_t
+crcEngineParallel(const crcEngine *engine, unsigned char const message[],
+				  size_t nBytes, int nThreads)
+{
+	crcSlice	slices[CRC_PARALLEL_MAX];
+	pthread_t	threads[CRC_PARALLEL_MAX];
+	int			started[CRC_PARALLEL_MAX];
+	size_t		chunk, offset = 0;
+	uint32_t	crc;
+	int			i;
+
+	if (nThreads > CRC_PARALLEL_MAX)
+	{
+		nThreads = CRC_PARALLEL_MAX;
+	}
+	if (nThreads <= 1 || nBytes < (size_t) nThreads * 4096)
+	{
+		return (crcEngineCompute(engine, message, nBytes));
+	}
+
+	/* keep slices 64-byte aligned relative to the message */
+	chunk = ((nBytes / nThreads) + 63) & ~(size_t) 63;
+
+	for (i = 0; i < nThreads; ++i)
+	{
+		slices[i].engine  = engine;
+		slices[i].message = message + offset;
+		slices[i].nBytes  = (offset + chunk <= nBytes) ? chunk : (nBytes - offset);
+		offset += slices[i].nBytes;
+
+		started[i] = (i > 0) &&
+					 (pthread_create(&threads[i], NULL, crcSliceThread, &slices[i]) == 0);
+	}
+
+	for (i = 0; i < nThreads; ++i)
+	{
+		if (started[i])
+		{
+			pthread_join(threads[i], NULL);
+		}
+		else
+		{
+			crcSliceThread(&slices[i]);
+		}
+	}
+
+	crc = slices[0].crc;
+	for (i = 1; i < nThreads; ++i)
+	{
+		crc = crcEngineCombine(engine, crc, slices[i].crc, slices[i].nBytes);
+	}
+
+	return (crc);
+
+}	/* crcEngineParallel() */
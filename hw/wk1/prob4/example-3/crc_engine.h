@@ -0,0 +1,99 @@
+/**********************************************************************
+ *
+ * Filename:    crc_engine.h
+ *
+ * Description: Run-time selectable CRC engine.  Unlike crc.h, which
+ *				fixes one CRC standard at compile time, an engine is
+ *				initialised at run time for any of the standards below
+ *				and for the fastest implementation the CPU supports.
+ *
+ * Notes:       Implementations, slowest to fastest:
+ *
+ *				  CRC_IMPL_BYTEWISE  one table lookup per byte (crcFast)
+ *				  CRC_IMPL_SLICE8    slicing-by-8, 8 tables
+ *				  CRC_IMPL_SLICE16   slicing-by-16, 16 tables
+ *				  CRC_IMPL_SSE42     SSE4.2 crc32 instruction, CRC-32C
+ *				                     only
+ *				  CRC_IMPL_PCLMUL    PCLMULQDQ folding of 64-byte blocks,
+ *				                     reflected standards (CRC-32,
+ *				                     CRC-32C, CRC-16) only
+ *
+ *				CRC_IMPL_AUTO picks the best one that is supported by
+ *				both the standard and the CPU.
+ *
+ *				CRC values passed to and returned from the engine are
+ *				always final (reflected and XOR'd) values, so a
+ *				message can be checksummed in pieces by feeding the
+ *				result of one crcEngineUpdate() into the next, or in
+ *				parallel by joining the pieces with crcEngineCombine().
+ *
+ **********************************************************************/
+
+#ifndef _crc_engine_h
+#define _crc_engine_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	CRC_STD_CRC32,			/* CRC-32 (Ethernet, zlib)           */
+	CRC_STD_CRC32C,			/* CRC-32C (Castagnoli, iSCSI, ext4) */
+	CRC_STD_CRC16,			/* CRC-16 (ARC)                      */
+	CRC_STD_CCITT,			/* CRC-CCITT (0xFFFF initial value)  */
+	CRC_STD_COUNT
+} crcStandard;
+
+typedef enum
+{
+	CRC_IMPL_AUTO,
+	CRC_IMPL_BYTEWISE,
+	CRC_IMPL_SLICE8,
+	CRC_IMPL_SLICE16,
+	CRC_IMPL_SSE42,
+	CRC_IMPL_PCLMUL,
+	CRC_IMPL_COUNT
+} crcImpl;
+
+typedef struct
+{
+	const char	*name;
+	int			 width;			/* CRC width in bits                */
+	uint32_t	 polynomial;	/* normal (MSB-first) polynomial    */
+	uint32_t	 initial;		/* initial remainder                */
+	uint32_t	 finalXor;		/* final XOR value                  */
+	int			 reflected;		/* REFLECT_DATA == REFLECT_REMAINDER */
+	uint32_t	 check;			/* CRC of "123456789"               */
+	crcImpl		 impl;			/* implementation in use            */
+
+	uint32_t	 table[16][256];	/* slicing tables, [0] is byte-wise */
+	uint64_t	 fold512[2];	/* PCLMUL constants, fold by 64 bytes */
+	uint64_t	 fold128[2];	/* PCLMUL constants, fold by 16 bytes */
+	uint32_t	 xpow2[64];		/* x^(2^k) mod P, for crcEngineCombine() */
+} crcEngine;
+
+
+int			 crcEngineInit(crcEngine *engine, crcStandard standard, crcImpl impl);
+int			 crcEngineSupported(crcStandard standard, crcImpl impl);
+const char	*crcEngineImplName(crcImpl impl);
+
+uint32_t	 crcEngineStart(const crcEngine *engine);
+uint32_t	 crcEngineUpdate(const crcEngine *engine, uint32_t crc,
+							 unsigned char const message[], size_t nBytes);
+uint32_t	 crcEngineCompute(const crcEngine *engine,
+							  unsigned char const message[], size_t nBytes);
+uint32_t	 crcEngineCombine(const crcEngine *engine, uint32_t crcA,
+							  uint32_t crcB, size_t nBytesB);
+uint32_t	 crcEngineParallel(const crcEngine *engine,
+							   unsigned char const message[], size_t nBytes,
+							   int nThreads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _crc_engine_h */
@@ -0,0 +1,495 @@
+/*
+ * Digest throughput benchmark
+ *
+ * Sweeps message size and thread count over the digests in this
+ * directory (md5.c, sha1.c, sha2.c, sha2_mb.c, crc.c, crc_engine.c) and
+ * reports, per point, aggregate MB/s, TSC cycles per byte and scaling
+ * efficiency against the single-thread rate, as CSV or JSON lines. The
+ * single-thread rate is measured (and not printed) when the thread list
+ * does not start with 1.
+ *
+ * Every thread hashes its own buffer, is pinned to its own CPU and is
+ * released together with the others from a barrier; timing uses
+ * CLOCK_MONOTONIC_RAW so NTP slewing cannot skew short runs.
+ *
+ * Usage: digestbench [-a algo,...] [-s min] [-S max] [-t n,...] [-T max]
+ *                    [-m seconds] [-j] [-p] [-r]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "md5.h"
+#include "sha1.h"
+#include "sha2.h"
+#include "sha2_mb.h"
+#include "crc.h"
+#include "crc_engine.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define READ_TSC() __rdtsc()
+#define HAVE_TSC 1
+#else
+#define READ_TSC() 0ULL
+#define HAVE_TSC 0
+#endif
+
+#define MAX_THREADS 256
+#define MAX_POINTS 32
+#define MB_BATCH SHA256_MB_MAX_LANES
+#define DEFAULT_MIN_SIZE 64ULL
+#define DEFAULT_MAX_SIZE (64ULL << 20)
+#define DEFAULT_MIN_SEC 0.25
+
+typedef enum
+{
+  ALGO_MD5,
+  ALGO_SHA1,
+  ALGO_SHA256,
+  ALGO_SHA256_FAST,
+  ALGO_SHA256_MB,
+  ALGO_CRC32_BYTEWISE,
+  ALGO_CRC32_SLICE16,
+  ALGO_CRC32_PCLMUL,
+  ALGO_CRC32C_SSE42,
+  ALGO_COUNT
+} algo_e;
+
+static const char *algoNames[ALGO_COUNT] = {
+    "md5", "sha1", "sha256", "sha256-fast", "sha256-mb",
+    "crc32", "crc32-slice16", "crc32-pclmul", "crc32c-sse42"};
+
+typedef struct
+{
+  int threadID;
+  int cpu;
+  algo_e algo;
+  size_t size;
+  double minSec;
+  unsigned char *buffer;
+  sha256_mb_mgr *mbMgr;
+  sha256_mb_job *mbJobs;
+
+  /* results */
+  uint64_t bytes;
+  uint64_t nsecs;
+  uint64_t cycles;
+  uint32_t sink;
+} benchThread_t;
+
+static crcEngine crcSlice16Engine, crcPclmulEngine, crcSse42Engine;
+static pthread_barrier_t startBarrier;
+static volatile uint32_t resultSink;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int algo_supported(algo_e algo)
+{
+  switch (algo)
+  {
+  case ALGO_CRC32_PCLMUL:
+    return crcEngineSupported(CRC_STD_CRC32, CRC_IMPL_PCLMUL);
+  case ALGO_CRC32C_SSE42:
+    return crcEngineSupported(CRC_STD_CRC32C, CRC_IMPL_SSE42);
+  default:
+    return 1;
+  }
+}
+
+/* hash the thread's buffer once; returns bytes consumed */
+static uint64_t hash_once(benchThread_t *tp)
+{
+  md5_state_t md5;
+  md5_byte_t digest[SHA256_DIGEST_SIZE];
+  int i;
+
+  switch (tp->algo)
+  {
+  case ALGO_MD5:
+    md5_init(&md5);
+    md5_append(&md5, tp->buffer, (int)tp->size);
+    md5_finish(&md5, digest);
+    tp->sink ^= digest[0];
+    return tp->size;
+
+  case ALGO_SHA1:
+    sha1(tp->buffer, (int)tp->size, digest);
+    tp->sink ^= digest[0];
+    return tp->size;
+
+  case ALGO_SHA256:
+    sha256(tp->buffer, (unsigned int)tp->size, digest);
+    tp->sink ^= digest[0];
+    return tp->size;
+
+  case ALGO_SHA256_FAST:
+    sha256_fast(tp->buffer, tp->size, digest);
+    tp->sink ^= digest[0];
+    return tp->size;
+
+  case ALGO_SHA256_MB:
+    for (i = 0; i < MB_BATCH; i++)
+    {
+      tp->mbJobs[i].message = tp->buffer;
+      tp->mbJobs[i].len = tp->size;
+    }
+    sha256_mb_hash(tp->mbMgr, tp->mbJobs, MB_BATCH);
+    tp->sink ^= tp->mbJobs[MB_BATCH - 1].digest[0];
+    return (uint64_t)tp->size * MB_BATCH;
+
+  case ALGO_CRC32_BYTEWISE:
+    tp->sink ^= crcFast(tp->buffer, (int)tp->size);
+    return tp->size;
+
+  case ALGO_CRC32_SLICE16:
+    tp->sink ^= crcEngineCompute(&crcSlice16Engine, tp->buffer, tp->size);
+    return tp->size;
+
+  case ALGO_CRC32_PCLMUL:
+    tp->sink ^= crcEngineCompute(&crcPclmulEngine, tp->buffer, tp->size);
+    return tp->size;
+
+  case ALGO_CRC32C_SSE42:
+    tp->sink ^= crcEngineCompute(&crcSse42Engine, tp->buffer, tp->size);
+    return tp->size;
+
+  default:
+    return 0;
+  }
+}
+
+void *benchThread(void *threadparam)
+{
+  benchThread_t *tp = (benchThread_t *)threadparam;
+  uint64_t start, stop, tscStart, tscStop, minNs;
+  uint64_t bytes = 0;
+  uint64_t batch = 1, n;
+
+  minNs = (uint64_t)(tp->minSec * 1.0e9);
+
+  /* warm caches and page in the buffer before the clock starts */
+  hash_once(tp);
+
+  pthread_barrier_wait(&startBarrier);
+
+  start = now_ns();
+  tscStart = READ_TSC();
+  do
+  {
+    /* grow the batch so the clock is read a few dozen times at most */
+    for (n = 0; n < batch; n++)
+      bytes += hash_once(tp);
+    stop = now_ns();
+    if (stop - start < minNs / 32)
+      batch *= 2;
+  } while (stop - start < minNs);
+  tscStop = READ_TSC();
+
+  tp->bytes = bytes;
+  tp->nsecs = stop - start;
+  tp->cycles = tscStop - tscStart;
+  resultSink ^= tp->sink;
+
+  return NULL;
+}
+
+static int run_point(benchThread_t *tp, int numThreads, int pin, int rtPolicy)
+{
+  pthread_t threads[MAX_THREADS];
+  pthread_attr_t attr;
+  struct sched_param param;
+  cpu_set_t cpuset;
+  int i, rc = 0;
+
+  pthread_barrier_init(&startBarrier, NULL, numThreads);
+
+  for (i = 0; i < numThreads; i++)
+  {
+    pthread_attr_init(&attr);
+    if (pin)
+    {
+      CPU_ZERO(&cpuset);
+      CPU_SET(tp[i].cpu, &cpuset);
+      pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+    }
+    if (rtPolicy)
+    {
+      pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+      pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+      param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+      pthread_attr_setschedparam(&attr, &param);
+    }
+
+    if (pthread_create(&threads[i], &attr, benchThread, &tp[i]) != 0)
+    {
+      perror("pthread_create");
+      /* threads already started are stuck on the barrier; give up */
+      exit(-1);
+    }
+    pthread_attr_destroy(&attr);
+  }
+
+  for (i = 0; i < numThreads; i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_barrier_destroy(&startBarrier);
+  return rc;
+}
+
+static int parse_list(const char *str, long *out, int max)
+{
+  char *copy = strdup(str), *tok, *save = NULL;
+  int n = 0;
+
+  for (tok = strtok_r(copy, ",", &save); tok != NULL && n < max;
+       tok = strtok_r(NULL, ",", &save))
+    out[n++] = strtol(tok, NULL, 0);
+
+  free(copy);
+  return n;
+}
+
+static size_t parse_size(const char *str)
+{
+  char *end;
+  double v = strtod(str, &end);
+
+  if (*end == 'k' || *end == 'K')
+    v *= 1024.0;
+  else if (*end == 'm' || *end == 'M')
+    v *= 1024.0 * 1024.0;
+  else if (*end == 'g' || *end == 'G')
+    v *= 1024.0 * 1024.0 * 1024.0;
+
+  return (size_t)v;
+}
+
+static void usage(const char *prog)
+{
+  int i;
+
+  printf("Usage: %s [options]\n"
+         "  -a algo,...   algorithms to run [all]\n"
+         "  -s size       smallest message size [64]\n"
+         "  -S size       largest message size [64M]\n"
+         "  -t n,...      thread counts [1,2,4,... up to -T]\n"
+         "  -T n          most threads for the default sweep [online CPUs]\n"
+         "  -m seconds    minimum run time per point [%.2f]\n"
+         "  -j            JSON lines instead of CSV\n"
+         "  -p            do not pin threads to CPUs\n"
+         "  -r            run workers SCHED_FIFO (needs privileges)\n"
+         "algorithms:",
+         prog, DEFAULT_MIN_SEC);
+  for (i = 0; i < ALGO_COUNT; i++)
+    printf(" %s", algoNames[i]);
+  printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+  static benchThread_t threadParams[MAX_THREADS];
+  int algoEnabled[ALGO_COUNT];
+  long threadCounts[MAX_POINTS];
+  int numThreadCounts = 0;
+  size_t minSize = DEFAULT_MIN_SIZE, maxSize = DEFAULT_MAX_SIZE, size;
+  double minSec = DEFAULT_MIN_SEC;
+  int json = 0, pin = 1, rtPolicy = 0;
+  int numCpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int maxThreads = numCpus;
+  int c, i, t, a;
+
+  for (a = 0; a < ALGO_COUNT; a++)
+    algoEnabled[a] = 1;
+
+  while ((c = getopt(argc, argv, "a:s:S:t:T:m:jprh")) != -1)
+  {
+    switch (c)
+    {
+    case 'a':
+    {
+      char *copy = strdup(optarg), *tok, *save = NULL;
+
+      for (a = 0; a < ALGO_COUNT; a++)
+        algoEnabled[a] = 0;
+      for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+      {
+        for (a = 0; a < ALGO_COUNT; a++)
+          if (strcmp(tok, algoNames[a]) == 0)
+            break;
+        if (a == ALGO_COUNT)
+        {
+          fprintf(stderr, "unknown algorithm %s\n", tok);
+          return -1;
+        }
+        algoEnabled[a] = 1;
+      }
+      free(copy);
+      break;
+    }
+    case 's':
+      minSize = parse_size(optarg);
+      break;
+    case 'S':
+      maxSize = parse_size(optarg);
+      break;
+    case 't':
+      numThreadCounts = parse_list(optarg, threadCounts, MAX_POINTS);
+      break;
+    case 'T':
+      maxThreads = atoi(optarg);
+      break;
+    case 'm':
+      minSec = atof(optarg);
+      break;
+    case 'j':
+      json = 1;
+      break;
+    case 'p':
+      pin = 0;
+      break;
+    case 'r':
+      rtPolicy = 1;
+      break;
+    default:
+      usage(argv[0]);
+      return (c == 'h') ? 0 : -1;
+    }
+  }
+
+  if (minSize < 1 || maxSize < minSize)
+  {
+    fprintf(stderr, "invalid size range\n");
+    return -1;
+  }
+
+  /* default sweep: 1, 2, 4, ... plus the CPU count itself */
+  if (numThreadCounts == 0)
+  {
+    for (t = 1; t <= maxThreads && numThreadCounts < MAX_POINTS; t *= 2)
+      threadCounts[numThreadCounts++] = t;
+    if (threadCounts[numThreadCounts - 1] != maxThreads && numThreadCounts < MAX_POINTS)
+      threadCounts[numThreadCounts++] = maxThreads;
+  }
+  for (i = 0; i < numThreadCounts; i++)
+  {
+    if (threadCounts[i] < 1 || threadCounts[i] > MAX_THREADS)
+    {
+      fprintf(stderr, "thread count must be 1..%d\n", MAX_THREADS);
+      return -1;
+    }
+  }
+
+  crcInit();
+  crcEngineInit(&crcSlice16Engine, CRC_STD_CRC32, CRC_IMPL_SLICE16);
+  crcEngineInit(&crcPclmulEngine, CRC_STD_CRC32, CRC_IMPL_PCLMUL);
+  crcEngineInit(&crcSse42Engine, CRC_STD_CRC32C, CRC_IMPL_SSE42);
+
+  /* one buffer and one SHA-256 manager per possible thread */
+  for (t = 0; t < MAX_THREADS; t++)
+  {
+    int used = 0;
+
+    for (i = 0; i < numThreadCounts; i++)
+      used |= (t < threadCounts[i]);
+    if (!used)
+      continue;
+
+    if (posix_memalign((void **)&threadParams[t].buffer, 64, maxSize) != 0)
+    {
+      fprintf(stderr, "out of memory for %zu byte buffers\n", maxSize);
+      return -1;
+    }
+    for (size = 0; size < maxSize; size++)
+      threadParams[t].buffer[size] = (unsigned char)(rand() >> 7);
+
+    threadParams[t].mbMgr = malloc(sizeof(sha256_mb_mgr));
+    threadParams[t].mbJobs = calloc(MB_BATCH, sizeof(sha256_mb_job));
+    sha256_mb_init(threadParams[t].mbMgr, SHA256_MB_AUTO, 0);
+  }
+
+  if (!json)
+    printf("algo,bytes,threads,iterations,MBps,MBps_per_thread,cycles_per_byte,scaling_eff\n");
+
+  for (a = 0; a < ALGO_COUNT; a++)
+  {
+    if (!algoEnabled[a] || !algo_supported((algo_e)a))
+      continue;
+
+    for (size = minSize; size <= maxSize; size *= 4)
+    {
+      double singleRate = 0.0;
+
+      /* i == -1 is the unlisted 1-thread baseline for scaling_eff */
+      for (i = (threadCounts[0] == 1) ? 0 : -1; i < numThreadCounts; i++)
+      {
+        int n = (i < 0) ? 1 : (int)threadCounts[i];
+        uint64_t bytes = 0, cycles = 0, iterations;
+        double secs = 0.0, rate, perThread, cpb, eff;
+
+        for (t = 0; t < n; t++)
+        {
+          threadParams[t].threadID = t;
+          threadParams[t].cpu = t % numCpus;
+          threadParams[t].algo = (algo_e)a;
+          threadParams[t].size = size;
+          threadParams[t].minSec = minSec;
+        }
+
+        run_point(threadParams, n, pin, rtPolicy);
+
+        for (t = 0; t < n; t++)
+        {
+          double s = threadParams[t].nsecs / 1.0e9;
+
+          bytes += threadParams[t].bytes;
+          cycles += threadParams[t].cycles;
+          if (s > secs)
+            secs = s;
+        }
+
+        /* aggregate rate over the slowest thread's wall time */
+        rate = (bytes / 1.0e6) / secs;
+        perThread = rate / n;
+        cpb = HAVE_TSC ? ((double)cycles / (double)bytes) : 0.0;
+        if (n == 1)
+          singleRate = rate;
+        if (i < 0)
+          continue;
+        eff = (singleRate > 0.0) ? (rate / (n * singleRate)) : 0.0;
+        iterations = bytes / size;
+
+        if (json)
+          printf("{\"algo\":\"%s\",\"bytes\":%zu,\"threads\":%d,\"iterations\":%llu,"
+                 "\"MBps\":%.2f,\"MBps_per_thread\":%.2f,\"cycles_per_byte\":%.3f,"
+                 "\"scaling_eff\":%.3f}\n",
+                 algoNames[a], size, n, (unsigned long long)iterations,
+                 rate, perThread, cpb, eff);
+        else
+          printf("%s,%zu,%d,%llu,%.2f,%.2f,%.3f,%.3f\n",
+                 algoNames[a], size, n, (unsigned long long)iterations,
+                 rate, perThread, cpb, eff);
+        fflush(stdout);
+      }
+
+      if (size > maxSize / 4)
+        break;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Whole-file MD5, SHA-1 and SHA-256 on top of hashfile.c
+ */
+
+#include "digestfile.h"
+#include "hashfile.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+int md5_file( const char *path, unsigned char output[16] )
+{
+    hashfile_opts opts;
+    hashfile_result res;
+
+    hashfile_defaults( &opts );
+    opts.algos = HASHFILE_MD5;
+
+    if( hashfile( path, &opts, &res ) != 0 )
+        return( -1 );
+
+    memcpy( output, res.md5, 16 );
+    return( 0 );
+}
+
+int sha1_file( char *path, unsigned char output[20] )
+{
+    hashfile_opts opts;
+    hashfile_result res;
+    int fd, ret;
+
+    if( ( fd = open( path, O_RDONLY ) ) < 0 )
+        return( 1 );
+
+    hashfile_defaults( &opts );
+    opts.algos = HASHFILE_SHA1;
+    ret = hashfile_fd( fd, &opts, &res );
+    close( fd );
+
+    if( ret != 0 )
+        return( 2 );
+
+    memcpy( output, res.sha1, 20 );
+    return( 0 );
+}
+
+int sha256_file( const char *path, unsigned char output[SHA256_DIGEST_SIZE] )
+{
+    hashfile_opts opts;
+    hashfile_result res;
+
+    hashfile_defaults( &opts );
+    opts.algos = HASHFILE_SHA256;
+
+    if( hashfile( path, &opts, &res ) != 0 )
+        return( -1 );
+
+    memcpy( output, res.sha256, SHA256_DIGEST_SIZE );
+    return( 0 );
+}
@@ -0,0 +1,46 @@
+/**
+ * \file digestfile.h
+ *
+ * Whole-file digests, one algorithm per call. They read through
+ * hashfile_fd(), so the I/O path is picked by file size (see hashfile.h);
+ * md5.c, sha1.c and sha2.c stay free of file I/O.
+ */
+#ifndef DIGESTFILE_H
+#define DIGESTFILE_H
+
+#include "sha2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Output = MD5( file contents )
+ *
+ * \return         0 if successful, or -1 with errno set
+ */
+int md5_file( const char *path, unsigned char output[16] );
+
+/**
+ * \brief          Output = SHA-1( file contents )
+ *
+ * \param path     input file name
+ * \param output   SHA-1 checksum result
+ *
+ * \return         0 if successful, 1 if open failed,
+ *                 or 2 if reading failed
+ */
+int sha1_file( char *path, unsigned char output[20] );
+
+/**
+ * \brief          Output = SHA-256( file contents )
+ *
+ * \return         0 if successful, or -1 with errno set
+ */
+int sha256_file( const char *path, unsigned char output[SHA256_DIGEST_SIZE] );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* digestfile.h */
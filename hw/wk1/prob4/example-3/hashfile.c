@@ -0,0 +1,602 @@
+/*
+ *  Streaming file hashing for md5.c, sha1.c, sha2.c and crc_engine.c
+ *
+ *  Every chunk of the file is read (or mapped) once and handed to each
+ *  requested digest in HASHFILE_STRIDE slices, so a slice is still in
+ *  L1/L2 when the next digest reads it.
+ */
+
+#define _GNU_SOURCE
+
+#include "hashfile.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha2_mb.h"
+#include "crc_engine.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HASHFILE_STRIDE     (64 * 1024)
+#define HASHFILE_ALIGN      4096
+#define HASHFILE_MAX_THREADS 64
+
+static crcEngine hashfile_crc;
+static pthread_once_t hashfile_crc_once = PTHREAD_ONCE_INIT;
+
+static void hashfile_crc_init( void )
+{
+    crcEngineInit( &hashfile_crc, CRC_STD_CRC32, CRC_IMPL_AUTO );
+}
+
+/*
+ * One-pass state for the linear digests
+ */
+typedef struct
+{
+    unsigned int algos;
+    md5_state_t md5;
+    sha1_context sha1;
+    sha256_ctx sha256;
+    uint32_t crc32;
+    uint64 size;
+}
+hashfile_state;
+
+static void hashfile_starts( hashfile_state *st, unsigned int algos )
+{
+    st->algos = algos;
+    st->size = 0;
+
+    if( algos & HASHFILE_MD5 )
+        md5_init( &st->md5 );
+    if( algos & HASHFILE_SHA1 )
+        sha1_starts( &st->sha1 );
+    if( algos & HASHFILE_SHA256 )
+        sha256_init( &st->sha256 );
+    if( algos & HASHFILE_CRC32 )
+        st->crc32 = crcEngineStart( &hashfile_crc );
+}
+
+static void hashfile_update( hashfile_state *st, const unsigned char *input,
+                             size_t ilen )
+{
+    size_t n;
+
+    st->size += ilen;
+
+    while( ilen > 0 )
+    {
+        n = ilen < HASHFILE_STRIDE ? ilen : HASHFILE_STRIDE;
+
+        if( st->algos & HASHFILE_MD5 )
+            md5_append( &st->md5, input, (int) n );
+        if( st->algos & HASHFILE_SHA1 )
+            sha1_update( &st->sha1, (unsigned char *) input, (int) n );
+        if( st->algos & HASHFILE_SHA256 )
+            sha256_fast_update( &st->sha256, input, n );
+        if( st->algos & HASHFILE_CRC32 )
+            st->crc32 = crcEngineUpdate( &hashfile_crc, st->crc32, input, n );
+
+        input += n;
+        ilen -= n;
+    }
+}
+
+static void hashfile_finish( hashfile_state *st, hashfile_result *res )
+{
+    res->size = st->size;
+
+    if( st->algos & HASHFILE_MD5 )
+        md5_finish( &st->md5, res->md5 );
+    if( st->algos & HASHFILE_SHA1 )
+        sha1_finish( &st->sha1, res->sha1 );
+    if( st->algos & HASHFILE_SHA256 )
+        sha256_final( &st->sha256, res->sha256 );
+    if( st->algos & HASHFILE_CRC32 )
+        res->crc32 = st->crc32;
+}
+
+/*
+ * read() into one buffer
+ */
+static int hashfile_read( int fd, size_t chunk, hashfile_state *st )
+{
+    unsigned char *buf;
+    ssize_t n;
+
+    if( ( buf = malloc( chunk ) ) == NULL )
+        return( -1 );
+
+    posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+    for( ;; )
+    {
+        n = read( fd, buf, chunk );
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n <= 0 )
+            break;
+
+        hashfile_update( st, buf, (size_t) n );
+    }
+
+    free( buf );
+    return( n < 0 ? -1 : 0 );
+}
+
+/*
+ * mmap() the whole file; returns -2 if it cannot be mapped
+ */
+static int hashfile_mmap( int fd, uint64 size, hashfile_state *st )
+{
+    void *map;
+
+    if( size == 0 )
+        return( 0 );
+
+    map = mmap( NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if( map == MAP_FAILED )
+        return( -2 );
+
+    madvise( map, (size_t) size, MADV_SEQUENTIAL );
+    hashfile_update( st, (const unsigned char *) map, (size_t) size );
+    munmap( map, (size_t) size );
+
+    return( 0 );
+}
+
+/*
+ * Double-buffered O_DIRECT: a reader thread fills one buffer while the
+ * caller hashes the other. The reads go through a second open of the file,
+ * so O_DIRECT (and dropping it again) never changes the caller's fd, which
+ * the tree workers pread() from with unaligned buffers
+ */
+typedef struct
+{
+    int fd;
+    size_t chunk;
+    unsigned char *buf[2];
+    ssize_t len[2];             /* bytes in buffer, 0 = EOF, -1 = error */
+    int full[2];
+    int err;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+}
+hashfile_direct_t;
+
+static ssize_t hashfile_fill( hashfile_direct_t *d, unsigned char *buf )
+{
+    size_t got = 0;
+    ssize_t n;
+    int flags;
+
+    while( got < d->chunk )
+    {
+        n = read( d->fd, buf + got, d->chunk - got );
+        if( n < 0 && errno == EINTR )
+            continue;
+        if( n < 0 && errno == EINVAL
+            && ( flags = fcntl( d->fd, F_GETFL ) ) != -1
+            && ( flags & O_DIRECT ) )
+        {
+            /* file system or a short read refused O_DIRECT, go buffered */
+            fcntl( d->fd, F_SETFL, flags & ~O_DIRECT );
+            continue;
+        }
+        if( n < 0 )
+        {
+            d->err = errno;
+            return( -1 );
+        }
+        if( n == 0 )
+            break;
+
+        got += (size_t) n;
+    }
+
+    return( (ssize_t) got );
+}
+
+static void *hashfile_reader( void *arg )
+{
+    hashfile_direct_t *d = (hashfile_direct_t *) arg;
+    ssize_t n;
+    int i = 0;
+
+    do
+    {
+        pthread_mutex_lock( &d->lock );
+        while( d->full[i] )
+            pthread_cond_wait( &d->cond, &d->lock );
+        pthread_mutex_unlock( &d->lock );
+
+        n = hashfile_fill( d, d->buf[i] );
+
+        pthread_mutex_lock( &d->lock );
+        d->len[i] = n;
+        d->full[i] = 1;
+        pthread_cond_broadcast( &d->cond );
+        pthread_mutex_unlock( &d->lock );
+
+        i ^= 1;
+    }
+    while( n > 0 );
+
+    return( NULL );
+}
+
+/* Returns 0, -1 on error, or -2 if the file could not be reopened for
+ * O_DIRECT (use buffered reads instead) */
+static int hashfile_direct( int fd, size_t chunk, hashfile_state *st )
+{
+    hashfile_direct_t d;
+    pthread_t reader;
+    char path[32];
+    off_t pos;
+    ssize_t n;
+    int i = 0, ret = 0;
+
+    memset( &d, 0, sizeof( d ) );
+    d.chunk = ( chunk + HASHFILE_ALIGN - 1 ) & ~(size_t) ( HASHFILE_ALIGN - 1 );
+
+    /* a new open file description: own flags, own offset */
+    snprintf( path, sizeof( path ), "/proc/self/fd/%d", fd );
+    if( ( d.fd = open( path, O_RDONLY | O_DIRECT ) ) < 0 )
+        return( -2 );
+    if( ( pos = lseek( fd, 0, SEEK_CUR ) ) > 0 )
+        lseek( d.fd, pos, SEEK_SET );
+
+    if( posix_memalign( (void **) &d.buf[0], HASHFILE_ALIGN, d.chunk ) != 0 )
+    {
+        close( d.fd );
+        return( -1 );
+    }
+    if( posix_memalign( (void **) &d.buf[1], HASHFILE_ALIGN, d.chunk ) != 0 )
+    {
+        free( d.buf[0] );
+        close( d.fd );
+        return( -1 );
+    }
+
+    pthread_mutex_init( &d.lock, NULL );
+    pthread_cond_init( &d.cond, NULL );
+
+    if( pthread_create( &reader, NULL, hashfile_reader, &d ) != 0 )
+    {
+        /* no reader thread, hash from the caller's thread instead */
+        while( ( n = hashfile_fill( &d, d.buf[0] ) ) > 0 )
+            hashfile_update( st, d.buf[0], (size_t) n );
+        ret = ( n < 0 ) ? -1 : 0;
+    }
+    else
+    {
+        do
+        {
+            pthread_mutex_lock( &d.lock );
+            while( !d.full[i] )
+                pthread_cond_wait( &d.cond, &d.lock );
+            n = d.len[i];
+            pthread_mutex_unlock( &d.lock );
+
+            if( n > 0 )
+                hashfile_update( st, d.buf[i], (size_t) n );
+
+            pthread_mutex_lock( &d.lock );
+            d.full[i] = 0;
+            pthread_cond_broadcast( &d.cond );
+            pthread_mutex_unlock( &d.lock );
+
+            i ^= 1;
+        }
+        while( n > 0 );
+
+        pthread_join( reader, NULL );
+        ret = ( n < 0 ) ? -1 : 0;
+    }
+
+    close( d.fd );
+    pthread_cond_destroy( &d.cond );
+    pthread_mutex_destroy( &d.lock );
+    free( d.buf[0] );
+    free( d.buf[1] );
+
+    if( ret != 0 && d.err != 0 )
+        errno = d.err;
+    return( ret );
+}
+
+/*
+ * Tree hash: workers claim leaves with an atomic counter
+ */
+typedef struct
+{
+    int fd;
+    const unsigned char *map;   /* whole file, or NULL to pread() */
+    uint64 size;
+    size_t leaf;
+    uint64 leaves;
+    uint64 next;
+    unsigned char *digests;     /* leaves * SHA256_DIGEST_SIZE */
+    int err;
+}
+hashfile_tree_t;
+
+static void *hashfile_tree_worker( void *arg )
+{
+    static const unsigned char leaf_prefix = 0x00;
+    hashfile_tree_t *t = (hashfile_tree_t *) arg;
+    unsigned char *buf = NULL;
+    sha256_ctx ctx;
+    uint64 i, off;
+    size_t len;
+    ssize_t n;
+
+    if( t->map == NULL && ( buf = malloc( t->leaf ) ) == NULL )
+    {
+        __atomic_store_n( &t->err, ENOMEM, __ATOMIC_RELAXED );
+        return( NULL );
+    }
+
+    while( ( i = __atomic_fetch_add( &t->next, 1, __ATOMIC_RELAXED ) )
+           < t->leaves )
+    {
+        off = i * t->leaf;
+        len = ( t->size - off < t->leaf ) ? (size_t) ( t->size - off ) : t->leaf;
+
+        sha256_init( &ctx );
+        sha256_fast_update( &ctx, &leaf_prefix, 1 );
+
+        if( t->map != NULL )
+            sha256_fast_update( &ctx, t->map + off, len );
+        else
+        {
+            n = pread( t->fd, buf, len, (off_t) off );
+            if( n != (ssize_t) len )
+            {
+                __atomic_store_n( &t->err, n < 0 ? errno : EIO,
+                                  __ATOMIC_RELAXED );
+                break;
+            }
+            sha256_fast_update( &ctx, buf, len );
+        }
+
+        sha256_final( &ctx, t->digests + i * SHA256_DIGEST_SIZE );
+    }
+
+    free( buf );
+    return( NULL );
+}
+
+/* Reduce the leaf digests level by level, in place; no leaves at all
+ * (an empty file) is SHA-256 of the empty string, as in RFC 6962 */
+static void hashfile_tree_root( unsigned char *digests, uint64 n,
+                                unsigned char root[SHA256_DIGEST_SIZE] )
+{
+    static const unsigned char node_prefix = 0x01;
+    sha256_ctx ctx;
+    uint64 i;
+
+    if( n == 0 )
+    {
+        sha256_fast( (const unsigned char *) "", 0, root );
+        return;
+    }
+
+    while( n > 1 )
+    {
+        for( i = 0; i + 1 < n; i += 2 )
+        {
+            sha256_init( &ctx );
+            sha256_fast_update( &ctx, &node_prefix, 1 );
+            sha256_fast_update( &ctx, digests + i * SHA256_DIGEST_SIZE,
+                                2 * SHA256_DIGEST_SIZE );
+            sha256_final( &ctx, digests + ( i / 2 ) * SHA256_DIGEST_SIZE );
+        }
+        if( n & 1 )
+            memmove( digests + ( n / 2 ) * SHA256_DIGEST_SIZE,
+                     digests + ( n - 1 ) * SHA256_DIGEST_SIZE,
+                     SHA256_DIGEST_SIZE );
+        n = ( n + 1 ) / 2;
+    }
+
+    memcpy( root, digests, SHA256_DIGEST_SIZE );
+}
+
+void hashfile_defaults( hashfile_opts *opts )
+{
+    memset( opts, 0, sizeof( hashfile_opts ) );
+    opts->algos = HASHFILE_MD5 | HASHFILE_SHA256 | HASHFILE_CRC32;
+    opts->io = HASHFILE_IO_AUTO;
+    opts->mmap_min = 256 * 1024;
+    opts->direct_min = 1ULL << 30;
+    opts->chunk = 1024 * 1024;
+    opts->leaf = 1024 * 1024;
+    opts->threads = 0;
+}
+
+int hashfile_fd( int fd, const hashfile_opts *opts, hashfile_result *res )
+{
+    hashfile_opts defaults;
+    hashfile_state st;
+    hashfile_tree_t tree;
+    pthread_t workers[HASHFILE_MAX_THREADS];
+    struct stat sb;
+    hashfile_io io;
+    void *map = MAP_FAILED;
+    uint64 size = 0;
+    unsigned int linear;
+    int regular, nthreads = 0, started = 0, i, ret = 0;
+
+    if( opts == NULL )
+    {
+        hashfile_defaults( &defaults );
+        opts = &defaults;
+    }
+    if( opts->chunk == 0 || ( ( opts->algos & HASHFILE_TREE ) && opts->leaf == 0 ) )
+    {
+        errno = EINVAL;
+        return( -1 );
+    }
+    if( fstat( fd, &sb ) != 0 )
+        return( -1 );
+
+    pthread_once( &hashfile_crc_once, hashfile_crc_init );
+    memset( res, 0, sizeof( hashfile_result ) );
+
+    regular = S_ISREG( sb.st_mode );
+    if( regular )
+        size = (uint64) sb.st_size;
+
+    io = opts->io;
+    if( io == HASHFILE_IO_AUTO )
+        io = !regular ? HASHFILE_IO_READ
+           : size >= opts->direct_min ? HASHFILE_IO_DIRECT
+           : size >= opts->mmap_min ? HASHFILE_IO_MMAP
+           : HASHFILE_IO_READ;
+    if( !regular )
+        io = HASHFILE_IO_READ;
+
+    linear = opts->algos & ( HASHFILE_MD5 | HASHFILE_SHA1 |
+                             HASHFILE_SHA256 | HASHFILE_CRC32 );
+    hashfile_starts( &st, linear );
+
+    /* tree leaves are hashed from the map when there is one, else pread() */
+    if( opts->algos & HASHFILE_TREE )
+    {
+        if( !regular )
+        {
+            errno = ESPIPE;
+            return( -1 );
+        }
+
+        memset( &tree, 0, sizeof( tree ) );
+        tree.fd = fd;
+        tree.size = size;
+        tree.leaf = opts->leaf;
+        tree.leaves = ( size + opts->leaf - 1 ) / opts->leaf;
+        tree.digests = malloc( (size_t) ( tree.leaves + 1 ) * SHA256_DIGEST_SIZE );
+        if( tree.digests == NULL )
+            return( -1 );
+
+        if( io == HASHFILE_IO_MMAP && size > 0 )
+        {
+            map = mmap( NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if( map != MAP_FAILED )
+                tree.map = (const unsigned char *) map;
+        }
+
+        nthreads = opts->threads > 0 ? opts->threads
+                 : (int) sysconf( _SC_NPROCESSORS_ONLN );
+        if( nthreads > HASHFILE_MAX_THREADS )
+            nthreads = HASHFILE_MAX_THREADS;
+
+        /* this thread is one of the workers once its linear pass is done */
+        for( started = 0; started < nthreads - 1; started++ )
+            if( pthread_create( &workers[started], NULL,
+                                hashfile_tree_worker, &tree ) != 0 )
+                break;
+    }
+
+    if( linear != 0 )
+    {
+        if( map != MAP_FAILED )
+        {
+            hashfile_update( &st, (const unsigned char *) map, (size_t) size );
+            ret = 0;
+        }
+        else
+        {
+            if( io == HASHFILE_IO_MMAP || ( opts->algos & HASHFILE_TREE ) )
+                lseek( fd, 0, SEEK_SET );
+
+            if( io == HASHFILE_IO_MMAP
+                && ( ret = hashfile_mmap( fd, size, &st ) ) == -2 )
+                io = HASHFILE_IO_READ;
+
+            if( io == HASHFILE_IO_DIRECT
+                && ( ret = hashfile_direct( fd, opts->chunk, &st ) ) == -2 )
+                io = HASHFILE_IO_READ;
+
+            if( io == HASHFILE_IO_READ )
+                ret = hashfile_read( fd, opts->chunk, &st );
+        }
+        hashfile_finish( &st, res );
+    }
+    else
+        res->size = size;
+
+    if( opts->algos & HASHFILE_TREE )
+    {
+        hashfile_tree_worker( &tree );
+        for( i = 0; i < started; i++ )
+            pthread_join( workers[i], NULL );
+
+        if( tree.err != 0 )
+        {
+            errno = tree.err;
+            ret = -1;
+        }
+        else
+            hashfile_tree_root( tree.digests, tree.leaves, res->tree );
+
+        if( linear == 0 )
+            res->size = size;
+        if( map != MAP_FAILED )
+            munmap( map, (size_t) size );
+        free( tree.digests );
+    }
+
+    res->io = io;
+    return( ret );
+}
+
+int hashfile( const char *path, const hashfile_opts *opts,
+              hashfile_result *res )
+{
+    int fd, ret, err;
+
+    if( ( fd = open( path, O_RDONLY ) ) < 0 )
+        return( -1 );
+
+    ret = hashfile_fd( fd, opts, res );
+
+    err = errno;
+    close( fd );
+    errno = err;
+
+    return( ret );
+}
+
+const char *hashfile_io_name( hashfile_io io )
+{
+    switch( io )
+    {
+        case HASHFILE_IO_AUTO:   return( "auto" );
+        case HASHFILE_IO_READ:   return( "read" );
+        case HASHFILE_IO_MMAP:   return( "mmap" );
+        case HASHFILE_IO_DIRECT: return( "direct" );
+    }
+
+    return( "unknown" );
+}
+
+void hashfile_hex( const unsigned char *digest, int len, char *out )
+{
+    static const char hex[] = "0123456789abcdef";
+    int i;
+
+    for( i = 0; i < len; i++ )
+    {
+        out[2 * i]     = hex[digest[i] >> 4];
+        out[2 * i + 1] = hex[digest[i] & 0x0F];
+    }
+    out[2 * len] = '\0';
+}
@@ -0,0 +1,129 @@
+/**
+ * \file hashfile.h
+ *
+ * Streaming file hashing: one pass over a file feeds any mix of MD5,
+ * SHA-1, SHA-256 and CRC-32, and an optional SHA-256 tree hash is
+ * computed in parallel across cores.
+ *
+ * The file is read the cheapest way for its size:
+ *
+ *   HASHFILE_IO_READ    read() into one buffer, for small files, pipes
+ *                       and anything that cannot be mapped
+ *   HASHFILE_IO_MMAP    mmap() with MADV_SEQUENTIAL, no copy at all
+ *   HASHFILE_IO_DIRECT  double-buffered O_DIRECT reads from a reader
+ *                       thread, so multi-GB files neither pollute the
+ *                       page cache nor stall the hashing on I/O; falls
+ *                       back to buffered reads where O_DIRECT is refused
+ *
+ * Tree hash: the file is split into leaves of opts.leaf bytes,
+ * leaf = SHA-256( 0x00 || data ), node = SHA-256( 0x01 || left || right ),
+ * and an odd node is promoted unchanged to the next level (the RFC 6962
+ * layout); an empty file has no leaves and hashes to SHA-256( "" ).
+ * Leaves are hashed by opts.threads workers.
+ */
+#ifndef HASHFILE_H
+#define HASHFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha2.h"
+
+#define HASHFILE_MD5        0x01
+#define HASHFILE_SHA1       0x02
+#define HASHFILE_SHA256     0x04
+#define HASHFILE_CRC32      0x08
+#define HASHFILE_TREE       0x10
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    HASHFILE_IO_AUTO,
+    HASHFILE_IO_READ,
+    HASHFILE_IO_MMAP,
+    HASHFILE_IO_DIRECT
+}
+hashfile_io;
+
+/**
+ * \brief          File hashing options, see hashfile_defaults()
+ */
+typedef struct
+{
+    unsigned int algos;     /*!< HASHFILE_* flags                     */
+    hashfile_io io;         /*!< I/O path, AUTO picks by file size    */
+    uint64 mmap_min;        /*!< AUTO: mmap files at least this big   */
+    uint64 direct_min;      /*!< AUTO: O_DIRECT files at least this big */
+    size_t chunk;           /*!< read()/O_DIRECT buffer size          */
+    size_t leaf;            /*!< tree-hash leaf size                  */
+    int threads;            /*!< tree-hash workers, 0 = online CPUs   */
+}
+hashfile_opts;
+
+/**
+ * \brief          File hashing results; only requested fields are set
+ */
+typedef struct
+{
+    uint64 size;                    /*!< bytes hashed          */
+    hashfile_io io;                 /*!< I/O path actually used */
+    unsigned char md5[16];
+    unsigned char sha1[20];
+    unsigned char sha256[SHA256_DIGEST_SIZE];
+    uint32_t crc32;
+    unsigned char tree[SHA256_DIGEST_SIZE];
+}
+hashfile_result;
+
+/**
+ * \brief          Fill in the default options (MD5, SHA-256 and CRC-32,
+ *                 AUTO I/O, 1 MB chunks and leaves)
+ *
+ * \param opts     options to be initialized
+ */
+void hashfile_defaults( hashfile_opts *opts );
+
+/**
+ * \brief          Hash the file at path in one pass
+ *
+ * \param path     input file name
+ * \param opts     options, or NULL for the defaults
+ * \param res      results
+ *
+ * \return         0 if successful, or -1 with errno set
+ */
+int hashfile( const char *path, const hashfile_opts *opts,
+              hashfile_result *res );
+
+/**
+ * \brief          Hash an open file descriptor from its current offset
+ *                 (from offset 0 when mapped or tree hashing)
+ *
+ * \param fd       readable file descriptor, not closed
+ * \param opts     options, or NULL for the defaults
+ * \param res      results
+ *
+ * \return         0 if successful, or -1 with errno set
+ */
+int hashfile_fd( int fd, const hashfile_opts *opts, hashfile_result *res );
+
+/**
+ * \brief          Name of an I/O path ("read", "mmap", ...)
+ */
+const char *hashfile_io_name( hashfile_io io );
+
+/**
+ * \brief          Write len bytes as lower-case hex plus a NUL
+ *
+ * \param out      buffer of at least 2 * len + 1 bytes
+ */
+void hashfile_hex( const unsigned char *digest, int len, char *out );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* hashfile.h */
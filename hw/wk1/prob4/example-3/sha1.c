@@ -321,38 +321,6 @@ void sha1( unsigned char *input, int ilen, unsigned char output[20] )
     memset( &ctx, 0, sizeof( sha1_context ) );
 }
 
-/*
- * output = SHA-1( file contents )
- */
-int sha1_file( char *path, unsigned char output[20] )
-{
-    FILE *f;
-    size_t n;
-    sha1_context ctx;
-    unsigned char buf[1024];
-
-    if( ( f = fopen( path, "rb" ) ) == NULL )
-        return( 1 );
-
-    sha1_starts( &ctx );
-
-    while( ( n = fread( buf, 1, sizeof( buf ), f ) ) > 0 )
-        sha1_update( &ctx, buf, (int) n );
-
-    sha1_finish( &ctx, output );
-
-    memset( &ctx, 0, sizeof( sha1_context ) );
-
-    if( ferror( f ) != 0 )
-    {
-        fclose( f );
-        return( 2 );
-    }
-
-    fclose( f );
-    return( 0 );
-}
-
 /*
  * SHA-1 HMAC context setup
  */
@@ -422,6 +390,92 @@ void sha1_hmac( unsigned char *key, int keylen, unsigned char *input, int ilen,
     memset( &ctx, 0, sizeof( sha1_context ) );
 }
 
+/*
+ * SHA-1 HMAC key setup: hash the ipad and opad blocks once
+ */
+void sha1_hmac_key_setup( sha1_hmac_key *hk, unsigned char *key, int keylen )
+{
+    sha1_context ctx;
+
+    sha1_hmac_starts( &ctx, key, keylen );
+    memcpy( hk->istate, ctx.state, sizeof( hk->istate ) );
+
+    sha1_starts( &ctx );
+    sha1_update( &ctx, ctx.opad, 64 );
+    memcpy( hk->ostate, ctx.state, sizeof( hk->ostate ) );
+
+    memset( &ctx, 0, sizeof( sha1_context ) );
+}
+
+/*
+ * SHA-1 HMAC context setup from a precomputed key
+ */
+void sha1_hmac_key_starts( sha1_context *ctx, const sha1_hmac_key *hk )
+{
+    ctx->total[0] = 64;
+    ctx->total[1] = 0;
+    memcpy( ctx->state, hk->istate, sizeof( hk->istate ) );
+}
+
+/*
+ * SHA-1 HMAC final digest from a precomputed key
+ */
+void sha1_hmac_key_finish( sha1_context *ctx, const sha1_hmac_key *hk,
+                           unsigned char output[20] )
+{
+    unsigned char block[64];
+
+    /*
+     * The outer hash is always the opad block plus one more block
+     * holding the inner digest, padding and a length of 84 bytes
+     */
+    sha1_finish( ctx, block );
+    memset( block + 20, 0, 64 - 20 );
+    block[20] = 0x80;
+    PUT_ULONG_BE( ( 64 + 20 ) << 3, block, 60 );
+
+    memcpy( ctx->state, hk->ostate, sizeof( hk->ostate ) );
+    sha1_process( ctx, block );
+
+    PUT_ULONG_BE( ctx->state[0], output,  0 );
+    PUT_ULONG_BE( ctx->state[1], output,  4 );
+    PUT_ULONG_BE( ctx->state[2], output,  8 );
+    PUT_ULONG_BE( ctx->state[3], output, 12 );
+    PUT_ULONG_BE( ctx->state[4], output, 16 );
+
+    memset( block, 0, sizeof( block ) );
+}
+
+/*
+ * output = HMAC-SHA-1( precomputed key, input buffer )
+ */
+void sha1_hmac_keyed( const sha1_hmac_key *hk, unsigned char *input, int ilen,
+                      unsigned char output[20] )
+{
+    sha1_context ctx;
+
+    sha1_hmac_key_starts( &ctx, hk );
+    sha1_update( &ctx, input, ilen );
+    sha1_hmac_key_finish( &ctx, hk, output );
+}
+
+/*
+ * output[i] = HMAC-SHA-1( precomputed key, input[i] ), i < count
+ */
+void sha1_hmac_batch( const sha1_hmac_key *hk, unsigned char *input[],
+                      const int ilen[], int count, unsigned char output[][20] )
+{
+    sha1_context ctx;
+    int i;
+
+    for( i = 0; i < count; i++ )
+    {
+        sha1_hmac_key_starts( &ctx, hk );
+        sha1_update( &ctx, input[i], ilen[i] );
+        sha1_hmac_key_finish( &ctx, hk, output[i] );
+    }
+}
+
 #if defined(XYSSL_SELF_TEST)
 
 /*
@@ -18,6 +18,18 @@ typedef struct
 }
 sha1_context;
 
+/**
+ * \brief          SHA-1 HMAC precomputed key: the compression states
+ *                 after the ipad and opad blocks, so each message only
+ *                 costs its own blocks plus one outer block
+ */
+typedef struct
+{
+    unsigned long istate[5];    /*!< state after the inner padding */
+    unsigned long ostate[5];    /*!< state after the outer padding */
+}
+sha1_hmac_key;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -55,17 +67,6 @@ void sha1_finish( sha1_context *ctx, unsigned char output[20] );
  */
 void sha1( unsigned char *input, int ilen, unsigned char output[20] );
 
-/**
- * \brief          Output = SHA-1( file contents )
- *
- * \param path     input file name
- * \param output   SHA-1 checksum result
- *
- * \return         0 if successful, 1 if fopen failed,
- *                 or 2 if fread failed
- */
-int sha1_file( char *path, unsigned char output[20] );
-
 /**
  * \brief          SHA-1 HMAC context setup
  *
@@ -105,6 +106,58 @@ void sha1_hmac( unsigned char *key, int keylen,
                 unsigned char *input, int ilen,
                 unsigned char output[20] );
 
+/**
+ * \brief          SHA-1 HMAC precomputed key setup
+ *
+ * \param hk       precomputed key to be initialized
+ * \param key      HMAC secret key
+ * \param keylen   length of the HMAC key
+ */
+void sha1_hmac_key_setup( sha1_hmac_key *hk, unsigned char *key, int keylen );
+
+/**
+ * \brief          SHA-1 HMAC context setup from a precomputed key;
+ *                 feed the message with sha1_update()
+ *
+ * \param ctx      HMAC context to be initialized
+ * \param hk       precomputed key
+ */
+void sha1_hmac_key_starts( sha1_context *ctx, const sha1_hmac_key *hk );
+
+/**
+ * \brief          SHA-1 HMAC final digest from a precomputed key
+ *
+ * \param ctx      HMAC context started by sha1_hmac_key_starts()
+ * \param hk       the same precomputed key
+ * \param output   SHA-1 HMAC checksum result
+ */
+void sha1_hmac_key_finish( sha1_context *ctx, const sha1_hmac_key *hk,
+                           unsigned char output[20] );
+
+/**
+ * \brief          Output = HMAC-SHA-1( precomputed key, input buffer )
+ *
+ * \param hk       precomputed key
+ * \param input    buffer holding the  data
+ * \param ilen     length of the input data
+ * \param output   HMAC-SHA-1 result
+ */
+void sha1_hmac_keyed( const sha1_hmac_key *hk, unsigned char *input, int ilen,
+                      unsigned char output[20] );
+
+/**
+ * \brief          Output[i] = HMAC-SHA-1( precomputed key, input[i] )
+ *                 for a batch of messages under one key
+ *
+ * \param hk       precomputed key
+ * \param input    message buffers
+ * \param ilen     message lengths
+ * \param count    number of messages
+ * \param output   HMAC-SHA-1 results, one per message
+ */
+void sha1_hmac_batch( const sha1_hmac_key *hk, unsigned char *input[],
+                      const int ilen[], int count, unsigned char output[][20] );
+
 /**
  * \brief          Checkup routine
  *
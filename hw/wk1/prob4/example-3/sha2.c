@@ -389,7 +389,7 @@ void sha256_final(sha256_ctx *ctx, unsigned char *digest)
 {
     unsigned int block_nb;
     unsigned int pm_len;
-    unsigned int len_b;
+    uint64 len_b;
 
 #ifndef UNROLL_LOOPS
     int i;
@@ -403,7 +403,8 @@ void sha256_final(sha256_ctx *ctx, unsigned char *digest)
 
     memset(ctx->block + ctx->len, 0, pm_len - ctx->len);
     ctx->block[ctx->len] = 0x80;
-    UNPACK32(len_b, ctx->block + pm_len - 4);
+    UNPACK32((uint32) (len_b >> 32), ctx->block + pm_len - 8);
+    UNPACK32((uint32) len_b, ctx->block + pm_len - 4);
 
     sha256_transf(ctx, ctx->block, block_nb);
 
@@ -586,7 +587,7 @@ void sha512_final(sha512_ctx *ctx, unsigned char *digest)
 {
     unsigned int block_nb;
     unsigned int pm_len;
-    unsigned int len_b;
+    uint64 len_b;
 
 #ifndef UNROLL_LOOPS
     int i;
@@ -600,7 +601,8 @@ void sha512_final(sha512_ctx *ctx, unsigned char *digest)
 
     memset(ctx->block + ctx->len, 0, pm_len - ctx->len);
     ctx->block[ctx->len] = 0x80;
-    UNPACK32(len_b, ctx->block + pm_len - 4);
+    UNPACK32((uint32) (len_b >> 32), ctx->block + pm_len - 8);
+    UNPACK32((uint32) len_b, ctx->block + pm_len - 4);
 
     sha512_transf(ctx, ctx->block, block_nb);
 
@@ -688,7 +690,7 @@ void sha384_final(sha384_ctx *ctx, unsigned char *digest)
 {
     unsigned int block_nb;
     unsigned int pm_len;
-    unsigned int len_b;
+    uint64 len_b;
 
 #ifndef UNROLL_LOOPS
     int i;
@@ -702,7 +704,8 @@ void sha384_final(sha384_ctx *ctx, unsigned char *digest)
 
     memset(ctx->block + ctx->len, 0, pm_len - ctx->len);
     ctx->block[ctx->len] = 0x80;
-    UNPACK32(len_b, ctx->block + pm_len - 4);
+    UNPACK32((uint32) (len_b >> 32), ctx->block + pm_len - 8);
+    UNPACK32((uint32) len_b, ctx->block + pm_len - 4);
 
     sha512_transf(ctx, ctx->block, block_nb);
 
@@ -788,7 +791,7 @@ void sha224_final(sha224_ctx *ctx, unsigned char *digest)
 {
     unsigned int block_nb;
     unsigned int pm_len;
-    unsigned int len_b;
+    uint64 len_b;
 
 #ifndef UNROLL_LOOPS
     int i;
@@ -802,7 +805,8 @@ void sha224_final(sha224_ctx *ctx, unsigned char *digest)
 
     memset(ctx->block + ctx->len, 0, pm_len - ctx->len);
     ctx->block[ctx->len] = 0x80;
-    UNPACK32(len_b, ctx->block + pm_len - 4);
+    UNPACK32((uint32) (len_b >> 32), ctx->block + pm_len - 8);
+    UNPACK32((uint32) len_b, ctx->block + pm_len - 4);
 
     sha256_transf(ctx, ctx->block, block_nb);
 
@@ -821,6 +825,130 @@ void sha224_final(sha224_ctx *ctx, unsigned char *digest)
 #endif /* !UNROLL_LOOPS */
 }
 
+/* HMAC-SHA-256 functions (RFC 2104) */
+
+void hmac_sha256_key_init(hmac_sha256_key *hk, const unsigned char *key,
+                          unsigned int key_size)
+{
+    unsigned char key_temp[SHA256_DIGEST_SIZE];
+    unsigned char block_pad[SHA256_BLOCK_SIZE];
+    sha256_ctx ctx;
+    unsigned int i;
+
+    if (key_size > SHA256_BLOCK_SIZE) {
+        sha256(key, key_size, key_temp);
+        key = key_temp;
+        key_size = SHA256_DIGEST_SIZE;
+    }
+
+    memset(block_pad, 0x36, SHA256_BLOCK_SIZE);
+    for (i = 0; i < key_size; i++) {
+        block_pad[i] ^= key[i];
+    }
+    sha256_init(&ctx);
+    sha256_transf(&ctx, block_pad, 1);
+    memcpy(hk->h_inside, ctx.h, sizeof(hk->h_inside));
+
+    memset(block_pad, 0x5c, SHA256_BLOCK_SIZE);
+    for (i = 0; i < key_size; i++) {
+        block_pad[i] ^= key[i];
+    }
+    sha256_init(&ctx);
+    sha256_transf(&ctx, block_pad, 1);
+    memcpy(hk->h_outside, ctx.h, sizeof(hk->h_outside));
+
+    memset(block_pad, 0, sizeof(block_pad));
+    memset(key_temp, 0, sizeof(key_temp));
+}
+
+/* Start the inner hash as if the ipad block had just been compressed */
+static void hmac_sha256_inside(sha256_ctx *ctx, const hmac_sha256_key *hk)
+{
+    memcpy(ctx->h, hk->h_inside, sizeof(hk->h_inside));
+    ctx->len = 0;
+    ctx->tot_len = SHA256_BLOCK_SIZE;
+}
+
+/* Finish the inner hash and run the outer one, which is a single block */
+static void hmac_sha256_outside(sha256_ctx *ctx, const hmac_sha256_key *hk,
+                                unsigned char *mac, unsigned int mac_size)
+{
+    unsigned char block[SHA256_BLOCK_SIZE];
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    int i;
+
+    sha256_final(ctx, block);
+    memset(block + SHA256_DIGEST_SIZE, 0,
+           SHA256_BLOCK_SIZE - SHA256_DIGEST_SIZE);
+    block[SHA256_DIGEST_SIZE] = 0x80;
+    UNPACK32((SHA256_BLOCK_SIZE + SHA256_DIGEST_SIZE) << 3,
+             block + SHA256_BLOCK_SIZE - 4);
+
+    memcpy(ctx->h, hk->h_outside, sizeof(hk->h_outside));
+    sha256_transf(ctx, block, 1);
+
+    for (i = 0 ; i < 8; i++) {
+        UNPACK32(ctx->h[i], &digest[i << 2]);
+    }
+
+    if (mac_size > SHA256_DIGEST_SIZE) {
+        mac_size = SHA256_DIGEST_SIZE;
+    }
+    memcpy(mac, digest, mac_size);
+}
+
+void hmac_sha256_init(hmac_sha256_ctx *ctx, const unsigned char *key,
+                      unsigned int key_size)
+{
+    hmac_sha256_key_init(&ctx->key, key, key_size);
+    hmac_sha256_inside(&ctx->ctx_inside, &ctx->key);
+}
+
+void hmac_sha256_reinit(hmac_sha256_ctx *ctx)
+{
+    hmac_sha256_inside(&ctx->ctx_inside, &ctx->key);
+}
+
+void hmac_sha256_update(hmac_sha256_ctx *ctx, const unsigned char *message,
+                        unsigned int message_len)
+{
+    sha256_update(&ctx->ctx_inside, message, message_len);
+}
+
+void hmac_sha256_final(hmac_sha256_ctx *ctx, unsigned char *mac,
+                       unsigned int mac_size)
+{
+    hmac_sha256_outside(&ctx->ctx_inside, &ctx->key, mac, mac_size);
+}
+
+void hmac_sha256(const unsigned char *key, unsigned int key_size,
+                 const unsigned char *message, unsigned int message_len,
+                 unsigned char *mac, unsigned mac_size)
+{
+    hmac_sha256_ctx ctx;
+
+    hmac_sha256_init(&ctx, key, key_size);
+    hmac_sha256_update(&ctx, message, message_len);
+    hmac_sha256_final(&ctx, mac, mac_size);
+
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+void hmac_sha256_batch(const hmac_sha256_key *hk,
+                       const unsigned char *messages[],
+                       const unsigned int message_lens[], unsigned int count,
+                       unsigned char *macs, unsigned int mac_size)
+{
+    sha256_ctx ctx;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        hmac_sha256_inside(&ctx, hk);
+        sha256_update(&ctx, messages[i], message_lens[i]);
+        hmac_sha256_outside(&ctx, hk, macs + i * mac_size, mac_size);
+    }
+}
+
 #ifdef TEST_VECTORS
 
 /* FIPS 180-2 Validation tests */
@@ -56,14 +56,14 @@ extern "C" {
 #endif
 
 typedef struct {
-    unsigned int tot_len;
+    uint64 tot_len;
     unsigned int len;
     unsigned char block[2 * SHA256_BLOCK_SIZE];
     uint32 h[8];
 } sha256_ctx;
 
 typedef struct {
-    unsigned int tot_len;
+    uint64 tot_len;
     unsigned int len;
     unsigned char block[2 * SHA512_BLOCK_SIZE];
     uint64 h[8];
@@ -72,6 +72,18 @@ typedef struct {
 typedef sha512_ctx sha384_ctx;
 typedef sha256_ctx sha224_ctx;
 
+/* HMAC-SHA-256 key: the states after the ipad and opad blocks, so a
+   message costs its own blocks plus one outer block */
+typedef struct {
+    uint32 h_inside[8];
+    uint32 h_outside[8];
+} hmac_sha256_key;
+
+typedef struct {
+    sha256_ctx ctx_inside;
+    hmac_sha256_key key;
+} hmac_sha256_ctx;
+
 void sha224_init(sha224_ctx *ctx);
 void sha224_update(sha224_ctx *ctx, const unsigned char *message,
                    unsigned int len);
@@ -79,6 +91,9 @@ void sha224_final(sha224_ctx *ctx, unsigned char *digest);
 void sha224(const unsigned char *message, unsigned int len,
             unsigned char *digest);
 
+void sha256_transf(sha256_ctx *ctx, const unsigned char *message,
+                   unsigned int block_nb);
+
 void sha256_init(sha256_ctx * ctx);
 void sha256_update(sha256_ctx *ctx, const unsigned char *message,
                    unsigned int len);
@@ -100,6 +115,23 @@ void sha512_final(sha512_ctx *ctx, unsigned char *digest);
 void sha512(const unsigned char *message, unsigned int len,
             unsigned char *digest);
 
+void hmac_sha256_key_init(hmac_sha256_key *hk, const unsigned char *key,
+                          unsigned int key_size);
+void hmac_sha256_init(hmac_sha256_ctx *ctx, const unsigned char *key,
+                      unsigned int key_size);
+void hmac_sha256_reinit(hmac_sha256_ctx *ctx);
+void hmac_sha256_update(hmac_sha256_ctx *ctx, const unsigned char *message,
+                        unsigned int message_len);
+void hmac_sha256_final(hmac_sha256_ctx *ctx, unsigned char *mac,
+                       unsigned int mac_size);
+void hmac_sha256(const unsigned char *key, unsigned int key_size,
+                 const unsigned char *message, unsigned int message_len,
+                 unsigned char *mac, unsigned mac_size);
+void hmac_sha256_batch(const hmac_sha256_key *hk,
+                       const unsigned char *messages[],
+                       const unsigned int message_lens[], unsigned int count,
+                       unsigned char *macs, unsigned int mac_size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,587 @@
+/*
+ * Multi-buffer SHA-256
+ *
+ * See sha2_mb.h for the interface. Lanes run in lock step: every call
+ * of a compression function advances each busy lane by one block, so a
+ * manager runs its lanes for as many blocks as the shortest job still
+ * needs, retires the finished jobs and refills the free lanes from the
+ * queue. Each job's final one or two padded blocks are built in a
+ * per-lane tail buffer when the job enters its lane, so the lanes only
+ * ever see whole blocks.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "sha2_mb.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA256_MB_X86
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+/* with this few jobs left, finish them one at a time on SHA-NI */
+#define SHA256_MB_NI_TAIL 2
+
+extern uint32 sha256_h0[8];
+extern uint32 sha256_k[64];
+
+#define PACK32(str, x)                        \
+{                                             \
+    *(x) =   ((uint32) *((str) + 3)      )    \
+           | ((uint32) *((str) + 2) <<  8)    \
+           | ((uint32) *((str) + 1) << 16)    \
+           | ((uint32) *((str) + 0) << 24);   \
+}
+
+#define UNPACK32(x, str)                      \
+{                                             \
+    *((str) + 3) = (uint8) ((x)      );       \
+    *((str) + 2) = (uint8) ((x) >>  8);       \
+    *((str) + 1) = (uint8) ((x) >> 16);       \
+    *((str) + 0) = (uint8) ((x) >> 24);       \
+}
+
+static const char *sha256_mb_names[SHA256_MB_ENGINES] =
+    {"auto", "scalar", "sse2", "avx2", "avx512"};
+
+static const unsigned char sha256_mb_zero_block[SHA256_BLOCK_SIZE];
+
+static uint64 sha256_mb_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64) ts.tv_sec * 1000000000ULL + (uint64) ts.tv_nsec;
+}
+
+#if defined(SHA256_MB_X86)
+
+/* Vector forms of the sha2.c round macros; ROTR there relies on sizeof */
+
+#define VROTR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+#define VCH(x, y, z)  (((x) & (y)) ^ (~(x) & (z)))
+#define VMAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define VF1(x) (VROTR(x,  2) ^ VROTR(x, 13) ^ VROTR(x, 22))
+#define VF2(x) (VROTR(x,  6) ^ VROTR(x, 11) ^ VROTR(x, 25))
+#define VF3(x) (VROTR(x,  7) ^ VROTR(x, 18) ^ ((x) >>  3))
+#define VF4(x) (VROTR(x, 17) ^ VROTR(x, 19) ^ ((x) >> 10))
+
+#define SHA256_MB_EXP(a, b, c, d, e, f, g, h, j)                      \
+{                                                                     \
+    if ((j) >= 16) {                                                  \
+        w[(j) & 15] += VF4(w[((j) - 2) & 15]) + w[((j) - 7) & 15]     \
+                     + VF3(w[((j) - 15) & 15]);                       \
+    }                                                                 \
+    t1 = wv[h] + VF2(wv[e]) + VCH(wv[e], wv[f], wv[g])                \
+         + w[(j) & 15] + sha256_k[j];                                 \
+    t2 = VF1(wv[a]) + VMAJ(wv[a], wv[b], wv[c]);                      \
+    wv[d] += t1;                                                      \
+    wv[h] = t1 + t2;                                                  \
+}
+
+#define SHA256_MB_LANES  4
+#define SHA256_MB_VEC    sha256_v4
+#define SHA256_MB_NAME   sha256_mb_x4
+#define SHA256_MB_TARGET __attribute__ ((target ("sse2")))
+#include "sha2_mb_lanes.h"
+
+#define SHA256_MB_LANES  8
+#define SHA256_MB_VEC    sha256_v8
+#define SHA256_MB_NAME   sha256_mb_x8
+#define SHA256_MB_TARGET __attribute__ ((target ("avx2")))
+#include "sha2_mb_lanes.h"
+
+#define SHA256_MB_LANES  16
+#define SHA256_MB_VEC    sha256_v16
+#define SHA256_MB_NAME   sha256_mb_x16
+#define SHA256_MB_TARGET __attribute__ ((target ("avx512f")))
+#include "sha2_mb_lanes.h"
+
+/*
+ * Single-stream SHA-256 on the SHA extensions. The state is kept as
+ * ABEF/CDGH word pairs as sha256rnds2 expects; each group of four rounds
+ * also advances the message schedule with sha256msg1/sha256msg2.
+ */
+__attribute__ ((target ("sha,sse4.1")))
+static void sha256_ni_transf(uint32 state[8], const unsigned char *message,
+                             uint64 block_nb)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i state0, state1, msg, tmp, abef_save, cdgh_save;
+    __m128i m[4];
+    int i;
+
+    tmp    = _mm_loadu_si128((const __m128i *) &state[0]);
+    state1 = _mm_loadu_si128((const __m128i *) &state[4]);
+    tmp    = _mm_shuffle_epi32(tmp, 0xB1);              /* CDAB */
+    state1 = _mm_shuffle_epi32(state1, 0x1B);           /* EFGH */
+    state0 = _mm_alignr_epi8(tmp, state1, 8);           /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);        /* CDGH */
+
+    while (block_nb--) {
+        abef_save = state0;
+        cdgh_save = state1;
+
+        for (i = 0; i < 16; i++) {
+            if (i < 4) {
+                m[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+                           (const __m128i *) (message + 16 * i)), mask);
+            }
+
+            msg = _mm_add_epi32(m[i & 3], _mm_loadu_si128(
+                      (const __m128i *) &sha256_k[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+            if (i >= 3 && i <= 14) {
+                tmp = _mm_alignr_epi8(m[i & 3], m[(i - 1) & 3], 4);
+                m[(i + 1) & 3] = _mm_add_epi32(m[(i + 1) & 3], tmp);
+                m[(i + 1) & 3] = _mm_sha256msg2_epu32(m[(i + 1) & 3],
+                                                      m[i & 3]);
+            }
+
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+            if (i >= 1 && i <= 12) {
+                m[(i - 1) & 3] = _mm_sha256msg1_epu32(m[(i - 1) & 3],
+                                                      m[i & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+        message += SHA256_BLOCK_SIZE;
+    }
+
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);           /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);           /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);        /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);           /* ABEF */
+
+    _mm_storeu_si128((__m128i *) &state[0], state0);
+    _mm_storeu_si128((__m128i *) &state[4], state1);
+}
+
+#endif /* SHA256_MB_X86 */
+
+int sha256_ni_supported(void)
+{
+    static int supported = -1;
+
+    if (supported < 0) {
+#if defined(SHA256_MB_X86)
+        unsigned int eax, ebx, ecx, edx;
+
+        supported = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+                    && (ebx & (1u << 29))
+                    && __builtin_cpu_supports("sse4.1");
+#else
+        supported = 0;
+#endif
+    }
+
+    return supported;
+}
+
+int sha256_mb_supported(sha256_mb_engine engine)
+{
+    switch (engine) {
+    case SHA256_MB_AUTO:
+    case SHA256_MB_SCALAR:
+        return 1;
+#if defined(SHA256_MB_X86)
+    case SHA256_MB_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SHA256_MB_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case SHA256_MB_AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *sha256_mb_engine_name(sha256_mb_engine engine)
+{
+    if (engine < 0 || engine >= SHA256_MB_ENGINES) {
+        return "unknown";
+    }
+
+    return sha256_mb_names[engine];
+}
+
+/* Single-stream compression of whole blocks, SHA-NI or sha2.c */
+static void sha256_blocks(uint32 h[8], const unsigned char *message,
+                          uint64 block_nb)
+{
+    sha256_ctx ctx;
+    unsigned int chunk;
+
+#if defined(SHA256_MB_X86)
+    if (sha256_ni_supported()) {
+        sha256_ni_transf(h, message, block_nb);
+        return;
+    }
+#endif
+
+    memcpy(ctx.h, h, sizeof(ctx.h));
+    while (block_nb > 0) {
+        chunk = block_nb > 0x10000 ? 0x10000 : (unsigned int) block_nb;
+        sha256_transf(&ctx, message, chunk);
+        message += (uint64) chunk << 6;
+        block_nb -= chunk;
+    }
+    memcpy(h, ctx.h, sizeof(ctx.h));
+}
+
+/* Build the padded final block(s) of a message, returns their count */
+static int sha256_pad(const unsigned char *message, uint64 len,
+                      unsigned char tail[2 * SHA256_BLOCK_SIZE])
+{
+    unsigned int rem_len = (unsigned int) (len % SHA256_BLOCK_SIZE);
+    int block_nb = (rem_len < SHA256_BLOCK_SIZE - 8) ? 1 : 2;
+    uint64 len_b = len << 3;
+    int i;
+
+    memset(tail, 0, 2 * SHA256_BLOCK_SIZE);
+    memcpy(tail, message + (len - rem_len), rem_len);
+    tail[rem_len] = 0x80;
+
+    for (i = 0; i < 8; i++) {
+        tail[(block_nb << 6) - 1 - i] = (uint8) (len_b >> (8 * i));
+    }
+
+    return block_nb;
+}
+
+void sha256_fast(const unsigned char *message, uint64 len,
+                 unsigned char *digest)
+{
+    unsigned char tail[2 * SHA256_BLOCK_SIZE];
+    uint32 h[8];
+    int block_nb;
+    int i;
+
+    memcpy(h, sha256_h0, sizeof(h));
+    sha256_blocks(h, message, len / SHA256_BLOCK_SIZE);
+    block_nb = sha256_pad(message, len, tail);
+    sha256_blocks(h, tail, block_nb);
+
+    for (i = 0; i < 8; i++) {
+        UNPACK32(h[i], &digest[i << 2]);
+    }
+}
+
+/*
+ * Streaming form of sha256_fast(): same context and framing as
+ * sha256_update(), so sha256_init() and sha256_final() pair with it,
+ * but whole blocks go through SHA-NI where available and the length
+ * may exceed 4 GB.
+ */
+void sha256_fast_update(sha256_ctx *ctx, const unsigned char *message,
+                        uint64 len)
+{
+    uint64 block_nb;
+    unsigned int rem_len;
+
+    if (ctx->len > 0) {
+        rem_len = SHA256_BLOCK_SIZE - ctx->len;
+        if (len < rem_len) {
+            memcpy(&ctx->block[ctx->len], message, (size_t) len);
+            ctx->len += (unsigned int) len;
+            return;
+        }
+
+        memcpy(&ctx->block[ctx->len], message, rem_len);
+        sha256_blocks(ctx->h, ctx->block, 1);
+        ctx->tot_len += SHA256_BLOCK_SIZE;
+        ctx->len = 0;
+        message += rem_len;
+        len -= rem_len;
+    }
+
+    block_nb = len / SHA256_BLOCK_SIZE;
+    sha256_blocks(ctx->h, message, block_nb);
+    ctx->tot_len += block_nb << 6;
+
+    rem_len = (unsigned int) (len % SHA256_BLOCK_SIZE);
+    memcpy(ctx->block, message + (block_nb << 6), rem_len);
+    ctx->len = rem_len;
+}
+
+int sha256_mb_init(sha256_mb_mgr *mgr, sha256_mb_engine engine,
+                   uint64 deadline_ns)
+{
+    if (mgr == NULL || !sha256_mb_supported(engine)) {
+        return -1;
+    }
+
+    if (engine == SHA256_MB_AUTO) {
+        if (sha256_mb_supported(SHA256_MB_AVX512)) {
+            engine = SHA256_MB_AVX512;
+        } else if (sha256_mb_supported(SHA256_MB_AVX2)) {
+            engine = SHA256_MB_AVX2;
+        } else if (sha256_mb_supported(SHA256_MB_SSE2)) {
+            engine = SHA256_MB_SSE2;
+        } else {
+            engine = SHA256_MB_SCALAR;
+        }
+    }
+
+    memset(mgr, 0, sizeof(*mgr));
+    mgr->engine = engine;
+    mgr->use_ni = sha256_ni_supported();
+    mgr->deadline_ns = deadline_ns;
+
+    switch (engine) {
+    case SHA256_MB_SSE2:   mgr->lanes = 4;  break;
+    case SHA256_MB_AVX2:   mgr->lanes = 8;  break;
+    case SHA256_MB_AVX512: mgr->lanes = 16; break;
+    default:               mgr->lanes = 1;  break;
+    }
+
+    return 0;
+}
+
+static void sha256_mb_complete(sha256_mb_mgr *mgr, sha256_mb_job *job)
+{
+    job->status = SHA256_MB_DONE;
+    job->next = NULL;
+
+    if (mgr->complete != NULL) {
+        mgr->complete(job, mgr->complete_arg);
+    }
+}
+
+static const unsigned char *sha256_mb_block(const sha256_mb_mgr *mgr,
+                                            int lane)
+{
+    uint64 done = mgr->done_blocks[lane];
+
+    if (done < mgr->full_blocks[lane]) {
+        return mgr->job[lane]->message + (done << 6);
+    }
+
+    return mgr->tail[lane] + ((done - mgr->full_blocks[lane]) << 6);
+}
+
+static uint64 sha256_mb_remaining(const sha256_mb_mgr *mgr, int lane)
+{
+    return mgr->full_blocks[lane] + mgr->tail_blocks[lane]
+           - mgr->done_blocks[lane];
+}
+
+/* Move queued jobs into free lanes */
+static void sha256_mb_fill(sha256_mb_mgr *mgr)
+{
+    sha256_mb_job *job;
+    int lane, i;
+
+    for (lane = 0; lane < mgr->lanes && mgr->head != NULL; lane++) {
+        if (mgr->job[lane] != NULL) {
+            continue;
+        }
+
+        job = mgr->head;
+        mgr->head = job->next;
+        if (mgr->head == NULL) {
+            mgr->last = NULL;
+        }
+        mgr->queued--;
+
+        mgr->job[lane] = job;
+        mgr->full_blocks[lane] = job->len / SHA256_BLOCK_SIZE;
+        mgr->done_blocks[lane] = 0;
+        mgr->tail_blocks[lane] = sha256_pad(job->message, job->len,
+                                            mgr->tail[lane]);
+        for (i = 0; i < 8; i++) {
+            mgr->h[i][lane] = sha256_h0[i];
+        }
+        mgr->active++;
+    }
+}
+
+/* Write out the digest of a lane whose job has no blocks left */
+static void sha256_mb_retire(sha256_mb_mgr *mgr, int lane)
+{
+    sha256_mb_job *job = mgr->job[lane];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        UNPACK32(mgr->h[i][lane], &job->digest[i << 2]);
+    }
+
+    mgr->job[lane] = NULL;
+    mgr->active--;
+    sha256_mb_complete(mgr, job);
+}
+
+/* Run the lanes until the shortest job completes; returns jobs done */
+static int sha256_mb_run(sha256_mb_mgr *mgr)
+{
+    const unsigned char *blk[SHA256_MB_MAX_LANES];
+    uint64 steps = 0, left, b;
+    int lane, done = 0;
+
+    for (lane = 0; lane < mgr->lanes; lane++) {
+        if (mgr->job[lane] != NULL) {
+            left = sha256_mb_remaining(mgr, lane);
+            if (steps == 0 || left < steps) {
+                steps = left;
+            }
+        }
+    }
+
+    for (b = 0; b < steps; b++) {
+        for (lane = 0; lane < SHA256_MB_MAX_LANES; lane++) {
+            blk[lane] = (lane < mgr->lanes && mgr->job[lane] != NULL)
+                        ? sha256_mb_block(mgr, lane) : sha256_mb_zero_block;
+        }
+
+#if defined(SHA256_MB_X86)
+        switch (mgr->engine) {
+        case SHA256_MB_SSE2:   sha256_mb_x4(mgr->h, blk);  break;
+        case SHA256_MB_AVX2:   sha256_mb_x8(mgr->h, blk);  break;
+        case SHA256_MB_AVX512: sha256_mb_x16(mgr->h, blk); break;
+        default: break;
+        }
+#endif
+
+        for (lane = 0; lane < mgr->lanes; lane++) {
+            if (mgr->job[lane] != NULL) {
+                mgr->done_blocks[lane]++;
+            }
+        }
+    }
+
+    for (lane = 0; lane < mgr->lanes; lane++) {
+        if (mgr->job[lane] != NULL && sha256_mb_remaining(mgr, lane) == 0) {
+            sha256_mb_retire(mgr, lane);
+            done++;
+        }
+    }
+
+    return done;
+}
+
+/* Finish one lane's job on the single-stream path */
+static void sha256_mb_finish_lane(sha256_mb_mgr *mgr, int lane)
+{
+    uint64 full = mgr->full_blocks[lane];
+    uint64 done = mgr->done_blocks[lane];
+    uint32 h[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        h[i] = mgr->h[i][lane];
+    }
+
+    if (done < full) {
+        sha256_blocks(h, mgr->job[lane]->message + (done << 6), full - done);
+        done = full;
+    }
+    sha256_blocks(h, mgr->tail[lane] + ((done - full) << 6),
+                  full + mgr->tail_blocks[lane] - done);
+
+    for (i = 0; i < 8; i++) {
+        mgr->h[i][lane] = h[i];
+    }
+    mgr->done_blocks[lane] = full + mgr->tail_blocks[lane];
+    sha256_mb_retire(mgr, lane);
+}
+
+void sha256_mb_submit(sha256_mb_mgr *mgr, sha256_mb_job *job)
+{
+    job->status = SHA256_MB_PENDING;
+    job->submit_ns = sha256_mb_now_ns();
+    job->next = NULL;
+
+    if (mgr->lanes == 1) {
+        sha256_fast(job->message, job->len, job->digest);
+        sha256_mb_complete(mgr, job);
+        return;
+    }
+
+    if (mgr->last != NULL) {
+        mgr->last->next = job;
+    } else {
+        mgr->head = job;
+    }
+    mgr->last = job;
+    mgr->queued++;
+
+    sha256_mb_fill(mgr);
+    while (mgr->active == mgr->lanes) {
+        sha256_mb_run(mgr);
+        sha256_mb_fill(mgr);
+    }
+}
+
+int sha256_mb_flush(sha256_mb_mgr *mgr)
+{
+    int done = 0;
+    int lane;
+
+    for (;;) {
+        sha256_mb_fill(mgr);
+        if (mgr->active == 0) {
+            break;
+        }
+
+        if (mgr->use_ni && mgr->queued == 0
+            && mgr->active <= SHA256_MB_NI_TAIL) {
+            for (lane = 0; lane < mgr->lanes; lane++) {
+                if (mgr->job[lane] != NULL) {
+                    sha256_mb_finish_lane(mgr, lane);
+                    done++;
+                }
+            }
+        } else {
+            done += sha256_mb_run(mgr);
+        }
+    }
+
+    return done;
+}
+
+int sha256_mb_poll(sha256_mb_mgr *mgr)
+{
+    uint64 oldest = 0;
+    int lane;
+
+    if (mgr->deadline_ns == 0 || (mgr->active == 0 && mgr->queued == 0)) {
+        return 0;
+    }
+
+    for (lane = 0; lane < mgr->lanes; lane++) {
+        if (mgr->job[lane] != NULL
+            && (oldest == 0 || mgr->job[lane]->submit_ns < oldest)) {
+            oldest = mgr->job[lane]->submit_ns;
+        }
+    }
+    if (mgr->head != NULL && (oldest == 0 || mgr->head->submit_ns < oldest)) {
+        oldest = mgr->head->submit_ns;
+    }
+
+    if (sha256_mb_now_ns() - oldest < mgr->deadline_ns) {
+        return 0;
+    }
+
+    return sha256_mb_flush(mgr);
+}
+
+int sha256_mb_hash(sha256_mb_mgr *mgr, sha256_mb_job *jobs, int njobs)
+{
+    int i;
+
+    for (i = 0; i < njobs; i++) {
+        sha256_mb_submit(mgr, &jobs[i]);
+    }
+
+    return sha256_mb_flush(mgr);
+}
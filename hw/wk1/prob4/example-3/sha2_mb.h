@@ -0,0 +1,103 @@
+/*
+ * Multi-buffer SHA-256
+ *
+ * Hashes up to 16 independent messages at once, one message per SIMD
+ * lane (4 lanes with SSE2, 8 with AVX2, 16 with AVX-512), and hashes
+ * single messages with the SHA extensions (SHA-NI) where available.
+ * Digests are identical to sha256() in sha2.c.
+ *
+ * A manager owns the lanes and a queue of pending jobs:
+ *
+ *   sha256_mb_submit()  queues a job and, once every lane is busy,
+ *                       runs the lanes until at least one job is done
+ *   sha256_mb_poll()    flushes everything if the oldest pending job
+ *                       has waited longer than the manager deadline
+ *   sha256_mb_flush()   completes every pending job
+ *
+ * Completed jobs are marked SHA256_MB_DONE and, if set, passed to the
+ * manager's completion callback. A job and its message buffer must stay
+ * valid until it completes.
+ *
+ * sha256_fast() and sha256_fast_update() hash a single message, with
+ * SHA-NI when the CPU has it and sha2.c otherwise.
+ */
+
+#ifndef SHA2_MB_H
+#define SHA2_MB_H
+
+#include "sha2.h"
+
+#define SHA256_MB_MAX_LANES 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    SHA256_MB_AUTO,
+    SHA256_MB_SCALAR,       /* 1 lane, sha2.c or SHA-NI */
+    SHA256_MB_SSE2,         /* 4 lanes */
+    SHA256_MB_AVX2,         /* 8 lanes */
+    SHA256_MB_AVX512,       /* 16 lanes */
+    SHA256_MB_ENGINES
+} sha256_mb_engine;
+
+typedef enum {
+    SHA256_MB_IDLE,
+    SHA256_MB_PENDING,
+    SHA256_MB_DONE
+} sha256_mb_status;
+
+typedef struct sha256_mb_job {
+    const unsigned char *message;
+    uint64 len;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    sha256_mb_status status;
+    void *user;                         /* caller's tag, untouched */
+
+    /* private */
+    uint64 submit_ns;
+    struct sha256_mb_job *next;
+} sha256_mb_job;
+
+typedef struct sha256_mb_mgr {
+    sha256_mb_engine engine;
+    int lanes;
+    int use_ni;                         /* SHA-NI for single streams */
+    uint64 deadline_ns;                 /* 0 = no deadline flush */
+    void (*complete)(sha256_mb_job *job, void *arg);
+    void *complete_arg;
+
+    /* private */
+    sha256_mb_job *head, *last;
+    int queued;
+    int active;
+    sha256_mb_job *job[SHA256_MB_MAX_LANES];
+    uint64 full_blocks[SHA256_MB_MAX_LANES];
+    uint64 done_blocks[SHA256_MB_MAX_LANES];
+    int tail_blocks[SHA256_MB_MAX_LANES];
+    uint32 h[8][SHA256_MB_MAX_LANES];   /* transposed: h[word][lane] */
+    unsigned char tail[SHA256_MB_MAX_LANES][2 * SHA256_BLOCK_SIZE];
+} sha256_mb_mgr;
+
+int sha256_mb_init(sha256_mb_mgr *mgr, sha256_mb_engine engine,
+                   uint64 deadline_ns);
+int sha256_mb_supported(sha256_mb_engine engine);
+const char *sha256_mb_engine_name(sha256_mb_engine engine);
+
+void sha256_mb_submit(sha256_mb_mgr *mgr, sha256_mb_job *job);
+int sha256_mb_poll(sha256_mb_mgr *mgr);
+int sha256_mb_flush(sha256_mb_mgr *mgr);
+int sha256_mb_hash(sha256_mb_mgr *mgr, sha256_mb_job *jobs, int njobs);
+
+int sha256_ni_supported(void);
+void sha256_fast(const unsigned char *message, uint64 len,
+                 unsigned char *digest);
+void sha256_fast_update(sha256_ctx *ctx, const unsigned char *message,
+                        uint64 len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !SHA2_MB_H */
@@ -0,0 +1,86 @@
+/*
+ * Multi-buffer SHA-256 compression function template
+ *
+ * Included by sha2_mb.c once per lane width with
+ *
+ *   SHA256_MB_LANES   number of 32-bit lanes (4, 8 or 16)
+ *   SHA256_MB_VEC     name of the vector type to define
+ *   SHA256_MB_NAME    name of the compression function to define
+ *   SHA256_MB_TARGET  function attribute selecting the instruction set
+ *
+ * Each lane runs the FIPS 180-2 compression on its own 64-byte block.
+ * The vector code uses GCC vector extensions, so the same source is
+ * compiled to SSE2, AVX2 or AVX-512 by the target attribute.
+ */
+
+typedef uint32 SHA256_MB_VEC
+    __attribute__ ((vector_size (4 * SHA256_MB_LANES)));
+
+SHA256_MB_TARGET
+static void SHA256_MB_NAME(uint32 h[8][SHA256_MB_MAX_LANES],
+                           const unsigned char *blk[SHA256_MB_MAX_LANES])
+{
+    uint32 wt[16][SHA256_MB_LANES];
+    SHA256_MB_VEC w[16];
+    SHA256_MB_VEC wv[8];
+    SHA256_MB_VEC t1, t2;
+    int i, j, l;
+
+    for (l = 0; l < SHA256_MB_LANES; l++) {
+        for (j = 0; j < 16; j++) {
+            PACK32(&blk[l][j << 2], &wt[j][l]);
+        }
+    }
+
+    memcpy(w, wt, sizeof(w));
+    for (i = 0; i < 8; i++) {
+        memcpy(&wv[i], h[i], sizeof(SHA256_MB_VEC));
+    }
+
+    /* fully unrolled so every schedule index is a constant */
+    SHA256_MB_EXP(0,1,2,3,4,5,6,7, 0); SHA256_MB_EXP(7,0,1,2,3,4,5,6, 1);
+    SHA256_MB_EXP(6,7,0,1,2,3,4,5, 2); SHA256_MB_EXP(5,6,7,0,1,2,3,4, 3);
+    SHA256_MB_EXP(4,5,6,7,0,1,2,3, 4); SHA256_MB_EXP(3,4,5,6,7,0,1,2, 5);
+    SHA256_MB_EXP(2,3,4,5,6,7,0,1, 6); SHA256_MB_EXP(1,2,3,4,5,6,7,0, 7);
+    SHA256_MB_EXP(0,1,2,3,4,5,6,7, 8); SHA256_MB_EXP(7,0,1,2,3,4,5,6, 9);
+    SHA256_MB_EXP(6,7,0,1,2,3,4,5,10); SHA256_MB_EXP(5,6,7,0,1,2,3,4,11);
+    SHA256_MB_EXP(4,5,6,7,0,1,2,3,12); SHA256_MB_EXP(3,4,5,6,7,0,1,2,13);
+    SHA256_MB_EXP(2,3,4,5,6,7,0,1,14); SHA256_MB_EXP(1,2,3,4,5,6,7,0,15);
+    SHA256_MB_EXP(0,1,2,3,4,5,6,7,16); SHA256_MB_EXP(7,0,1,2,3,4,5,6,17);
+    SHA256_MB_EXP(6,7,0,1,2,3,4,5,18); SHA256_MB_EXP(5,6,7,0,1,2,3,4,19);
+    SHA256_MB_EXP(4,5,6,7,0,1,2,3,20); SHA256_MB_EXP(3,4,5,6,7,0,1,2,21);
+    SHA256_MB_EXP(2,3,4,5,6,7,0,1,22); SHA256_MB_EXP(1,2,3,4,5,6,7,0,23);
+    SHA256_MB_EXP(0,1,2,3,4,5,6,7,24); SHA256_MB_EXP(7,0,1,2,3,4,5,6,25);
+    SHA256_MB_EXP(6,7,0,1,2,3,4,5,26); SHA256_MB_EXP(5,6,7,0,1,2,3,4,27);
+    SHA256_MB_EXP(4,5,6,7,0,1,2,3,28); SHA256_MB_EXP(3,4,5,6,7,0,1,2,29);
+    SHA256_MB_EXP(2,3,4,5,6,7,0,1,30); SHA256_MB_EXP(1,2,3,4,5,6,7,0,31);
+    SHA256_MB_EXP(0,1,2,3,4,5,6,7,32); SHA256_MB_EXP(7,0,1,2,3,4,5,6,33);
+    SHA256_MB_EXP(6,7,0,1,2,3,4,5,34); SHA256_MB_EXP(5,6,7,0,1,2,3,4,35);
+    SHA256_MB_EXP(4,5,6,7,0,1,2,3,36); SHA256_MB_EXP(3,4,5,6,7,0,1,2,37);
+    SHA256_MB_EXP(2,3,4,5,6,7,0,1,38); SHA256_MB_EXP(1,2,3,4,5,6,7,0,39);
+    SHA256_MB_EXP(0,1,2,3,4,5,6,7,40); SHA256_MB_EXP(7,0,1,2,3,4,5,6,41);
+    SHA256_MB_EXP(6,7,0,1,2,3,4,5,42); SHA256_MB_EXP(5,6,7,0,1,2,3,4,43);
+    SHA256_MB_EXP(4,5,6,7,0,1,2,3,44); SHA256_MB_EXP(3,4,5,6,7,0,1,2,45);
+    SHA256_MB_EXP(2,3,4,5,6,7,0,1,46); SHA256_MB_EXP(1,2,3,4,5,6,7,0,47);
+    SHA256_MB_EXP(0,1,2,3,4,5,6,7,48); SHA256_MB_EXP(7,0,1,2,3,4,5,6,49);
+    SHA256_MB_EXP(6,7,0,1,2,3,4,5,50); SHA256_MB_EXP(5,6,7,0,1,2,3,4,51);
+    SHA256_MB_EXP(4,5,6,7,0,1,2,3,52); SHA256_MB_EXP(3,4,5,6,7,0,1,2,53);
+    SHA256_MB_EXP(2,3,4,5,6,7,0,1,54); SHA256_MB_EXP(1,2,3,4,5,6,7,0,55);
+    SHA256_MB_EXP(0,1,2,3,4,5,6,7,56); SHA256_MB_EXP(7,0,1,2,3,4,5,6,57);
+    SHA256_MB_EXP(6,7,0,1,2,3,4,5,58); SHA256_MB_EXP(5,6,7,0,1,2,3,4,59);
+    SHA256_MB_EXP(4,5,6,7,0,1,2,3,60); SHA256_MB_EXP(3,4,5,6,7,0,1,2,61);
+    SHA256_MB_EXP(2,3,4,5,6,7,0,1,62); SHA256_MB_EXP(1,2,3,4,5,6,7,0,63);
+
+    for (i = 0; i < 8; i++) {
+        SHA256_MB_VEC hv;
+
+        memcpy(&hv, h[i], sizeof(SHA256_MB_VEC));
+        hv += wv[i];
+        memcpy(h[i], &hv, sizeof(SHA256_MB_VEC));
+    }
+}
+
+#undef SHA256_MB_LANES
+#undef SHA256_MB_VEC
+#undef SHA256_MB_NAME
+#undef SHA256_MB_TARGET
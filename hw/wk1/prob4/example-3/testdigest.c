@@ -4,6 +4,8 @@
 #include <pthread.h>
 #include <sched.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <signal.h>
 #include <semaphore.h>
 
@@ -114,7 +116,7 @@ void setSchedPolicy(void)
 
 void *digestThread(void *threadparam)
 {
-  int i;
+  int i, completed = 0;
   md5_state_t state;
   md5_byte_t digest[16];
   struct timeval StartTime, StopTime;
@@ -133,6 +135,7 @@ void *digestThread(void *threadparam)
     md5_append(&state, (const md5_byte_t *)test, strlen(test));
 
     md5_finish(&state, digest);
+    completed++;
 
     if (threadActive == FALSE)
       break;
@@ -146,7 +149,8 @@ void *digestThread(void *threadparam)
   else
     microsecs -= (StartTime.tv_usec - StopTime.tv_usec);
 
-  rate = ((double)ITERATIONS) / (((double)microsecs) / 1000000.0);
+  // digests actually computed, fewer than THREAD_ITERATIONS if stopped early
+  rate = ((double)completed) / (((double)microsecs) / 1000000.0);
 
   tp->microsecs = microsecs;
   tp->digestsPerSec = rate;
@@ -4,55 +4,7 @@
 
 #define TRUE 1
 #define FALSE 0
-#define U32_T unsigned int
-
-U32_T ex0_period[] = {2, 10, 15};
-U32_T ex0_wcet[] = {1, 1, 2};
-uint32_t ex0_numSer = sizeof(ex0_period) / sizeof(U32_T);
-
-U32_T ex1_period[] = {2, 5, 7};
-U32_T ex1_wcet[] = {1, 1, 2};
-uint32_t ex1_numSer = sizeof(ex1_period) / sizeof(U32_T);
-
-U32_T ex2_period[] = {2, 5, 7, 13};
-U32_T ex2_wcet[] = {1, 1, 1, 2};
-uint32_t ex2_numSer = sizeof(ex2_period) / sizeof(U32_T);
-
-U32_T ex3_period[] = {3, 5, 15};
-U32_T ex3_wcet[] = {1, 2, 3};
-uint32_t ex3_numSer = sizeof(ex3_period) / sizeof(U32_T);
-
-U32_T ex4_period[] = {2, 4, 16};
-U32_T ex4_wcet[] = {1, 1, 4};
-uint32_t ex4_numSer = sizeof(ex4_period) / sizeof(U32_T);
-
-U32_T ex5_period[] = {2, 5, 10};
-U32_T ex5_wcet[] = {1, 2, 1};
-uint32_t ex5_numSer = sizeof(ex5_period) / sizeof(U32_T);
-
-U32_T ex6_period[] = {2, 5, 7, 13};
-U32_T ex6_wcet[] = {1, 1, 1, 2};
-uint32_t ex6_numSer = sizeof(ex6_period) / sizeof(U32_T);
-
-U32_T ex7_period[] = {3, 5, 15};
-U32_T ex7_wcet[] = {1, 2, 4};
-uint32_t ex7_numSer = sizeof(ex7_period) / sizeof(U32_T);
-
-U32_T ex8_period[] = {2, 5, 7, 13};
-U32_T ex8_wcet[] = {1, 1, 1, 2};
-uint32_t ex8_numSer = sizeof(ex8_period) / sizeof(U32_T);
-
-U32_T ex9_period[] = {6, 8, 12, 24};
-U32_T ex9_wcet[] = {1, 2, 4, 6};
-uint32_t ex9_numSer = sizeof(ex9_period) / sizeof(U32_T);
-
-U32_T ex10_period[] = {2, 5, 7, 14};
-U32_T ex10_wcet[] = {1, 1, 1, 2};
-uint32_t ex10_numSer = sizeof(ex10_period) / sizeof(U32_T);
-
-U32_T ex11_period[] = {3, 6, 9};
-U32_T ex11_wcet[] = {1, 2, 3};
-uint32_t ex11_numSer = sizeof(ex11_period) / sizeof(U32_T);
+#include "service_sets.h"
 
 int completion_time_feasibility(U32_T numServices, U32_T period[], U32_T wcet[], U32_T deadline[]);
 int scheduling_point_feasibility(U32_T numServices, U32_T period[], U32_T wcet[], U32_T deadline[]);
@@ -66,7 +18,6 @@ int main(void)
 
   printf("******** Completion Test Feasibility Example\n");
 
-  #define NUM_TST 12
   U32_T *period[] = {  ex0_period, ex1_period, ex2_period, ex3_period, ex4_period, ex5_period, ex6_period, ex7_period, ex8_period, ex9_period, ex10_period, ex11_period};
   U32_T *wcet[]   = {  ex0_wcet,   ex1_wcet,   ex2_wcet,   ex3_wcet,   ex4_wcet,   ex5_wcet,   ex6_wcet,   ex7_wcet,   ex8_wcet,   ex9_wcet,   ex10_wcet, ex11_wcet};
   uint32_t num[]  = {  ex0_numSer, ex1_numSer, ex2_numSer, ex3_numSer, ex4_numSer, ex5_numSer, ex6_numSer, ex7_numSer, ex8_numSer, ex9_numSer, ex10_numSer, ex11_numSer};
@@ -0,0 +1,507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "service_sets.h"
+
+#define TRUE 1
+#define FALSE 0
+#define MAX_SERVICES 32
+#define NO_TASK (-1)
+
+// Discrete-event schedule simulator: releases every service at t=0 and runs
+// the set over its hyperperiod under RM, DM, EDF or LLF, jumping from one
+// event (release, completion, deadline, LLF zero laxity) to the next so
+// hyperperiods of 10^9 ticks take as long as their number of jobs.
+//
+// LLF defers preemption as modified LLF does: a job picked at a release or
+// completion keeps the processor until it finishes or a waiting job's
+// laxity reaches zero, and ties go to the earlier deadline. Plain LLF
+// swaps jobs of equal laxity every other tick, which on 333/999,333/1000,
+// 333/1001 meant ~295M preemptions for 3M jobs.
+//
+// A context switch costs cs ticks, charged to the job being switched to
+// whenever its service is not the one that ran last; a job preempted while
+// switching pays again when it resumes. A late job runs to completion, and
+// a release that finds the service's previous job still pending is skipped.
+
+typedef enum
+{
+  POLICY_RM,
+  POLICY_DM,
+  POLICY_EDF,
+  POLICY_LLF,
+  NUM_POLICIES
+} policy_e;
+
+static const char *policyNames[NUM_POLICIES] = {"RM", "DM", "EDF", "LLF"};
+
+typedef struct
+{
+  U32_T period, wcet, deadline;
+  uint64_t nextRelease;
+
+  // current job
+  int pending, late;
+  uint64_t job, release, absDeadline, remaining, switchLeft;
+
+  // statistics
+  uint64_t jobs, completed, missed, skipped, preempted;
+  uint64_t worstResponse, sumResponse;
+} simTask_t;
+
+typedef struct
+{
+  uint64_t horizon, busy, overhead, switches, preemptions, misses, events;
+  int64_t firstMiss;            // -1 if none
+} simResult_t;
+
+// consecutive timeline pieces of the same job in the same state are merged
+typedef struct
+{
+  FILE *fp;
+  int example;
+  policy_e policy;
+  uint64_t limit;
+  int open, task;
+  uint64_t job, start, end;
+  const char *state;
+} timeline_t;
+
+static uint64_t gcd64(uint64_t a, uint64_t b)
+{
+  while (b != 0)
+  {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// 0 if the hyperperiod does not fit in 64 bits
+static uint64_t hyperperiod(U32_T numServices, U32_T period[])
+{
+  uint64_t h = 1;
+
+  for (U32_T i = 0; i < numServices; i++)
+  {
+    uint64_t step = period[i] / gcd64(h, period[i]);
+    if (h > UINT64_MAX / step)
+      return 0;
+    h *= step;
+  }
+  return h;
+}
+
+static void timeline_flush(timeline_t *tl)
+{
+  if (tl->fp == NULL || !tl->open)
+    return;
+  if (tl->task == NO_TASK)
+    fprintf(tl->fp, "%d,%s,%" PRIu64 ",%" PRIu64 ",idle,,%s\n", tl->example, policyNames[tl->policy],
+            tl->start, tl->end, tl->state);
+  else
+    fprintf(tl->fp, "%d,%s,%" PRIu64 ",%" PRIu64 ",S%d,%" PRIu64 ",%s\n", tl->example,
+            policyNames[tl->policy], tl->start, tl->end, tl->task + 1, tl->job, tl->state);
+  tl->open = FALSE;
+}
+
+static void timeline_add(timeline_t *tl, int task, uint64_t job, const char *state,
+                         uint64_t start, uint64_t end)
+{
+  if (tl->fp == NULL || start >= end || start >= tl->limit)
+    return;
+  if (tl->open && tl->task == task && tl->job == job && tl->state == state && tl->end == start)
+  {
+    tl->end = end;
+    return;
+  }
+  timeline_flush(tl);
+  tl->open = TRUE;
+  tl->task = task;
+  tl->job = job;
+  tl->state = state;
+  tl->start = start;
+  tl->end = end;
+}
+
+static void timeline_miss(timeline_t *tl, int task, uint64_t job, uint64_t at)
+{
+  if (tl->fp == NULL || at >= tl->limit)
+    return;
+  timeline_flush(tl);
+  fprintf(tl->fp, "%d,%s,%" PRIu64 ",%" PRIu64 ",S%d,%" PRIu64 ",miss\n", tl->example,
+          policyNames[tl->policy], at, at, task + 1, job);
+}
+
+static void record_miss(simTask_t *t, int task, simResult_t *res, timeline_t *tl)
+{
+  t->late = TRUE;
+  t->missed++;
+  res->misses++;
+  if (res->firstMiss < 0)
+    res->firstMiss = (int64_t)t->absDeadline;
+  timeline_miss(tl, task, t->job, t->absDeadline);
+}
+
+// laxity including the work still owed to a switch
+static int64_t laxity(const simTask_t *t, uint64_t now)
+{
+  return (int64_t)t->absDeadline - (int64_t)now - (int64_t)(t->remaining + t->switchLeft);
+}
+
+// key the policy orders pending jobs by, smaller runs first
+static int64_t priority_key(const simTask_t *t, policy_e policy, uint64_t now)
+{
+  switch (policy)
+  {
+  case POLICY_RM:  return t->period;
+  case POLICY_DM:  return t->deadline;
+  case POLICY_EDF: return (int64_t)t->absDeadline;
+  default:         return laxity(t, now);
+  }
+}
+
+static int select_job(simTask_t tasks[], U32_T numServices, policy_e policy, uint64_t now, int running)
+{
+  int best = NO_TASK;
+  int64_t bestKey = 0;
+
+  for (U32_T i = 0; i < numServices; i++)
+  {
+    if (!tasks[i].pending)
+      continue;
+    int64_t key = priority_key(&tasks[i], policy, now);
+    // dynamic priorities tie often; keep the running job rather than switch,
+    // and under LLF otherwise run the earlier deadline
+    if (best == NO_TASK || key < bestKey ||
+        (key == bestKey && (policy == POLICY_EDF || policy == POLICY_LLF) && (int)i == running) ||
+        (key == bestKey && policy == POLICY_LLF && best != running &&
+         tasks[i].absDeadline < tasks[best].absDeadline))
+    {
+      best = i;
+      bestKey = key;
+    }
+  }
+  return best;
+}
+
+static uint64_t simulate(U32_T numServices, U32_T period[], U32_T wcet[], U32_T deadline[],
+                         policy_e policy, uint64_t cs, uint64_t horizon, simTask_t tasks[],
+                         simResult_t *res, timeline_t *tl)
+{
+  uint64_t now = 0;
+  int running = NO_TASK, lastRan = NO_TASK;
+
+  memset(res, 0, sizeof(*res));
+  res->horizon = horizon;
+  res->firstMiss = -1;
+  memset(tasks, 0, numServices * sizeof(simTask_t));
+  for (U32_T i = 0; i < numServices; i++)
+  {
+    tasks[i].period = period[i];
+    tasks[i].wcet = wcet[i];
+    tasks[i].deadline = deadline[i];
+  }
+
+  while (now < horizon)
+  {
+    // releases and deadlines due now
+    for (U32_T i = 0; i < numServices; i++)
+    {
+      simTask_t *t = &tasks[i];
+      if (t->pending && !t->late && t->absDeadline <= now)
+        record_miss(t, i, res, tl);
+      if (t->nextRelease == now)
+      {
+        if (t->pending)
+          t->skipped++;
+        else
+        {
+          t->pending = TRUE;
+          t->late = FALSE;
+          t->job = t->jobs++;
+          t->release = now;
+          t->absDeadline = now + t->deadline;
+          t->remaining = t->wcet;
+          t->switchLeft = 0;
+        }
+        t->nextRelease += t->period;
+      }
+    }
+
+    int pick = select_job(tasks, numServices, policy, now, running);
+    if (pick != running)
+    {
+      if (running != NO_TASK && tasks[running].pending)
+      {
+        tasks[running].preempted++;
+        tasks[running].switchLeft = 0;
+        res->preemptions++;
+      }
+      if (pick != NO_TASK && pick != lastRan)
+      {
+        tasks[pick].switchLeft = cs;
+        res->switches++;
+      }
+      running = pick;
+    }
+
+    // next event
+    uint64_t next = horizon;
+    for (U32_T i = 0; i < numServices; i++)
+    {
+      simTask_t *t = &tasks[i];
+      if (t->nextRelease < next)
+        next = t->nextRelease;
+      if (t->pending && !t->late && t->absDeadline < next)
+        next = t->absDeadline;
+    }
+    if (running != NO_TASK)
+    {
+      simTask_t *r = &tasks[running];
+      if (now + r->switchLeft + r->remaining < next)
+        next = now + r->switchLeft + r->remaining;
+
+      // a waiting job's laxity falls one a tick; it takes over when that reaches zero
+      if (policy == POLICY_LLF)
+      {
+        for (U32_T i = 0; i < numServices; i++)
+        {
+          if (!tasks[i].pending || (int)i == running)
+            continue;
+          int64_t lax = laxity(&tasks[i], now);
+          if (lax > 0 && now + (uint64_t)lax < next)
+            next = now + (uint64_t)lax;
+        }
+      }
+    }
+
+    // run up to it
+    uint64_t dt = next - now;
+    if (running == NO_TASK)
+      timeline_add(tl, NO_TASK, 0, "idle", now, next);
+    else
+    {
+      simTask_t *r = &tasks[running];
+      uint64_t sw = (dt < r->switchLeft) ? dt : r->switchLeft;
+      timeline_add(tl, running, r->job, "switch", now, now + sw);
+      timeline_add(tl, running, r->job, "run", now + sw, next);
+      r->switchLeft -= sw;
+      r->remaining -= dt - sw;
+      res->overhead += sw;
+      res->busy += dt;
+      lastRan = running;
+
+      if (r->remaining == 0 && r->switchLeft == 0)
+      {
+        uint64_t response = next - r->release;
+        r->pending = FALSE;
+        r->completed++;
+        r->sumResponse += response;
+        if (response > r->worstResponse)
+          r->worstResponse = response;
+        running = NO_TASK;
+      }
+    }
+    now = next;
+    res->events++;
+  }
+
+  // jobs still pending whose deadline is the end of the run
+  for (U32_T i = 0; i < numServices; i++)
+  {
+    if (tasks[i].pending && !tasks[i].late && tasks[i].absDeadline <= now)
+      record_miss(&tasks[i], i, res, tl);
+  }
+  timeline_flush(tl);
+  return now;
+}
+
+static void print_result(U32_T numServices, simTask_t tasks[], const simResult_t *res,
+                         policy_e policy, uint64_t cs, int verbose)
+{
+  printf("  %-3s cs=%" PRIu64 ": %s, %" PRIu64 " misses", policyNames[policy], cs,
+         res->misses ? "INFEASIBLE" : "FEASIBLE", res->misses);
+  if (res->firstMiss >= 0)
+    printf(" (first at %" PRId64 ")", res->firstMiss);
+  printf(", busy %.2f%%, overhead %.2f%%, %" PRIu64 " switches, %" PRIu64 " preemptions, %" PRIu64 " events\n",
+         100.0 * res->busy / res->horizon, 100.0 * res->overhead / res->horizon, res->switches,
+         res->preemptions, res->events);
+  if (!verbose)
+    return;
+  for (U32_T i = 0; i < numServices; i++)
+  {
+    simTask_t *t = &tasks[i];
+    printf("    S%d: jobs %" PRIu64 ", done %" PRIu64 ", response worst %" PRIu64 " avg %.2f (D=%d), "
+           "preempted %" PRIu64 ", missed %" PRIu64 ", skipped %" PRIu64 "\n",
+           i + 1, t->jobs, t->completed, t->worstResponse,
+           t->completed ? (double)t->sumResponse / t->completed : 0.0, t->deadline, t->preempted,
+           t->missed, t->skipped);
+  }
+}
+
+static void print_set(int exNum, U32_T numServices, U32_T period[], U32_T wcet[], U32_T deadline[],
+                      uint64_t horizon)
+{
+  float utot = 0.0f;
+
+  for (U32_T ind = 0; ind < numServices; ++ind)
+    utot += (float)wcet[ind] / (float)period[ind];
+  if (exNum >= 0)
+    printf("Ex-%d U=%4.2f (", exNum, utot);
+  else
+    printf("Set U=%4.2f (", utot);
+  for (U32_T ind = 0; ind < numServices; ++ind)
+    printf("C%d=%d, ", ind + 1, wcet[ind]);
+  for (U32_T ind = 0; ind < numServices; ++ind)
+    printf("T%d=%d, ", ind + 1, period[ind]);
+  for (U32_T ind = 0; ind < numServices; ++ind)
+  {
+    printf("D%d=%d", ind + 1, deadline[ind]);
+    if (ind != numServices - 1)
+      printf(", ");
+  }
+  printf("), %" PRIu64 " ticks\n", horizon);
+}
+
+// C/T[/D] for each service, comma separated; D defaults to T
+static int parse_set(char *arg, U32_T period[], U32_T wcet[], U32_T deadline[])
+{
+  U32_T n = 0;
+
+  for (char *tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ","))
+  {
+    unsigned int c, t, d;
+    int fields = sscanf(tok, "%u/%u/%u", &c, &t, &d);
+    if (n == MAX_SERVICES || fields < 2 || c == 0 || t == 0)
+      return 0;
+    wcet[n] = c;
+    period[n] = t;
+    deadline[n] = (fields == 3 && d > 0) ? d : t;
+    n++;
+  }
+  return n;
+}
+
+static void usage(const char *name)
+{
+  printf("%s [-p rm|dm|edf|llf] [-c cs] [-h ticks] [-e example] [-s C/T[/D],...] [-v]\n"
+         "   [-t timeline.csv] [-l ticks]\n\n"
+         "Simulates each example service set (or -s) over its hyperperiod under RM, DM,\n"
+         "EDF and LLF and reports deadline misses, response times and preemptions.\n"
+         "-p  one policy only\n"
+         "-c  context switch cost in ticks (default 0)\n"
+         "-h  ticks to simulate instead of the hyperperiod\n"
+         "-e  one of the examples, 0-%d\n"
+         "-s  a service set, e.g. 1/2,1/10,2/15 or 1/4/3,2/8\n"
+         "-v  per-service statistics\n"
+         "-t  write the schedule as CSV: example,policy,start,end,service,job,state\n"
+         "    with state run, switch, idle or miss (example -1 for -s)\n"
+         "-l  timeline only up to this tick\n", name, NUM_TST - 1);
+}
+
+int main(int argc, char *argv[])
+{
+  U32_T *period[] = {  ex0_period, ex1_period, ex2_period, ex3_period, ex4_period, ex5_period, ex6_period, ex7_period, ex8_period, ex9_period, ex10_period, ex11_period};
+  U32_T *wcet[]   = {  ex0_wcet,   ex1_wcet,   ex2_wcet,   ex3_wcet,   ex4_wcet,   ex5_wcet,   ex6_wcet,   ex7_wcet,   ex8_wcet,   ex9_wcet,   ex10_wcet, ex11_wcet};
+  uint32_t num[]  = {  ex0_numSer, ex1_numSer, ex2_numSer, ex3_numSer, ex4_numSer, ex5_numSer, ex6_numSer, ex7_numSer, ex8_numSer, ex9_numSer, ex10_numSer, ex11_numSer};
+  U32_T setPeriod[MAX_SERVICES], setWcet[MAX_SERVICES], setDeadline[MAX_SERVICES];
+  simTask_t tasks[MAX_SERVICES];
+  simResult_t res;
+  timeline_t tl;
+  uint64_t cs = 0, ticks = 0;
+  int onlyPolicy = -1, onlyExample = -1, verbose = FALSE, setSize = 0;
+  const char *timelinePath = NULL;
+  int opt, rc = 0;
+
+  memset(&tl, 0, sizeof(tl));
+  tl.limit = UINT64_MAX;
+  while ((opt = getopt(argc, argv, "p:c:h:e:s:vt:l:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'p':
+      for (int p = 0; p < NUM_POLICIES; p++)
+        if (strcasecmp(optarg, policyNames[p]) == 0)
+          onlyPolicy = p;
+      if (onlyPolicy < 0)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'c': cs = strtoull(optarg, NULL, 0); break;
+    case 'h': ticks = strtoull(optarg, NULL, 0); break;
+    case 'e': onlyExample = atoi(optarg); break;
+    case 's':
+      if ((setSize = parse_set(optarg, setPeriod, setWcet, setDeadline)) == 0)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'v': verbose = TRUE; break;
+    case 't': timelinePath = optarg; break;
+    case 'l': tl.limit = strtoull(optarg, NULL, 0); break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (onlyExample >= NUM_TST)
+  {
+    usage(argv[0]);
+    return -1;
+  }
+  if (timelinePath != NULL)
+  {
+    if ((tl.fp = fopen(timelinePath, "w")) == NULL)
+    {
+      perror(timelinePath);
+      return -1;
+    }
+    fprintf(tl.fp, "example,policy,start,end,service,job,state\n");
+  }
+
+  printf("******** Schedule Simulation Example\n");
+  for (int testInd = (setSize ? -1 : 0); testInd < (setSize ? 0 : NUM_TST); ++testInd)
+  {
+    U32_T n = setSize ? (U32_T)setSize : num[testInd];
+    U32_T *pPeriod = setSize ? setPeriod : period[testInd];
+    U32_T *pWcet = setSize ? setWcet : wcet[testInd];
+    U32_T *pDeadline = setSize ? setDeadline : period[testInd];   // T=D, as feasibility_tests
+    uint64_t horizon = ticks ? ticks : hyperperiod(n, pPeriod);
+
+    if (onlyExample >= 0 && testInd != onlyExample)
+      continue;
+    if (horizon == 0)
+    {
+      if (setSize)
+        printf("Set: hyperperiod overflows 64 bits, give -h\n");
+      else
+        printf("Ex-%d: hyperperiod overflows 64 bits, give -h\n", testInd);
+      rc = -1;
+      continue;
+    }
+    print_set(testInd, n, pPeriod, pWcet, pDeadline, horizon);
+    for (int p = 0; p < NUM_POLICIES; p++)
+    {
+      if (onlyPolicy >= 0 && p != onlyPolicy)
+        continue;
+      tl.example = testInd;
+      tl.policy = (policy_e)p;
+      simulate(n, pPeriod, pWcet, pDeadline, (policy_e)p, cs, horizon, tasks, &res, &tl);
+      print_result(n, tasks, &res, (policy_e)p, cs, verbose);
+    }
+  }
+
+  if (tl.fp != NULL)
+    fclose(tl.fp);
+  return rc;
+}
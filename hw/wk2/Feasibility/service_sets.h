@@ -0,0 +1,60 @@
+#ifndef SERVICE_SETS_H
+#define SERVICE_SETS_H
+
+#include <stdint.h>
+
+#define U32_T unsigned int
+
+// example service sets shared by feasibility_tests and schedsim; T=D
+
+#define NUM_TST 12
+
+static U32_T ex0_period[] = {2, 10, 15};
+static U32_T ex0_wcet[] = {1, 1, 2};
+static uint32_t ex0_numSer = sizeof(ex0_period) / sizeof(U32_T);
+
+static U32_T ex1_period[] = {2, 5, 7};
+static U32_T ex1_wcet[] = {1, 1, 2};
+static uint32_t ex1_numSer = sizeof(ex1_period) / sizeof(U32_T);
+
+static U32_T ex2_period[] = {2, 5, 7, 13};
+static U32_T ex2_wcet[] = {1, 1, 1, 2};
+static uint32_t ex2_numSer = sizeof(ex2_period) / sizeof(U32_T);
+
+static U32_T ex3_period[] = {3, 5, 15};
+static U32_T ex3_wcet[] = {1, 2, 3};
+static uint32_t ex3_numSer = sizeof(ex3_period) / sizeof(U32_T);
+
+static U32_T ex4_period[] = {2, 4, 16};
+static U32_T ex4_wcet[] = {1, 1, 4};
+static uint32_t ex4_numSer = sizeof(ex4_period) / sizeof(U32_T);
+
+static U32_T ex5_period[] = {2, 5, 10};
+static U32_T ex5_wcet[] = {1, 2, 1};
+static uint32_t ex5_numSer = sizeof(ex5_period) / sizeof(U32_T);
+
+static U32_T ex6_period[] = {2, 5, 7, 13};
+static U32_T ex6_wcet[] = {1, 1, 1, 2};
+static uint32_t ex6_numSer = sizeof(ex6_period) / sizeof(U32_T);
+
+static U32_T ex7_period[] = {3, 5, 15};
+static U32_T ex7_wcet[] = {1, 2, 4};
+static uint32_t ex7_numSer = sizeof(ex7_period) / sizeof(U32_T);
+
+static U32_T ex8_period[] = {2, 5, 7, 13};
+static U32_T ex8_wcet[] = {1, 1, 1, 2};
+static uint32_t ex8_numSer = sizeof(ex8_period) / sizeof(U32_T);
+
+static U32_T ex9_period[] = {6, 8, 12, 24};
+static U32_T ex9_wcet[] = {1, 2, 4, 6};
+static uint32_t ex9_numSer = sizeof(ex9_period) / sizeof(U32_T);
+
+static U32_T ex10_period[] = {2, 5, 7, 14};
+static U32_T ex10_wcet[] = {1, 1, 1, 2};
+static uint32_t ex10_numSer = sizeof(ex10_period) / sizeof(U32_T);
+
+static U32_T ex11_period[] = {3, 6, 9};
+static U32_T ex11_wcet[] = {1, 2, 3};
+static uint32_t ex11_numSer = sizeof(ex11_period) / sizeof(U32_T);
+
+#endif
@@ -28,10 +28,19 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 
 #include <linux/videodev2.h>
 
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "frameview.h"
+#include "framesource.h"
+#include "framearchive.h"
+#include "farsource.h"
+#include "rtstats.h"
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 #define COLOR_CONVERT
@@ -39,9 +48,12 @@
 #define VRES 240
 #define HRES_STR "320"
 #define VRES_STR "240"
-
-// Format is used by a number of functions, so made as a file global
-static struct v4l2_format fmt;
+#define MAX_DEVICES 4
+#define DEQUEUE_TIMEOUT_MS 2000
+#define STATS_SOCK_PATH "/tmp/capture.stats"
+#define STATS_INTERVAL_MS 1000
+#define ARCHIVE_DEPTH 8
+#define ARCHIVE_KEY_INTERVAL 30
 
 enum io_method {
         IO_METHOD_READ,
@@ -54,16 +66,60 @@ struct buffer {
         size_t  length;
 };
 
-static char            *dev_name;
+// Times a frame picks up on its way from the sensor to a file, CLOCK_MONOTONIC
+struct frame_times {
+        struct timespec         capture;        /* driver timestamp, else dequeued */
+        struct timespec         dequeued;       /* back in userspace */
+        struct timespec         processing;     /* process_image started */
+        struct timespec         converted;      /* dump started */
+        struct timespec         persisted;      /* dump written and closed */
+        int                     driver_clock;   /* capture is the driver's monotonic stamp */
+};
+
+// Each camera has its own format, buffer set and counters
+struct device {
+        char                   *name;
+        char                    stem[16];       /* dump file prefix */
+        int                     fd;
+        struct v4l2_format      fmt;
+        struct buffer          *buffers;
+        unsigned int            n_buffers;
+        framePool_t             view_pool;
+        unsigned int            framecnt;       /* frames processed */
+        faWriter_t             *archive;        /* instead of dumps, if set */
+
+        /* dequeue thread only */
+        int                     frames;         /* frames dequeued */
+        int                     have_seq;
+        __u32                   last_seq;
+        unsigned int            dropped;        /* gaps in the driver's sequence */
+        const char             *ts_source;      /* what the driver stamps */
+        struct timeval          first_ts;
+        struct timeval          last_ts;
+        double                  min_interval_ms;
+        double                  max_interval_ms;
+        double                  sum_interval_ms;
+        unsigned int            intervals;
+};
+
+static struct device    devices[MAX_DEVICES];
+static int              n_devices;
 //static enum io_method   io = IO_METHOD_USERPTR;
 //static enum io_method   io = IO_METHOD_READ;
 static enum io_method   io = IO_METHOD_MMAP;
-static int              fd = -1;
-struct buffer          *buffers;
-static unsigned int     n_buffers;
 static int              out_buf;
+static int              sync_dumps;
+static rtStats_t        stats;
+static int              stage_dqbuf, stage_handoff, stage_convert, stage_write, stage_total;
 static int              force_format=1;
 static int              frame_count = 30;
+static int              zero_copy;
+static int              export_dmabuf;
+static frameQueue_t     view_queue;
+static pthread_t        process_thread;
+static char            *replay_spec;
+static frameSource_t   *replay;
+static int              archive_workers = -1;   /* -1 = dump files */
 
 static void errno_exit(const char *s)
 {
@@ -82,15 +138,16 @@ static int xioctl(int fh, int request, void *arg)
 }
 
 char ppm_header[]="P6\n#9999999999 sec 9999999999 msec \n"HRES_STR" "VRES_STR"\n255\n";
-char ppm_dumpname[]="test00000000.ppm";
 
-static void dump_ppm(const void *p, int size, unsigned int tag, struct timespec *time)
+static void dump_ppm(const char *stem, const void *p, int size, unsigned int tag, struct frame_times *t)
 {
+    const struct timespec *time = &t->capture;
     int written, i, total, dumpfd;
+    char dumpname[32];
    
-    snprintf(&ppm_dumpname[4], 9, "%08d", tag);
-    strncat(&ppm_dumpname[12], ".ppm", 5);
-    dumpfd = open(ppm_dumpname, O_WRONLY | O_NONBLOCK | O_CREAT, 00666);
+    snprintf(dumpname, sizeof(dumpname), "%s%08d.ppm", stem, tag);
+    clock_gettime(CLOCK_MONOTONIC, &t->converted);
+    dumpfd = open(dumpname, O_WRONLY | O_NONBLOCK | O_CREAT, 00666);
 
     snprintf(&ppm_header[4], 11, "%010d", (int)time->tv_sec);
     strncat(&ppm_header[14], " sec ", 5);
@@ -106,19 +163,23 @@ static void dump_ppm(const void *p, int size, unsigned int tag, struct timespec
     } while(total < size);
 
     printf("wrote %d bytes\n", total);
+    if (sync_dumps)
+        fdatasync(dumpfd);
     close(dumpfd);
+    clock_gettime(CLOCK_MONOTONIC, &t->persisted);
 }
 
 char pgm_header[]="P5\n#9999999999 sec 9999999999 msec \n"HRES_STR" "VRES_STR"\n255\n";
-char pgm_dumpname[]="test00000000.pgm";
 
-static void dump_pgm(const void *p, int size, unsigned int tag, struct timespec *time)
+static void dump_pgm(const char *stem, const void *p, int size, unsigned int tag, struct frame_times *t)
 {
+    const struct timespec *time = &t->capture;
     int written, i, total, dumpfd;
+    char dumpname[32];
    
-    snprintf(&pgm_dumpname[4], 9, "%08d", tag);
-    strncat(&pgm_dumpname[12], ".pgm", 5);
-    dumpfd = open(pgm_dumpname, O_WRONLY | O_NONBLOCK | O_CREAT, 00666);
+    snprintf(dumpname, sizeof(dumpname), "%s%08d.pgm", stem, tag);
+    clock_gettime(CLOCK_MONOTONIC, &t->converted);
+    dumpfd = open(dumpname, O_WRONLY | O_NONBLOCK | O_CREAT, 00666);
 
     snprintf(&pgm_header[4], 11, "%010d", (int)time->tv_sec);
     strncat(&pgm_header[14], " sec ", 5);
@@ -136,7 +197,10 @@ static void dump_pgm(const void *p, int size, unsigned int tag, struct timespec
 
     printf("wrote %d bytes\n", total);
 
+    if (sync_dumps)
+        fdatasync(dumpfd);
     close(dumpfd);  
+    clock_gettime(CLOCK_MONOTONIC, &t->persisted);
 }
 
 
@@ -200,33 +264,72 @@ void yuv2rgb(int y, int u, int v, unsigned char *r, unsigned char *g, unsigned c
    *b = b1 ;
 }
 
-unsigned int framecnt=0;
 unsigned char bigbuffer[(1280*960)];
 
-static void process_image(const void *p, int size)
+/* the frame as captured goes to the archive; farcunpack makes the PPMs later */
+static void archive_frame(struct device *dev, const void *p, int size, struct frame_times *t)
+{
+    fsFrame_t frame;
+
+    CLEAR(frame);
+    frame.data = p;
+    frame.bytes = size;
+    frame.width = dev->fmt.fmt.pix.width;
+    frame.height = dev->fmt.fmt.pix.height;
+    frame.sequence = dev->framecnt;
+    frame.timestamp = t->capture;
+    if (dev->fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_GREY)
+        frame.format = FS_GREY;
+    else if (dev->fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_RGB24)
+        frame.format = FS_RGB24;
+    else
+        frame.format = FS_YUYV;
+
+    /* converted to persisted is only the copy into the archive queue */
+    clock_gettime(CLOCK_MONOTONIC, &t->converted);
+    if (0 == fa_submit(dev->archive, &frame, 0))
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t->persisted);
+        printf("archived size %d\n", size);
+    }
+    else
+    {
+        printf("archive full, not archived\n");
+    }
+}
+
+static void process_image(struct device *dev, const void *p, int size, struct frame_times *t)
 {
     int i, newi, newsize=0;
-    struct timespec frame_time;
     int y_temp, y2_temp, u_temp, v_temp;
     unsigned char *pptr = (unsigned char *)p;
 
-    // record when process was called
-    clock_gettime(CLOCK_REALTIME, &frame_time);    
+    // record when process was called; files are stamped with the capture time
+    clock_gettime(CLOCK_MONOTONIC, &t->processing);
+    t->persisted.tv_sec = 0;
 
-    framecnt++;
-    printf("frame %d: ", framecnt);
+    dev->framecnt++;
+    printf("%s frame %d: ", dev->name, dev->framecnt);
 
     // This just dumps the frame to a file now, but you could replace with whatever image
     // processing you wish.
     //
 
-    if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_GREY)
+    if (dev->archive &&
+        ((dev->fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_GREY) ||
+         (dev->fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV) ||
+         (dev->fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_RGB24)))
+    {
+        archive_frame(dev, p, size, t);
+    }
+
+    else if(dev->fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_GREY)
     {
         printf("Dump graymap as-is size %d\n", size);
-        dump_pgm(p, size, framecnt, &frame_time);
+        dump_pgm(dev->stem, p, size, dev->framecnt, t);
     }
 
-    else if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV)
+    else if(dev->fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV)
     {
 
 #if defined(COLOR_CONVERT)
@@ -242,7 +345,7 @@ static void process_image(const void *p, int size)
             yuv2rgb(y2_temp, u_temp, v_temp, &bigbuffer[newi+3], &bigbuffer[newi+4], &bigbuffer[newi+5]);
         }
 
-        dump_ppm(bigbuffer, ((size*6)/4), framecnt, &frame_time);
+        dump_ppm(dev->stem, bigbuffer, ((size*6)/4), dev->framecnt, t);
 #else
         printf("Dump YUYV converted to YY size %d\n", size);
        
@@ -256,37 +359,116 @@ static void process_image(const void *p, int size)
             bigbuffer[newi+1]=pptr[i+2];
         }
 
-        dump_pgm(bigbuffer, (size/2), framecnt, &frame_time);
+        dump_pgm(dev->stem, bigbuffer, (size/2), dev->framecnt, t);
 #endif
 
     }
 
-    else if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_RGB24)
+    else if(dev->fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_RGB24)
     {
         printf("Dump RGB as-is size %d\n", size);
-        dump_ppm(p, size, framecnt, &frame_time);
+        dump_ppm(dev->stem, p, size, dev->framecnt, t);
     }
     else
     {
         printf("ERROR - unknown dump format\n");
     }
 
+    if (t->persisted.tv_sec != 0)
+    {
+        if (t->driver_clock)
+        {
+            rtstats_record(&stats, stage_dqbuf, &t->capture, &t->dequeued);
+            rtstats_record(&stats, stage_total, &t->capture, &t->persisted);
+        }
+        rtstats_record(&stats, stage_handoff, &t->dequeued, &t->processing);
+        rtstats_record(&stats, stage_convert, &t->processing, &t->converted);
+        rtstats_record(&stats, stage_write, &t->converted, &t->persisted);
+    }
+
     fflush(stderr);
     //fprintf(stderr, ".");
     fflush(stdout);
 }
 
 
-static int read_frame(void)
+static double tv_diff_ms(const struct timeval *a, const struct timeval *b)
+{
+    return (a->tv_sec - b->tv_sec) * 1000.0 + (a->tv_usec - b->tv_usec) / 1000.0;
+}
+
+/* capture time from the driver, if it stamps with the monotonic clock */
+static void frame_times_init(struct device *dev, struct frame_times *t, __u32 flags,
+                             const struct timeval *timestamp, const struct timespec *dequeued)
+{
+    t->dequeued = *dequeued;
+    t->driver_clock = ((flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC);
+    if (t->driver_clock)
+    {
+        t->capture.tv_sec = timestamp->tv_sec;
+        t->capture.tv_nsec = timestamp->tv_usec * 1000;
+    }
+    else
+    {
+        t->capture = *dequeued;
+    }
+
+    if (NULL == dev->ts_source)
+    {
+        if (!t->driver_clock)
+            dev->ts_source = "no monotonic timestamps, latency from dequeue";
+        else if ((flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) == V4L2_BUF_FLAG_TSTAMP_SRC_SOE)
+            dev->ts_source = "timestamps at start of exposure";
+        else
+            dev->ts_source = "timestamps at end of frame";
+    }
+}
+
+/* drops and frame interval from the driver's sequence number and timestamp */
+static void account_frame(struct device *dev, const struct v4l2_buffer *buf)
+{
+    double interval;
+
+    if (dev->have_seq)
+    {
+        /* a sequence that goes backwards is not a drop */
+        if (buf->sequence > dev->last_seq + 1)
+        {
+            dev->dropped += buf->sequence - dev->last_seq - 1;
+            fprintf(stderr, "%s dropped %u frames before sequence %u\n",
+                    dev->name, buf->sequence - dev->last_seq - 1, buf->sequence);
+        }
+
+        interval = tv_diff_ms(&buf->timestamp, &dev->last_ts);
+        if ((0 == dev->intervals) || (interval < dev->min_interval_ms))
+            dev->min_interval_ms = interval;
+        if (interval > dev->max_interval_ms)
+            dev->max_interval_ms = interval;
+        dev->sum_interval_ms += interval;
+        dev->intervals++;
+    }
+    else
+    {
+        dev->first_ts = buf->timestamp;
+    }
+
+    dev->have_seq = 1;
+    dev->last_seq = buf->sequence;
+    dev->last_ts = buf->timestamp;
+}
+
+static int read_frame(struct device *dev)
 {
     struct v4l2_buffer buf;
+    struct frame_times times;
+    struct timespec now;
     unsigned int i;
 
     switch (io)
     {
 
         case IO_METHOD_READ:
-            if (-1 == read(fd, buffers[0].start, buffers[0].length))
+            if (-1 == read(dev->fd, dev->buffers[0].start, dev->buffers[0].length))
             {
                 switch (errno)
                 {
@@ -304,7 +486,12 @@ static int read_frame(void)
                 }
             }
 
-            process_image(buffers[0].start, buffers[0].length);
+            /* read() has no timestamp, so latency starts here */
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            times.capture = times.dequeued = now;
+            times.driver_clock = 0;
+            dev->ts_source = "read i/o, latency from read()";
+            process_image(dev, dev->buffers[0].start, dev->buffers[0].length, &times);
             break;
 
         case IO_METHOD_MMAP:
@@ -313,7 +500,7 @@ static int read_frame(void)
             buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
             buf.memory = V4L2_MEMORY_MMAP;
 
-            if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf))
+            if (-1 == xioctl(dev->fd, VIDIOC_DQBUF, &buf))
             {
                 switch (errno)
                 {
@@ -333,11 +520,21 @@ static int read_frame(void)
                 }
             }
 
-            assert(buf.index < n_buffers);
+            assert(buf.index < dev->n_buffers);
+            account_frame(dev, &buf);
+
+            if (zero_copy)
+            {
+                /* hand on the mapped buffer itself; it is requeued when released */
+                fv_queue_push(&view_queue, fv_acquire(&dev->view_pool, &buf));
+                break;
+            }
 
-            process_image(buffers[buf.index].start, buf.bytesused);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            frame_times_init(dev, &times, buf.flags, &buf.timestamp, &now);
+            process_image(dev, dev->buffers[buf.index].start, buf.bytesused, &times);
 
-            if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
+            if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
                     errno_exit("VIDIOC_QBUF");
             break;
 
@@ -347,7 +544,7 @@ static int read_frame(void)
             buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
             buf.memory = V4L2_MEMORY_USERPTR;
 
-            if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf))
+            if (-1 == xioctl(dev->fd, VIDIOC_DQBUF, &buf))
             {
                 switch (errno)
                 {
@@ -364,16 +561,19 @@ static int read_frame(void)
                 }
             }
 
-            for (i = 0; i < n_buffers; ++i)
-                    if (buf.m.userptr == (unsigned long)buffers[i].start
-                        && buf.length == buffers[i].length)
+            for (i = 0; i < dev->n_buffers; ++i)
+                    if (buf.m.userptr == (unsigned long)dev->buffers[i].start
+                        && buf.length == dev->buffers[i].length)
                             break;
 
-            assert(i < n_buffers);
+            assert(i < dev->n_buffers);
+            account_frame(dev, &buf);
 
-            process_image((void *)buf.m.userptr, buf.bytesused);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            frame_times_init(dev, &times, buf.flags, &buf.timestamp, &now);
+            process_image(dev, (void *)buf.m.userptr, buf.bytesused, &times);
 
-            if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
+            if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
                     errno_exit("VIDIOC_QBUF");
             break;
     }
@@ -383,67 +583,310 @@ static int read_frame(void)
 }
 
 
-static void mainloop(void)
+/* frames are read straight from the driver's mapping; only the YUYV
+ * conversion writes anything, into bigbuffer, as it does without -z */
+static void *process_views(void *arg)
 {
-    unsigned int count;
-    struct timespec read_delay;
-    struct timespec time_error;
+    frameView_t *view;
+    struct frame_times times;
+    int i;
 
-    read_delay.tv_sec=0;
-    read_delay.tv_nsec=30000;
+    (void)arg;
+    while ((view = fv_queue_pop(&view_queue)) != NULL)
+    {
+        for (i = 0; i < n_devices; ++i)
+            if (view->pool == &devices[i].view_pool)
+                break;
+        frame_times_init(&devices[i], &times, view->flags, &view->timestamp, &view->dequeued);
+        process_image(&devices[i], view->data, view->bytesused, &times);
+        fv_unref(view);
+    }
+    return NULL;
+}
 
-    count = frame_count;
+static void start_processing(void)
+{
+    unsigned int i, slots = 0;
+    int d;
 
-    while (count > 0)
+    if (io != IO_METHOD_MMAP)
     {
-        for (;;)
+        fprintf(stderr, "zero copy needs memory mapped buffers, copying instead\n");
+        zero_copy = 0;
+        return;
+    }
+
+    for (d = 0; d < n_devices; ++d)
+    {
+        struct device *dev = &devices[d];
+
+        if (-1 == fv_pool_init(&dev->view_pool, dev->fd, dev->n_buffers, export_dmabuf))
         {
-            fd_set fds;
-            struct timeval tv;
-            int r;
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        for (i = 0; i < dev->n_buffers; ++i)
+            fv_pool_map(&dev->view_pool, i, dev->buffers[i].start, dev->buffers[i].length);
+        slots += dev->n_buffers;
+    }
 
-            FD_ZERO(&fds);
-            FD_SET(fd, &fds);
+    /* room for every buffer of every device, so the dequeue thread never waits */
+    if (-1 == fv_queue_init(&view_queue, slots))
+        errno_exit("fv_queue_init");
 
-            /* Timeout. */
-            tv.tv_sec = 2;
-            tv.tv_usec = 0;
+    if (0 != pthread_create(&process_thread, NULL, process_views, NULL))
+        errno_exit("pthread_create");
+}
 
-            r = select(fd + 1, &fds, NULL, NULL, &tv);
+static void stop_processing(void)
+{
+    int d;
 
-            if (-1 == r)
-            {
-                if (EINTR == errno)
-                    continue;
-                errno_exit("select");
-            }
+    if (!zero_copy)
+        return;
+
+    /* every buffer must be back with the driver before STREAMOFF and munmap */
+    fv_queue_close(&view_queue);
+    pthread_join(process_thread, NULL);
+    for (d = 0; d < n_devices; ++d)
+    {
+        fv_pool_drain(&devices[d].view_pool);
+        fv_pool_destroy(&devices[d].view_pool);
+    }
+    fv_queue_destroy(&view_queue);
+}
+
+/* one thread dequeues from every device as its frames become ready */
+static void *dequeue_loop(void *arg)
+{
+    struct epoll_event ev, events[MAX_DEVICES];
+    struct device *dev;
+    int epfd, active, n, i;
+
+    (void)arg;
+    if (-1 == (epfd = epoll_create1(EPOLL_CLOEXEC)))
+        errno_exit("epoll_create1");
+
+    for (i = 0; i < n_devices; ++i)
+    {
+        CLEAR(ev);
+        ev.events = EPOLLIN;
+        ev.data.ptr = &devices[i];
+        if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, devices[i].fd, &ev))
+            errno_exit("EPOLL_CTL_ADD");
+    }
+    active = n_devices;
 
-            if (0 == r)
+    while (active > 0)
+    {
+        n = epoll_wait(epfd, events, MAX_DEVICES, DEQUEUE_TIMEOUT_MS);
+
+        if (-1 == n)
+        {
+            if (EINTR == errno)
+                continue;
+            errno_exit("epoll_wait");
+        }
+
+        if (0 == n)
+        {
+            fprintf(stderr, "epoll timeout\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (i = 0; i < n; ++i)
+        {
+            dev = events[i].data.ptr;
+
+            /* EAGAIN - level triggered, so epoll reports it again */
+            if (!read_frame(dev))
+                continue;
+
+            if (++dev->frames >= frame_count)
             {
-                fprintf(stderr, "select timeout\n");
-                exit(EXIT_FAILURE);
+                epoll_ctl(epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+                active--;
             }
+        }
+    }
 
-            if (read_frame())
-            {
-                if(nanosleep(&read_delay, &time_error) != 0)
-                    perror("nanosleep");
-                else
-                    printf("time_error.tv_sec=%ld, time_error.tv_nsec=%ld\n", time_error.tv_sec, time_error.tv_nsec);
+    close(epfd);
+    return NULL;
+}
 
-                count--;
-                break;
-            }
+static void mainloop(void)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+    pthread_t dequeue_thread;
+    int rc = -1;
+
+    /* SCHED_FIFO only when the thread just dequeues and hands off (-z);
+       otherwise process_image does file I/O and printf on it */
+    if (zero_copy)
+    {
+        pthread_attr_init(&attr);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+
+        if (0 != (rc = pthread_create(&dequeue_thread, &attr, dequeue_loop, NULL)))
+            fprintf(stderr, "no SCHED_FIFO for the dequeue thread (%s), using the default policy\n",
+                    strerror(rc));
+        pthread_attr_destroy(&attr);
+    }
 
-            /* EAGAIN - continue select loop unless count done. */
-            if(count <= 0) break;
+    if (0 != rc)
+    {
+        if (0 != (rc = pthread_create(&dequeue_thread, NULL, dequeue_loop, NULL)))
+        {
+            errno = rc;
+            errno_exit("pthread_create");
         }
+    }
 
-        if(count <= 0) break;
+    pthread_join(dequeue_thread, NULL);
+}
+
+static void init_stats(void)
+{
+    rtstats_init(&stats);
+    stage_dqbuf = rtstats_add_stage(&stats, "dqbuf", 0.0, 0.0);
+    stage_handoff = rtstats_add_stage(&stats, "handoff", 0.0, 0.0);
+    stage_convert = rtstats_add_stage(&stats, "convert", 0.0, 0.0);
+    stage_write = rtstats_add_stage(&stats, "write", 0.0, 0.0);
+    stage_total = rtstats_add_stage(&stats, "exposure-to-file", 0.0, 0.0);
+    if (0 != rtstats_serve(&stats, STATS_SOCK_PATH, STATS_INTERVAL_MS))
+        fprintf(stderr, "no statistics on %s, continuing without\n", STATS_SOCK_PATH);
+}
+
+static void open_archive(struct device *dev)
+{
+    char path[32];
+
+    if (archive_workers < 0)
+        return;
+    snprintf(path, sizeof(path), "%s.far", dev->stem);
+    dev->archive = fa_create(path, archive_workers, ARCHIVE_DEPTH, ARCHIVE_KEY_INTERVAL, sync_dumps);
+    if (NULL == dev->archive)
+        exit(EXIT_FAILURE);
+}
+
+static void close_archive(struct device *dev)
+{
+    faStats_t as;
+
+    if (NULL == dev->archive)
+        return;
+    if (0 != fa_close(dev->archive, &as))
+        fprintf(stderr, "%s.far: write failed, %s\n", dev->stem, strerror(as.writeError));
+    dev->archive = NULL;
+    fprintf(stderr, "%s.far: %llu frames, %llu not archived, %.1f MB for %.1f MB captured (%.2fx), "
+            "encode %.3f msec/frame\n", dev->stem, (unsigned long long)as.frames,
+            (unsigned long long)as.refused, as.storedBytes / 1.0e6, as.rawBytes / 1.0e6,
+            as.storedBytes ? (double)as.rawBytes / as.storedBytes : 0.0,
+            as.frames ? as.encodeNs / 1.0e6 / as.frames : 0.0);
+}
+
+static void print_stats(void)
+{
+    struct device *dev;
+    char text[RTSTATS_TEXT_LEN];
+    int i;
+
+    for (i = 0; i < n_devices; ++i)
+    {
+        dev = &devices[i];
+        fprintf(stderr, "%s: %d frames, %u dropped", dev->name, dev->frames, dev->dropped);
+        if (dev->intervals > 0)
+            fprintf(stderr, ", interval min/avg/max %.3f/%.3f/%.3f msec",
+                    dev->min_interval_ms, dev->sum_interval_ms / dev->intervals, dev->max_interval_ms);
+        /* driver timestamps share one monotonic clock, so they compare across devices */
+        if ((i > 0) && dev->have_seq && devices[0].have_seq)
+            fprintf(stderr, ", first frame %+.3f msec after %s",
+                    tv_diff_ms(&dev->first_ts, &devices[0].first_ts), devices[0].name);
+        if (dev->ts_source)
+            fprintf(stderr, ", %s", dev->ts_source);
+        fprintf(stderr, "\n");
     }
+
+    /* latency percentiles over every camera's frames */
+    rtstats_format(&stats, text, sizeof(text));
+    fprintf(stderr, "%s", text);
+    rtstats_destroy(&stats);
 }
 
-static void stop_capturing(void)
+static void open_replay(struct device *dev)
+{
+    int width, height;
+    fsFormat_e format;
+
+    if (NULL == (replay = fs_open(replay_spec)))
+        exit(EXIT_FAILURE);
+
+    /* the dump headers are fixed at the forced device format */
+    fs_format(replay, &width, &height, &format);
+    if ((width != HRES) || (height != VRES))
+    {
+        fprintf(stderr, "%s is %dx%d, frames are dumped as "HRES_STR"x"VRES_STR"\n",
+                replay_spec, width, height);
+        exit(EXIT_FAILURE);
+    }
+
+    CLEAR(dev->fmt);
+    dev->fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    dev->fmt.fmt.pix.width = width;
+    dev->fmt.fmt.pix.height = height;
+    dev->fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (format == FS_GREY)
+        dev->fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;
+    else if (format == FS_RGB24)
+        dev->fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+    else
+        dev->fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+}
+
+/* like mainloop, but frames come from a recording at its own rate */
+static void replay_loop(struct device *dev)
+{
+    unsigned int count = frame_count;
+    unsigned int replayed = 0;
+    uint64_t max_late = 0;
+    fsFrame_t frame;
+    struct frame_times times;
+    int r;
+
+    while (count > 0)
+    {
+        r = fs_read(replay, &frame);
+        if (-1 == r)
+            exit(EXIT_FAILURE);
+        if (0 == r)
+            break;
+
+        /* the release time stands in for the exposure */
+        times.capture = frame.timestamp;
+        clock_gettime(CLOCK_MONOTONIC, &times.dequeued);
+        times.driver_clock = 1;
+        process_image(dev, frame.data, frame.bytes, &times);
+        if (frame.lateNs > max_late)
+            max_late = frame.lateNs;
+        replayed++;
+        count--;
+    }
+
+    fprintf(stderr, "replayed %u frames, max release lateness %.3f msec, %llu skipped\n",
+            replayed, max_late / 1.0e6, (unsigned long long)fs_dropped(replay));
+    dev->frames = replayed;
+    dev->dropped = fs_dropped(replay);
+    dev->ts_source = "release times of the replay";
+    fs_close(replay);
+    close_archive(dev);
+    print_stats();
+}
+
+static void stop_capturing(struct device *dev)
 {
         enum v4l2_buf_type type;
 
@@ -455,13 +898,13 @@ static void stop_capturing(void)
         case IO_METHOD_MMAP:
         case IO_METHOD_USERPTR:
                 type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                if (-1 == xioctl(fd, VIDIOC_STREAMOFF, &type))
+                if (-1 == xioctl(dev->fd, VIDIOC_STREAMOFF, &type))
                         errno_exit("VIDIOC_STREAMOFF");
                 break;
         }
 }
 
-static void start_capturing(void)
+static void start_capturing(struct device *dev)
 {
         unsigned int i;
         enum v4l2_buf_type type;
@@ -474,7 +917,7 @@ static void start_capturing(void)
                 break;
 
         case IO_METHOD_MMAP:
-                for (i = 0; i < n_buffers; ++i) 
+                for (i = 0; i < dev->n_buffers; ++i) 
                 {
                         printf("allocated buffer %d\n", i);
                         struct v4l2_buffer buf;
@@ -484,80 +927,80 @@ static void start_capturing(void)
                         buf.memory = V4L2_MEMORY_MMAP;
                         buf.index = i;
 
-                        if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
+                        if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
                                 errno_exit("VIDIOC_QBUF");
                 }
                 type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
+                if (-1 == xioctl(dev->fd, VIDIOC_STREAMON, &type))
                         errno_exit("VIDIOC_STREAMON");
                 break;
 
         case IO_METHOD_USERPTR:
-                for (i = 0; i < n_buffers; ++i) {
+                for (i = 0; i < dev->n_buffers; ++i) {
                         struct v4l2_buffer buf;
 
                         CLEAR(buf);
                         buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                         buf.memory = V4L2_MEMORY_USERPTR;
                         buf.index = i;
-                        buf.m.userptr = (unsigned long)buffers[i].start;
-                        buf.length = buffers[i].length;
+                        buf.m.userptr = (unsigned long)dev->buffers[i].start;
+                        buf.length = dev->buffers[i].length;
 
-                        if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
+                        if (-1 == xioctl(dev->fd, VIDIOC_QBUF, &buf))
                                 errno_exit("VIDIOC_QBUF");
                 }
                 type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
+                if (-1 == xioctl(dev->fd, VIDIOC_STREAMON, &type))
                         errno_exit("VIDIOC_STREAMON");
                 break;
         }
 }
 
-static void uninit_device(void)
+static void uninit_device(struct device *dev)
 {
         unsigned int i;
 
         switch (io) {
         case IO_METHOD_READ:
-                free(buffers[0].start);
+                free(dev->buffers[0].start);
                 break;
 
         case IO_METHOD_MMAP:
-                for (i = 0; i < n_buffers; ++i)
-                        if (-1 == munmap(buffers[i].start, buffers[i].length))
+                for (i = 0; i < dev->n_buffers; ++i)
+                        if (-1 == munmap(dev->buffers[i].start, dev->buffers[i].length))
                                 errno_exit("munmap");
                 break;
 
         case IO_METHOD_USERPTR:
-                for (i = 0; i < n_buffers; ++i)
-                        free(buffers[i].start);
+                for (i = 0; i < dev->n_buffers; ++i)
+                        free(dev->buffers[i].start);
                 break;
         }
 
-        free(buffers);
+        free(dev->buffers);
 }
 
-static void init_read(unsigned int buffer_size)
+static void init_read(struct device *dev, unsigned int buffer_size)
 {
-        buffers = calloc(1, sizeof(*buffers));
+        dev->buffers = calloc(1, sizeof(*dev->buffers));
 
-        if (!buffers) 
+        if (!dev->buffers) 
         {
                 fprintf(stderr, "Out of memory\n");
                 exit(EXIT_FAILURE);
         }
 
-        buffers[0].length = buffer_size;
-        buffers[0].start = malloc(buffer_size);
+        dev->buffers[0].length = buffer_size;
+        dev->buffers[0].start = malloc(buffer_size);
 
-        if (!buffers[0].start) 
+        if (!dev->buffers[0].start) 
         {
                 fprintf(stderr, "Out of memory\n");
                 exit(EXIT_FAILURE);
         }
 }
 
-static void init_mmap(void)
+static void init_mmap(struct device *dev)
 {
         struct v4l2_requestbuffers req;
 
@@ -567,12 +1010,12 @@ static void init_mmap(void)
         req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         req.memory = V4L2_MEMORY_MMAP;
 
-        if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) 
+        if (-1 == xioctl(dev->fd, VIDIOC_REQBUFS, &req)) 
         {
                 if (EINVAL == errno) 
                 {
                         fprintf(stderr, "%s does not support "
-                                 "memory mapping\n", dev_name);
+                                 "memory mapping\n", dev->name);
                         exit(EXIT_FAILURE);
                 } else 
                 {
@@ -582,44 +1025,44 @@ static void init_mmap(void)
 
         if (req.count < 2) 
         {
-                fprintf(stderr, "Insufficient buffer memory on %s\n", dev_name);
+                fprintf(stderr, "Insufficient buffer memory on %s\n", dev->name);
                 exit(EXIT_FAILURE);
         }
 
-        buffers = calloc(req.count, sizeof(*buffers));
+        dev->buffers = calloc(req.count, sizeof(*dev->buffers));
 
-        if (!buffers) 
+        if (!dev->buffers) 
         {
                 fprintf(stderr, "Out of memory\n");
                 exit(EXIT_FAILURE);
         }
 
-        for (n_buffers = 0; n_buffers < req.count; ++n_buffers) {
+        for (dev->n_buffers = 0; dev->n_buffers < req.count; ++dev->n_buffers) {
                 struct v4l2_buffer buf;
 
                 CLEAR(buf);
 
                 buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                 buf.memory      = V4L2_MEMORY_MMAP;
-                buf.index       = n_buffers;
+                buf.index       = dev->n_buffers;
 
-                if (-1 == xioctl(fd, VIDIOC_QUERYBUF, &buf))
+                if (-1 == xioctl(dev->fd, VIDIOC_QUERYBUF, &buf))
                         errno_exit("VIDIOC_QUERYBUF");
 
-                buffers[n_buffers].length = buf.length;
-                buffers[n_buffers].start =
+                dev->buffers[dev->n_buffers].length = buf.length;
+                dev->buffers[dev->n_buffers].start =
                         mmap(NULL /* start anywhere */,
                               buf.length,
                               PROT_READ | PROT_WRITE /* required */,
                               MAP_SHARED /* recommended */,
-                              fd, buf.m.offset);
+                              dev->fd, buf.m.offset);
 
-                if (MAP_FAILED == buffers[n_buffers].start)
+                if (MAP_FAILED == dev->buffers[dev->n_buffers].start)
                         errno_exit("mmap");
         }
 }
 
-static void init_userp(unsigned int buffer_size)
+static void init_userp(struct device *dev, unsigned int buffer_size)
 {
         struct v4l2_requestbuffers req;
 
@@ -629,46 +1072,46 @@ static void init_userp(unsigned int buffer_size)
         req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         req.memory = V4L2_MEMORY_USERPTR;
 
-        if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
+        if (-1 == xioctl(dev->fd, VIDIOC_REQBUFS, &req)) {
                 if (EINVAL == errno) {
                         fprintf(stderr, "%s does not support "
-                                 "user pointer i/o\n", dev_name);
+                                 "user pointer i/o\n", dev->name);
                         exit(EXIT_FAILURE);
                 } else {
                         errno_exit("VIDIOC_REQBUFS");
                 }
         }
 
-        buffers = calloc(4, sizeof(*buffers));
+        dev->buffers = calloc(4, sizeof(*dev->buffers));
 
-        if (!buffers) {
+        if (!dev->buffers) {
                 fprintf(stderr, "Out of memory\n");
                 exit(EXIT_FAILURE);
         }
 
-        for (n_buffers = 0; n_buffers < 4; ++n_buffers) {
-                buffers[n_buffers].length = buffer_size;
-                buffers[n_buffers].start = malloc(buffer_size);
+        for (dev->n_buffers = 0; dev->n_buffers < 4; ++dev->n_buffers) {
+                dev->buffers[dev->n_buffers].length = buffer_size;
+                dev->buffers[dev->n_buffers].start = malloc(buffer_size);
 
-                if (!buffers[n_buffers].start) {
+                if (!dev->buffers[dev->n_buffers].start) {
                         fprintf(stderr, "Out of memory\n");
                         exit(EXIT_FAILURE);
                 }
         }
 }
 
-static void init_device(void)
+static void init_device(struct device *dev)
 {
     struct v4l2_capability cap;
     struct v4l2_cropcap cropcap;
     struct v4l2_crop crop;
     unsigned int min;
 
-    if (-1 == xioctl(fd, VIDIOC_QUERYCAP, &cap))
+    if (-1 == xioctl(dev->fd, VIDIOC_QUERYCAP, &cap))
     {
         if (EINVAL == errno) {
             fprintf(stderr, "%s is no V4L2 device\n",
-                     dev_name);
+                     dev->name);
             exit(EXIT_FAILURE);
         }
         else
@@ -680,7 +1123,7 @@ static void init_device(void)
     if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE))
     {
         fprintf(stderr, "%s is no video capture device\n",
-                 dev_name);
+                 dev->name);
         exit(EXIT_FAILURE);
     }
 
@@ -690,7 +1133,7 @@ static void init_device(void)
             if (!(cap.capabilities & V4L2_CAP_READWRITE))
             {
                 fprintf(stderr, "%s does not support read i/o\n",
-                         dev_name);
+                         dev->name);
                 exit(EXIT_FAILURE);
             }
             break;
@@ -700,7 +1143,7 @@ static void init_device(void)
             if (!(cap.capabilities & V4L2_CAP_STREAMING))
             {
                 fprintf(stderr, "%s does not support streaming i/o\n",
-                         dev_name);
+                         dev->name);
                 exit(EXIT_FAILURE);
             }
             break;
@@ -714,12 +1157,12 @@ static void init_device(void)
 
     cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-    if (0 == xioctl(fd, VIDIOC_CROPCAP, &cropcap))
+    if (0 == xioctl(dev->fd, VIDIOC_CROPCAP, &cropcap))
     {
         crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         crop.c = cropcap.defrect; /* reset to default */
 
-        if (-1 == xioctl(fd, VIDIOC_S_CROP, &crop))
+        if (-1 == xioctl(dev->fd, VIDIOC_S_CROP, &crop))
         {
             switch (errno)
             {
@@ -739,32 +1182,32 @@ static void init_device(void)
     }
 
 
-    CLEAR(fmt);
+    CLEAR(dev->fmt);
 
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    dev->fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
     if (force_format)
     {
         printf("FORCING FORMAT\n");
-        fmt.fmt.pix.width       = HRES;
-        fmt.fmt.pix.height      = VRES;
+        dev->fmt.fmt.pix.width       = HRES;
+        dev->fmt.fmt.pix.height      = VRES;
 
         // Specify the Pixel Coding Formate here
 
         // This one work for Logitech C200
-        fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+        dev->fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
 
-        //fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_UYVY;
-        //fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_VYUY;
+        //dev->fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_UYVY;
+        //dev->fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_VYUY;
 
         // Would be nice if camera supported
-        //fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;
-        //fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+        //dev->fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;
+        //dev->fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
 
-        //fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
-        fmt.fmt.pix.field       = V4L2_FIELD_NONE;
+        //dev->fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
+        dev->fmt.fmt.pix.field       = V4L2_FIELD_NONE;
 
-        if (-1 == xioctl(fd, VIDIOC_S_FMT, &fmt))
+        if (-1 == xioctl(dev->fd, VIDIOC_S_FMT, &dev->fmt))
                 errno_exit("VIDIOC_S_FMT");
 
         /* Note VIDIOC_S_FMT may change width and height. */
@@ -773,74 +1216,76 @@ static void init_device(void)
     {
         printf("ASSUMING FORMAT\n");
         /* Preserve original settings as set by v4l2-ctl for example */
-        if (-1 == xioctl(fd, VIDIOC_G_FMT, &fmt))
+        if (-1 == xioctl(dev->fd, VIDIOC_G_FMT, &dev->fmt))
                     errno_exit("VIDIOC_G_FMT");
     }
 
     /* Buggy driver paranoia. */
-    min = fmt.fmt.pix.width * 2;
-    if (fmt.fmt.pix.bytesperline < min)
-            fmt.fmt.pix.bytesperline = min;
-    min = fmt.fmt.pix.bytesperline * fmt.fmt.pix.height;
-    if (fmt.fmt.pix.sizeimage < min)
-            fmt.fmt.pix.sizeimage = min;
+    min = dev->fmt.fmt.pix.width * 2;
+    if (dev->fmt.fmt.pix.bytesperline < min)
+            dev->fmt.fmt.pix.bytesperline = min;
+    min = dev->fmt.fmt.pix.bytesperline * dev->fmt.fmt.pix.height;
+    if (dev->fmt.fmt.pix.sizeimage < min)
+            dev->fmt.fmt.pix.sizeimage = min;
 
     switch (io)
     {
         case IO_METHOD_READ:
-            init_read(fmt.fmt.pix.sizeimage);
+            init_read(dev, dev->fmt.fmt.pix.sizeimage);
             break;
 
         case IO_METHOD_MMAP:
-            init_mmap();
+            init_mmap(dev);
             break;
 
         case IO_METHOD_USERPTR:
-            init_userp(fmt.fmt.pix.sizeimage);
+            init_userp(dev, dev->fmt.fmt.pix.sizeimage);
             break;
     }
 }
 
 
-static void close_device(void)
+static void close_device(struct device *dev)
 {
-        if (-1 == close(fd))
+        if (-1 == close(dev->fd))
                 errno_exit("close");
 
-        fd = -1;
+        dev->fd = -1;
 }
 
-static void open_device(void)
+static void open_device(struct device *dev)
 {
         struct stat st;
 
-        if (-1 == stat(dev_name, &st)) {
+        if (-1 == stat(dev->name, &st)) {
                 fprintf(stderr, "Cannot identify '%s': %d, %s\n",
-                         dev_name, errno, strerror(errno));
+                         dev->name, errno, strerror(errno));
                 exit(EXIT_FAILURE);
         }
 
         if (!S_ISCHR(st.st_mode)) {
-                fprintf(stderr, "%s is no device\n", dev_name);
+                fprintf(stderr, "%s is no device\n", dev->name);
                 exit(EXIT_FAILURE);
         }
 
-        fd = open(dev_name, O_RDWR /* required */ | O_NONBLOCK, 0);
+        dev->fd = open(dev->name, O_RDWR /* required */ | O_NONBLOCK, 0);
 
-        if (-1 == fd) {
+        if (-1 == dev->fd) {
                 fprintf(stderr, "Cannot open '%s': %d, %s\n",
-                         dev_name, errno, strerror(errno));
+                         dev->name, errno, strerror(errno));
                 exit(EXIT_FAILURE);
         }
 }
 
+static const char *default_name = "/dev/video0";
+
 static void usage(FILE *fp, int argc, char **argv)
 {
         fprintf(fp,
                  "Usage: %s [options]\n\n"
                  "Version 1.3\n"
                  "Options:\n"
-                 "-d | --device name   Video device name [%s]\n"
+                 "-d | --device name   Video device name [%s], repeat for up to %d cameras\n"
                  "-h | --help          Print this message\n"
                  "-m | --mmap          Use memory mapped buffers [default]\n"
                  "-r | --read          Use read() calls\n"
@@ -848,11 +1293,19 @@ static void usage(FILE *fp, int argc, char **argv)
                  "-o | --output        Outputs stream to stdout\n"
                  "-f | --format        Force format to 640x480 GREY\n"
                  "-c | --count         Number of frames to grab [%i]\n"
+                 "-z | --zerocopy      Hand mmap buffers to another thread without copying them;\n"
+                 "                     only then does the dequeue thread run SCHED_FIFO\n"
+                 "-e | --expbuf        With -z, also export the buffers as dmabufs\n"
+                 "-S | --sync          fdatasync every dump, so latency ends on disk\n"
+                 "-A | --archive N     Compress frames into <stem>.far on N threads (0 = all CPUs)\n"
+                 "                     instead of dumping them; farcunpack turns it into PPMs\n"
+                 "-F | --replay spec   Replay a recording instead of a device, e.g.\n"
+                 "                     pnm:rec/f%%04d.pgm,fps=30 or yuyv:rec.yuv,size="HRES_STR"x"VRES_STR",ts=t.txt\n"
                  "",
-                 argv[0], dev_name, frame_count);
+                 argv[0], default_name, MAX_DEVICES, frame_count);
 }
 
-static const char short_options[] = "d:hmruofc:";
+static const char short_options[] = "d:hmruofc:zeSF:A:";
 
 static const struct option
 long_options[] = {
@@ -864,15 +1317,36 @@ long_options[] = {
         { "output", no_argument,       NULL, 'o' },
         { "format", no_argument,       NULL, 'f' },
         { "count",  required_argument, NULL, 'c' },
+        { "zerocopy", no_argument,     NULL, 'z' },
+        { "expbuf", no_argument,       NULL, 'e' },
+        { "sync",   no_argument,       NULL, 'S' },
+        { "replay", required_argument, NULL, 'F' },
+        { "archive", required_argument, NULL, 'A' },
         { 0, 0, 0, 0 }
 };
 
+static void add_device(char *name)
+{
+    struct device *dev;
+
+    if (n_devices == MAX_DEVICES)
+    {
+        fprintf(stderr, "at most %d devices\n", MAX_DEVICES);
+        exit(EXIT_FAILURE);
+    }
+    dev = &devices[n_devices++];
+    dev->name = name;
+    dev->fd = -1;
+}
+
 int main(int argc, char **argv)
 {
-    if(argc > 1)
-        dev_name = argv[1];
-    else
-        dev_name = "/dev/video0";
+    struct device *dev;
+    int i;
+
+    if((argc > 1) && (argv[1][0] != '-'))
+        default_name = argv[1];
+    fa_register_source();
 
     for (;;)
     {
@@ -891,7 +1365,7 @@ int main(int argc, char **argv)
                 break;
 
             case 'd':
-                dev_name = optarg;
+                add_device(optarg);
                 break;
 
             case 'h':
@@ -918,6 +1392,28 @@ int main(int argc, char **argv)
                 force_format++;
                 break;
 
+            case 'z':
+                zero_copy++;
+                break;
+
+            case 'e':
+                export_dmabuf++;
+                break;
+
+            case 'S':
+                sync_dumps++;
+                break;
+
+            case 'F':
+                replay_spec = optarg;
+                break;
+
+            case 'A':
+                archive_workers = atoi(optarg);
+                if (archive_workers < 0)
+                        archive_workers = 0;
+                break;
+
             case 'c':
                 errno = 0;
                 frame_count = strtol(optarg, NULL, 0);
@@ -931,13 +1427,48 @@ int main(int argc, char **argv)
         }
     }
 
-    open_device();
-    init_device();
-    start_capturing();
+    init_stats();
+
+    if (replay_spec)
+    {
+        n_devices = 0;
+        add_device(replay_spec);
+        strcpy(devices[0].stem, "test");
+        open_replay(&devices[0]);
+        open_archive(&devices[0]);
+        replay_loop(&devices[0]);
+        return 0;
+    }
+
+    if (0 == n_devices)
+        add_device((char *)default_name);
+
+    for (i = 0; i < n_devices; ++i)
+    {
+        dev = &devices[i];
+        /* one camera keeps the original file names */
+        if (1 == n_devices)
+            strcpy(dev->stem, "test");
+        else
+            snprintf(dev->stem, sizeof(dev->stem), "cam%d_", i);
+        open_device(dev);
+        init_device(dev);
+        open_archive(dev);
+    }
+    if (zero_copy)
+        start_processing();
+    for (i = 0; i < n_devices; ++i)
+        start_capturing(&devices[i]);
     mainloop();
-    stop_capturing();
-    uninit_device();
-    close_device();
+    stop_processing();
+    for (i = 0; i < n_devices; ++i)
+    {
+        stop_capturing(&devices[i]);
+        uninit_device(&devices[i]);
+        close_device(&devices[i]);
+        close_archive(&devices[i]);
+    }
+    print_stats();
     fprintf(stderr, "\n");
     return 0;
 }
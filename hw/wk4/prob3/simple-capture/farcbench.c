@@ -0,0 +1,259 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file farcbench.c
+ * @brief compression ratio against encode time of the capture archive
+ *
+ * For key frames only and for a few key intervals, reports the ratio of
+ * captured to stored bytes, the msec one thread spends encoding a frame,
+ * and the frame rate the archive sustains with its worker pool writing to
+ * a real file. The archive is read back and every frame compared, so a
+ * codec change that loses data fails here. Frames are synthetic (a still
+ * textured scene with a moving block and sensor noise) unless a recording
+ * (framesource.h spec) is given.
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "framearchive.h"
+#include "farsource.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define TIMESPEC_TO_MSEC(time)        ((((double)time.tv_sec) * 1.0e3) + (((double)time.tv_nsec) * 1.0e-6))
+#define DEFAULT_WIDTH                 (640)
+#define DEFAULT_HEIGHT                (480)
+#define DEFAULT_FRAMES                (120)
+#define DEFAULT_PATH                  "/tmp/farcbench.far"
+#define ARCHIVE_DEPTH                 (16)
+#define MAX_MODES                     (4)
+
+static const int keyIntervals[MAX_MODES] = { 1, 8, 30, 300 };
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static void usage(const char *name)
+{
+  printf("%s [-s WxH] [-n frames] [-j workers] [-o archive] [-F spec]\n\n"
+         "Compression ratio and encode time of the capture archive, key frames\n"
+         "only and with deltas between key frames, YUYV frames.\n"
+         "-s  frame size (default %dx%d)\n"
+         "-n  frames (default %d)\n"
+         "-j  archive encoder threads (default 0 = online CPUs)\n"
+         "-o  archive written for the pool timing (default %s)\n"
+         "-F  recording to use instead of synthetic frames, e.g.\n"
+         "    yuyv:rec.yuv,size=640x480,fps=0\n",
+         name, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_FRAMES, DEFAULT_PATH);
+}
+
+static double now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return TIMESPEC_TO_MSEC(ts);
+}
+
+/* still texture, a block moving across it, and a couple of counts of noise */
+static void synthesize(uint8_t *yuyv, int width, int height, int seq)
+{
+  unsigned int seed = 1 + seq;
+  int bx = (seq * 7) % width, by = height / 3, bs = height / 4;
+  int x, y, luma;
+
+  for(y = 0; y < height; ++y) {
+    uint8_t *row = yuyv + (size_t)y * width * 2;
+    for(x = 0; x < width; ++x) {
+      seed = seed * 1103515245u + 12345u;
+      luma = 64 + ((x / 16 + y / 16) & 1) * 64 + (x * y) % 32;
+      if((x >= bx) && (x < bx + bs) && (y >= by) && (y < by + bs)) {
+        luma = 220 - (x - bx);
+      }
+      luma += (int)((seed >> 16) % 5) - 2;
+      row[2 * x] = (uint8_t)((luma < 0) ? 0 : ((luma > 255) ? 255 : luma));
+      row[2 * x + 1] = (uint8_t)(128 + ((x & 1) ? 6 : -6) + ((x / 64) & 3));
+    }
+  }
+}
+
+static int load_frames(const char *spec, uint8_t *frames, int count, int width, int height)
+{
+  frameSource_t *src = fs_open(spec);
+  fsFrame_t frame;
+  fsFormat_e format;
+  int w, h, n = 0;
+
+  if(src == NULL) {
+    return -1;
+  }
+  fs_format(src, &w, &h, &format);
+  if((format != FS_YUYV) || (w != width) || (h != height)) {
+    fprintf(stderr, "%s is not %dx%d YUYV\n", spec, width, height);
+    fs_close(src);
+    return -1;
+  }
+  while((n < count) && (fs_read(src, &frame) == 1)) {
+    memcpy(frames + (size_t)n * width * height * 2, frame.data, (size_t)width * height * 2);
+    ++n;
+  }
+  fs_close(src);
+  return n;
+}
+
+static void make_frame(fsFrame_t *frame, const uint8_t *data, int width, int height, int seq)
+{
+  memset(frame, 0, sizeof(*frame));
+  frame->data = data;
+  frame->bytes = (size_t)width * height * 2;
+  frame->width = width;
+  frame->height = height;
+  frame->format = FS_YUYV;
+  frame->sequence = (uint32_t)seq;
+  frame->timestamp.tv_sec = seq / 30;
+  frame->timestamp.tv_nsec = (seq % 30) * 33333333L;
+}
+
+/* frames that do not come back as they went in */
+static int verify(const char *path, const uint8_t *frames, int count, size_t frameBytes)
+{
+  faReader_t *reader = fa_open(path);
+  fsFrame_t frame;
+  int n = 0, bad = 0;
+
+  if(reader == NULL) {
+    return count;
+  }
+  while((n < count) && (fa_read(reader, &frame) == 1)) {
+    if((frame.bytes != frameBytes) || (frame.sequence != (uint32_t)n) ||
+       (memcmp(frame.data, frames + frameBytes * n, frameBytes) != 0)) {
+      ++bad;
+    }
+    ++n;
+  }
+  fa_close_reader(reader);
+  return bad + (count - n);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int main(int argc, char *argv[])
+{
+  int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
+  int count = DEFAULT_FRAMES, workers = 0;
+  const char *path = DEFAULT_PATH;
+  const char *spec = NULL;
+  uint8_t *frames, *coded, *scratch;
+  uint32_t planeBytes[FA_MAX_PLANES];
+  size_t frameBytes, codedTotal;
+  faWriter_t *writer;
+  faStats_t stats;
+  fsFrame_t frame;
+  double start, encodeMs, poolMs;
+  int opt, i, m, bad, failed = 0;
+
+  fa_register_source();
+  while((opt = getopt(argc, argv, "s:n:j:o:F:")) != -1) {
+    switch(opt) {
+    case 's':
+      if(sscanf(optarg, "%dx%d", &width, &height) != 2) {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'n': count = atoi(optarg); break;
+    case 'j': workers = atoi(optarg); break;
+    case 'o': path = optarg; break;
+    case 'F': spec = optarg; break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if((width < 2) || (width & 1) || (height < 1) || (count < 1)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  frameBytes = (size_t)width * height * 2;
+  frames = (uint8_t *)malloc(frameBytes * count);
+  coded = (uint8_t *)malloc(fa_bound(frameBytes));
+  scratch = (uint8_t *)malloc((size_t)width * height);
+  if((frames == NULL) || (coded == NULL) || (scratch == NULL)) {
+    fprintf(stderr, "out of memory\n");
+    return -1;
+  }
+  if(spec != NULL) {
+    if((count = load_frames(spec, frames, count, width, height)) <= 0) {
+      fprintf(stderr, "no frames from %s\n", spec);
+      return -1;
+    }
+  } else {
+    for(i = 0; i < count; ++i) {
+      synthesize(frames + frameBytes * i, width, height, i);
+    }
+  }
+
+  printf("%dx%d YUYV, %d frames, %.1f KB each raw (%.1f KB as the RGB dump)\n",
+         width, height, count, frameBytes / 1024.0, frameBytes * 1.5 / 1024.0);
+  printf("%-10s %8s %12s %12s %10s %8s\n", "keys", "ratio", "KB/frame", "enc ms/frame", "pool fps", "lost");
+
+  for(m = 0; m < MAX_MODES; ++m) {
+    const int key = keyIntervals[m];
+
+    /* one thread, frame by frame, as a worker does it */
+    codedTotal = 0;
+    start = now_ms();
+    for(i = 0; i < count; ++i) {
+      const uint8_t *ref = (i % key) ? frames + frameBytes * (i - 1) : NULL;
+      make_frame(&frame, frames + frameBytes * i, width, height, i);
+      codedTotal += sizeof(faRecord_t) + fa_encode(&frame, ref, coded, scratch, planeBytes);
+    }
+    encodeMs = (now_ms() - start) / count;
+
+    /* the pool, into a file, submitting as fast as it takes them */
+    if((writer = fa_create(path, workers, ARCHIVE_DEPTH, key, 0)) == NULL) {
+      return -1;
+    }
+    start = now_ms();
+    for(i = 0; i < count; ++i) {
+      make_frame(&frame, frames + frameBytes * i, width, height, i);
+      fa_submit(writer, &frame, 1);
+    }
+    if(fa_close(writer, &stats) != 0) {
+      fprintf(stderr, "writing %s failed\n", path);
+      return -1;
+    }
+    poolMs = now_ms() - start;
+
+    bad = verify(path, frames, count, frameBytes);
+    failed |= (bad != 0);
+    if(key == 1) {
+      printf("%-10s", "all");
+    } else {
+      printf("every %-4d", key);
+    }
+    printf(" %8.2f %12.1f %12.3f %10.1f %8d\n", (double)count * frameBytes / codedTotal,
+           codedTotal / 1024.0 / count, encodeMs, count * 1000.0 / poolMs, bad);
+  }
+  unlink(path);
+
+  free(frames);
+  free(coded);
+  free(scratch);
+  return failed ? 1 : 0;
+}
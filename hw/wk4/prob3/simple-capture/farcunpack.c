@@ -0,0 +1,165 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file farcunpack.c
+ * @brief decodes a capture archive (framearchive.h) back to PPM / PGM files
+ *
+ * The files are named and stamped like the ones capture dumps directly:
+ * <stem><frame>.ppm with the capture time in the header comment. YUYV is
+ * converted to RGB with the same integer conversion capture uses, or with -g
+ * only the Y plane is written, as a PGM.
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "framearchive.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define NAME_LEN                      (FS_PATH_LEN)
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static void usage(const char *name)
+{
+  printf("%s [-g] [-n frames] archive [stem]\n\n"
+         "Writes every frame of a capture archive as <stem><frame>.ppm (default\n"
+         "stem test), or .pgm for grey frames.\n"
+         "-g  YUYV frames as their Y plane only, PGM\n"
+         "-n  stop after this many frames\n", name);
+}
+
+/* as capture.c, which matches what the dumps hold */
+static void yuv2rgb(int y, int u, int v, unsigned char *r, unsigned char *g, unsigned char *b)
+{
+  int c = y - 16, d = u - 128, e = v - 128;
+  int r1 = (298 * c + 409 * e + 128) >> 8;
+  int g1 = (298 * c - 100 * d - 208 * e + 128) >> 8;
+  int b1 = (298 * c + 516 * d + 128) >> 8;
+
+  *r = (unsigned char)((r1 > 255) ? 255 : ((r1 < 0) ? 0 : r1));
+  *g = (unsigned char)((g1 > 255) ? 255 : ((g1 < 0) ? 0 : g1));
+  *b = (unsigned char)((b1 > 255) ? 255 : ((b1 < 0) ? 0 : b1));
+}
+
+static int write_pnm(const char *path, int colour, const fsFrame_t *frame, const uint8_t *pixels)
+{
+  size_t bytes = (size_t)frame->width * frame->height * (colour ? 3 : 1);
+  FILE *fp = fopen(path, "wb");
+  int ok;
+
+  if(fp == NULL) {
+    perror(path);
+    return -1;
+  }
+  fprintf(fp, "%s\n#%010d sec %010d msec \n%d %d\n255\n", colour ? "P6" : "P5",
+          (int)frame->timestamp.tv_sec, (int)(frame->timestamp.tv_nsec / 1000000),
+          frame->width, frame->height);
+  ok = (fwrite(pixels, 1, bytes, fp) == bytes);
+  if((fclose(fp) != 0) || !ok) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int main(int argc, char *argv[])
+{
+  const char *stem = "test";
+  faReader_t *reader;
+  fsFrame_t frame;
+  char path[NAME_LEN];
+  uint8_t *out = NULL;
+  size_t outSize = 0;
+  int greyOnly = 0, limit = -1, count = 0;
+  int opt, r, rc = 0;
+  size_t i, pixels;
+
+  while((opt = getopt(argc, argv, "gn:")) != -1) {
+    switch(opt) {
+    case 'g': greyOnly = 1; break;
+    case 'n': limit = atoi(optarg); break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if((optind >= argc) || (argc - optind > 2)) {
+    usage(argv[0]);
+    return -1;
+  }
+  if(argc - optind == 2) {
+    stem = argv[optind + 1];
+  }
+  if((reader = fa_open(argv[optind])) == NULL) {
+    return -1;
+  }
+
+  while((limit < 0) || (count < limit)) {
+    if((r = fa_read(reader, &frame)) <= 0) {
+      if(r < 0) {
+        fprintf(stderr, "%s is corrupt after %d frames\n", argv[optind], count);
+        rc = -1;
+      }
+      break;
+    }
+    pixels = (size_t)frame.width * frame.height;
+    if(outSize < pixels * 3) {
+      free(out);
+      outSize = pixels * 3;
+      if((out = (uint8_t *)malloc(outSize)) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        rc = -1;
+        break;
+      }
+    }
+
+    if(frame.format == FS_GREY) {
+      snprintf(path, sizeof(path), "%s%08u.pgm", stem, frame.sequence);
+      r = write_pnm(path, 0, &frame, frame.data);
+    } else if(frame.format == FS_RGB24) {
+      snprintf(path, sizeof(path), "%s%08u.ppm", stem, frame.sequence);
+      r = write_pnm(path, 1, &frame, frame.data);
+    } else if(greyOnly) {
+      for(i = 0; i < pixels; ++i) {
+        out[i] = frame.data[2 * i];
+      }
+      snprintf(path, sizeof(path), "%s%08u.pgm", stem, frame.sequence);
+      r = write_pnm(path, 0, &frame, out);
+    } else {
+      /* Y0 U Y1 V -> RGB RGB */
+      for(i = 0; i < pixels; i += 2) {
+        const uint8_t *p = frame.data + 2 * i;
+        yuv2rgb(p[0], p[1], p[3], &out[3 * i], &out[3 * i + 1], &out[3 * i + 2]);
+        yuv2rgb(p[2], p[1], p[3], &out[3 * i + 3], &out[3 * i + 4], &out[3 * i + 5]);
+      }
+      snprintf(path, sizeof(path), "%s%08u.ppm", stem, frame.sequence);
+      r = write_pnm(path, 1, &frame, out);
+    }
+    if(r != 0) {
+      rc = -1;
+      break;
+    }
+    ++count;
+  }
+
+  printf("wrote %d frames\n", count);
+  free(out);
+  fa_close_reader(reader);
+  return rc;
+}
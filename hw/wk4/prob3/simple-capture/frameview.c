@@ -0,0 +1,233 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file frameview.c
+ * @brief zero-copy, reference counted views of V4L2 capture buffers
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "frameview.h"
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static int fv_ioctl(int fd, unsigned long request, void *arg)
+{
+  int r;
+
+  do {
+    r = ioctl(fd, request, arg);
+  } while((r == -1) && (errno == EINTR));
+  return r;
+}
+
+static void fv_requeue(frameView_t *view)
+{
+  framePool_t *pool = view->pool;
+  struct v4l2_buffer buf;
+
+  memset(&buf, 0, sizeof(buf));
+  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  buf.index = view->index;
+  if(fv_ioctl(pool->fd, VIDIOC_QBUF, &buf) == -1) {
+    fprintf(stderr, "VIDIOC_QBUF buffer %u error %d, %s\n", view->index, errno, strerror(errno));
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  if(--pool->outstanding == 0) {
+    pthread_cond_broadcast(&pool->idle);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int fv_pool_init(framePool_t *pool, int fd, unsigned int count, int exportDmabuf)
+{
+  unsigned int i;
+
+  memset(pool, 0, sizeof(*pool));
+  pool->views = calloc(count, sizeof(*pool->views));
+  if(pool->views == NULL) {
+    return -1;
+  }
+  pool->count = count;
+  pool->fd = fd;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+
+  for(i = 0; i < count; ++i) {
+    pool->views[i].index = i;
+    pool->views[i].dmabufFd = -1;
+    pool->views[i].pool = pool;
+    if(exportDmabuf) {
+      struct v4l2_exportbuffer expbuf;
+      memset(&expbuf, 0, sizeof(expbuf));
+      expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      expbuf.index = i;
+      expbuf.flags = O_RDONLY | O_CLOEXEC;
+      if(fv_ioctl(fd, VIDIOC_EXPBUF, &expbuf) == -1) {
+        fprintf(stderr, "VIDIOC_EXPBUF buffer %u error %d, %s; not exported\n", i, errno, strerror(errno));
+      } else {
+        pool->views[i].dmabufFd = expbuf.fd;
+      }
+    }
+  }
+  return 0;
+}
+
+void fv_pool_map(framePool_t *pool, unsigned int index, const void *start, size_t length)
+{
+  if(index < pool->count) {
+    pool->views[index].data = start;
+    pool->views[index].length = length;
+  }
+}
+
+frameView_t *fv_acquire(framePool_t *pool, const struct v4l2_buffer *buf)
+{
+  frameView_t *view;
+
+  if(buf->index >= pool->count) {
+    return NULL;
+  }
+  view = &pool->views[buf->index];
+  view->bytesused = buf->bytesused;
+  view->sequence = buf->sequence;
+  view->flags = buf->flags;
+  view->timestamp = buf->timestamp;
+  clock_gettime(CLOCK_MONOTONIC, &view->dequeued);
+  __atomic_store_n(&view->refs, 1, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&pool->lock);
+  ++pool->outstanding;
+  pthread_mutex_unlock(&pool->lock);
+  return view;
+}
+
+void fv_ref(frameView_t *view)
+{
+  __atomic_add_fetch(&view->refs, 1, __ATOMIC_RELAXED);
+}
+
+void fv_unref(frameView_t *view)
+{
+  /* release: every consumer's reads of the buffer happen before the requeue */
+  if(__atomic_sub_fetch(&view->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    fv_requeue(view);
+  }
+}
+
+void fv_pool_drain(framePool_t *pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  while(pool->outstanding > 0) {
+    pthread_cond_wait(&pool->idle, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void fv_pool_destroy(framePool_t *pool)
+{
+  unsigned int i;
+
+  for(i = 0; i < pool->count; ++i) {
+    if(pool->views[i].dmabufFd >= 0) {
+      close(pool->views[i].dmabufFd);
+    }
+  }
+  free(pool->views);
+  pool->views = NULL;
+  pool->count = 0;
+  pthread_cond_destroy(&pool->idle);
+  pthread_mutex_destroy(&pool->lock);
+}
+
+int fv_queue_init(frameQueue_t *queue, unsigned int capacity)
+{
+  memset(queue, 0, sizeof(*queue));
+  if(capacity < 1) {
+    errno = EINVAL;
+    return -1;
+  }
+  queue->slots = calloc(capacity, sizeof(*queue->slots));
+  if(queue->slots == NULL) {
+    return -1;
+  }
+  queue->capacity = capacity;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->notEmpty, NULL);
+  pthread_cond_init(&queue->notFull, NULL);
+  return 0;
+}
+
+int fv_queue_push(frameQueue_t *queue, frameView_t *view)
+{
+  pthread_mutex_lock(&queue->lock);
+  while(!queue->closed && (queue->size == queue->capacity)) {
+    pthread_cond_wait(&queue->notFull, &queue->lock);
+  }
+  if(queue->closed) {
+    pthread_mutex_unlock(&queue->lock);
+    fv_unref(view);
+    return -1;
+  }
+  queue->slots[(queue->head + queue->size) % queue->capacity] = view;
+  ++queue->size;
+  pthread_cond_signal(&queue->notEmpty);
+  pthread_mutex_unlock(&queue->lock);
+  return 0;
+}
+
+frameView_t *fv_queue_pop(frameQueue_t *queue)
+{
+  frameView_t *view = NULL;
+
+  pthread_mutex_lock(&queue->lock);
+  while(!queue->closed && (queue->size == 0)) {
+    pthread_cond_wait(&queue->notEmpty, &queue->lock);
+  }
+  if(queue->size > 0) {
+    view = queue->slots[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    --queue->size;
+    pthread_cond_signal(&queue->notFull);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return view;
+}
+
+void fv_queue_close(frameQueue_t *queue)
+{
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = 1;
+  pthread_cond_broadcast(&queue->notEmpty);
+  pthread_cond_broadcast(&queue->notFull);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+void fv_queue_destroy(frameQueue_t *queue)
+{
+  free(queue->slots);
+  queue->slots = NULL;
+  pthread_cond_destroy(&queue->notFull);
+  pthread_cond_destroy(&queue->notEmpty);
+  pthread_mutex_destroy(&queue->lock);
+}
@@ -0,0 +1,147 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file frameview.h
+ * @brief zero-copy, reference counted views of V4L2 capture buffers
+ *
+ * A dequeued mmap buffer is wrapped in a view instead of being copied. The
+ * view holds one reference per consumer; whoever drops the last one queues
+ * the buffer back to the driver (VIDIOC_QBUF), so a buffer returns to the
+ * capture ring only once every stage is done with it. Optionally each buffer
+ * is also exported as a dmabuf (VIDIOC_EXPBUF) whose fd travels with the
+ * view, for consumers in other processes or devices.
+ *
+ * A bounded queue of views hands frames from the dequeue loop to processing
+ * threads; pushing a view transfers the caller's reference.
+ *
+ ************************************************************************************
+ */
+
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <linux/videodev2.h>
+
+struct framePool_s;
+
+typedef struct {
+  const uint8_t *data;          /* the driver's mapping, read only */
+  size_t length;                /* mapped size */
+  size_t bytesused;
+  unsigned int index;           /* driver buffer index */
+  int dmabufFd;                 /* exported buffer, -1 if not exported */
+  uint32_t sequence;
+  uint32_t flags;               /* V4L2_BUF_FLAG_*, e.g. the timestamp clock */
+  struct timeval timestamp;     /* driver's capture time */
+  struct timespec dequeued;     /* CLOCK_MONOTONIC, when it was acquired */
+  int refs;                     /* atomic */
+  struct framePool_s *pool;
+} frameView_t;
+
+typedef struct framePool_s {
+  frameView_t *views;
+  unsigned int count;
+  int fd;                       /* V4L2 device the buffers belong to */
+  pthread_mutex_t lock;
+  pthread_cond_t idle;
+  unsigned int outstanding;     /* views dequeued and not yet requeued */
+} framePool_t;
+
+typedef struct {
+  frameView_t **slots;
+  unsigned int capacity;
+  unsigned int head;
+  unsigned int size;
+  int closed;
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+} frameQueue_t;
+
+/**
+ * @brief set up views for a device's mmap buffers
+ *
+ * @param pool pool to initialize
+ * @param fd V4L2 device
+ * @param count number of buffers (VIDIOC_REQBUFS count)
+ * @param exportDmabuf also export every buffer with VIDIOC_EXPBUF
+ * @return int 0 on success, -1 if out of memory
+ */
+int fv_pool_init(framePool_t *pool, int fd, unsigned int count, int exportDmabuf);
+
+/**
+ * @brief record where buffer index is mapped
+ */
+void fv_pool_map(framePool_t *pool, unsigned int index, const void *start, size_t length);
+
+/**
+ * @brief wrap a dequeued buffer; the caller holds the only reference
+ *
+ * @param pool pool of the device the buffer came from
+ * @param buf as filled by VIDIOC_DQBUF
+ * @return frameView_t* the view, NULL for a bad index
+ */
+frameView_t *fv_acquire(framePool_t *pool, const struct v4l2_buffer *buf);
+
+/**
+ * @brief one more consumer; any thread
+ */
+void fv_ref(frameView_t *view);
+
+/**
+ * @brief consumer done; the last one requeues the buffer. Any thread
+ */
+void fv_unref(frameView_t *view);
+
+/**
+ * @brief wait until every dequeued buffer has been requeued, e.g. before
+ * VIDIOC_STREAMOFF and munmap
+ */
+void fv_pool_drain(framePool_t *pool);
+
+/**
+ * @brief close exported dmabufs and free the views; buffers stay mapped
+ */
+void fv_pool_destroy(framePool_t *pool);
+
+/**
+ * @brief empty queue holding up to capacity views
+ *
+ * @return int 0, or -1 with errno EINVAL for a capacity of 0 or ENOMEM
+ */
+int fv_queue_init(frameQueue_t *queue, unsigned int capacity);
+
+/**
+ * @brief hand a view (and the caller's reference) on, waiting for room
+ *
+ * @return int 0, or -1 if the queue is closed and the reference was dropped
+ */
+int fv_queue_push(frameQueue_t *queue, frameView_t *view);
+
+/**
+ * @brief next view, waiting for one; the caller now holds its reference
+ *
+ * @return frameView_t* NULL once the queue is closed and empty
+ */
+frameView_t *fv_queue_pop(frameQueue_t *queue);
+
+/**
+ * @brief end of stream; waiting consumers drain what is queued, then stop
+ */
+void fv_queue_close(frameQueue_t *queue);
+
+void fv_queue_destroy(frameQueue_t *queue);
+
+#endif /* FRAMEVIEW_H */
@@ -0,0 +1,216 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file annbench.cpp
+ * @brief recall@1 and time per frame of the k-d forest against brute force
+ *
+ * Reference descriptors come from a descriptor database (all objects but
+ * the last; the last object's descriptors are the queries, i.e. a real
+ * second view) or are synthetic SIFT-like clusters with queries perturbed
+ * from reference points. Brute force provides the ground truth.
+ *
+ ************************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "annidx.h"
+#include "descdb.h"
+
+using namespace std;
+
+#define TIMESPEC_TO_mSEC(time)	((((double)time.tv_sec) * 1.0e3) + (((double)time.tv_nsec) * 1.0e-6))
+#define SIFT_DIMS                 (128)
+#define POINTS_PER_CLUSTER        (50)
+
+void help(char** argv)
+{
+  cout << argv[0] << " [-d database] [-n points] [-q queries] [-t trees,...] [-c checks,...] [-j threads] [-s seed]\n\n"
+  << "Compares recall@1 and msec per frame (one frame = all queries) of the k-d forest\n"
+  << "against exhaustive search.\n"
+  << "-d  use a descriptor database: the last object queries all the others\n"
+  << "-n  synthetic reference descriptors (default 100000)\n"
+  << "-q  synthetic queries, about one frame of SIFT (default 1000)\n"
+  << "-t  forest sizes to try (default 1,4,8)\n"
+  << "-c  checks to try (default 16,32,64,128,256,512)\n"
+  << "-j  search threads (default 1)\n"
+  << "-s  random seed (default 1)" << endl;
+}
+
+static vector<int> parseList(const char *arg)
+{
+    vector<int> vals;
+    stringstream ss(arg);
+    string item;
+
+    while(getline(ss, item, ',')) {
+        vals.push_back(atoi(item.c_str()));
+    }
+    return vals;
+}
+
+static double nowMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return TIMESPEC_TO_mSEC(ts);
+}
+
+/* SIFT-like: non-negative, clustered, a few strong bins per descriptor */
+static void synthesize(int numPoints, int numQueries, unsigned int seed,
+                       vector<float>& base, vector<float>& queries)
+{
+    mt19937 gen(seed);
+    normal_distribution<float> noise(0.0f, 12.0f);
+    normal_distribution<float> qnoise(0.0f, 8.0f);
+    exponential_distribution<float> bin(1.0f / 20.0f);
+    int numClusters = max(numPoints / POINTS_PER_CLUSTER, 1);
+    vector<float> centers((size_t)numClusters * SIFT_DIMS);
+
+    for(size_t i = 0; i < centers.size(); ++i) {
+        centers[i] = min(bin(gen), 255.0f);
+    }
+    base.resize((size_t)numPoints * SIFT_DIMS);
+    for(int p = 0; p < numPoints; ++p) {
+        const float *c = &centers[(size_t)(gen() % numClusters) * SIFT_DIMS];
+        for(int d = 0; d < SIFT_DIMS; ++d) {
+            base[(size_t)p * SIFT_DIMS + d] = max(c[d] + noise(gen), 0.0f);
+        }
+    }
+    queries.resize((size_t)numQueries * SIFT_DIMS);
+    for(int q = 0; q < numQueries; ++q) {
+        const float *b = &base[(size_t)(gen() % numPoints) * SIFT_DIMS];
+        for(int d = 0; d < SIFT_DIMS; ++d) {
+            queries[(size_t)q * SIFT_DIMS + d] = max(b[d] + qnoise(gen), 0.0f);
+        }
+    }
+}
+
+static bool loadDb(const char *path, vector<float>& base, vector<float>& queries, int& cols)
+{
+    DescDb db;
+
+    if(!db.open(path)) {
+        return false;
+    }
+    if(db.numObjects() < 2) {
+        cerr << path << ": need at least two objects" << endl;
+        return false;
+    }
+    base.clear();
+    queries.clear();
+    for(int o = 0; o < db.numObjects(); ++o) {
+        cv::Mat desc = db.descriptors(o);
+        cv::Mat descF;
+        if(desc.empty()) {
+            continue;
+        }
+        desc.convertTo(descF, CV_32F);
+        cols = descF.cols;
+        vector<float>& dst = (o == db.numObjects() - 1) ? queries : base;
+        for(int r = 0; r < descF.rows; ++r) {
+            dst.insert(dst.end(), descF.ptr<float>(r), descF.ptr<float>(r) + cols);
+        }
+    }
+    return !base.empty() && !queries.empty();
+}
+
+int main(int argc, char** argv)
+{
+    const char *dbPath = NULL;
+    int numPoints = 100000, numQueries = 1000, numThreads = 1;
+    unsigned int seed = 1;
+    vector<int> treeList = {1, 4, 8};
+    vector<int> checkList = {16, 32, 64, 128, 256, 512};
+    int opt;
+
+    while((opt = getopt(argc, argv, "d:n:q:t:c:j:s:h")) != -1) {
+        switch(opt) {
+        case 'd': dbPath = optarg; break;
+        case 'n': numPoints = atoi(optarg); break;
+        case 'q': numQueries = atoi(optarg); break;
+        case 't': treeList = parseList(optarg); break;
+        case 'c': checkList = parseList(optarg); break;
+        case 'j': numThreads = max(atoi(optarg), 1); break;
+        case 's': seed = (unsigned int)atoi(optarg); break;
+        default:
+            help(argv);
+            return -1;
+        }
+    }
+
+    vector<float> base, queries;
+    int cols = SIFT_DIMS;
+    if(dbPath != NULL) {
+        if(!loadDb(dbPath, base, queries, cols)) {
+            return -1;
+        }
+    } else {
+        if((numPoints <= 0) || (numQueries <= 0)) {
+            help(argv);
+            return -1;
+        }
+        synthesize(numPoints, numQueries, seed, base, queries);
+    }
+    int rows = (int)(base.size() / cols);
+    int nq = (int)(queries.size() / cols);
+    cout << "reference " << rows << " x " << cols << ", " << nq << " queries per frame, "
+         << numThreads << " thread(s)" << endl;
+
+    /* ground truth */
+    vector<int> truth(nq), idx(nq);
+    vector<float> truthDist(nq), dist(nq);
+    double t0 = nowMs();
+    annBruteForce(base.data(), rows, cols, cols, queries.data(), nq, cols, 1,
+                  truth.data(), truthDist.data(), numThreads);
+    double bruteMs = nowMs() - t0;
+
+    cout << fixed;
+    cout << left << setw(12) << "method" << right << setw(6) << "trees" << setw(8) << "checks"
+         << setw(10) << "build_ms" << setw(10) << "recall@1" << setw(10) << "ms/frame"
+         << setw(9) << "speedup" << endl;
+    cout << left << setw(12) << "BruteForce" << right << setw(6) << "-" << setw(8) << "-"
+         << setw(10) << setprecision(1) << 0.0 << setw(10) << setprecision(4) << 1.0
+         << setw(10) << setprecision(2) << bruteMs << setw(9) << 1.0 << endl;
+
+    for(size_t t = 0; t < treeList.size(); ++t) {
+        KdForest forest;
+        t0 = nowMs();
+        forest.build(base.data(), rows, cols, cols, treeList[t], ANN_LEAF_SIZE, seed);
+        double buildMs = nowMs() - t0;
+
+        for(size_t c = 0; c < checkList.size(); ++c) {
+            t0 = nowMs();
+            forest.knnSearch(queries.data(), nq, cols, 1, checkList[c], idx.data(), dist.data(), numThreads);
+            double ms = nowMs() - t0;
+
+            /* ties at the same distance count as hits */
+            int hits = 0;
+            for(int q = 0; q < nq; ++q) {
+                hits += (idx[q] == truth[q]) || (dist[q] <= truthDist[q]);
+            }
+            cout << left << setw(12) << "KdForest" << right << setw(6) << treeList[t]
+                 << setw(8) << checkList[c] << setw(10) << setprecision(1) << buildMs
+                 << setw(10) << setprecision(4) << (double)hits / nq
+                 << setw(10) << setprecision(2) << ms << setw(9) << bruteMs / ms << endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,330 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file annidx.cpp
+ * @brief approximate nearest neighbour search over descriptors with a
+ * randomized k-d forest
+ *
+ ************************************************************************************
+ */
+
+#include <string.h>
+#include <float.h>
+
+#include <algorithm>
+#include <queue>
+#include <thread>
+
+#include "annidx.h"
+
+using namespace std;
+
+/* per-thread search state, reused across queries */
+struct KdForest::scratch_s {
+    /* closest unexplored branch first */
+    typedef pair<float, pair<int, int> > branch_t;   /* bound, (tree, node) */
+    vector<branch_t> heap;
+    vector<uint32_t> visited;     /* stamp per point, so trees don't recheck */
+    uint32_t stamp;
+
+    scratch_s() : stamp(0) {}
+};
+
+static unsigned int nextRandom(unsigned int& state)
+{
+    /* xorshift; only steers the choice of split dimensions */
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/* keep the k best in ascending order */
+static void insertResult(int *indices, float *dists, int k, int idx, float dist)
+{
+    int pos = k - 1;
+
+    if(dist >= dists[pos]) {
+        return;
+    }
+    while((pos > 0) && (dists[pos - 1] > dist)) {
+        dists[pos] = dists[pos - 1];
+        indices[pos] = indices[pos - 1];
+        --pos;
+    }
+    dists[pos] = dist;
+    indices[pos] = idx;
+}
+
+float annDistance(const float *a, const float *b, int cols)
+{
+    /* eight partial sums so the loop vectorizes without -ffast-math */
+    float part[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    float sum = 0.0f;
+    int i = 0;
+
+    for(; i + 8 <= cols; i += 8) {
+        for(int j = 0; j < 8; ++j) {
+            float d = a[i + j] - b[i + j];
+            part[j] += d * d;
+        }
+    }
+    for(; i < cols; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    for(int j = 0; j < 8; ++j) {
+        sum += part[j];
+    }
+    return sum;
+}
+
+KdForest::KdForest() :
+    rows(0), cols(0), leafSize(ANN_LEAF_SIZE)
+{
+}
+
+void KdForest::build(const float *points, int numRows, int numCols, size_t stride,
+                     int numTrees, int leaf, unsigned int seed)
+{
+    rows = numRows;
+    cols = numCols;
+    leafSize = max(leaf, 1);
+    data.resize((size_t)rows * cols);
+    for(int r = 0; r < rows; ++r) {
+        memcpy(&data[(size_t)r * cols], points + (size_t)r * stride, cols * sizeof(float));
+    }
+
+    trees.assign(max(numTrees, 1), tree_t());
+    unsigned int rng = seed * 2654435761u + 1;
+    for(size_t t = 0; t < trees.size(); ++t) {
+        trees[t].perm.resize(rows);
+        for(int r = 0; r < rows; ++r) {
+            trees[t].perm[r] = r;
+        }
+        trees[t].nodes.clear();
+        trees[t].nodes.reserve(2 * (rows / leafSize + 1));
+        if(rows > 0) {
+            buildNode(trees[t], 0, rows, rng);
+        }
+    }
+}
+
+void KdForest::build(const uint8_t *points, int numRows, int numCols, size_t stride,
+                     int numTrees, int leaf, unsigned int seed)
+{
+    vector<float> tmp((size_t)numRows * numCols);
+
+    for(int r = 0; r < numRows; ++r) {
+        for(int c = 0; c < numCols; ++c) {
+            tmp[(size_t)r * numCols + c] = points[(size_t)r * stride + c];
+        }
+    }
+    build(tmp.data(), numRows, numCols, numCols, numTrees, leaf, seed);
+}
+
+int KdForest::buildNode(tree_t& tree, int lo, int hi, unsigned int& rng)
+{
+    int self = (int)tree.nodes.size();
+    node_t node;
+
+    tree.nodes.push_back(node_t());
+    if(hi - lo <= leafSize) {
+        node.dim = -1;
+        node.split = 0.0f;
+        node.child[0] = lo;
+        node.child[1] = hi;
+        tree.nodes[self] = node;
+        return self;
+    }
+
+    /* mean and variance of a sample of the range */
+    int step = max((hi - lo) / ANN_VARIANCE_SAMPLES, 1);
+    int cnt = 0;
+    vector<double> mean(cols, 0.0), var(cols, 0.0);
+    for(int i = lo; i < hi; i += step, ++cnt) {
+        const float *p = point(tree.perm[i]);
+        for(int c = 0; c < cols; ++c) {
+            mean[c] += p[c];
+        }
+    }
+    for(int c = 0; c < cols; ++c) {
+        mean[c] /= cnt;
+    }
+    for(int i = lo; i < hi; i += step) {
+        const float *p = point(tree.perm[i]);
+        for(int c = 0; c < cols; ++c) {
+            double d = p[c] - mean[c];
+            var[c] += d * d;
+        }
+    }
+
+    /* random pick among the highest-variance dimensions */
+    vector<pair<double, int> > ranked(cols);
+    for(int c = 0; c < cols; ++c) {
+        ranked[c] = make_pair(var[c], c);
+    }
+    int numTop = min(cols, ANN_RANDOM_DIMS);
+    partial_sort(ranked.begin(), ranked.begin() + numTop, ranked.end(), greater<pair<double, int> >());
+    node.dim = ranked[nextRandom(rng) % numTop].second;
+    node.split = (float)mean[node.dim];
+
+    /* partition around the mean; fall back to the median if it is lopsided */
+    int *perm = tree.perm.data();
+    int mid = (int)(std::partition(perm + lo, perm + hi,
+                                   [&](int idx) { return point(idx)[node.dim] < node.split; }) - perm);
+    if((mid == lo) || (mid == hi)) {
+        mid = lo + (hi - lo) / 2;
+        std::nth_element(perm + lo, perm + mid, perm + hi,
+                         [&](int a, int b) { return point(a)[node.dim] < point(b)[node.dim]; });
+        node.split = point(perm[mid])[node.dim];
+    }
+
+    node.child[0] = buildNode(tree, lo, mid, rng);
+    node.child[1] = buildNode(tree, mid, hi, rng);
+    tree.nodes[self] = node;
+    return self;
+}
+
+void KdForest::searchOne(const float *query, int k, int checks, int *indices, float *dists,
+                         scratch_s& scratch) const
+{
+    typedef scratch_s::branch_t branch_t;
+    greater<branch_t> cmp;
+    int checked = 0;
+
+    for(int i = 0; i < k; ++i) {
+        indices[i] = -1;
+        dists[i] = FLT_MAX;
+    }
+    if(rows == 0) {
+        return;
+    }
+    if(++scratch.stamp == 0) {
+        fill(scratch.visited.begin(), scratch.visited.end(), 0);
+        scratch.stamp = 1;
+    }
+    scratch.heap.clear();
+    for(size_t t = 0; t < trees.size(); ++t) {
+        scratch.heap.push_back(branch_t(0.0f, make_pair((int)t, 0)));
+    }
+    make_heap(scratch.heap.begin(), scratch.heap.end(), cmp);
+
+    while(!scratch.heap.empty()) {
+        pop_heap(scratch.heap.begin(), scratch.heap.end(), cmp);
+        branch_t br = scratch.heap.back();
+        scratch.heap.pop_back();
+
+        /* nothing left that could improve the results */
+        if(br.first >= dists[k - 1]) {
+            break;
+        }
+        if((checks != ANN_EXACT) && (checked >= checks)) {
+            break;
+        }
+
+        /* descend to a leaf, queueing the far side of each split */
+        const tree_t& tree = trees[br.second.first];
+        const node_t *node = &tree.nodes[br.second.second];
+        while(node->dim >= 0) {
+            float diff = query[node->dim] - node->split;
+            int nearSide = (diff < 0.0f) ? 0 : 1;
+            /* the summed bound prunes harder but may overshoot when a path
+             * splits one dimension twice; exact search keeps a strict bound */
+            float bound = (checks == ANN_EXACT) ? max(br.first, diff * diff) : br.first + diff * diff;
+            if(bound < dists[k - 1]) {
+                scratch.heap.push_back(branch_t(bound, make_pair(br.second.first, node->child[1 - nearSide])));
+                push_heap(scratch.heap.begin(), scratch.heap.end(), cmp);
+            }
+            node = &tree.nodes[node->child[nearSide]];
+        }
+
+        for(int i = node->child[0]; i < node->child[1]; ++i) {
+            int idx = tree.perm[i];
+            if(scratch.visited[idx] == scratch.stamp) {
+                continue;
+            }
+            scratch.visited[idx] = scratch.stamp;
+            insertResult(indices, dists, k, idx, annDistance(query, point(idx), cols));
+            ++checked;
+        }
+    }
+}
+
+void KdForest::knnSearch(const float *queries, int numQueries, size_t stride, int k, int checks,
+                         int *indices, float *dists, int numThreads) const
+{
+    numThreads = max(1, min(numThreads, numQueries));
+    auto worker = [&](int first, int last) {
+        scratch_s scratch;
+        scratch.visited.assign(rows, 0);
+        for(int q = first; q < last; ++q) {
+            searchOne(queries + (size_t)q * stride, k, checks,
+                      indices + (size_t)q * k, dists + (size_t)q * k, scratch);
+        }
+    };
+
+    if(numThreads == 1) {
+        worker(0, numQueries);
+        return;
+    }
+    vector<thread> pool;
+    for(int t = 0; t < numThreads; ++t) {
+        pool.push_back(thread(worker, (int)((int64_t)numQueries * t / numThreads),
+                              (int)((int64_t)numQueries * (t + 1) / numThreads)));
+    }
+    for(size_t t = 0; t < pool.size(); ++t) {
+        pool[t].join();
+    }
+}
+
+void KdForest::knnSearchPoints(const vector<int>& points, const KdForest& from, int k, int checks,
+                               int *indices, float *dists) const
+{
+    scratch_s scratch;
+
+    scratch.visited.assign(rows, 0);
+    for(size_t q = 0; q < points.size(); ++q) {
+        searchOne(from.point(points[q]), k, checks, indices + q * k, dists + q * k, scratch);
+    }
+}
+
+void annBruteForce(const float *data, int rows, int cols, size_t stride,
+                   const float *queries, int numQueries, size_t qstride, int k,
+                   int *indices, float *dists, int numThreads)
+{
+    numThreads = max(1, min(numThreads, numQueries));
+    auto worker = [&](int first, int last) {
+        for(int q = first; q < last; ++q) {
+            int *idx = indices + (size_t)q * k;
+            float *dst = dists + (size_t)q * k;
+            for(int i = 0; i < k; ++i) {
+                idx[i] = -1;
+                dst[i] = FLT_MAX;
+            }
+            for(int r = 0; r < rows; ++r) {
+                insertResult(idx, dst, k, r, annDistance(queries + (size_t)q * qstride,
+                                                         data + (size_t)r * stride, cols));
+            }
+        }
+    };
+
+    if(numThreads == 1) {
+        worker(0, numQueries);
+        return;
+    }
+    vector<thread> pool;
+    for(int t = 0; t < numThreads; ++t) {
+        pool.push_back(thread(worker, (int)((int64_t)numQueries * t / numThreads),
+                              (int)((int64_t)numQueries * (t + 1) / numThreads)));
+    }
+    for(size_t t = 0; t < pool.size(); ++t) {
+        pool[t].join();
+    }
+}
@@ -0,0 +1,137 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file annidx.h
+ * @brief approximate nearest neighbour search over descriptors with a
+ * randomized k-d forest
+ *
+ * Several k-d trees are built over the same points, each splitting on a
+ * dimension picked at random among the few with the highest variance. A
+ * query descends every tree, then keeps visiting the closest unexplored
+ * branch of any tree (one priority queue for the whole forest) until it has
+ * computed `checks` distances. More checks buy recall: a few dozen reach
+ * about 90% recall@1 on SIFT, a few hundred come close to exact search, at a
+ * cost that grows with checks rather than with the number of points.
+ *
+ * Plain float arrays in and out, so the index has no OpenCV dependency;
+ * distances are squared L2.
+ *
+ ************************************************************************************
+ */
+
+#ifndef ANNIDX_H
+#define ANNIDX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define ANN_DEFAULT_TREES             (4)
+#define ANN_DEFAULT_CHECKS            (64)
+#define ANN_LEAF_SIZE                 (8)
+#define ANN_RANDOM_DIMS               (5)     /* split among the top-variance dims */
+#define ANN_VARIANCE_SAMPLES          (100)
+#define ANN_EXACT                     (-1)    /* checks: search until proven exact */
+
+class KdForest
+{
+public:
+    KdForest();
+
+    /**
+     * @brief build the forest over a copy of the points
+     *
+     * @param data first point
+     * @param rows number of points
+     * @param cols dimensions
+     * @param stride floats from one point to the next
+     * @param numTrees trees in the forest
+     * @param leafSize points per leaf
+     * @param seed random seed; the same seed gives the same forest
+     */
+    void build(const float *data, int rows, int cols, size_t stride,
+               int numTrees = ANN_DEFAULT_TREES, int leafSize = ANN_LEAF_SIZE, unsigned int seed = 0);
+
+    /**
+     * @brief build over 8-bit descriptors (e.g. SIFT stored as uint8)
+     */
+    void build(const uint8_t *data, int rows, int cols, size_t stride,
+               int numTrees = ANN_DEFAULT_TREES, int leafSize = ANN_LEAF_SIZE, unsigned int seed = 0);
+
+    int size() const { return rows; }
+    int dims() const { return cols; }
+    bool empty() const { return rows == 0; }
+
+    /**
+     * @brief k nearest neighbours of a batch of queries
+     *
+     * @param queries first query
+     * @param numQueries number of queries
+     * @param stride floats from one query to the next
+     * @param k neighbours per query
+     * @param checks distances computed per query, ANN_EXACT for exact search
+     * @param indices numQueries * k point indices, -1 where fewer were found
+     * @param dists numQueries * k squared distances, ascending per query
+     * @param numThreads threads to split the batch over
+     */
+    void knnSearch(const float *queries, int numQueries, size_t stride, int k, int checks,
+                   int *indices, float *dists, int numThreads = 1) const;
+
+    /**
+     * @brief knnSearch() for a subset of the indexed points themselves,
+     * e.g. a reverse lookup for match candidates
+     *
+     * @param points indices of the points to use as queries
+     */
+    void knnSearchPoints(const std::vector<int>& points, const KdForest& from, int k, int checks,
+                         int *indices, float *dists) const;
+
+    /**
+     * @brief the stored copy of point idx
+     */
+    const float *point(int idx) const { return &data[(size_t)idx * cols]; }
+
+private:
+    typedef struct {
+        int dim;                  /* split dimension, -1 for a leaf */
+        float split;
+        int child[2];             /* children, or the leaf's [first, last) in perm */
+    } node_t;
+
+    typedef struct {
+        std::vector<node_t> nodes;
+        std::vector<int> perm;
+    } tree_t;
+
+    struct scratch_s;
+
+    int buildNode(tree_t& tree, int lo, int hi, unsigned int& rng);
+    void searchOne(const float *query, int k, int checks, int *indices, float *dists, scratch_s& scratch) const;
+
+    int rows;
+    int cols;
+    int leafSize;
+    std::vector<float> data;
+    std::vector<tree_t> trees;
+};
+
+/**
+ * @brief squared L2 distance between two descriptors
+ */
+float annDistance(const float *a, const float *b, int cols);
+
+/**
+ * @brief exact k nearest neighbours by exhaustive search, the baseline and
+ * ground truth for KdForest
+ */
+void annBruteForce(const float *data, int rows, int cols, size_t stride,
+                   const float *queries, int numQueries, size_t qstride, int k,
+                   int *indices, float *dists, int numThreads = 1);
+
+#endif /* ANNIDX_H */
@@ -0,0 +1,372 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file descdb.cpp
+ * @brief persisted keypoint / descriptor database for reference objects
+ *
+ ************************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <algorithm>
+#include <map>
+
+#include "opencv2/features2d/features2d.hpp"
+
+#include "descdb.h"
+
+using namespace cv;
+using namespace std;
+
+#define ALIGN_UP(val)                 (((val) + DESCDB_ALIGN - 1) & ~((uint64_t)DESCDB_ALIGN - 1))
+
+static bool sectionOk(const descDbHeader_t *hdr, uint64_t off, uint64_t len)
+{
+    return (off % DESCDB_ALIGN == 0) && (off >= hdr->headerSize) &&
+           (off <= hdr->fileSize) && (len <= hdr->fileSize - off);
+}
+
+static bool writeSection(FILE *fp, uint64_t off, const void *data, size_t len)
+{
+    static const char pad[DESCDB_ALIGN] = {0};
+    long pos = ftell(fp);
+
+    if((pos < 0) || ((uint64_t)pos > off) || (off - pos > DESCDB_ALIGN)) {
+        return false;
+    }
+    if((fwrite(pad, 1, off - pos, fp) != off - pos) ||
+       ((len > 0) && (fwrite(data, 1, len, fp) != len))) {
+        return false;
+    }
+    return true;
+}
+
+DescDb::DescDb() :
+    map(NULL), mapSize(0), hdr(NULL), objects(NULL), kpts(NULL), desc(NULL), lists(NULL), postings(NULL)
+{
+}
+
+DescDb::~DescDb()
+{
+    close();
+}
+
+bool DescDb::open(const string& path)
+{
+    struct stat st;
+    int fd;
+
+    close();
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        cerr << "descdb: can't open " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    if((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(descDbHeader_t))) {
+        cerr << "descdb: " << path << " is too short" << endl;
+        ::close(fd);
+        return false;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED) {
+        map = NULL;
+        cerr << "descdb: can't map " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    mapSize = st.st_size;
+
+    /* everything below only looks at the header and the small tables,
+     * the descriptors are faulted in when first matched against */
+    const descDbHeader_t *h = (const descDbHeader_t *)map;
+    const uint8_t *base = (const uint8_t *)map;
+    size_t elemSize = (h->descType == CV_32F) ? sizeof(float) : 1;
+    if((memcmp(h->magic, DESCDB_MAGIC, sizeof(h->magic)) != 0) || (h->version != DESCDB_VERSION) ||
+       (h->headerSize != sizeof(descDbHeader_t)) || (h->fileSize != mapSize) ||
+       ((h->descType != CV_32F) && (h->descType != CV_8U)) || (h->descCols == 0) ||
+       !sectionOk(h, h->objectsOff, (uint64_t)h->numObjects * sizeof(descDbObject_t)) ||
+       !sectionOk(h, h->keypointsOff, h->numKeypoints * sizeof(descDbKeyPoint_t)) ||
+       !sectionOk(h, h->descriptorsOff, h->numKeypoints * h->descCols * elemSize) ||
+       !sectionOk(h, h->centroidsOff, (uint64_t)h->numLists * h->descCols * sizeof(float)) ||
+       !sectionOk(h, h->listsOff, (uint64_t)h->numLists * sizeof(descDbList_t)) ||
+       !sectionOk(h, h->postingsOff, h->numPostings * sizeof(descDbPosting_t))) {
+        cerr << "descdb: " << path << " is not a valid database" << endl;
+        close();
+        return false;
+    }
+    objects = (const descDbObject_t *)(base + h->objectsOff);
+    kpts = (const descDbKeyPoint_t *)(base + h->keypointsOff);
+    desc = base + h->descriptorsOff;
+    lists = (const descDbList_t *)(base + h->listsOff);
+    postings = (const descDbPosting_t *)(base + h->postingsOff);
+    for(uint32_t i = 0; i < h->numObjects; ++i) {
+        if((uint64_t)objects[i].firstKeypoint + objects[i].numKeypoints > h->numKeypoints) {
+            cerr << "descdb: " << path << ": object " << i << " out of range" << endl;
+            close();
+            return false;
+        }
+    }
+    for(uint32_t i = 0; i < h->numLists; ++i) {
+        if((uint64_t)lists[i].firstPosting + lists[i].numPostings > h->numPostings) {
+            cerr << "descdb: " << path << ": index list " << i << " out of range" << endl;
+            close();
+            return false;
+        }
+    }
+    if(h->numLists > 0) {
+        centroids = Mat(h->numLists, h->descCols, CV_32F, (void *)(base + h->centroidsOff));
+    }
+    hdr = h;
+    return true;
+}
+
+void DescDb::close()
+{
+    centroids.release();
+    if(map != NULL) {
+        munmap(map, mapSize);
+    }
+    map = NULL;
+    mapSize = 0;
+    hdr = NULL;
+    objects = NULL;
+    kpts = NULL;
+    desc = NULL;
+    lists = NULL;
+    postings = NULL;
+}
+
+Mat DescDb::descriptors(int idx) const
+{
+    const descDbObject_t& obj = objects[idx];
+    size_t rowBytes = hdr->descCols * ((hdr->descType == CV_32F) ? sizeof(float) : 1);
+
+    if(obj.numKeypoints == 0) {
+        return Mat();
+    }
+    /* read-only mapping; the matchers never write their inputs */
+    return Mat(obj.numKeypoints, hdr->descCols, hdr->descType,
+               (void *)(desc + (size_t)obj.firstKeypoint * rowBytes), rowBytes);
+}
+
+void DescDb::keypoints(int idx, vector<KeyPoint>& kps) const
+{
+    const descDbObject_t& obj = objects[idx];
+
+    kps.resize(obj.numKeypoints);
+    for(uint32_t i = 0; i < obj.numKeypoints; ++i) {
+        const descDbKeyPoint_t& k = kpts[obj.firstKeypoint + i];
+        kps[i] = KeyPoint(k.x, k.y, k.size, k.angle, k.response, k.octave, k.classId);
+    }
+}
+
+void DescDb::shortlist(const Mat& query, int maxObjects, vector<pair<int, float> >& ranked) const
+{
+    vector<float> score(numObjects(), 0.0f);
+    vector<DMatch> cells;
+    Mat queryF;
+
+    ranked.clear();
+    if(!isOpen() || query.empty() || (maxObjects <= 0)) {
+        return;
+    }
+    if(hdr->numLists == 0) {
+        /* no index: everything is a candidate */
+        for(int i = 0; (i < numObjects()) && (i < maxObjects); ++i) {
+            ranked.push_back(make_pair(i, 0.0f));
+        }
+        return;
+    }
+
+    /* nearest cell per query descriptor, then idf-weighted votes */
+    query.convertTo(queryF, CV_32F);
+    BFMatcher(NORM_L2).match(queryF, centroids, cells);
+    for(size_t q = 0; q < cells.size(); ++q) {
+        const descDbList_t& list = lists[cells[q].trainIdx];
+        for(uint32_t p = 0; p < list.numPostings; ++p) {
+            uint32_t obj = postings[list.firstPosting + p].object;
+            if(obj < hdr->numObjects) {
+                score[obj] += list.idf;
+            }
+        }
+    }
+
+    /* objects with many keypoints own many cells; don't let size win */
+    for(int i = 0; i < numObjects(); ++i) {
+        if(score[i] > 0.0f) {
+            ranked.push_back(make_pair(i, score[i] / sqrtf((float)objects[i].numKeypoints)));
+        }
+    }
+    size_t keep = min(ranked.size(), (size_t)maxObjects);
+    partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(),
+                 [](const pair<int, float>& a, const pair<int, float>& b) { return a.second > b.second; });
+    ranked.resize(keep);
+}
+
+bool DescDb::build(const string& path, const vector<string>& names,
+                   const vector<vector<KeyPoint> >& kps,
+                   const vector<Mat>& descs, const vector<Size>& sizes, int numLists)
+{
+    descDbHeader_t h;
+    size_t numObj = names.size();
+    int type = -1, cols = 0;
+    uint64_t total = 0;
+
+    if((kps.size() != numObj) || (descs.size() != numObj) || (sizes.size() != numObj) || (numObj == 0)) {
+        cerr << "descdb: object lists differ in length" << endl;
+        return false;
+    }
+    for(size_t i = 0; i < numObj; ++i) {
+        if(descs[i].empty()) {
+            /* keypoints without rows would shift every later object's rows */
+            if(!kps[i].empty()) {
+                cerr << "descdb: " << names[i] << " has keypoints but no descriptors" << endl;
+                return false;
+            }
+            continue;
+        }
+        if(type < 0) {
+            type = descs[i].type();
+            cols = descs[i].cols;
+        }
+        if((descs[i].type() != type) || (descs[i].cols != cols) || ((size_t)descs[i].rows != kps[i].size()) ||
+           ((type != CV_32F) && (type != CV_8U))) {
+            cerr << "descdb: descriptors of " << names[i] << " don't match the others" << endl;
+            return false;
+        }
+        total += descs[i].rows;
+    }
+    if(total == 0) {
+        cerr << "descdb: no descriptors to store" << endl;
+        return false;
+    }
+
+    /* object table, keypoints and one descriptor matrix */
+    vector<descDbObject_t> objs(numObj);
+    vector<descDbKeyPoint_t> packed;
+    vector<int> rowObject;
+    Mat all;
+    packed.reserve(total);
+    rowObject.reserve(total);
+    for(size_t i = 0; i < numObj; ++i) {
+        memset(&objs[i], 0, sizeof(descDbObject_t));
+        snprintf(objs[i].name, sizeof(objs[i].name), "%s", names[i].c_str());
+        objs[i].firstKeypoint = (uint32_t)packed.size();
+        objs[i].numKeypoints = (uint32_t)kps[i].size();
+        objs[i].width = sizes[i].width;
+        objs[i].height = sizes[i].height;
+        for(size_t k = 0; k < kps[i].size(); ++k) {
+            descDbKeyPoint_t p;
+            p.x = kps[i][k].pt.x;
+            p.y = kps[i][k].pt.y;
+            p.size = kps[i][k].size;
+            p.angle = kps[i][k].angle;
+            p.response = kps[i][k].response;
+            p.octave = kps[i][k].octave;
+            p.classId = kps[i][k].class_id;
+            p.reserved = 0;
+            packed.push_back(p);
+            rowObject.push_back((int)i);
+        }
+        if(!descs[i].empty()) {
+            all.push_back(descs[i]);
+        }
+    }
+
+    /* coarse index: k-means on a sample, then every row to its nearest cell */
+    Mat allF, centers;
+    vector<descDbList_t> listTab;
+    vector<descDbPosting_t> postTab;
+    int k = min(numLists, (int)total);
+    if(k > 0) {
+        Mat sample, labels;
+        all.convertTo(allF, CV_32F);
+        if(total > (uint64_t)k * DESCDB_KMEANS_SAMPLES) {
+            RNG rng(0x5eed);
+            for(int s = 0; s < k * DESCDB_KMEANS_SAMPLES; ++s) {
+                sample.push_back(allF.row(rng.uniform(0, (int)total)));
+            }
+        } else {
+            sample = allF;
+        }
+        kmeans(sample, k, labels, TermCriteria(TermCriteria::EPS + TermCriteria::COUNT, 10, 1e-3),
+               1, KMEANS_PP_CENTERS, centers);
+
+        vector<DMatch> cells;
+        BFMatcher(NORM_L2).match(allF, centers, cells);
+        vector<std::map<uint32_t, uint32_t> > cellObjects(k);
+        for(size_t r = 0; r < cells.size(); ++r) {
+            ++cellObjects[cells[r].trainIdx][rowObject[cells[r].queryIdx]];
+        }
+        listTab.resize(k);
+        for(int c = 0; c < k; ++c) {
+            listTab[c].firstPosting = (uint32_t)postTab.size();
+            listTab[c].numPostings = (uint32_t)cellObjects[c].size();
+            listTab[c].idf = listTab[c].numPostings ?
+                             logf(1.0f + (float)numObj / (float)listTab[c].numPostings) : 0.0f;
+            listTab[c].reserved = 0;
+            for(std::map<uint32_t, uint32_t>::const_iterator it = cellObjects[c].begin();
+                it != cellObjects[c].end(); ++it) {
+                descDbPosting_t p = { it->first, it->second };
+                postTab.push_back(p);
+            }
+        }
+    }
+
+    /* section offsets */
+    size_t elemSize = (type == CV_32F) ? sizeof(float) : 1;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DESCDB_MAGIC, sizeof(h.magic));
+    h.version = DESCDB_VERSION;
+    h.headerSize = sizeof(descDbHeader_t);
+    h.numObjects = (uint32_t)numObj;
+    h.descType = type;
+    h.descCols = cols;
+    h.numLists = k;
+    h.numKeypoints = total;
+    h.numPostings = postTab.size();
+    h.objectsOff = ALIGN_UP((uint64_t)sizeof(h));
+    h.keypointsOff = ALIGN_UP(h.objectsOff + numObj * sizeof(descDbObject_t));
+    h.descriptorsOff = ALIGN_UP(h.keypointsOff + total * sizeof(descDbKeyPoint_t));
+    h.centroidsOff = ALIGN_UP(h.descriptorsOff + total * cols * elemSize);
+    h.listsOff = ALIGN_UP(h.centroidsOff + (uint64_t)k * cols * sizeof(float));
+    h.postingsOff = ALIGN_UP(h.listsOff + (uint64_t)k * sizeof(descDbList_t));
+    h.fileSize = h.postingsOff + postTab.size() * sizeof(descDbPosting_t);
+
+    /* write next to the target and rename, so readers never see half a file */
+    string tmpPath = path + ".tmp";
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if(fp == NULL) {
+        cerr << "descdb: can't create " << tmpPath << ": " << strerror(errno) << endl;
+        return false;
+    }
+    Mat allC = all.isContinuous() ? all : all.clone();
+    bool ok = writeSection(fp, 0, &h, sizeof(h)) &&
+              writeSection(fp, h.objectsOff, objs.data(), numObj * sizeof(descDbObject_t)) &&
+              writeSection(fp, h.keypointsOff, packed.data(), total * sizeof(descDbKeyPoint_t)) &&
+              writeSection(fp, h.descriptorsOff, allC.data, total * cols * elemSize) &&
+              writeSection(fp, h.centroidsOff, centers.ptr(), (size_t)k * cols * sizeof(float)) &&
+              writeSection(fp, h.listsOff, listTab.data(), listTab.size() * sizeof(descDbList_t)) &&
+              writeSection(fp, h.postingsOff, postTab.data(), postTab.size() * sizeof(descDbPosting_t));
+    if((fclose(fp) != 0) || !ok || (rename(tmpPath.c_str(), path.c_str()) != 0)) {
+        cerr << "descdb: failed writing " << path << endl;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
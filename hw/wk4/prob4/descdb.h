@@ -0,0 +1,178 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file descdb.h
+ * @brief persisted keypoint / descriptor database for reference objects
+ *
+ * One file holds any number of reference objects: their keypoints, one
+ * descriptor matrix with the rows of all objects back to back, and a coarse
+ * inverted index (k-means centroids with, per centroid, the objects owning
+ * descriptors in that cell). Every section starts on a 64 byte boundary, so
+ * open() only maps the file and checks the header; descriptors are handed
+ * out as cv::Mat headers over the mapping and nothing is copied or
+ * recomputed at startup.
+ *
+ * Layout (little endian):
+ *   descDbHeader_t
+ *   descDbObject_t   [numObjects]
+ *   descDbKeyPoint_t [numKeypoints]
+ *   descriptors      [numKeypoints][descCols] of descType
+ *   centroids        [numLists][descCols] float
+ *   descDbList_t     [numLists]
+ *   descDbPosting_t  [sum of list postings]
+ *
+ * The index assumes L2 descriptors (SIFT, SURF); shortlist() votes each
+ * query descriptor's cell for the objects in it, weighted by idf, so a frame
+ * is only matched in full against the few objects likely to be in it.
+ *
+ ************************************************************************************
+ */
+
+#ifndef DESCDB_H
+#define DESCDB_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "opencv2/core/core.hpp"
+
+#define DESCDB_MAGIC                  "DESCDB\r\n"
+#define DESCDB_VERSION                (1)
+#define DESCDB_ALIGN                  (64)
+#define DESCDB_NAME_LEN               (64)
+#define DESCDB_DEFAULT_LISTS          (256)
+#define DESCDB_KMEANS_SAMPLES         (64)    /* rows sampled per centroid */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t numObjects;
+    uint32_t descType;            /* CV_32F or CV_8U */
+    uint32_t descCols;
+    uint32_t numLists;
+    uint64_t numKeypoints;
+    uint64_t numPostings;
+    uint64_t objectsOff;
+    uint64_t keypointsOff;
+    uint64_t descriptorsOff;
+    uint64_t centroidsOff;
+    uint64_t listsOff;
+    uint64_t postingsOff;
+    uint64_t fileSize;
+} descDbHeader_t;
+
+typedef struct {
+    char name[DESCDB_NAME_LEN];   /* usually the source image path */
+    uint32_t firstKeypoint;       /* row of its first descriptor */
+    uint32_t numKeypoints;
+    uint32_t width;               /* image size the keypoints refer to */
+    uint32_t height;
+} descDbObject_t;
+
+typedef struct {
+    float x;
+    float y;
+    float size;
+    float angle;
+    float response;
+    int32_t octave;
+    int32_t classId;
+    int32_t reserved;
+} descDbKeyPoint_t;
+
+typedef struct {
+    uint32_t firstPosting;
+    uint32_t numPostings;
+    float idf;                    /* log(1 + numObjects / numPostings) */
+    uint32_t reserved;
+} descDbList_t;
+
+typedef struct {
+    uint32_t object;
+    uint32_t count;               /* object's descriptors in the cell */
+} descDbPosting_t;
+
+class DescDb
+{
+public:
+    DescDb();
+    ~DescDb();
+
+    /**
+     * @brief map a database file read-only and validate it
+     *
+     * @param path database file
+     * @return bool false, with a message on cerr, if missing or malformed
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief unmap the file; Mats handed out must no longer be used
+     */
+    void close();
+
+    bool isOpen() const { return hdr != NULL; }
+    int numObjects() const { return hdr ? (int)hdr->numObjects : 0; }
+    const descDbObject_t& object(int idx) const { return objects[idx]; }
+
+    /**
+     * @brief an object's descriptors, a header over the mapping (no copy)
+     */
+    cv::Mat descriptors(int idx) const;
+
+    /**
+     * @brief unpack an object's keypoints
+     */
+    void keypoints(int idx, std::vector<cv::KeyPoint>& kps) const;
+
+    /**
+     * @brief rank objects by how many of the query's descriptors fall in
+     * their cells of the index
+     *
+     * @param query query descriptors, same type and width as the database
+     * @param maxObjects length of the shortlist
+     * @param ranked (object, score) best first
+     */
+    void shortlist(const cv::Mat& query, int maxObjects, std::vector<std::pair<int, float> >& ranked) const;
+
+    /**
+     * @brief write a database, building its index
+     *
+     * @param path output file, replaced
+     * @param names object names
+     * @param kps keypoints per object
+     * @param descs descriptors per object, all the same type and width
+     * @param sizes image size per object
+     * @param numLists index cells; clamped to the number of descriptors
+     * @return bool false, with a message on cerr, on failure
+     */
+    static bool build(const std::string& path, const std::vector<std::string>& names,
+                      const std::vector<std::vector<cv::KeyPoint> >& kps,
+                      const std::vector<cv::Mat>& descs, const std::vector<cv::Size>& sizes,
+                      int numLists = DESCDB_DEFAULT_LISTS);
+
+private:
+    DescDb(const DescDb&);
+    DescDb& operator=(const DescDb&);
+
+    void *map;
+    size_t mapSize;
+    const descDbHeader_t *hdr;
+    const descDbObject_t *objects;
+    const descDbKeyPoint_t *kpts;
+    const uint8_t *desc;
+    const descDbList_t *lists;
+    const descDbPosting_t *postings;
+    cv::Mat centroids;            /* header over the mapping */
+};
+
+#endif /* DESCDB_H */
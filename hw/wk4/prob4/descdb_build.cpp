@@ -0,0 +1,103 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file descdb_build.cpp
+ * @brief extract SIFT features of reference images into a descriptor database
+ *
+ ************************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/features2d/features2d.hpp"
+#include <opencv2/xfeatures2d.hpp>
+
+#include <iostream>
+
+#include "descdb.h"
+
+using namespace cv;
+using namespace std;
+
+#define TIMESPEC_TO_mSEC(time)	((((float)time.tv_sec) * 1.0e3) + (((float)time.tv_nsec) * 1.0e-6))
+#define REF_IMG_COLS              (640)
+#define REF_IMG_ROWS              (480)
+
+void help(char** argv)
+{
+  cout << argv[0] << " [-l lists] [database] [image1] [image2] ...\n\n"
+  << "Extracts SIFT keypoints and descriptors of each reference image, resized to "
+  << REF_IMG_COLS << "x" << REF_IMG_ROWS << " like the matcher does,\n"
+  << "and writes them with a prebuilt index to one database file.\n"
+  << "-l sets the number of index cells (default " << DESCDB_DEFAULT_LISTS << ", 0 = no index).\n"
+  << "\n"
+  << "Example of usage:\n"
+  << "./descdb_build objects.db img3.jpg img4.jpg" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    int numLists = DESCDB_DEFAULT_LISTS;
+    int arg = 1;
+
+    if((argc > 2) && (strcmp(argv[1], "-l") == 0)) {
+        numLists = atoi(argv[2]);
+        arg = 3;
+    }
+    if(argc - arg < 2) {
+        help(argv);
+        return -1;
+    }
+    string dbPath = argv[arg++];
+
+    Ptr<FeatureDetector> detector = cv::xfeatures2d::SIFT::create();
+    Ptr<DescriptorExtractor> descriptorExtractor = cv::xfeatures2d::SIFT::create();
+
+    vector<string> names;
+    vector<vector<KeyPoint> > keypoints;
+    vector<Mat> descriptors;
+    vector<Size> sizes;
+    struct timespec startTime, stopTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for(; arg < argc; ++arg) {
+        Mat img = imread(argv[arg]);
+        if(img.empty()) {
+            cout << "Can not read image " << argv[arg] << ", skipped" << endl;
+            continue;
+        }
+        resize(img, img, Size(REF_IMG_COLS, REF_IMG_ROWS));
+
+        vector<KeyPoint> kps;
+        Mat desc;
+        detector->detect(img, kps);
+        descriptorExtractor->compute(img, kps, desc);
+        cout << argv[arg] << ": " << kps.size() << " keypoints" << endl;
+
+        names.push_back(argv[arg]);
+        keypoints.push_back(kps);
+        descriptors.push_back(desc);
+        sizes.push_back(img.size());
+    }
+    if(names.empty()) {
+        cout << "no images to store" << endl;
+        return -1;
+    }
+
+    if(!DescDb::build(dbPath, names, keypoints, descriptors, sizes, numLists)) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stopTime);
+    cout << "wrote " << names.size() << " objects to " << dbPath << " in "
+         << TIMESPEC_TO_mSEC(stopTime) - TIMESPEC_TO_mSEC(startTime) << " msec" << endl;
+    return 0;
+}
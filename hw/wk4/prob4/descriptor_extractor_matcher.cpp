@@ -4,7 +4,29 @@
 #include "opencv2/features2d/features2d.hpp"
 #include <opencv2/xfeatures2d.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <thread>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "annidx.h"
+#include "changegate.h"
+#include "descdb.h"
+#include "farsource.h"
+#include "framequeue.h"
+#include "frametrace.h"
+#include "homography.h"
+#include "pyramidmat.h"
+#include "replaycapture.h"
+#include "rtstats.h"
+#include "tracker.h"
 
 using namespace cv;
 using namespace std;
@@ -12,27 +34,83 @@ using namespace std;
 #define TIMESPEC_TO_mSEC(time)	((((float)time.tv_sec) * 1.0e3) + (((float)time.tv_nsec) * 1.0e-6))
 int calc_dt(struct timespec *stop, struct timespec *start, struct timespec *delta_t);
 
+#define PIPE_QUEUE_DEPTH          (2)
+#define PIPE_DISPLAY_DEPTH        (1)
+#define PIPE_STATS_SOCK_PATH      "/tmp/matcher.stats"
+#define PIPE_STATS_INTERVAL_MS    (1000)
+#define BATCH_INLIER_TOLERANCE    (0.10)  /* fraction of the baseline's inliers */
+#define BATCH_INLIER_SLACK        (3)     /* inliers, for frames with few */
+#define BATCH_TIME_TOLERANCE      (1.25)  /* median frame time vs the baseline */
+
 void help(char** argv)
 {
-  cout << argv[0] << " [detectorType] [descriptorType] [matcherType] [matcherFilterType] [image1] [image2] [ransacReprojThreshold]\n\n"
+  cout << argv[0] << " [detectorType] [descriptorType] [matcherType] [matcherFilterType] [image1] [input] [ransacReprojThreshold] [mode] [gate]\n\n"
   << "This program demonstrates keypoint finding and matching between 2 images using features2d framework.\n"
   << "If ransacReprojThreshold>=0 then homography matrix is calculated and used to filter matches\n"
+  << "If image1 ends in .db it is a descriptor database from descdb_build; each frame is\n"
+  << "matched against the objects its index shortlists and the best one is drawn.\n"
+  << "input is cam (camera 0), a video file, an image sequence such as frame_%04d.png or\n"
+  << "a replayed recording (pnm:frame_%04d.ppm[,fps=30] or yuyv:cam.yuv,size=640x480\n"
+  << "[,ts=times.txt] or far:run.far from capture -A, see framesource.h) released at the\n"
+  << "camera's rate.\n"
+  << "mode is sequential (default), pipelined (detect, describe, match and RANSAC in\n"
+  << "their own threads, overlapping successive frames) or headless (pipelined, no\n"
+  << "window; stop with SIGINT). Pipelined modes print per-stage latency on exit and\n"
+  << "stream it to " << PIPE_STATS_SOCK_PATH << ". tracking runs full detection and matching\n"
+  << "only on keyframes and follows the object with optical flow in between.\n"
+  << "batch[:results.csv[:baseline.csv]] runs every frame of the input through the full\n"
+  << "path without a window, writes per-frame timings and inliers as CSV (to stdout\n"
+  << "without a file) and exits 1 if results regress against a baseline, i.e. an earlier\n"
+  << "results file: another object, fewer inliers or a slower median frame.\n"
+  << "gate is 1 (default) to skip frames the change gate finds unchanged in the sequential\n"
+  << "and pipelined modes, 0 to match every frame.\n"
+  << "With " FT_ENV_PATH "=file set, the pipelined, headless and batch modes write each\n"
+  << "frame's release-to-result latency and a checksum of its result to file (see\n"
+  << "frametrace.h and ../replay).\n"
   << "\n"
   << "Example of usage:\n"
   << "./descriptor_extractor_matcher SURF SURF BruteForce CrossCheckFilter cola1.jpg cola2.jpg 3\n"
+  << "./descriptor_extractor_matcher SIFT SIFT BruteForce CrossCheckFilter objects.db cam 3\n"
+  << "./descriptor_extractor_matcher SIFT SIFT KdForest CrossCheckFilter objects.db cam 3 headless\n"
+  << "./descriptor_extractor_matcher SIFT SIFT BruteForce CrossCheckFilter box.png seq/frame_%04d.png 3 batch:run.csv:base.csv\n"
+  << "./descriptor_extractor_matcher SIFT SIFT KdForest CrossCheckFilter objects.db pnm:rec/f%04d.ppm,fps=30,drop 3 headless\n"
   << "\n"
   << "Possible detectorType values: SIFT.\n"
   << "Possible descriptorType values: SIFT.\n"
-  << "Possible matcherType values: see in documentation on createDescriptorMatcher().\n"
+  << "Possible matcherType values: see in documentation on createDescriptorMatcher(),\n"
+  << "  or KdForest[:checks] for the approximate k-d forest (more checks, better recall;\n"
+  << "  checks > 0, or -1 for an exact search).\n"
   << "Possible matcherFilterType values: NoneFilter, CrossCheckFilter." << endl;
 }
 
 #define DRAW_RICH_KEYPOINTS_MODE  (0)
 #define DRAW_OUTLIERS_MODE        (0)
+#define DB_SHORTLIST              (3)     /* objects matched in full per frame */
+#define REF_IMG_COLS              (640)
+#define REF_IMG_ROWS              (480)
+#define ANN_MATCHER_NAME          "KdForest"
 
 const string winName = "correspondences";
 
 enum { NONE_FILTER = 0, CROSS_CHECK_FILTER = 1 };
+enum { MODE_SEQUENTIAL = 0, MODE_PIPELINED = 1, MODE_HEADLESS = 2, MODE_TRACKING = 3, MODE_BATCH = 4 };
+
+/* the mode name is the part before any ':' options */
+int getRunMode( const string& arg )
+{
+    string str = arg.substr(0, arg.find(':'));
+    if( str == "sequential" )
+        return MODE_SEQUENTIAL;
+    if( str == "pipelined" )
+        return MODE_PIPELINED;
+    if( str == "headless" )
+        return MODE_HEADLESS;
+    if( str == "tracking" )
+        return MODE_TRACKING;
+    if( str == "batch" )
+        return MODE_BATCH;
+    return -1;
+}
 
 int getMatcherFilterType( const string& str )
 {
@@ -78,53 +156,165 @@ void crossCheckMatching( Ptr<DescriptorMatcher>& descriptorMatcher,
     }
 }
 
-void doIteration( const Mat& img1, Mat& img2,
-                  vector<KeyPoint>& keypoints1, const Mat& descriptors1,
-                  Ptr<FeatureDetector>& detector, Ptr<DescriptorExtractor>& descriptorExtractor,
-                  Ptr<DescriptorMatcher>& descriptorMatcher, int matcherFilter,
-                  double ransacReprojThreshold, Mat &drawImg)
+/* RANSAC threads, 0 for one per online CPU; batch runs use one so the
+ * results are reproducible */
+static int gRansacThreads = 0;
+
+/* skip frames the change gate finds unchanged (sequential and pipelined modes) */
+static bool gUseGate = true;
+
+/* search threads for a frame's queries, one per online CPU */
+int annThreads( void )
 {
-    assert(!img1.empty());
-    assert(!img2.empty());
+    static int threads = max((int)sysconf(_SC_NPROCESSORS_ONLN), 1);
+    return threads;
+}
 
-    vector<KeyPoint> keypoints2;
-    detector->detect( img2, keypoints2 );
-    Mat descriptors2;
-    descriptorExtractor->compute( img2, keypoints2, descriptors2 );
+/* k-d forest over a reference object's descriptors, built once per object */
+void buildForest( const Mat& descriptors, KdForest& index )
+{
+    if(descriptors.empty()) {
+        return;
+    }
+    if(descriptors.type() == CV_8U) {
+        index.build(descriptors.ptr<uint8_t>(0), descriptors.rows, descriptors.cols, descriptors.step1());
+    } else {
+        Mat descriptorsF;
+        descriptors.convertTo(descriptorsF, CV_32F);
+        index.build(descriptorsF.ptr<float>(0), descriptorsF.rows, descriptorsF.cols, descriptorsF.step1());
+    }
+}
 
-    vector<DMatch> filteredMatches;
-    if(matcherFilter == CROSS_CHECK_FILTER) {
+/* approximate matching against a k-d forest over the reference
+ * descriptors, the frame's descriptors being the queries. The cross-check
+ * does a single reverse lookup, and only for the reference points that
+ * some frame descriptor picked, instead of a second full knn pass */
+void annMatching( const KdForest& index1, const Mat& descriptors2, int matcherFilter,
+                  int checks, int threads, vector<DMatch>& filteredMatches12 )
+{
+    filteredMatches12.clear();
+    Mat queries;
+    if(descriptors2.type() == CV_32F) {
+        queries = descriptors2;
+    } else {
+        descriptors2.convertTo(queries, CV_32F);
+    }
+    int nq = queries.rows;
+    vector<int> fwdIdx(nq);
+    vector<float> fwdDist(nq);
+    index1.knnSearch(queries.ptr<float>(0), nq, queries.step1(), 1, checks,
+                     fwdIdx.data(), fwdDist.data(), threads);
+
+    if(matcherFilter != CROSS_CHECK_FILTER) {
+        for(int q = 0; q < nq; ++q) {
+            if(fwdIdx[q] >= 0) {
+                filteredMatches12.push_back(DMatch(fwdIdx[q], q, sqrtf(fwdDist[q])));
+            }
+        }
+        return;
+    }
+
+    /* one frame's worth of points: a single tree is enough */
+    KdForest index2;
+    index2.build(queries.ptr<float>(0), nq, queries.cols, queries.step1(), 1);
+    vector<int> candidates;
+    vector<int> slot(index1.size(), -1);
+    for(int q = 0; q < nq; ++q) {
+        if((fwdIdx[q] >= 0) && (slot[fwdIdx[q]] < 0)) {
+            slot[fwdIdx[q]] = (int)candidates.size();
+            candidates.push_back(fwdIdx[q]);
+        }
+    }
+    vector<int> revIdx(candidates.size());
+    vector<float> revDist(candidates.size());
+    index2.knnSearchPoints(candidates, index1, 1, checks, revIdx.data(), revDist.data());
+    for(int q = 0; q < nq; ++q) {
+        if((fwdIdx[q] >= 0) && (revIdx[slot[fwdIdx[q]]] == q)) {
+            filteredMatches12.push_back(DMatch(fwdIdx[q], q, sqrtf(fwdDist[q])));
+        }
+    }
+}
+
+/* match one reference object's descriptors to the frame's, through its
+ * k-d forest if index1 is given */
+void matchDescriptors( const Mat& descriptors1, const Mat& descriptors2,
+                       Ptr<DescriptorMatcher>& descriptorMatcher, const KdForest *index1, int annChecks,
+                       int matcherFilter, vector<DMatch>& filteredMatches )
+{
+    filteredMatches.clear();
+    if(descriptors1.empty() || descriptors2.empty()) {
+        return;
+    }
+
+    if(index1 != NULL) {
+        annMatching(*index1, descriptors2, matcherFilter, annChecks, annThreads(), filteredMatches);
+    } else if(matcherFilter == CROSS_CHECK_FILTER) {
         crossCheckMatching(descriptorMatcher, descriptors1, descriptors2, filteredMatches, 1);
     } else {
         simpleMatching(descriptorMatcher, descriptors1, descriptors2, filteredMatches);
     }
+}
 
-    vector<int> queryIdxs(filteredMatches.size());
-    vector<int> trainIdxs(filteredMatches.size());
+/* fit a homography to the matches with RANSAC, best matches sampled first,
+ * and clear the outliers in matchesMask. Returns the number of inliers, 0
+ * when no homography was found; with verification off (a negative
+ * threshold) every match counts, for every object alike */
+int verifyMatches( const vector<KeyPoint>& keypoints1, const vector<KeyPoint>& keypoints2,
+                   const vector<DMatch>& filteredMatches, double ransacReprojThreshold,
+                   vector<char>& matchesMask, Mat& H12 )
+{
+    size_t n = filteredMatches.size();
+    matchesMask.clear();
+    H12.release();
+    if(ransacReprojThreshold < 0) {
+        return (int)n;
+    }
+    if(n < RANSAC_SAMPLE_SIZE) {
+        return 0;
+    }
 
-    for(size_t i = 0; i < filteredMatches.size(); ++i) {
-        queryIdxs[i] = filteredMatches[i].queryIdx;
-        trainIdxs[i] = filteredMatches[i].trainIdx;
+    vector<Point2f> points1(n), points2(n);
+    vector<float> distances(n);
+    for(size_t i = 0; i < n; ++i) {
+        points1[i] = keypoints1[filteredMatches[i].queryIdx].pt;
+        points2[i] = keypoints2[filteredMatches[i].trainIdx].pt;
+        distances[i] = filteredMatches[i].distance;
     }
 
-    Mat H12;
-    if(ransacReprojThreshold >= 0) {
-        vector<Point2f> points1; KeyPoint::convert(keypoints1, points1, queryIdxs);
-        vector<Point2f> points2; KeyPoint::convert(keypoints2, points2, trainIdxs);
-        H12 = findHomography( Mat(points1), Mat(points2), CV_RANSAC, ransacReprojThreshold );
+    double H[9];
+    vector<uint8_t> inlierMask(n);
+    int inliers = ransacHomography(&points1[0].x, &points2[0].x, distances.data(), (int)n,
+                                   ransacReprojThreshold, H, inlierMask.data(),
+                                   RANSAC_CONFIDENCE, RANSAC_MAX_ITERS,
+                                   gRansacThreads > 0 ? gRansacThreads : annThreads());
+    if(inliers == 0) {
+        return 0;
     }
+    H12 = Mat(3, 3, CV_64F, H).clone();
+    matchesMask.assign(inlierMask.begin(), inlierMask.end());
+    return inliers;
+}
 
-    if(!H12.empty()) {// filter outliers
-        vector<char> matchesMask(filteredMatches.size(), 0);
-        vector<Point2f> points1; KeyPoint::convert(keypoints1, points1, queryIdxs);
-        vector<Point2f> points2; KeyPoint::convert(keypoints2, points2, trainIdxs);
-        Mat points1t; perspectiveTransform(Mat(points1), points1t, H12);
+/* match one reference object against the frame; see matchDescriptors()
+ * and verifyMatches() */
+int matchObject( const vector<KeyPoint>& keypoints1, const Mat& descriptors1,
+                 const vector<KeyPoint>& keypoints2, const Mat& descriptors2,
+                 Ptr<DescriptorMatcher>& descriptorMatcher, const KdForest *index1, int annChecks,
+                 int matcherFilter, double ransacReprojThreshold, vector<DMatch>& filteredMatches,
+                 vector<char>& matchesMask, Mat& H12 )
+{
+    matchDescriptors(descriptors1, descriptors2, descriptorMatcher, index1, annChecks,
+                     matcherFilter, filteredMatches);
+    return verifyMatches(keypoints1, keypoints2, filteredMatches, ransacReprojThreshold,
+                         matchesMask, H12);
+}
 
-        double maxInlierDist = ransacReprojThreshold < 0 ? 3 : ransacReprojThreshold;
-        for( size_t i1 = 0; i1 < points1.size(); ++i1) {
-            if(norm(points2[i1] - points1t.at<Point2f>((int)i1,0)) <= maxInlierDist) // inlier
-                matchesMask[i1] = 1;
-        }
+void drawObject( const Mat& img1, const vector<KeyPoint>& keypoints1,
+                 const Mat& img2, const vector<KeyPoint>& keypoints2,
+                 const vector<DMatch>& filteredMatches, vector<char>& matchesMask,
+                 const Mat& H12, Mat& drawImg )
+{
+    if(!H12.empty()) {
         // draw inliers
         drawMatches(img1, keypoints1, img2, keypoints2, filteredMatches, drawImg, CV_RGB(0, 255, 0), CV_RGB(0, 0, 255), matchesMask
 #if DRAW_RICH_KEYPOINTS_MODE
@@ -145,12 +335,777 @@ void doIteration( const Mat& img1, Mat& img2,
     }
 }
 
+void doIteration( const Mat& img1, Mat& img2,
+                  vector<KeyPoint>& keypoints1, const Mat& descriptors1,
+                  Ptr<FeatureDetector>& detector, Ptr<DescriptorExtractor>& descriptorExtractor,
+                  Ptr<DescriptorMatcher>& descriptorMatcher, const KdForest *index1, int annChecks,
+                  int matcherFilter, double ransacReprojThreshold, Mat &drawImg)
+{
+    assert(!img1.empty());
+    assert(!img2.empty());
+
+    vector<KeyPoint> keypoints2;
+    detector->detect( img2, keypoints2 );
+    Mat descriptors2;
+    descriptorExtractor->compute( img2, keypoints2, descriptors2 );
+
+    vector<DMatch> filteredMatches;
+    vector<char> matchesMask;
+    Mat H12;
+    matchObject(keypoints1, descriptors1, keypoints2, descriptors2, descriptorMatcher, index1, annChecks,
+                matcherFilter, ransacReprojThreshold, filteredMatches, matchesMask, H12);
+    drawObject(img1, keypoints1, img2, keypoints2, filteredMatches, matchesMask, H12, drawImg);
+}
+
+/* reference images are only needed for drawing; load them on first use */
+const Mat& referenceImage( const DescDb& db, int idx )
+{
+    static std::map<int, Mat> cache;
+    std::map<int, Mat>::iterator it = cache.find(idx);
+
+    if(it == cache.end()) {
+        const descDbObject_t& obj = db.object(idx);
+        Mat img = imread(obj.name);
+        if(img.empty()) {
+            img = Mat(obj.height, obj.width, CV_8UC3, Scalar::all(0));
+        } else {
+            resize(img, img, Size(obj.width, obj.height));
+        }
+        it = cache.insert(make_pair(idx, img)).first;
+    }
+    return it->second;
+}
+
+/* k-d forest over a database object, built on first use; only one thread
+ * matches at a time (the capture loop or the pipeline's match stage) */
+const KdForest *dbForest( const DescDb& db, int obj )
+{
+    static std::map<int, KdForest> forests;
+    std::map<int, KdForest>::iterator it = forests.find(obj);
+
+    if(it == forests.end()) {
+        it = forests.insert(make_pair(obj, KdForest())).first;
+        buildForest(db.descriptors(obj), it->second);
+    }
+    return &it->second;
+}
+
+/* match the frame against the objects the database index shortlists and
+ * draw the one with the most inliers */
+int doDbIteration( const DescDb& db, Mat& img2,
+                   Ptr<FeatureDetector>& detector, Ptr<DescriptorExtractor>& descriptorExtractor,
+                   Ptr<DescriptorMatcher>& descriptorMatcher, bool useAnn, int annChecks,
+                   int matcherFilter, double ransacReprojThreshold, Mat &drawImg)
+{
+    assert(!img2.empty());
+
+    vector<KeyPoint> keypoints2;
+    detector->detect( img2, keypoints2 );
+    Mat descriptors2;
+    descriptorExtractor->compute( img2, keypoints2, descriptors2 );
+
+    vector<pair<int, float> > candidates;
+    db.shortlist(descriptors2, DB_SHORTLIST, candidates);
+
+    int bestObj = -1, bestInliers = -1;
+    vector<KeyPoint> keypoints1, bestKeypoints1;
+    vector<DMatch> filteredMatches, bestMatches;
+    vector<char> matchesMask, bestMask;
+    Mat H12, bestH12;
+    for(size_t c = 0; c < candidates.size(); ++c) {
+        int obj = candidates[c].first;
+        const KdForest *index1 = useAnn ? dbForest(db, obj) : NULL;
+        db.keypoints(obj, keypoints1);
+        int inliers = matchObject(keypoints1, db.descriptors(obj), keypoints2, descriptors2,
+                                  descriptorMatcher, index1, annChecks, matcherFilter,
+                                  ransacReprojThreshold, filteredMatches, matchesMask, H12);
+        if(inliers > bestInliers) {
+            bestObj = candidates[c].first;
+            bestInliers = inliers;
+            bestKeypoints1.swap(keypoints1);
+            bestMatches.swap(filteredMatches);
+            bestMask.swap(matchesMask);
+            bestH12 = H12;
+        }
+    }
+
+    if(bestObj < 0) {
+        drawImg = img2.clone();
+    } else {
+        drawObject(referenceImage(db, bestObj), bestKeypoints1, img2, keypoints2,
+                   bestMatches, bestMask, bestH12, drawImg);
+    }
+    return bestObj;
+}
+
+/* pipelined mode: capture -> detect -> describe -> match -> ransac [-> display]
+ * Every stage runs in its own thread and hands frames on through a bounded
+ * queue, so frame n is matched while frame n+1 is described and frame n+2
+ * detected. A full queue blocks the stage upstream (the camera drops frames
+ * meanwhile); the display only takes frames it has room for, so highgui
+ * never throttles the pipeline, and headless runs have no display at all */
+
+enum { PIPE_CAPTURE = 0, PIPE_DETECT, PIPE_DESCRIBE, PIPE_MATCH, PIPE_RANSAC, PIPE_DISPLAY,
+       PIPE_FRAME, PIPE_NUM_STAGES };
+static const char *pipeStageNames[PIPE_NUM_STAGES] = {
+    "capture", "detect", "describe", "match", "ransac", "display", "frame"
+};
+
+/* what frames are matched against: a database, or one reference image */
+typedef struct {
+    const DescDb *db;                 /* NULL for the single image below */
+    const Mat *img1;
+    const vector<KeyPoint> *keypoints1;
+    const Mat *descriptors1;
+    const KdForest *index1;           /* the image's forest, NULL without ANN */
+    bool useAnn;
+    int annChecks;
+    int matcherFilter;
+    double ransacReprojThreshold;
+} matchRef_t;
+
+/* one reference object's matches to a frame */
+typedef struct {
+    int obj;                          /* database object, -1 for the single image */
+    vector<KeyPoint> keypoints1;
+    vector<DMatch> matches;
+    vector<char> mask;
+    Mat H12;
+    int inliers;
+} pipeCandidate_t;
+
+/* a frame and everything the stages found in it */
+typedef struct pipeFrame_s {
+    int seq;
+    uint32_t frame;                   /* replay release index, else frames read */
+    struct timespec released;         /* replay release time, else read started */
+    struct timespec captured;
+    Mat img;                          /* read only, may be a level of pyr */
+    vector<KeyPoint> keypoints2;
+    Mat descriptors2;
+    vector<pipeCandidate_t> candidates;
+    int best;                         /* index into candidates, -1 if none */
+    pyramid_t *pyr;                   /* the camera frame, shared; NULL if resized */
+
+    pipeFrame_s() : seq(0), frame(0), best(-1), pyr(NULL) {}
+    ~pipeFrame_s() { if(pyr != NULL) pyr_unref(pyr); }
+} pipeFrame_t;
+
+/* scale a camera frame to the reference size. A camera delivering a
+ * power-of-two multiple of it is decimated through the frame's pyramid,
+ * which pyr keeps (dropping the previous frame's) so img stays valid and
+ * the smaller levels are there for any stage that wants them. Anything
+ * else is resized. Read each frame into a fresh camImg */
+static void refFrame( const Mat& camImg, Mat& img, pyramid_t *&pyr )
+{
+    if(pyr != NULL) {
+        pyr_unref(pyr);
+    }
+    pyr = pyr_from_mat(camImg, PYR_GAUSSIAN);
+    int level = (pyr != NULL) ? pyr_find(pyr, REF_IMG_COLS, REF_IMG_ROWS) : -1;
+    img = (level >= 0) ? pyr_mat(pyr, level) : Mat();
+    if(img.empty()) {
+        if(pyr != NULL) {
+            pyr_unref(pyr);
+            pyr = NULL;
+        }
+        resize(camImg, img, Size(REF_IMG_COLS, REF_IMG_ROWS));
+    }
+}
+
+/* where a frame came from; the release time of a replay is its exposure */
+static void sourceFrame( VideoCapture& capture, const struct timespec& readStart, uint32_t framesRead,
+                         pipeFrame_t *frame )
+{
+    ReplayCapture *replay = dynamic_cast<ReplayCapture *>(&capture);
+    if((replay != NULL) && replay->replaying()) {
+        frame->frame = replay->lastFrame().sequence;
+        frame->released = replay->lastFrame().timestamp;
+    } else {
+        frame->frame = framesRead;
+        frame->released = readStart;
+    }
+}
+
+/* a frame's result, for replay traces: the object found and its inlier
+ * matches, which floating point noise in the homography does not change */
+static uint64_t resultChecksum( const pipeFrame_t *frame )
+{
+    int32_t obj = (frame->best < 0) ? -2 : frame->candidates[frame->best].obj;
+    uint64_t sum = ft_checksum(FT_CHECKSUM_INIT, &obj, sizeof(obj));
+
+    if(frame->best >= 0) {
+        const pipeCandidate_t& cand = frame->candidates[frame->best];
+        for(size_t m = 0; m < cand.matches.size(); ++m) {
+            if(!cand.mask.empty() && !cand.mask[m]) {
+                continue;
+            }
+            int32_t pair[2] = { cand.matches[m].queryIdx, cand.matches[m].trainIdx };
+            sum = ft_checksum(sum, pair, sizeof(pair));
+        }
+    }
+    return sum;
+}
+
+typedef BoundedQueue<pipeFrame_t *> pipeQueue_t;
+
+static std::atomic<bool> gStop(false);
+static frameTrace_t gTrace;
+
+static void stopHandler( int sig )
+{
+    (void)sig;
+    gStop = true;
+}
+
+/* shortlisted database objects, or the single image, with their matches */
+static void pipeMatch( const matchRef_t& ref, Ptr<DescriptorMatcher>& descriptorMatcher, pipeFrame_t *frame )
+{
+    frame->candidates.clear();
+    if(ref.db == NULL) {
+        frame->candidates.resize(1);
+        pipeCandidate_t& cand = frame->candidates[0];
+        cand.obj = -1;
+        cand.keypoints1 = *ref.keypoints1;
+        matchDescriptors(*ref.descriptors1, frame->descriptors2, descriptorMatcher, ref.index1,
+                         ref.annChecks, ref.matcherFilter, cand.matches);
+        return;
+    }
+
+    vector<pair<int, float> > shortlist;
+    ref.db->shortlist(frame->descriptors2, DB_SHORTLIST, shortlist);
+    frame->candidates.resize(shortlist.size());
+    for(size_t c = 0; c < shortlist.size(); ++c) {
+        pipeCandidate_t& cand = frame->candidates[c];
+        cand.obj = shortlist[c].first;
+        ref.db->keypoints(cand.obj, cand.keypoints1);
+        matchDescriptors(ref.db->descriptors(cand.obj), frame->descriptors2, descriptorMatcher,
+                         ref.useAnn ? dbForest(*ref.db, cand.obj) : NULL, ref.annChecks,
+                         ref.matcherFilter, cand.matches);
+    }
+}
+
+/* homography per candidate; the one with the most inliers wins */
+static void pipeRansac( const matchRef_t& ref, pipeFrame_t *frame )
+{
+    frame->best = -1;
+    for(size_t c = 0; c < frame->candidates.size(); ++c) {
+        pipeCandidate_t& cand = frame->candidates[c];
+        cand.inliers = verifyMatches(cand.keypoints1, frame->keypoints2, cand.matches,
+                                     ref.ransacReprojThreshold, cand.mask, cand.H12);
+        if((frame->best < 0) || (cand.inliers > frame->candidates[frame->best].inliers)) {
+            frame->best = (int)c;
+        }
+    }
+}
+
+static void pipeDraw( const matchRef_t& ref, pipeFrame_t *frame, Mat& drawImg )
+{
+    if(frame->best < 0) {
+        drawImg = frame->img.clone();
+        return;
+    }
+    pipeCandidate_t& cand = frame->candidates[frame->best];
+    const Mat& img1 = (cand.obj < 0) ? *ref.img1 : referenceImage(*ref.db, cand.obj);
+    drawObject(img1, cand.keypoints1, frame->img, frame->keypoints2,
+               cand.matches, cand.mask, cand.H12, drawImg);
+}
+
+/* take frames from in, run work on each (timed as stage), pass them to
+ * out; a lossy out drops frames it has no room for, a NULL out ends them */
+template <typename Work>
+static void pipeStage( rtStats_t *stats, int stage, pipeQueue_t& in, pipeQueue_t *out, bool lossy, Work work )
+{
+    pipeFrame_t *frame;
+    struct timespec start, end;
+
+    while(in.pop(frame)) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        work(frame);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        rtstats_record(stats, stage, &start, &end);
+
+        bool passed = false;
+        if(out != NULL) {
+            passed = lossy ? out->tryPush(frame) : out->push(frame);
+        }
+        if(!passed) {
+            delete frame;
+        }
+    }
+    if(out != NULL) {
+        out->close();
+    }
+}
+
+static void pipeReport( rtStats_t *stats, double wallMs, size_t displayDrops )
+{
+    static char text[RTSTATS_TEXT_LEN];
+    rtStageSnap_t snap;
+    int slowest = -1;
+    double slowestMs = 0.0;
+
+    for(int s = PIPE_CAPTURE; s < PIPE_FRAME; ++s) {
+        if((rtstats_snapshot(stats, s, &snap) == 0) && (snap.count > 0) && (snap.meanMs > slowestMs)) {
+            slowest = s;
+            slowestMs = snap.meanMs;
+        }
+    }
+    rtstats_snapshot(stats, PIPE_FRAME, &snap);
+    rtstats_format(stats, text, sizeof(text));
+    cout << text;
+    cout << snap.count << " frames in " << wallMs << " msec, "
+         << (wallMs > 0.0 ? 1000.0 * snap.count / wallMs : 0.0) << " fps";
+    if(slowest >= 0) {
+        cout << ", bound by " << pipeStageNames[slowest] << " at " << 1000.0 / slowestMs << " fps";
+    }
+    cout << ", " << displayDrops << " frames not displayed" << endl;
+}
+
+/* run the stages until the camera stops, 'x' in the window or a signal */
+int runPipeline( VideoCapture& capture, const matchRef_t& ref,
+                 Ptr<FeatureDetector>& detector, Ptr<DescriptorExtractor>& descriptorExtractor,
+                 Ptr<DescriptorMatcher>& descriptorMatcher, bool display )
+{
+    static rtStats_t stats;
+    pipeQueue_t toDetect(PIPE_QUEUE_DEPTH), toDescribe(PIPE_QUEUE_DEPTH), toMatch(PIPE_QUEUE_DEPTH);
+    pipeQueue_t toRansac(PIPE_QUEUE_DEPTH), toDisplay(PIPE_DISPLAY_DEPTH);
+    struct timespec startTime, stopTime, deltaTime;
+
+    rtstats_init(&stats);
+    for(int s = 0; s < PIPE_NUM_STAGES; ++s) {
+        rtstats_add_stage(&stats, pipeStageNames[s], 0.0, 0.0);
+    }
+    if(rtstats_serve(&stats, PIPE_STATS_SOCK_PATH, PIPE_STATS_INTERVAL_MS) != 0) {
+        cerr << "stage statistics not served on " << PIPE_STATS_SOCK_PATH << endl;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    /* a static scene is matched once; unchanged frames never enter the pipeline */
+    changeGate_t gate;
+    uint64_t unchanged = 0;
+    bool gated = gUseGate &&
+                 (cg_init(&gate, REF_IMG_COLS, REF_IMG_ROWS, 3, CG_DEFAULT_TILE, CG_DEFAULT_THRESHOLD) == 0);
+
+    thread captureThread([&]() {
+        struct timespec start;
+        int seq = 0;
+        uint32_t framesRead = 0;
+        while(!gStop) {
+            pipeFrame_t *frame = new pipeFrame_t();
+            Mat camImg;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            capture >> camImg;
+            if(camImg.empty()) {
+                delete frame;
+                break;
+            }
+            sourceFrame(capture, start, framesRead++, frame);
+            refFrame(camImg, frame->img, frame->pyr);
+            if(gated && cg_matches(&gate, frame->img.cols, frame->img.rows, frame->img.channels()) &&
+               (cg_update(&gate, frame->img.ptr(), frame->img.step) == 0)) {
+                ++unchanged;
+                delete frame;
+                continue;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &frame->captured);
+            rtstats_record(&stats, PIPE_CAPTURE, &start, &frame->captured);
+            frame->seq = seq++;
+            frame->best = -1;
+            if(!toDetect.push(frame)) {
+                delete frame;
+                break;
+            }
+        }
+        toDetect.close();
+    });
+    thread detectThread([&]() {
+        pipeStage(&stats, PIPE_DETECT, toDetect, &toDescribe, false, [&](pipeFrame_t *frame) {
+            detector->detect(frame->img, frame->keypoints2);
+        });
+    });
+    thread describeThread([&]() {
+        pipeStage(&stats, PIPE_DESCRIBE, toDescribe, &toMatch, false, [&](pipeFrame_t *frame) {
+            descriptorExtractor->compute(frame->img, frame->keypoints2, frame->descriptors2);
+        });
+    });
+    thread matchThread([&]() {
+        pipeStage(&stats, PIPE_MATCH, toMatch, &toRansac, false, [&](pipeFrame_t *frame) {
+            pipeMatch(ref, descriptorMatcher, frame);
+        });
+    });
+    thread ransacThread([&]() {
+        pipeStage(&stats, PIPE_RANSAC, toRansac, display ? &toDisplay : NULL, true, [&](pipeFrame_t *frame) {
+            struct timespec done;
+            pipeRansac(ref, frame);
+            clock_gettime(CLOCK_MONOTONIC, &done);
+            rtstats_record(&stats, PIPE_FRAME, &frame->captured, &done);
+            if(ft_enabled(&gTrace)) {
+                ft_record(&gTrace, frame->frame, &frame->released, &done, resultChecksum(frame));
+            }
+        });
+    });
+
+    /* highgui stays on the main thread */
+    if(display) {
+        pipeFrame_t *frame;
+        struct timespec start, end;
+        Mat drawImg;
+        while(toDisplay.pop(frame)) {
+            if(!gStop) {
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                pipeDraw(ref, frame, drawImg);
+                imshow(winName, drawImg);
+                char c = waitKey(1);
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                rtstats_record(&stats, PIPE_DISPLAY, &start, &end);
+                if(c == 'x') {
+                    imwrite("prob4.jpg", drawImg);
+                    gStop = true;
+                }
+            }
+            delete frame;
+        }
+    }
+
+    captureThread.join();
+    detectThread.join();
+    describeThread.join();
+    matchThread.join();
+    ransacThread.join();
+    clock_gettime(CLOCK_MONOTONIC, &stopTime);
+    calc_dt(&stopTime, &startTime, &deltaTime);
+
+    pipeReport(&stats, TIMESPEC_TO_mSEC(deltaTime), toDisplay.dropped());
+    rtstats_destroy(&stats);
+    if(gated) {
+        cout << unchanged << " unchanged frames skipped" << endl;
+        cg_destroy(&gate);
+    }
+    return 0;
+}
+
+/* tracking mode: keyframes take the full detect/describe/match/RANSAC path
+ * (the pipeline's stage functions, run in line), the frames in between only
+ * optical flow and a homography refit over the keyframe's inliers */
+
+enum { TRACK_STAGE_KEYFRAME = 0, TRACK_STAGE_TRACK, TRACK_STAGE_DISPLAY, TRACK_NUM_STAGES };
+static const char *trackStageNames[TRACK_NUM_STAGES] = { "keyframe", "track", "display" };
+
+/* start tracking the winner's inliers, if the keyframe found one confidently */
+static void seedTracker( HomographyTracker& tracker, const pipeFrame_t& frame )
+{
+    vector<Point2f> refPoints, framePoints;
+
+    if(frame.best < 0) {
+        return;
+    }
+    const pipeCandidate_t& cand = frame.candidates[frame.best];
+    for(size_t i = 0; i < cand.mask.size(); ++i) {
+        if(cand.mask[i]) {
+            refPoints.push_back(cand.keypoints1[cand.matches[i].queryIdx].pt);
+            framePoints.push_back(frame.keypoints2[cand.matches[i].trainIdx].pt);
+        }
+    }
+    tracker.start(frame.img, refPoints, framePoints, cand.H12, cand.obj);
+}
+
+/* the tracked correspondences as a one-candidate frame, for drawing */
+static void trackedFrame( const HomographyTracker& tracker, pipeFrame_t& frame )
+{
+    frame.candidates.resize(1);
+    frame.best = 0;
+    pipeCandidate_t& cand = frame.candidates[0];
+    cand.obj = tracker.object();
+    KeyPoint::convert(tracker.referencePoints(), cand.keypoints1);
+    KeyPoint::convert(tracker.framePoints(), frame.keypoints2);
+    cand.matches.resize(cand.keypoints1.size());
+    for(size_t i = 0; i < cand.matches.size(); ++i) {
+        cand.matches[i] = DMatch((int)i, (int)i, 0.0f);
+    }
+    cand.mask.assign(cand.matches.size(), 1);
+    cand.H12 = tracker.homography();
+    cand.inliers = (int)cand.matches.size();
+}
+
+int runTracking( VideoCapture& capture, const matchRef_t& ref,
+                 Ptr<FeatureDetector>& detector, Ptr<DescriptorExtractor>& descriptorExtractor,
+                 Ptr<DescriptorMatcher>& descriptorMatcher, bool display )
+{
+    static rtStats_t stats;
+    static char text[RTSTATS_TEXT_LEN];
+    HomographyTracker tracker;
+    pipeFrame_t frame;
+    Mat drawImg;
+    int keyframes = 0, tracked = 0;
+    struct timespec startTime, stopTime, deltaTime, start, end;
+
+    rtstats_init(&stats);
+    for(int s = 0; s < TRACK_NUM_STAGES; ++s) {
+        rtstats_add_stage(&stats, trackStageNames[s], 0.0, 0.0);
+    }
+    if(rtstats_serve(&stats, PIPE_STATS_SOCK_PATH, PIPE_STATS_INTERVAL_MS) != 0) {
+        cerr << "stage statistics not served on " << PIPE_STATS_SOCK_PATH << endl;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    for(frame.seq = 0; !gStop; ++frame.seq) {
+        Mat camImg;
+        capture >> camImg;
+        if(camImg.empty()) {
+            break;
+        }
+        refFrame(camImg, frame.img, frame.pyr);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if(tracker.active() && tracker.track(frame.img, ref.ransacReprojThreshold)) {
+            trackedFrame(tracker, frame);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            rtstats_record(&stats, TRACK_STAGE_TRACK, &start, &end);
+            ++tracked;
+        } else {
+            detector->detect(frame.img, frame.keypoints2);
+            descriptorExtractor->compute(frame.img, frame.keypoints2, frame.descriptors2);
+            pipeMatch(ref, descriptorMatcher, &frame);
+            pipeRansac(ref, &frame);
+            seedTracker(tracker, frame);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            rtstats_record(&stats, TRACK_STAGE_KEYFRAME, &start, &end);
+            ++keyframes;
+        }
+
+        if(display) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            pipeDraw(ref, &frame, drawImg);
+            imshow(winName, drawImg);
+            char c = waitKey(1);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            rtstats_record(&stats, TRACK_STAGE_DISPLAY, &start, &end);
+            if(c == 'x') {
+                imwrite("prob4.jpg", drawImg);
+                break;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stopTime);
+    calc_dt(&stopTime, &startTime, &deltaTime);
+
+    float wallMs = TIMESPEC_TO_mSEC(deltaTime);
+    rtstats_format(&stats, text, sizeof(text));
+    cout << text;
+    cout << keyframes + tracked << " frames (" << keyframes << " keyframes, " << tracked
+         << " tracked) in " << wallMs << " msec, "
+         << (wallMs > 0.0f ? 1000.0f * (keyframes + tracked) / wallMs : 0.0f) << " fps" << endl;
+    rtstats_destroy(&stats);
+    return 0;
+}
+
+/* batch mode: every frame of a file input through the full path, in order
+ * and without a window, for benchmarks and regression runs off camera */
+
+typedef struct {
+    int frame;
+    int object;                       /* -1: single reference or none found */
+    int keypoints;
+    int matches;
+    int inliers;
+    float detectMs;
+    float describeMs;
+    float matchMs;
+    float ransacMs;
+    float totalMs;
+} batchRow_t;
+
+static const char *batchHeader =
+    "frame,object,keypoints,matches,inliers,detect_ms,describe_ms,match_ms,ransac_ms,total_ms";
+
+static float msecSince( struct timespec *start )
+{
+    struct timespec now, delta;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    calc_dt(&now, start, &delta);
+    *start = now;
+    return TIMESPEC_TO_mSEC(delta);
+}
+
+static void writeBatchRow( ostream& out, const batchRow_t& row )
+{
+    out << row.frame << "," << row.object << "," << row.keypoints << "," << row.matches << ","
+        << row.inliers << "," << row.detectMs << "," << row.describeMs << "," << row.matchMs << ","
+        << row.ransacMs << "," << row.totalMs << "\n";
+}
+
+static bool readBatchRows( const string& path, vector<batchRow_t>& rows )
+{
+    ifstream in(path.c_str());
+    string line;
+
+    if(!in) {
+        cerr << "can not read baseline " << path << endl;
+        return false;
+    }
+    rows.clear();
+    while(getline(in, line)) {
+        batchRow_t row;
+        if(sscanf(line.c_str(), "%d,%d,%d,%d,%d,%f,%f,%f,%f,%f", &row.frame, &row.object,
+                  &row.keypoints, &row.matches, &row.inliers, &row.detectMs, &row.describeMs,
+                  &row.matchMs, &row.ransacMs, &row.totalMs) == 10) {
+            rows.push_back(row);
+        }
+    }
+    return true;
+}
+
+static float medianTotalMs( const vector<batchRow_t>& rows )
+{
+    vector<float> totals;
+
+    for(size_t i = 0; i < rows.size(); ++i) {
+        totals.push_back(rows[i].totalMs);
+    }
+    if(totals.empty()) {
+        return 0.0f;
+    }
+    nth_element(totals.begin(), totals.begin() + totals.size() / 2, totals.end());
+    return totals[totals.size() / 2];
+}
+
+/* regressions against the baseline, each reported; 0 if none */
+static int compareBatch( const vector<batchRow_t>& rows, const vector<batchRow_t>& base )
+{
+    int regressions = 0;
+
+    if(rows.size() != base.size()) {
+        cerr << "regression: " << rows.size() << " frames, baseline has " << base.size() << endl;
+        ++regressions;
+    }
+    for(size_t i = 0; i < min(rows.size(), base.size()); ++i) {
+        int minInliers = base[i].inliers - max(BATCH_INLIER_SLACK, (int)(BATCH_INLIER_TOLERANCE * base[i].inliers));
+        if(rows[i].object != base[i].object) {
+            cerr << "regression: frame " << rows[i].frame << " matched object " << rows[i].object
+                 << ", baseline " << base[i].object << endl;
+            ++regressions;
+        } else if(rows[i].inliers < minInliers) {
+            cerr << "regression: frame " << rows[i].frame << " has " << rows[i].inliers
+                 << " inliers, baseline " << base[i].inliers << endl;
+            ++regressions;
+        }
+    }
+    float median = medianTotalMs(rows), baseMedian = medianTotalMs(base);
+    if(median > BATCH_TIME_TOLERANCE * baseMedian) {
+        cerr << "regression: median frame " << median << " msec, baseline " << baseMedian << " msec" << endl;
+        ++regressions;
+    }
+    return regressions;
+}
+
+int runBatch( VideoCapture& capture, const matchRef_t& ref,
+              Ptr<FeatureDetector>& detector, Ptr<DescriptorExtractor>& descriptorExtractor,
+              Ptr<DescriptorMatcher>& descriptorMatcher, const string& csvPath, const string& baselinePath )
+{
+    vector<batchRow_t> rows, base;
+    pipeFrame_t frame;
+    struct timespec start, frameStart, readStart;
+    float maxDt = 0.0f, cumDt = 0.0f;
+
+    if(!baselinePath.empty() && !readBatchRows(baselinePath, base)) {
+        return -1;
+    }
+    ofstream csvFile;
+    if(!csvPath.empty()) {
+        csvFile.open(csvPath.c_str());
+        if(!csvFile) {
+            cerr << "can not write " << csvPath << endl;
+            return -1;
+        }
+    }
+    ostream& csv = csvPath.empty() ? cout : csvFile;
+    csv << batchHeader << "\n";
+
+    gRansacThreads = 1;
+    for(frame.seq = 0; !gStop; ++frame.seq) {
+        Mat camImg;
+        clock_gettime(CLOCK_MONOTONIC, &readStart);
+        capture >> camImg;
+        if(camImg.empty()) {
+            break;
+        }
+        sourceFrame(capture, readStart, (uint32_t)frame.seq, &frame);
+        refFrame(camImg, frame.img, frame.pyr);
+
+        batchRow_t row;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        frameStart = start;
+        detector->detect(frame.img, frame.keypoints2);
+        row.detectMs = msecSince(&start);
+        descriptorExtractor->compute(frame.img, frame.keypoints2, frame.descriptors2);
+        row.describeMs = msecSince(&start);
+        pipeMatch(ref, descriptorMatcher, &frame);
+        row.matchMs = msecSince(&start);
+        pipeRansac(ref, &frame);
+        row.ransacMs = msecSince(&start);
+        row.totalMs = msecSince(&frameStart);
+        if(ft_enabled(&gTrace)) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            ft_record(&gTrace, frame.frame, &frame.released, &start, resultChecksum(&frame));
+        }
+
+        row.frame = frame.seq;
+        row.keypoints = (int)frame.keypoints2.size();
+        row.object = -1;
+        row.matches = 0;
+        row.inliers = 0;
+        if(frame.best >= 0) {
+            row.object = frame.candidates[frame.best].obj;
+            row.matches = (int)frame.candidates[frame.best].matches.size();
+            row.inliers = frame.candidates[frame.best].inliers;
+        }
+        writeBatchRow(csv, row);
+        rows.push_back(row);
+        maxDt = max(maxDt, row.totalMs);
+        cumDt += row.totalMs;
+    }
+    csv.flush();
+
+    if(rows.empty()) {
+        cerr << "no frames read" << endl;
+        return -1;
+    }
+    cerr << rows.size() << " frames, avg: " << cumDt / rows.size() << " msec, median: "
+         << medianTotalMs(rows) << " msec, max: " << maxDt << " msec" << endl;
+    if(base.empty()) {
+        return 0;
+    }
+    int regressions = compareBatch(rows, base);
+    cerr << (regressions ? "FAIL: " : "PASS: ") << regressions << " regressions against "
+         << baselinePath << endl;
+    return regressions ? 1 : 0;
+}
+
 int main(int argc, char** argv)
 {
-    if(argc != 8) {
+    fa_register_source();
+    if((argc < 8) || (argc > 10)) {
     	help(argv);
         return -1;
     }
+    int mode = MODE_SEQUENTIAL;
+    if(argc >= 9) {
+        mode = getRunMode(argv[8]);
+        if(mode < 0) {
+            help(argv);
+            return -1;
+        }
+    }
+    if(argc == 10) {
+        string gateArg = argv[9];
+        if((gateArg != "0") && (gateArg != "1")) {
+            help(argv);
+            return -1;
+        }
+        gUseGate = (gateArg == "1");
+    }
     double ransacReprojThreshold = atof(argv[7]);
     ransacReprojThreshold = ransacReprojThreshold < 0 ? 0 : ransacReprojThreshold;
 
@@ -163,48 +1118,164 @@ int main(int argc, char** argv)
       detector = cv::xfeatures2d::SIFT::create();
       descriptorExtractor = cv::xfeatures2d::SIFT::create();
     }
-    Ptr<DescriptorMatcher> descriptorMatcher = DescriptorMatcher::create(argv[3]);
+    /* KdForest[:checks] selects the k-d forest, anything else an OpenCV matcher */
+    string matcherName = argv[3];
+    bool useAnn = (matcherName.compare(0, strlen(ANN_MATCHER_NAME), ANN_MATCHER_NAME) == 0);
+    int annChecks = ANN_DEFAULT_CHECKS;
+    Ptr<DescriptorMatcher> descriptorMatcher;
+    if(useAnn) {
+        size_t colon = matcherName.find(':');
+        if(colon != string::npos) {
+            /* a positive count, or -1 for an exact search */
+            const char *checks = matcherName.c_str() + colon + 1;
+            char *end;
+            long n = strtol(checks, &end, 10);
+            if((end == checks) || (*end != '\0') || ((n <= 0) && (n != ANN_EXACT)) || (n > INT_MAX)) {
+                help(argv);
+                return -1;
+            }
+            annChecks = (int)n;
+        }
+    } else {
+        descriptorMatcher = DescriptorMatcher::create(matcherName);
+    }
 
-    if(detector.empty() || descriptorExtractor.empty() || descriptorMatcher.empty()) {
+    if(detector.empty() || descriptorExtractor.empty() || (!useAnn && descriptorMatcher.empty())) {
         cout << "Can not create detector or descriptor exstractor or descriptor matcher of given types" << endl;
         return -1;
     }
     int mactherFilterType = getMatcherFilterType(argv[4]);
-		
-    Mat img1 = imread(argv[5]);
-    resize(img1, img1, Size(640, 480));
-    
-    if(img1.empty()) {
-        cout << "Can not read images" << endl;
-        return -1;
-    }
 
-    /* get keypoints and descriptor of object of interest */
+    /* reference objects: a prebuilt database maps in without any
+     * extraction, a single image is described here */
+    string refName = argv[5];
+    bool useDb = (refName.size() > 3) && (refName.compare(refName.size() - 3, 3, ".db") == 0);
+    DescDb db;
+    Mat img1;
     vector<KeyPoint> keypoints1;
-    detector->detect( img1, keypoints1 );
     Mat descriptors1;
-    descriptorExtractor->compute( img1, keypoints1, descriptors1 );
+    KdForest index1;
+    struct timespec startTime, stopTime, deltaTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    if(useDb) {
+        if(!db.open(refName)) {
+            return -1;
+        }
+    } else {
+        img1 = imread(refName);
+        if(img1.empty()) {
+            cout << "Can not read images" << endl;
+            return -1;
+        }
+        resize(img1, img1, Size(REF_IMG_COLS, REF_IMG_ROWS));
 
-    namedWindow(winName, 1);
+        /* get keypoints and descriptor of object of interest */
+        detector->detect( img1, keypoints1 );
+        descriptorExtractor->compute( img1, keypoints1, descriptors1 );
+        if(useAnn) {
+            buildForest(descriptors1, index1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stopTime);
+    calc_dt(&stopTime, &startTime, &deltaTime);
+    /* batch mode may write its CSV to stdout */
+    ostream& info = (mode == MODE_BATCH) ? cerr : cout;
+    info << "reference " << (useDb ? "database" : "image") << " ready in "
+         << TIMESPEC_TO_mSEC(deltaTime) << " msec";
+    if(useDb) {
+        info << ", " << db.numObjects() << " objects";
+    }
+    info << endl;
 
-    cout << "enter 'x' to exit\n\r";
-    struct timespec startTime, stopTime, deltaTime;
-    float maxDt, cumDt;
+    if((mode == MODE_HEADLESS) || (mode == MODE_BATCH)) {
+        info << "send SIGINT to exit\n\r";
+    } else {
+        namedWindow(winName, 1);
+        cout << "enter 'x' to exit\n\r";
+    }
+
+    float maxDt = 0.0f, cumDt = 0.0f;
     int cnt = 1;
     Mat readImg, drawImg;
-    VideoCapture capture;
-    if(!capture.open(0)) {
-      cout << "failed to open camera\n";
+    changeGate_t gate;
+    bool gated = gUseGate &&
+                 (cg_init(&gate, REF_IMG_COLS, REF_IMG_ROWS, 3, CG_DEFAULT_TILE, CG_DEFAULT_THRESHOLD) == 0);
+    ReplayCapture capture;
+    string input = argv[6];
+    bool opened = (input == "cam") ? capture.open(0) : capture.open(input);
+    if(!opened) {
+      cout << "failed to open " << ((input == "cam") ? string("camera") : input) << "\n";
       return -1;
     }
 
+    if(mode != MODE_SEQUENTIAL) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = stopHandler;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+
+        matchRef_t ref;
+        ref.db = useDb ? &db : NULL;
+        ref.img1 = &img1;
+        ref.keypoints1 = &keypoints1;
+        ref.descriptors1 = &descriptors1;
+        ref.index1 = useAnn ? &index1 : NULL;
+        ref.useAnn = useAnn;
+        ref.annChecks = annChecks;
+        ref.matcherFilter = mactherFilterType;
+        ref.ransacReprojThreshold = ransacReprojThreshold;
+        if(ft_open(&gTrace, "descriptor_extractor_matcher") < 0) {
+            return -1;
+        }
+        int rc;
+        if(mode == MODE_TRACKING) {
+            rc = runTracking(capture, ref, detector, descriptorExtractor, descriptorMatcher, true);
+        } else if(mode == MODE_BATCH) {
+            /* batch:results.csv:baseline.csv */
+            string opts = argv[8], csvPath, baselinePath;
+            size_t colon = opts.find(':');
+            if(colon != string::npos) {
+                csvPath = opts.substr(colon + 1);
+                colon = csvPath.find(':');
+                if(colon != string::npos) {
+                    baselinePath = csvPath.substr(colon + 1);
+                    csvPath.erase(colon);
+                }
+            }
+            rc = runBatch(capture, ref, detector, descriptorExtractor, descriptorMatcher,
+                          csvPath, baselinePath);
+        } else {
+            rc = runPipeline(capture, ref, detector, descriptorExtractor, descriptorMatcher,
+                             mode == MODE_PIPELINED);
+        }
+        if(capture.dropped() > 0) {
+            cerr << "replay skipped " << capture.dropped() << " frames the pipeline was too late for\n";
+        }
+        ft_close(&gTrace);
+        return rc;
+    }
+
+    pyramid_t *readPyr = NULL;
     while(1) {
-      capture >> readImg;
-      resize(readImg, readImg, Size(640,480));
+      Mat camImg;
+      capture >> camImg;
+      if(camImg.empty()) {
+        break;
+      }
+      refFrame(camImg, readImg, readPyr);
       clock_gettime(CLOCK_MONOTONIC, &startTime);    
-      doIteration( img1, readImg, keypoints1, descriptors1,
-              detector, descriptorExtractor, descriptorMatcher, mactherFilterType,
-              ransacReprojThreshold, drawImg);
+      if(gated && cg_matches(&gate, readImg.cols, readImg.rows, readImg.channels()) &&
+         (cg_update(&gate, readImg.ptr(), readImg.step) == 0) && !drawImg.empty()) {
+        /* nothing moved, the last result still holds */
+      } else if(useDb) {
+        doDbIteration( db, readImg, detector, descriptorExtractor, descriptorMatcher,
+                useAnn, annChecks, mactherFilterType, ransacReprojThreshold, drawImg);
+      } else {
+        doIteration( img1, readImg, keypoints1, descriptors1,
+                detector, descriptorExtractor, descriptorMatcher, useAnn ? &index1 : NULL, annChecks,
+                mactherFilterType, ransacReprojThreshold, drawImg);
+      }
       clock_gettime(CLOCK_MONOTONIC, &stopTime);
       calc_dt(&stopTime, &startTime, &deltaTime);
       float dt = TIMESPEC_TO_mSEC(deltaTime);
@@ -219,6 +1290,13 @@ int main(int argc, char** argv)
         break;
       }
     }
+    if(gated) {
+      cout << gate.unchangedFrames << " unchanged frames skipped" << endl;
+      cg_destroy(&gate);
+    }
+    if(readPyr != NULL) {
+      pyr_unref(readPyr);
+    }
     return 0;
 }
 
@@ -0,0 +1,129 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file framequeue.h
+ * @brief bounded blocking queue that connects the stages of a frame pipeline
+ *
+ * A producer blocks while the queue is full, so a slow stage holds back the
+ * ones upstream instead of letting frames pile up; tryPush() is for
+ * consumers that may lose frames (e.g. a display). close() is the end of
+ * stream: pushes fail from then on, and pop() fails once the queue is
+ * drained, so each stage can close its output when its input runs dry.
+ *
+ ************************************************************************************
+ */
+
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) :
+        capacity(capacity > 0 ? capacity : 1), closed(false), drops(0)
+    {
+    }
+
+    /**
+     * @brief append an item, waiting for room
+     *
+     * @return bool false if the queue is closed; the item was not queued
+     */
+    bool push(const T& item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notFull.wait(lock, [this] { return closed || (items.size() < capacity); });
+        if(closed) {
+            return false;
+        }
+        append(item);
+        return true;
+    }
+
+    /**
+     * @brief append an item if there is room right now
+     *
+     * @return bool false if the queue is full (counted as a drop) or closed
+     */
+    bool tryPush(const T& item)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(closed) {
+            return false;
+        }
+        if(items.size() >= capacity) {
+            ++drops;
+            return false;
+        }
+        append(item);
+        return true;
+    }
+
+    /**
+     * @brief take the oldest item, waiting for one
+     *
+     * @return bool false once the queue is closed and empty
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if(items.empty()) {
+            return false;
+        }
+        item = items.front();
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief end of stream; wakes every waiting producer and consumer
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    size_t dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return drops;
+    }
+
+private:
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+
+    /* caller holds mtx */
+    void append(const T& item)
+    {
+        items.push_back(item);
+        notEmpty.notify_one();
+    }
+
+    const size_t capacity;
+    mutable std::mutex mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T> items;
+    bool closed;
+    size_t drops;
+};
+
+#endif /* FRAMEQUEUE_H */
@@ -0,0 +1,455 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file homography.cpp
+ * @brief robust homography from point correspondences: PROSAC sampling,
+ * batched inlier counting, early termination and several threads
+ *
+ ************************************************************************************
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "homography.h"
+
+using namespace std;
+
+#define SAMPLE                        RANSAC_SAMPLE_SIZE
+#define MIN_SAMPLE_AREA               (1.0)   /* px^2; smaller triangles are collinear */
+#define MIN_PIVOT                     (1e-10)
+#define NONRANDOM_BETA                (0.05)  /* chance an outlier fits a wrong model */
+#define NONRANDOM_Z                   (2.33)  /* ~1% chance a wrong model passes */
+#define MAX_REFITS                    (4)
+
+/* correspondences in rank order, one array per coordinate so scoring loops
+ * vectorize */
+typedef struct {
+    int n;
+    float thresh2;
+    vector<float> xs, ys, xd, yd;
+} ransacData_t;
+
+/* best model so far, shared by the threads */
+typedef struct {
+    mutex lock;
+    double H[9];
+    atomic<int> count;
+    atomic<int> iterLimit;
+    vector<uint8_t> mask;         /* scratch for the stopping bound */
+} ransacBest_t;
+
+static unsigned int nextRandom(unsigned int& state)
+{
+    /* xorshift, seeded per iteration so a sample depends only on its index */
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/* solve the 8x8 system in the first 8 columns of A for the 9th, by
+ * Gaussian elimination with partial pivoting */
+static bool solve8(double A[8][9], double h[8])
+{
+    for(int c = 0; c < 8; ++c) {
+        int pivot = c;
+        for(int r = c + 1; r < 8; ++r) {
+            if(fabs(A[r][c]) > fabs(A[pivot][c])) {
+                pivot = r;
+            }
+        }
+        if(fabs(A[pivot][c]) < MIN_PIVOT) {
+            return false;
+        }
+        if(pivot != c) {
+            for(int k = c; k < 9; ++k) {
+                swap(A[c][k], A[pivot][k]);
+            }
+        }
+        for(int r = c + 1; r < 8; ++r) {
+            double f = A[r][c] / A[c][c];
+            for(int k = c; k < 9; ++k) {
+                A[r][k] -= f * A[c][k];
+            }
+        }
+    }
+    for(int r = 7; r >= 0; --r) {
+        double sum = A[r][8];
+        for(int k = r + 1; k < 8; ++k) {
+            sum -= A[r][k] * h[k];
+        }
+        h[r] = sum / A[r][r];
+    }
+    return true;
+}
+
+/* the two DLT rows of one correspondence, with h[8] fixed at 1 */
+static void dltRows(double x, double y, double u, double v, double r0[9], double r1[9])
+{
+    double a[9] = { x, y, 1.0, 0.0, 0.0, 0.0, -u * x, -u * y, u };
+    double b[9] = { 0.0, 0.0, 0.0, x, y, 1.0, -v * x, -v * y, v };
+
+    memcpy(r0, a, sizeof(a));
+    memcpy(r1, b, sizeof(b));
+}
+
+static bool collinear(const float *x, const float *y, int a, int b, int c)
+{
+    double area = (x[b] - x[a]) * (double)(y[c] - y[a]) - (y[b] - y[a]) * (double)(x[c] - x[a]);
+    return fabs(area) < MIN_SAMPLE_AREA;
+}
+
+/* exact homography through four correspondences */
+static bool minimalHomography(const ransacData_t& d, const int idx[SAMPLE], double H[9])
+{
+    const float *xs = d.xs.data(), *ys = d.ys.data(), *xd = d.xd.data(), *yd = d.yd.data();
+    double A[8][9];
+
+    for(int i = 0; i < SAMPLE; ++i) {
+        for(int j = i + 1; j < SAMPLE; ++j) {
+            for(int k = j + 1; k < SAMPLE; ++k) {
+                if(collinear(xs, ys, idx[i], idx[j], idx[k]) || collinear(xd, yd, idx[i], idx[j], idx[k])) {
+                    return false;
+                }
+            }
+        }
+    }
+    for(int i = 0; i < SAMPLE; ++i) {
+        int p = idx[i];
+        dltRows(xs[p], ys[p], xd[p], yd[p], A[2 * i], A[2 * i + 1]);
+    }
+    if(!solve8(A, H)) {
+        return false;
+    }
+    H[8] = 1.0;
+    return true;
+}
+
+/* inliers of H among points [first, last); division-free:
+ * |H*s - d*w|^2 <= t^2 * w^2 */
+static inline int countRange(const ransacData_t& d, const float h[9], int first, int last, uint8_t *mask)
+{
+    const float *xs = d.xs.data(), *ys = d.ys.data(), *xd = d.xd.data(), *yd = d.yd.data();
+    int count = 0;
+
+    for(int i = first; i < last; ++i) {
+        float w = h[6] * xs[i] + h[7] * ys[i] + h[8];
+        float ex = h[0] * xs[i] + h[1] * ys[i] + h[2] - xd[i] * w;
+        float ey = h[3] * xs[i] + h[4] * ys[i] + h[5] - yd[i] * w;
+        int in = (ex * ex + ey * ey) <= d.thresh2 * w * w;
+        if(mask != NULL) {
+            mask[i] = (uint8_t)in;
+        }
+        count += in;
+    }
+    return count;
+}
+
+/* inliers of H, or -1 as soon as it cannot beat toBeat */
+static int countInliers(const ransacData_t& d, const double H[9], int toBeat)
+{
+    float h[9];
+    int count = 0;
+
+    for(int i = 0; i < 9; ++i) {
+        h[i] = (float)H[i];
+    }
+    for(int b = 0; b < d.n; b += RANSAC_BATCH) {
+        int e = min(b + RANSAC_BATCH, d.n);
+        count += countRange(d, h, b, e, NULL);
+        if(count + (d.n - e) <= toBeat) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+static int inlierMask(const ransacData_t& d, const double H[9], uint8_t *mask)
+{
+    float h[9];
+
+    for(int i = 0; i < 9; ++i) {
+        h[i] = (float)H[i];
+    }
+    return countRange(d, h, 0, d.n, mask);
+}
+
+/* hypotheses needed to draw an all-inlier sample with this confidence */
+static int requiredIters(double confidence, int inliers, int n, int maxIters)
+{
+    double w = (double)inliers / n;
+    double p = pow(w, SAMPLE);
+
+    if(p >= 1.0) {
+        return 1;
+    }
+    if(p <= 0.0) {
+        return maxIters;
+    }
+    double k = log(1.0 - confidence) / log(1.0 - p);
+    return (k >= maxIters) ? maxIters : max((int)ceil(k), 1);
+}
+
+/* PROSAC stopping bound: the fewest hypotheses that give the confidence
+ * for any prefix of the ranking whose inlier count could not come from a
+ * wrong model (binomial tail, normal approximation). With good matches
+ * ranked first this stops long before the bound over all points would */
+static int prosacIters(const uint8_t *mask, int n, double confidence, int maxIters)
+{
+    int limit = maxIters, inliers = 0;
+
+    for(int k = 0; k < n; ++k) {
+        inliers += mask[k];
+        int size = k + 1;
+        if(size < 2 * SAMPLE) {
+            continue;
+        }
+        double mu = (size - SAMPLE) * NONRANDOM_BETA;
+        double sigma = sqrt(mu * (1.0 - NONRANDOM_BETA));
+        if(inliers >= SAMPLE + mu + NONRANDOM_Z * sigma) {
+            limit = min(limit, requiredIters(confidence, inliers, size, maxIters));
+        }
+    }
+    return limit;
+}
+
+/* PROSAC growth schedule: the subset grows to the best n points at
+ * iteration growAt[n] (Chum and Matas, T'_n) */
+static void prosacSchedule(int n, int maxIters, vector<int>& growAt)
+{
+    double Tn = maxIters;
+
+    growAt.assign(n + 1, 0);
+    for(int i = 0; i < SAMPLE; ++i) {
+        Tn *= (double)(SAMPLE - i) / (n - i);
+    }
+    growAt[SAMPLE] = 1;
+    for(int k = SAMPLE; k < n; ++k) {
+        double Tnext = Tn * (k + 1) / (k + 1 - SAMPLE);
+        growAt[k + 1] = growAt[k] + max((int)ceil(Tnext - Tn), 1);
+        Tn = Tnext;
+    }
+}
+
+static void sampleWorker(const ransacData_t& d, const vector<int>& growAt, int first, int step,
+                         double confidence, int maxIters, unsigned int seed, ransacBest_t& best)
+{
+    int subset = SAMPLE;
+    int idx[SAMPLE];
+    double H[9];
+
+    for(int t = first; t <= best.iterLimit.load(memory_order_relaxed); t += step) {
+        while((subset < d.n) && (growAt[subset + 1] <= t)) {
+            ++subset;
+        }
+
+        /* the newest point of the subset plus three older ones, or, once the
+         * schedule has moved past it, any four of the subset */
+        unsigned int rng = (seed ^ ((unsigned int)t * 2654435761u)) | 1;
+        int numDrawn = 0, pool = subset;
+        if(t <= growAt[subset]) {
+            idx[numDrawn++] = subset - 1;
+            pool = subset - 1;
+        }
+        while(numDrawn < SAMPLE) {
+            int cand = (int)(nextRandom(rng) % pool);
+            bool dup = false;
+            for(int i = 0; i < numDrawn; ++i) {
+                dup = dup || (idx[i] == cand);
+            }
+            if(!dup) {
+                idx[numDrawn++] = cand;
+            }
+        }
+
+        if(!minimalHomography(d, idx, H)) {
+            continue;
+        }
+        int count = countInliers(d, H, best.count.load(memory_order_relaxed));
+        if(count < 0) {
+            continue;
+        }
+        lock_guard<mutex> guard(best.lock);
+        if(count > best.count.load(memory_order_relaxed)) {
+            memcpy(best.H, H, sizeof(H));
+            best.count.store(count, memory_order_relaxed);
+            inlierMask(d, H, best.mask.data());
+            int limit = prosacIters(best.mask.data(), d.n, confidence, maxIters);
+            if(limit < best.iterLimit.load(memory_order_relaxed)) {
+                best.iterLimit.store(limit, memory_order_relaxed);
+            }
+        }
+    }
+}
+
+/* least squares over the inliers, in coordinates normalized to a mean
+ * distance of sqrt(2) from the centroid for conditioning */
+static bool refitHomography(const ransacData_t& d, const uint8_t *mask, double H[9])
+{
+    double cs[2] = {0.0, 0.0}, cd[2] = {0.0, 0.0}, ss = 0.0, sd = 0.0;
+    int count = 0;
+
+    for(int i = 0; i < d.n; ++i) {
+        if(mask[i]) {
+            cs[0] += d.xs[i]; cs[1] += d.ys[i];
+            cd[0] += d.xd[i]; cd[1] += d.yd[i];
+            ++count;
+        }
+    }
+    if(count < SAMPLE) {
+        return false;
+    }
+    for(int k = 0; k < 2; ++k) {
+        cs[k] /= count;
+        cd[k] /= count;
+    }
+    for(int i = 0; i < d.n; ++i) {
+        if(mask[i]) {
+            ss += hypot(d.xs[i] - cs[0], d.ys[i] - cs[1]);
+            sd += hypot(d.xd[i] - cd[0], d.yd[i] - cd[1]);
+        }
+    }
+    if((ss <= 0.0) || (sd <= 0.0)) {
+        return false;
+    }
+    ss = M_SQRT2 * count / ss;
+    sd = M_SQRT2 * count / sd;
+
+    /* normal equations of the DLT rows */
+    double A[8][9];
+    double r[2][9];
+    memset(A, 0, sizeof(A));
+    for(int i = 0; i < d.n; ++i) {
+        if(!mask[i]) {
+            continue;
+        }
+        dltRows((d.xs[i] - cs[0]) * ss, (d.ys[i] - cs[1]) * ss,
+                (d.xd[i] - cd[0]) * sd, (d.yd[i] - cd[1]) * sd, r[0], r[1]);
+        for(int k = 0; k < 2; ++k) {
+            for(int a = 0; a < 8; ++a) {
+                for(int b = 0; b < 9; ++b) {
+                    A[a][b] += r[k][a] * r[k][b];
+                }
+            }
+        }
+    }
+    double h[9];
+    if(!solve8(A, h)) {
+        return false;
+    }
+    h[8] = 1.0;
+
+    /* undo the normalization: H = Td^-1 * Hn * Ts */
+    double Ts[9] = { ss, 0.0, -ss * cs[0], 0.0, ss, -ss * cs[1], 0.0, 0.0, 1.0 };
+    double TdInv[9] = { 1.0 / sd, 0.0, cd[0], 0.0, 1.0 / sd, cd[1], 0.0, 0.0, 1.0 };
+    double tmp[9], out[9];
+    for(int i = 0; i < 3; ++i) {
+        for(int j = 0; j < 3; ++j) {
+            tmp[3 * i + j] = h[3 * i] * Ts[j] + h[3 * i + 1] * Ts[3 + j] + h[3 * i + 2] * Ts[6 + j];
+        }
+    }
+    for(int i = 0; i < 3; ++i) {
+        for(int j = 0; j < 3; ++j) {
+            out[3 * i + j] = TdInv[3 * i] * tmp[j] + TdInv[3 * i + 1] * tmp[3 + j] + TdInv[3 * i + 2] * tmp[6 + j];
+        }
+    }
+    if(fabs(out[8]) < MIN_PIVOT) {
+        return false;
+    }
+    for(int i = 0; i < 9; ++i) {
+        H[i] = out[i] / out[8];
+    }
+    return true;
+}
+
+int ransacHomography(const float *src, const float *dst, const float *score, int n,
+                     double threshold, double H[9], uint8_t *mask,
+                     double confidence, int maxIters, int numThreads, unsigned int seed)
+{
+    if((n < SAMPLE) || (maxIters < 1)) {
+        return 0;
+    }
+
+    /* rank by score for PROSAC */
+    vector<int> order(n);
+    for(int i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    if(score != NULL) {
+        stable_sort(order.begin(), order.end(), [score](int a, int b) { return score[a] < score[b]; });
+    }
+    ransacData_t d;
+    d.n = n;
+    d.thresh2 = (float)(threshold * threshold);
+    d.xs.resize(n); d.ys.resize(n); d.xd.resize(n); d.yd.resize(n);
+    for(int i = 0; i < n; ++i) {
+        d.xs[i] = src[2 * order[i]];
+        d.ys[i] = src[2 * order[i] + 1];
+        d.xd[i] = dst[2 * order[i]];
+        d.yd[i] = dst[2 * order[i] + 1];
+    }
+
+    vector<int> growAt;
+    prosacSchedule(n, maxIters, growAt);
+    ransacBest_t best;
+    best.count.store(0);
+    best.iterLimit.store(maxIters);
+    best.mask.resize(n);
+
+    numThreads = max(1, min(numThreads, maxIters));
+    if(numThreads == 1) {
+        sampleWorker(d, growAt, 1, 1, confidence, maxIters, seed, best);
+    } else {
+        vector<thread> pool;
+        for(int t = 0; t < numThreads; ++t) {
+            pool.push_back(thread(sampleWorker, cref(d), cref(growAt), t + 1, numThreads,
+                                  confidence, maxIters, seed, ref(best)));
+        }
+        for(size_t t = 0; t < pool.size(); ++t) {
+            pool[t].join();
+        }
+    }
+    if(best.count.load() < SAMPLE) {
+        return 0;
+    }
+
+    /* refit over the inliers while that gains some, at most MAX_REFITS
+     * times; a refit that keeps the count is taken but ends it */
+    vector<uint8_t> ranked(n), refitRanked(n);
+    int count = inlierMask(d, best.H, ranked.data());
+    double refit[9];
+    for(int r = 0; (r < MAX_REFITS) && refitHomography(d, ranked.data(), refit); ++r) {
+        int refitCount = inlierMask(d, refit, refitRanked.data());
+        if(refitCount < count) {
+            break;
+        }
+        memcpy(best.H, refit, sizeof(refit));
+        ranked.swap(refitRanked);
+        bool gained = (refitCount > count);
+        count = refitCount;
+        if(!gained) {
+            break;
+        }
+    }
+
+    memcpy(H, best.H, sizeof(best.H));
+    if(mask != NULL) {
+        for(int i = 0; i < n; ++i) {
+            mask[order[i]] = ranked[i];
+        }
+    }
+    return count;
+}
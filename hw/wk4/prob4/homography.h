@@ -0,0 +1,69 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file homography.h
+ * @brief robust homography from point correspondences: PROSAC sampling,
+ * batched inlier counting, early termination and several threads
+ *
+ * - PROSAC: correspondences are ranked by a quality score (the match
+ *   distance) and hypotheses are drawn from a subset of the best ones that
+ *   grows over time, so a good model usually turns up within the first few
+ *   dozen samples instead of the hundreds uniform sampling needs at a high
+ *   outlier ratio.
+ * - Scoring runs over the points in structure-of-arrays batches that the
+ *   compiler vectorizes, without divisions, and abandons a hypothesis as
+ *   soon as it can no longer beat the best one.
+ * - Sampling stops once an all-inlier sample has been drawn with the
+ *   requested confidence, given the best inlier ratio so far.
+ * - Hypotheses are interleaved over threads, which share the best model
+ *   and the iteration bound.
+ * - The winner is refit by least squares over its inliers, again over
+ *   the new inliers while their number grows (a few times at most).
+ *
+ * The inlier mask comes back with the model, in the caller's point order.
+ * Plain float arrays in and out, so there is no OpenCV dependency; with
+ * more than one thread the result may vary from run to run, as the threads
+ * race to the stopping bound.
+ *
+ ************************************************************************************
+ */
+
+#ifndef HOMOGRAPHY_H
+#define HOMOGRAPHY_H
+
+#include <stdint.h>
+
+#define RANSAC_CONFIDENCE             (0.995)
+#define RANSAC_MAX_ITERS              (2000)
+#define RANSAC_SAMPLE_SIZE            (4)
+#define RANSAC_BATCH                  (64)    /* points scored between checks */
+
+/**
+ * @brief fit H mapping src to dst, dst ~ H * src
+ *
+ * @param src n points, interleaved x, y (e.g. a vector<Point2f>'s data)
+ * @param dst the corresponding points
+ * @param score per correspondence, lower is better (e.g. descriptor
+ *        distance); NULL to take the points as already ranked
+ * @param n number of correspondences
+ * @param threshold max reprojection error of an inlier, in pixels
+ * @param H row-major 3x3 result, H[8] = 1
+ * @param mask n entries, 1 for inliers; may be NULL
+ * @param confidence probability of having drawn an all-inlier sample
+ * @param maxIters hypotheses at most
+ * @param numThreads threads to split the hypotheses over
+ * @param seed random seed
+ * @return int number of inliers, 0 if no model was found (H untouched)
+ */
+int ransacHomography(const float *src, const float *dst, const float *score, int n,
+                     double threshold, double H[9], uint8_t *mask,
+                     double confidence = RANSAC_CONFIDENCE, int maxIters = RANSAC_MAX_ITERS,
+                     int numThreads = 1, unsigned int seed = 0);
+
+#endif /* HOMOGRAPHY_H */
@@ -0,0 +1,136 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file seqgen.cpp
+ * @brief synthesize a reproducible image sequence of a reference object for
+ * the matcher's batch mode
+ *
+ * The reference image, resized like the matcher resizes it, is warped onto a
+ * fixed clutter background along a smooth closed path (scale, rotation,
+ * translation and a little perspective), with sensor-like noise. The same
+ * reference, frame count and seed always give the same frames, so a
+ * baseline results file stays valid until the matcher changes. The true
+ * reference-to-frame homography of every frame goes to truth.csv.
+ *
+ ************************************************************************************
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include <fstream>
+#include <iostream>
+
+using namespace cv;
+using namespace std;
+
+#define REF_IMG_COLS              (640)
+#define REF_IMG_ROWS              (480)
+#define SEQ_DEFAULT_FRAMES        (100)
+#define SEQ_CLUTTER_SIGMA         (3.0)
+#define SEQ_NOISE_SIGMA           (4.0)
+
+void help(char** argv)
+{
+  cout << argv[0] << " [-n frames] [-s seed] [reference] [outdir]\n\n"
+  << "Writes outdir/frame_0000.png ... and outdir/truth.csv (frame,h0..h8, reference to\n"
+  << "frame homography) for ./descriptor_extractor_matcher ... outdir/frame_%04d.png 3 batch\n"
+  << "-n  frames (default " << SEQ_DEFAULT_FRAMES << ")\n"
+  << "-s  noise and clutter seed (default 1)" << endl;
+}
+
+/* frame t of n along the path, in reference pixel coordinates */
+static Mat pathHomography(int t, int n)
+{
+    double phase = 2.0 * M_PI * t / n;
+    double scale = 0.45 + 0.10 * sin(phase);
+    double angle = (12.0 * M_PI / 180.0) * sin(2.0 * phase);
+    double cx = REF_IMG_COLS / 2.0, cy = REF_IMG_ROWS / 2.0;
+
+    Mat center = (Mat_<double>(3, 3) << 1, 0, -cx, 0, 1, -cy, 0, 0, 1);
+    Mat tilt = (Mat_<double>(3, 3) << 1, 0, 0, 0, 1, 0, 2e-4 * sin(phase), 1e-4 * cos(phase), 1);
+    Mat rotScale = (Mat_<double>(3, 3) << scale * cos(angle), -scale * sin(angle), 0,
+                                          scale * sin(angle), scale * cos(angle), 0,
+                                          0, 0, 1);
+    Mat place = (Mat_<double>(3, 3) << 1, 0, cx + 60.0 * cos(phase), 0, 1, cy + 40.0 * sin(phase), 0, 0, 1);
+    Mat H = place * rotScale * tilt * center;
+    return H / H.at<double>(2, 2);
+}
+
+int main(int argc, char** argv)
+{
+    int numFrames = SEQ_DEFAULT_FRAMES;
+    unsigned int seed = 1;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:s:h")) != -1) {
+        switch(opt) {
+        case 'n': numFrames = atoi(optarg); break;
+        case 's': seed = (unsigned int)atoi(optarg); break;
+        default:
+            help(argv);
+            return -1;
+        }
+    }
+    if((argc - optind != 2) || (numFrames <= 0)) {
+        help(argv);
+        return -1;
+    }
+    string outDir = argv[optind + 1];
+
+    Mat ref = imread(argv[optind]);
+    if(ref.empty()) {
+        cout << "Can not read image " << argv[optind] << endl;
+        return -1;
+    }
+    resize(ref, ref, Size(REF_IMG_COLS, REF_IMG_ROWS));
+
+    RNG rng(seed);
+    Mat clutter(REF_IMG_ROWS, REF_IMG_COLS, CV_8UC3);
+    rng.fill(clutter, RNG::UNIFORM, 0, 256);
+    GaussianBlur(clutter, clutter, Size(0, 0), SEQ_CLUTTER_SIGMA);
+
+    ofstream truth((outDir + "/truth.csv").c_str());
+    if(!truth) {
+        cout << "can not write to " << outDir << endl;
+        return -1;
+    }
+    truth << "frame,h0,h1,h2,h3,h4,h5,h6,h7,h8\n";
+    truth.precision(9);
+
+    Mat frame, noisy, noise(REF_IMG_ROWS, REF_IMG_COLS, CV_16SC3);
+    char name[64];
+    for(int t = 0; t < numFrames; ++t) {
+        Mat H = pathHomography(t, numFrames);
+        frame = clutter.clone();
+        warpPerspective(ref, frame, H, frame.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+        rng.fill(noise, RNG::NORMAL, 0, SEQ_NOISE_SIGMA);
+        frame.convertTo(noisy, CV_16SC3);
+        noisy += noise;
+        noisy.convertTo(frame, CV_8UC3);
+
+        snprintf(name, sizeof(name), "/frame_%04d.png", t);
+        if(!imwrite(outDir + name, frame)) {
+            cout << "can not write " << outDir + name << endl;
+            return -1;
+        }
+        truth << t;
+        for(int i = 0; i < 9; ++i) {
+            truth << "," << H.at<double>(i / 3, i % 3);
+        }
+        truth << "\n";
+    }
+    cout << "wrote " << numFrames << " frames to " << outDir << endl;
+    return 0;
+}
@@ -0,0 +1,131 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file tracker.cpp
+ * @brief follow a matched object from frame to frame with pyramidal
+ * Lucas-Kanade optical flow instead of detecting and matching again
+ *
+ ************************************************************************************
+ */
+
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/video/video.hpp"
+
+#include "homography.h"
+#include "tracker.h"
+
+using namespace cv;
+using namespace std;
+
+HomographyTracker::HomographyTracker() :
+    isActive(false), obj(-1), numTracked(0), keyframeInliers(0)
+{
+}
+
+void HomographyTracker::buildPyramid(const Mat& frame, vector<Mat>& pyramid)
+{
+    if(frame.channels() == 1) {
+        gray = frame;
+    } else {
+        cvtColor(frame, gray, COLOR_BGR2GRAY);
+    }
+    buildOpticalFlowPyramid(gray, pyramid, Size(TRACK_WIN_SIZE, TRACK_WIN_SIZE), TRACK_PYR_LEVELS);
+}
+
+bool HomographyTracker::start(const Mat& frame, const vector<Point2f>& refPoints,
+                              const vector<Point2f>& framePoints, const Mat& H, int refObj)
+{
+    stop();
+    if(H.empty() || (refPoints.size() != framePoints.size()) || (refPoints.size() < TRACK_START_INLIERS)) {
+        return false;
+    }
+    buildPyramid(frame, prevPyr);
+    refPts = refPoints;
+    framePts = framePoints;
+    H12 = H.clone();
+    obj = refObj;
+    keyframeInliers = refPts.size();
+    isActive = true;
+    return true;
+}
+
+bool HomographyTracker::track(const Mat& frame, double ransacReprojThreshold)
+{
+    if(!isActive) {
+        return false;
+    }
+    if(++numTracked > TRACK_MAX_FRAMES) {
+        stop();
+        return false;
+    }
+
+    buildPyramid(frame, nextPyr);
+    vector<Point2f> nextPts;
+    vector<uchar> status;
+    vector<float> err;
+    calcOpticalFlowPyrLK(prevPyr, nextPyr, framePts, nextPts, status, err,
+                         Size(TRACK_WIN_SIZE, TRACK_WIN_SIZE), TRACK_PYR_LEVELS);
+    prevPyr.swap(nextPyr);
+
+    /* keep what the flow found, then what agrees with one homography */
+    size_t kept = 0;
+    for(size_t i = 0; i < nextPts.size(); ++i) {
+        if(status[i]) {
+            refPts[kept] = refPts[i];
+            framePts[kept] = nextPts[i];
+            ++kept;
+        }
+    }
+    refPts.resize(kept);
+    framePts.resize(kept);
+    if(kept < TRACK_MIN_POINTS) {
+        stop();
+        return false;
+    }
+
+    double H[9];
+    vector<uint8_t> inlierMask(kept);
+    if(ransacHomography(&refPts[0].x, &framePts[0].x, NULL, (int)kept, ransacReprojThreshold,
+                        H, inlierMask.data()) == 0) {
+        stop();
+        return false;
+    }
+    kept = 0;
+    for(size_t i = 0; i < refPts.size(); ++i) {
+        if(inlierMask[i]) {
+            refPts[kept] = refPts[i];
+            framePts[kept] = framePts[i];
+            ++kept;
+        }
+    }
+    refPts.resize(kept);
+    framePts.resize(kept);
+    H12 = Mat(3, 3, CV_64F, H).clone();
+    if((kept < TRACK_MIN_POINTS) || (inlierRatio() < TRACK_MIN_INLIER_RATIO)) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void HomographyTracker::stop()
+{
+    isActive = false;
+    numTracked = 0;
+    keyframeInliers = 0;
+    refPts.clear();
+    framePts.clear();
+    prevPyr.clear();
+    H12.release();
+}
+
+double HomographyTracker::inlierRatio() const
+{
+    return keyframeInliers ? (double)refPts.size() / keyframeInliers : 0.0;
+}
@@ -0,0 +1,94 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file tracker.h
+ * @brief follow a matched object from frame to frame with pyramidal
+ * Lucas-Kanade optical flow instead of detecting and matching again
+ *
+ * A keyframe (full SIFT detection and matching) that yields a confident
+ * homography seeds the tracker with its inlier correspondences. On each
+ * following frame the frame-side points are moved by optical flow and the
+ * homography is refit from the fixed reference-side points to the tracked
+ * ones, so it does not accumulate drift. Points RANSAC rejects are dropped.
+ * The tracker gives up, asking for a new keyframe, when too few of the
+ * keyframe's inliers survive or after a fixed number of frames.
+ *
+ * Each frame's pyramid is built once and reused as the previous pyramid of
+ * the next frame.
+ *
+ ************************************************************************************
+ */
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include "opencv2/core/core.hpp"
+
+#include <vector>
+
+#define TRACK_START_INLIERS       (20)    /* keyframe inliers needed to track */
+#define TRACK_MIN_POINTS          (10)    /* below this, H is not trusted */
+#define TRACK_MIN_INLIER_RATIO    (0.5)   /* of the keyframe's inliers */
+#define TRACK_MAX_FRAMES          (30)    /* force a keyframe this often */
+#define TRACK_WIN_SIZE            (21)
+#define TRACK_PYR_LEVELS          (3)
+
+class HomographyTracker
+{
+public:
+    HomographyTracker();
+
+    /**
+     * @brief start tracking from a keyframe
+     *
+     * @param frame keyframe (BGR or grey)
+     * @param refPoints inlier locations in the reference object
+     * @param framePoints the same inliers in the keyframe
+     * @param H12 reference to keyframe homography
+     * @param refObj reference object the points belong to
+     * @return bool false, and not tracking, if there are too few inliers
+     */
+    bool start(const cv::Mat& frame, const std::vector<cv::Point2f>& refPoints,
+               const std::vector<cv::Point2f>& framePoints, const cv::Mat& H12, int refObj);
+
+    /**
+     * @brief follow the points into the next frame and refit H
+     *
+     * @param frame next frame, same size as the keyframe
+     * @param ransacReprojThreshold RANSAC threshold for the refit
+     * @return bool false when tracking is lost and a keyframe is needed
+     */
+    bool track(const cv::Mat& frame, double ransacReprojThreshold);
+
+    void stop();
+
+    bool active() const { return isActive; }
+    int object() const { return obj; }
+    int framesSinceKeyframe() const { return numTracked; }
+    double inlierRatio() const;
+    const cv::Mat& homography() const { return H12; }
+    const std::vector<cv::Point2f>& referencePoints() const { return refPts; }
+    const std::vector<cv::Point2f>& framePoints() const { return framePts; }
+
+private:
+    void buildPyramid(const cv::Mat& frame, std::vector<cv::Mat>& pyramid);
+
+    bool isActive;
+    int obj;
+    int numTracked;
+    size_t keyframeInliers;
+    cv::Mat gray;
+    cv::Mat H12;
+    std::vector<cv::Mat> prevPyr;
+    std::vector<cv::Mat> nextPyr;
+    std::vector<cv::Point2f> refPts;
+    std::vector<cv::Point2f> framePts;
+};
+
+#endif /* TRACKER_H */
@@ -0,0 +1,661 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file blur.c
+ * @brief multi-threaded Gaussian blur for 8-bit interleaved images
+ *
+ * The inner loops run over whole rows of 16/32-bit integers (or floats for
+ * the IIR path) with no branches, so the compiler vectorizes them to
+ * SSE/AVX or NEON; build this file with -O3.
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "blur.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define BLUR_H_SHIFT                  (6)     /* horizontal pass keeps 8 extra bits */
+#define BLUR_V_SHIFT                  (2 * BLUR_Q - BLUR_H_SHIFT)
+
+/* x86: also build AVX2 copies of the row loops, picked at load time */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define BLUR_ROW_FN                   __attribute__((target_clones("avx2", "default")))
+#else
+#define BLUR_ROW_FN
+#endif
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+
+/* BORDER_REFLECT_101: ... 2 1 | 0 1 2 ... n-1 | n-2 n-3 ... */
+static int reflect101(int i, int n)
+{
+  if(n == 1) {
+    return 0;
+  }
+  while((i < 0) || (i >= n)) {
+    if(i < 0) {
+      i = -i;
+    }
+    if(i >= n) {
+      i = 2 * n - 2 - i;
+    }
+  }
+  return i;
+}
+
+/* same rule as cv::getGaussianKernel(), quantized to Q14 */
+static void make_kernel(blurEngine_t *engine)
+{
+  double w[BLUR_MAX_TAPS];
+  int q[BLUR_MAX_TAPS];
+  int r = engine->ksize / 2;
+  double sum = 0.0;
+  int qsum = 0;
+  int trim = 0;
+  int i;
+
+  for(i = 0; i <= 2 * r; ++i) {
+    double d = i - r;
+    w[i] = exp(-0.5 * d * d / (engine->sigma * engine->sigma));
+    sum += w[i];
+  }
+  for(i = 0; i <= 2 * r; ++i) {
+    q[i] = (int)lround(w[i] / sum * (1 << BLUR_Q));
+    qsum += q[i];
+  }
+  /* put the rounding error in the centre tap so the gain is exactly 1 */
+  q[r] += (1 << BLUR_Q) - qsum;
+
+  /* drop the tails that quantized to zero, they cost time and add nothing */
+  while((trim < r) && (q[trim] == 0)) {
+    ++trim;
+  }
+  engine->radius = r - trim;
+  for(i = 0; i <= 2 * engine->radius; ++i) {
+    engine->kernel[i] = (int16_t)q[trim + i];
+  }
+}
+
+/* Young & van Vliet, "Recursive implementation of the Gaussian filter", 1995 */
+static void make_iir(blurEngine_t *engine)
+{
+  double sigma = (engine->sigma < 0.5) ? 0.5 : engine->sigma;
+  double q, b0, b1, b2, b3;
+
+  if(sigma >= 2.5) {
+    q = 0.98711 * sigma - 0.96330;
+  } else {
+    q = 3.97156 - 4.14554 * sqrt(1.0 - 0.26891 * sigma);
+  }
+
+  b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+  b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+  b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+  b3 = 0.422205 * q * q * q;
+
+  engine->iirA[0] = (float)(b1 / b0);
+  engine->iirA[1] = (float)(b2 / b0);
+  engine->iirA[2] = (float)(b3 / b0);
+  engine->iirB = (float)(1.0 - (b1 + b2 + b3) / b0);
+}
+
+static void *blur_worker(void *arg)
+{
+  blurEngine_t *engine = (blurEngine_t *)arg;
+  int idx = __atomic_add_fetch(&engine->nextIdx, 1, __ATOMIC_RELAXED);
+  unsigned int seen = 0;
+  blurTask_f task;
+
+  pthread_mutex_lock(&engine->lock);
+  for(;;) {
+    while(!engine->shutdown && (engine->generation == seen)) {
+      pthread_cond_wait(&engine->startCond, &engine->lock);
+    }
+    if(engine->shutdown) {
+      break;
+    }
+    seen = engine->generation;
+    task = engine->task;
+    pthread_mutex_unlock(&engine->lock);
+
+    task(engine, idx, engine->numThreads);
+
+    pthread_mutex_lock(&engine->lock);
+    if(--engine->pending == 0) {
+      pthread_cond_signal(&engine->doneCond);
+    }
+  }
+  pthread_mutex_unlock(&engine->lock);
+  return NULL;
+}
+
+/* run task on every thread, the caller's included, and wait for all */
+static void blur_run(blurEngine_t *engine, blurTask_f task)
+{
+  if(engine->numThreads == 1) {
+    task(engine, 0, 1);
+    return;
+  }
+
+  pthread_mutex_lock(&engine->lock);
+  engine->task = task;
+  engine->pending = engine->numThreads - 1;
+  ++engine->generation;
+  pthread_cond_broadcast(&engine->startCond);
+  pthread_mutex_unlock(&engine->lock);
+
+  task(engine, 0, engine->numThreads);
+
+  pthread_mutex_lock(&engine->lock);
+  while(engine->pending > 0) {
+    pthread_cond_wait(&engine->doneCond, &engine->lock);
+  }
+  pthread_mutex_unlock(&engine->lock);
+}
+
+/* horizontal pass of one source row into a Q8 ring row */
+BLUR_ROW_FN static void sep_row(const blurEngine_t *engine, const uint8_t *srcRow,
+                    uint16_t *pad, int32_t *acc, uint16_t *out)
+{
+  const int ch = engine->channels;
+  const int r = engine->radius;
+  const int n = engine->width * ch;
+  const int16_t *k = engine->kernel;
+  int x, c, i;
+
+  /* widen once and reflect the borders so the taps never branch */
+  for(x = 0; x < n; ++x) {
+    pad[r * ch + x] = srcRow[x];
+  }
+  for(i = 1; i <= r; ++i) {
+    int left = reflect101(-i, engine->width);
+    int right = reflect101(engine->width - 1 + i, engine->width);
+    for(c = 0; c < ch; ++c) {
+      pad[(r - i) * ch + c] = srcRow[left * ch + c];
+      pad[(r + engine->width - 1 + i) * ch + c] = srcRow[right * ch + c];
+    }
+  }
+
+  {
+    const int32_t kc = k[r];
+    const uint16_t *pc = pad + r * ch;
+    for(x = 0; x < n; ++x) {
+      acc[x] = kc * pc[x];
+    }
+  }
+  /* symmetric taps: one multiply per pair */
+  for(i = 0; i < r; ++i) {
+    const int32_t kk = k[i];
+    const uint16_t *pl = pad + i * ch;
+    const uint16_t *pr = pad + (2 * r - i) * ch;
+    for(x = 0; x < n; ++x) {
+      acc[x] += kk * (pl[x] + pr[x]);
+    }
+  }
+  for(x = 0; x < n; ++x) {
+    out[x] = (uint16_t)((acc[x] + (1 << (BLUR_H_SHIFT - 1))) >> BLUR_H_SHIFT);
+  }
+}
+
+/* vertical pass over (2r + 1) ring rows into one output row */
+BLUR_ROW_FN static void sep_col(const blurEngine_t *engine, const uint16_t *const *rows,
+                    int32_t *acc, uint8_t *dstRow)
+{
+  const int r = engine->radius;
+  const int n = engine->width * engine->channels;
+  const int16_t *k = engine->kernel;
+  int x, i;
+
+  {
+    const int32_t kc = k[r];
+    const uint16_t *pc = rows[r];
+    for(x = 0; x < n; ++x) {
+      acc[x] = kc * pc[x];
+    }
+  }
+  for(i = 0; i < r; ++i) {
+    const int32_t kk = k[i];
+    const uint16_t *pt = rows[i];
+    const uint16_t *pb = rows[2 * r - i];
+    for(x = 0; x < n; ++x) {
+      acc[x] += kk * (pt[x] + pb[x]);
+    }
+  }
+  for(x = 0; x < n; ++x) {
+    int32_t v = (acc[x] + (1 << (BLUR_V_SHIFT - 1))) >> BLUR_V_SHIFT;
+    dstRow[x] = (uint8_t)(v > 255 ? 255 : v);
+  }
+}
+
+/* luma of one YUYV row, decimate pixels summed per output pixel; d is a
+ * constant at every call so each case vectorizes on its own */
+static inline __attribute__((always_inline))
+void yuyv_luma_sum(const uint8_t *row, int32_t *acc, int width, const int d)
+{
+  int x, i;
+
+  for(x = 0; x < width; ++x) {
+    int32_t s = 0;
+    for(i = 0; i < d; ++i) {
+      s += row[2 * (x * d + i)];
+    }
+    acc[x] += s;
+  }
+}
+
+/* one grey ring input row straight from the decimate YUYV rows under it */
+BLUR_ROW_FN static void yuyv_row(const blurEngine_t *engine, int y, int32_t *acc, uint8_t *grey)
+{
+  const int d = engine->decimate;
+  const int w = engine->width;
+  const int shift = 2 * __builtin_ctz(d);
+  const uint8_t *row = engine->yuyv + (size_t)y * d * engine->yuyvStride;
+  int x, k;
+
+  for(x = 0; x < w; ++x) {
+    acc[x] = 0;
+  }
+  for(k = 0; k < d; ++k, row += engine->yuyvStride) {
+    switch(d) {
+    case 1:  yuyv_luma_sum(row, acc, w, 1); break;
+    case 2:  yuyv_luma_sum(row, acc, w, 2); break;
+    case 4:  yuyv_luma_sum(row, acc, w, 4); break;
+    default: yuyv_luma_sum(row, acc, w, 8); break;
+    }
+  }
+  for(x = 0; x < w; ++x) {
+    grey[x] = (uint8_t)((acc[x] + ((1 << shift) >> 1)) >> shift);
+  }
+}
+
+/* source row j of the blur, reflected; made from YUYV in the fused path */
+static const uint8_t *sep_src_row(const blurEngine_t *engine, int j, int32_t *acc, uint8_t *grey)
+{
+  j = reflect101(j, engine->height);
+  if(engine->yuyv == NULL) {
+    return engine->src + (size_t)j * engine->srcStride;
+  }
+  yuyv_row(engine, j, acc, grey);
+  return grey;
+}
+
+/* per-thread separable scratch: ring rows, padded row, accumulator, row
+ * table, fused input row */
+#define ALIGN64(n)                    (((n) + 63) & ~(size_t)63)
+
+static size_t sep_scratch_size(const blurEngine_t *engine, size_t *padOff,
+                               size_t *accOff, size_t *rowsOff, size_t *greyOff)
+{
+  size_t n = (size_t)engine->width * engine->channels;
+  size_t ringRows = 2 * engine->radius + 1;
+
+  *padOff = ALIGN64(ringRows * n * sizeof(uint16_t));
+  *accOff = *padOff + ALIGN64((n + 2 * engine->radius * engine->channels) * sizeof(uint16_t));
+  *rowsOff = *accOff + ALIGN64(n * sizeof(int32_t));
+  *greyOff = *rowsOff + ALIGN64(ringRows * sizeof(uint16_t *));
+  return *greyOff + n;
+}
+
+static void sep_task(blurEngine_t *engine, int idx, int count)
+{
+  const int r = engine->radius;
+  const int ringRows = 2 * r + 1;
+  const size_t n = (size_t)engine->width * engine->channels;
+  const int y0 = (int)((long)engine->height * idx / count);
+  const int y1 = (int)((long)engine->height * (idx + 1) / count);
+  uint8_t *scratch = (uint8_t *)engine->scratch[idx];
+  size_t padOff, accOff, rowsOff, greyOff;
+  uint16_t *ring, *pad;
+  int32_t *acc;
+  const uint16_t **rows;
+  uint8_t *grey;
+  int y, j, i;
+
+  sep_scratch_size(engine, &padOff, &accOff, &rowsOff, &greyOff);
+  ring = (uint16_t *)scratch;
+  pad = (uint16_t *)(scratch + padOff);
+  acc = (int32_t *)(scratch + accOff);
+  rows = (const uint16_t **)(scratch + rowsOff);
+  grey = scratch + greyOff;
+
+  if(y0 >= y1) {
+    return;
+  }
+
+  /* prime the ring with rows y0 - r .. y0 + r - 1 */
+  for(j = y0 - r; j < y0 + r; ++j) {
+    sep_row(engine, sep_src_row(engine, j, acc, grey),
+            pad, acc, ring + (size_t)((j - (y0 - r)) % ringRows) * n);
+  }
+
+  for(y = y0; y < y1; ++y) {
+    j = y + r;
+    sep_row(engine, sep_src_row(engine, j, acc, grey),
+            pad, acc, ring + (size_t)((j - (y0 - r)) % ringRows) * n);
+
+    for(i = 0; i < ringRows; ++i) {
+      rows[i] = ring + (size_t)((y - r + i - (y0 - r)) % ringRows) * n;
+    }
+    sep_col(engine, rows, acc, engine->dst + (size_t)y * engine->dstStride);
+  }
+}
+
+/* IIR horizontal: forward and backward along each row, rows split by thread.
+ * The recursion is serial along a row, so IIR_LANES rows run side by side
+ * and the lanes, not the pixels, are vectorized */
+#define IIR_LANES                     (8)
+
+BLUR_ROW_FN static void iir_rows_task(blurEngine_t *engine, int idx, int count)
+{
+  const int ch = engine->channels;
+  const int w = engine->width;
+  const size_t n = (size_t)w * ch;
+  const int y0 = (int)((long)engine->height * idx / count);
+  const int y1 = (int)((long)engine->height * (idx + 1) / count);
+  const float B = engine->iirB;
+  const float a1 = engine->iirA[0], a2 = engine->iirA[1], a3 = engine->iirA[2];
+  const uint8_t *in[IIR_LANES];
+  float *p[IIR_LANES];
+  float w1[IIR_LANES], w2[IIR_LANES], w3[IIR_LANES], v[IIR_LANES];
+  int y, x, c, j, lanes;
+  size_t e;
+
+  for(y = y0; y < y1; y += IIR_LANES) {
+    lanes = (y1 - y < IIR_LANES) ? (y1 - y) : IIR_LANES;
+    /* short last block: repeat its first row in the spare lanes */
+    for(j = 0; j < IIR_LANES; ++j) {
+      int row = y + ((j < lanes) ? j : 0);
+      in[j] = engine->src + (size_t)row * engine->srcStride;
+      p[j] = engine->plane + (size_t)row * n;
+    }
+
+    for(c = 0; c < ch; ++c) {
+      /* steady state for a constant edge: the filter has unit DC gain */
+      for(j = 0; j < IIR_LANES; ++j) {
+        w1[j] = w2[j] = w3[j] = in[j][c];
+      }
+      for(x = 0, e = c; x < w; ++x, e += ch) {
+        for(j = 0; j < IIR_LANES; ++j) {
+          v[j] = B * in[j][e] + a1 * w1[j] + a2 * w2[j] + a3 * w3[j];
+          w3[j] = w2[j];
+          w2[j] = w1[j];
+          w1[j] = v[j];
+        }
+        for(j = 0; j < lanes; ++j) {
+          p[j][e] = v[j];
+        }
+      }
+
+      for(j = 0; j < IIR_LANES; ++j) {
+        w1[j] = w2[j] = w3[j] = p[j < lanes ? j : 0][(w - 1) * ch + c];
+      }
+      for(x = w - 1, e = (size_t)x * ch + c; x >= 0; --x, e -= ch) {
+        for(j = 0; j < IIR_LANES; ++j) {
+          v[j] = B * p[j < lanes ? j : 0][e] + a1 * w1[j] + a2 * w2[j] + a3 * w3[j];
+          w3[j] = w2[j];
+          w2[j] = w1[j];
+          w1[j] = v[j];
+        }
+        for(j = 0; j < lanes; ++j) {
+          p[j][e] = v[j];
+        }
+      }
+    }
+  }
+}
+
+/* IIR vertical: whole rows at a time over a slice of columns per thread */
+BLUR_ROW_FN static void iir_cols_task(blurEngine_t *engine, int idx, int count)
+{
+  const size_t n = (size_t)engine->width * engine->channels;
+  const int h = engine->height;
+  const size_t x0 = n * idx / count;
+  const size_t x1 = n * (idx + 1) / count;
+  const size_t m = x1 - x0;
+  const float B = engine->iirB;
+  const float a1 = engine->iirA[0], a2 = engine->iirA[1], a3 = engine->iirA[2];
+  float *edge = (float *)engine->scratch[idx];
+  const float *p1, *p2, *p3;
+  float *p;
+  size_t x;
+  int y;
+
+  if(m == 0) {
+    return;
+  }
+
+  /* forward, in place: row y becomes w[y] */
+  memcpy(edge, engine->plane + x0, m * sizeof(float));
+  for(y = 0; y < h; ++y) {
+    p = engine->plane + (size_t)y * n + x0;
+    p1 = (y >= 1) ? p - n : edge;
+    p2 = (y >= 2) ? p - 2 * n : edge;
+    p3 = (y >= 3) ? p - 3 * n : edge;
+    for(x = 0; x < m; ++x) {
+      p[x] = B * p[x] + a1 * p1[x] + a2 * p2[x] + a3 * p3[x];
+    }
+  }
+
+  /* backward, writing the output as each row is final */
+  memcpy(edge, engine->plane + (size_t)(h - 1) * n + x0, m * sizeof(float));
+  for(y = h - 1; y >= 0; --y) {
+    uint8_t *out = engine->dst + (size_t)y * engine->dstStride + x0;
+    p = engine->plane + (size_t)y * n + x0;
+    p1 = (y + 1 < h) ? p + n : edge;
+    p2 = (y + 2 < h) ? p + 2 * n : edge;
+    p3 = (y + 3 < h) ? p + 3 * n : edge;
+    for(x = 0; x < m; ++x) {
+      float v = B * p[x] + a1 * p1[x] + a2 * p2[x] + a3 * p3[x];
+      p[x] = v;
+      v = (v < 0.0f) ? 0.0f : ((v > 255.0f) ? 255.0f : v);
+      out[x] = (uint8_t)(v + 0.5f);
+    }
+  }
+}
+
+static int grow(void **buf, size_t *size, size_t need)
+{
+  void *p;
+
+  if(*size >= need) {
+    return 0;
+  }
+  if((p = realloc(*buf, need)) == NULL) {
+    return -1;
+  }
+  *buf = p;
+  *size = need;
+  return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+
+int blur_configure(blurEngine_t *engine, int ksize, double sigma, blurMethod_e method)
+{
+  if((engine == NULL) || (ksize < 1) || ((ksize & 1) == 0) || (ksize > BLUR_MAX_TAPS)) {
+    return -1;
+  }
+
+  engine->ksize = ksize;
+  engine->sigma = (sigma > 0.0) ? sigma : (0.3 * ((ksize - 1) * 0.5 - 1) + 0.8);
+  make_kernel(engine);
+  make_iir(engine);
+
+  if(method == BLUR_AUTO) {
+    method = (2 * engine->radius + 1 > BLUR_IIR_MIN_TAPS) ? BLUR_IIR : BLUR_SEPARABLE;
+  }
+  engine->method = method;
+  return 0;
+}
+
+int blur_init(blurEngine_t *engine, int ksize, double sigma, blurMethod_e method, int numThreads)
+{
+  int ind;
+
+  if((engine == NULL) || (ksize < 1) || ((ksize & 1) == 0) || (ksize > BLUR_MAX_TAPS)) {
+    return -1;
+  }
+
+  memset(engine, 0, sizeof(blurEngine_t));
+  blur_configure(engine, ksize, sigma, method);
+
+  if(numThreads <= 0) {
+    numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  engine->numThreads = (numThreads > BLUR_MAX_THREADS) ? BLUR_MAX_THREADS
+                       : ((numThreads < 1) ? 1 : numThreads);
+
+  pthread_mutex_init(&engine->lock, NULL);
+  pthread_cond_init(&engine->startCond, NULL);
+  pthread_cond_init(&engine->doneCond, NULL);
+
+  /* workers inherit the caller's scheduling policy and priority */
+  for(ind = 1; ind < engine->numThreads; ++ind) {
+    if(pthread_create(&engine->threads[ind], NULL, blur_worker, engine) != 0) {
+      engine->numThreads = ind;
+      blur_destroy(engine);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int blur_apply(blurEngine_t *engine, const uint8_t *src, int srcStride,
+               uint8_t *dst, int dstStride, int width, int height, int channels)
+{
+  size_t n = (size_t)width * channels;
+  size_t need, padOff, accOff, rowsOff, greyOff;
+  int ind;
+
+  if((engine == NULL) || (src == NULL) || (dst == NULL) || (src == dst) ||
+     (width < 1) || (height < 1) || (channels < 1) || (channels > 4)) {
+    return -1;
+  }
+
+  engine->yuyv = NULL;
+  engine->src = src;
+  engine->dst = dst;
+  engine->srcStride = srcStride;
+  engine->dstStride = dstStride;
+  engine->width = width;
+  engine->height = height;
+  engine->channels = channels;
+
+  /* allocate here, not in the workers, so a frame never mallocs twice */
+  if(engine->method == BLUR_IIR) {
+    if(grow((void **)&engine->plane, &engine->planeSize, n * height * sizeof(float)) != 0) {
+      return -1;
+    }
+    need = (n / engine->numThreads + 1) * sizeof(float);
+  } else {
+    need = sep_scratch_size(engine, &padOff, &accOff, &rowsOff, &greyOff);
+  }
+  for(ind = 0; ind < engine->numThreads; ++ind) {
+    if(grow(&engine->scratch[ind], &engine->scratchSize[ind], need) != 0) {
+      return -1;
+    }
+  }
+
+  if(engine->method == BLUR_IIR) {
+    blur_run(engine, iir_rows_task);
+    blur_run(engine, iir_cols_task);
+  } else {
+    blur_run(engine, sep_task);
+  }
+  return 0;
+}
+
+int blur_apply_yuyv(blurEngine_t *engine, const uint8_t *yuyv, int yuyvStride, int width, int height,
+                    int decimate, uint8_t *dst, int dstStride)
+{
+  size_t need, padOff, accOff, rowsOff, greyOff;
+  int ind;
+
+  if((engine == NULL) || (yuyv == NULL) || (dst == NULL) || (yuyv == dst) ||
+     ((decimate != 1) && (decimate != 2) && (decimate != 4) && (decimate != 8)) ||
+     (width / decimate < 1) || (height / decimate < 1) || (yuyvStride < 2 * width)) {
+    return -1;
+  }
+
+  engine->yuyv = yuyv;
+  engine->yuyvStride = yuyvStride;
+  engine->decimate = decimate;
+  engine->src = NULL;
+  engine->dst = dst;
+  engine->srcStride = 0;
+  engine->dstStride = dstStride;
+  engine->width = width / decimate;
+  engine->height = height / decimate;
+  engine->channels = 1;
+
+  need = sep_scratch_size(engine, &padOff, &accOff, &rowsOff, &greyOff);
+  for(ind = 0; ind < engine->numThreads; ++ind) {
+    if(grow(&engine->scratch[ind], &engine->scratchSize[ind], need) != 0) {
+      return -1;
+    }
+  }
+
+  blur_run(engine, sep_task);
+  engine->yuyv = NULL;
+  return 0;
+}
+
+void blur_destroy(blurEngine_t *engine)
+{
+  int ind;
+
+  if(engine == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&engine->lock);
+  engine->shutdown = 1;
+  pthread_cond_broadcast(&engine->startCond);
+  pthread_mutex_unlock(&engine->lock);
+  for(ind = 1; ind < engine->numThreads; ++ind) {
+    pthread_join(engine->threads[ind], NULL);
+  }
+
+  for(ind = 0; ind < BLUR_MAX_THREADS; ++ind) {
+    free(engine->scratch[ind]);
+    engine->scratch[ind] = NULL;
+    engine->scratchSize[ind] = 0;
+  }
+  free(engine->plane);
+  engine->plane = NULL;
+  engine->planeSize = 0;
+
+  pthread_cond_destroy(&engine->doneCond);
+  pthread_cond_destroy(&engine->startCond);
+  pthread_mutex_destroy(&engine->lock);
+}
+
+const char *blur_method_name(blurMethod_e method)
+{
+  switch(method) {
+  case BLUR_AUTO:
+    return "auto";
+  case BLUR_SEPARABLE:
+    return "separable";
+  case BLUR_IIR:
+    return "iir";
+  }
+  return "unknown";
+}
@@ -0,0 +1,244 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file fusebench.c
+ * @brief msec per frame of the fused YUYV -> grey -> decimate -> blur pass
+ * against the same steps run one after the other
+ *
+ * The staged path is what the capture and filter code does today: the whole
+ * frame is converted to grey, the grey frame decimated, the decimated frame
+ * blurred, each step a full pass through memory. Both paths use the same
+ * blur engine and rounding, so their outputs must match exactly. Frames are
+ * cycled through a ring larger than the cache, like fresh DMA buffers, and
+ * are synthetic unless a YUYV recording (framesource.h spec) is given.
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blur.h"
+#include "framesource.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define TIMESPEC_TO_MSEC(time)        ((((double)time.tv_sec) * 1.0e3) + (((double)time.tv_nsec) * 1.0e-6))
+#define DEFAULT_WIDTH                 (640)
+#define DEFAULT_HEIGHT                (480)
+#define DEFAULT_FRAMES                (200)
+#define DEFAULT_RING                  (8)     /* 8 VGA frames, about 5 MB */
+#define FILTER_SIZE                   (31)
+#define FILTER_SIGMA                  (2.0)
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static void usage(const char *name)
+{
+  printf("%s [-s WxH] [-d decimate] [-k ksize] [-j threads] [-n frames] [-r ring] [-F spec]\n\n"
+         "Times YUYV -> grey -> decimate -> blur fused in one pass against the same\n"
+         "steps staged through full frames, and checks the outputs are identical.\n"
+         "-s  frame size (default %dx%d)\n"
+         "-d  decimation, 1, 2, 4 or 8 (default 2)\n"
+         "-k  blur kernel size, odd (default %d, sigma %.1f / decimation)\n"
+         "-j  blur threads (default 1, 0 = online CPUs)\n"
+         "-n  frames to time per path (default %d)\n"
+         "-r  distinct frames cycled through (default %d)\n"
+         "-F  YUYV recording to use instead of synthetic frames,\n"
+         "    e.g. yuyv:rec.yuv,size=640x480\n",
+         name, DEFAULT_WIDTH, DEFAULT_HEIGHT, FILTER_SIZE, FILTER_SIGMA, DEFAULT_FRAMES, DEFAULT_RING);
+}
+
+static double now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return TIMESPEC_TO_MSEC(ts);
+}
+
+/* a gradient that moves between frames, plus noise */
+static void synthesize(uint8_t *yuyv, int width, int height, int seq)
+{
+  unsigned int seed = 1 + seq;
+  int x, y;
+
+  for(y = 0; y < height; ++y) {
+    uint8_t *row = yuyv + (size_t)y * width * 2;
+    for(x = 0; x < width; ++x) {
+      seed = seed * 1103515245u + 12345u;
+      row[2 * x] = (uint8_t)(((x + y + 4 * seq) & 0xff) / 2 + ((seed >> 16) & 0x3f));
+      row[2 * x + 1] = (uint8_t)(128 + ((x & 1) ? 10 : -10));
+    }
+  }
+}
+
+static int load_frames(const char *spec, uint8_t *ring, int count, int width, int height)
+{
+  frameSource_t *src = fs_open(spec);
+  fsFrame_t frame;
+  fsFormat_e format;
+  int w, h, n = 0;
+
+  if(src == NULL) {
+    return -1;
+  }
+  fs_format(src, &w, &h, &format);
+  if((format != FS_YUYV) || (w != width) || (h != height)) {
+    fprintf(stderr, "%s is not %dx%d YUYV\n", spec, width, height);
+    fs_close(src);
+    return -1;
+  }
+  while((n < count) && (fs_read(src, &frame) == 1)) {
+    memcpy(ring + (size_t)n * width * height * 2, frame.data, (size_t)width * height * 2);
+    ++n;
+  }
+  fs_close(src);
+  return n;
+}
+
+/* the steps as separate passes: whole frame to grey, decimate, blur */
+static void staged(blurEngine_t *engine, const uint8_t *yuyv, int width, int height, int d,
+                   uint8_t *grey, uint8_t *small, uint8_t *out)
+{
+  const int ow = width / d;
+  const int oh = height / d;
+  const int shift = 2 * __builtin_ctz(d);
+  int x, y, i, k;
+
+  for(i = 0; i < width * height; ++i) {
+    grey[i] = yuyv[2 * i];
+  }
+  for(y = 0; y < oh; ++y) {
+    for(x = 0; x < ow; ++x) {
+      int sum = 0;
+      for(k = 0; k < d; ++k) {
+        const uint8_t *row = grey + (size_t)(y * d + k) * width + x * d;
+        for(i = 0; i < d; ++i) {
+          sum += row[i];
+        }
+      }
+      small[y * ow + x] = (uint8_t)((sum + ((1 << shift) >> 1)) >> shift);
+    }
+  }
+  blur_apply(engine, small, ow, out, ow, ow, oh, 1);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int main(int argc, char *argv[])
+{
+  int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
+  int decimate = 2, ksize = FILTER_SIZE, threads = 1;
+  int frames = DEFAULT_FRAMES, ringFrames = DEFAULT_RING;
+  const char *spec = NULL;
+  blurEngine_t engine;
+  uint8_t *ring, *grey, *small, *outStaged, *outFused;
+  size_t frameBytes;
+  double start, stagedMs, fusedMs;
+  int opt, i, ow, oh, mismatches = 0;
+
+  while((opt = getopt(argc, argv, "s:d:k:j:n:r:F:")) != -1) {
+    switch(opt) {
+    case 's':
+      if(sscanf(optarg, "%dx%d", &width, &height) != 2) {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'd': decimate = atoi(optarg); break;
+    case 'k': ksize = atoi(optarg); break;
+    case 'j': threads = atoi(optarg); break;
+    case 'n': frames = atoi(optarg); break;
+    case 'r': ringFrames = atoi(optarg); break;
+    case 'F': spec = optarg; break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(((decimate != 1) && (decimate != 2) && (decimate != 4) && (decimate != 8)) ||
+     (width < 2 * decimate) || (height < decimate) || (width & 1) || (frames < 1) || (ringFrames < 1)) {
+    usage(argv[0]);
+    return -1;
+  }
+  ow = width / decimate;
+  oh = height / decimate;
+
+  if(blur_init(&engine, ksize, FILTER_SIGMA / decimate, BLUR_SEPARABLE, threads) != 0) {
+    fprintf(stderr, "bad kernel size %d\n", ksize);
+    return -1;
+  }
+
+  frameBytes = (size_t)width * height * 2;
+  ring = (uint8_t *)malloc(frameBytes * ringFrames);
+  grey = (uint8_t *)malloc((size_t)width * height);
+  small = (uint8_t *)malloc((size_t)ow * oh);
+  outStaged = (uint8_t *)malloc((size_t)ow * oh);
+  outFused = (uint8_t *)malloc((size_t)ow * oh);
+  if((ring == NULL) || (grey == NULL) || (small == NULL) || (outStaged == NULL) || (outFused == NULL)) {
+    fprintf(stderr, "out of memory\n");
+    return -1;
+  }
+  if(spec != NULL) {
+    if((ringFrames = load_frames(spec, ring, ringFrames, width, height)) <= 0) {
+      fprintf(stderr, "no frames from %s\n", spec);
+      return -1;
+    }
+  } else {
+    for(i = 0; i < ringFrames; ++i) {
+      synthesize(ring + frameBytes * i, width, height, i);
+    }
+  }
+
+  /* same result, frame by frame */
+  for(i = 0; i < ringFrames; ++i) {
+    staged(&engine, ring + frameBytes * i, width, height, decimate, grey, small, outStaged);
+    blur_apply_yuyv(&engine, ring + frameBytes * i, width * 2, width, height, decimate, outFused, ow);
+    if(memcmp(outStaged, outFused, (size_t)ow * oh) != 0) {
+      ++mismatches;
+    }
+  }
+
+  start = now_ms();
+  for(i = 0; i < frames; ++i) {
+    staged(&engine, ring + frameBytes * (i % ringFrames), width, height, decimate, grey, small, outStaged);
+  }
+  stagedMs = (now_ms() - start) / frames;
+
+  start = now_ms();
+  for(i = 0; i < frames; ++i) {
+    blur_apply_yuyv(&engine, ring + frameBytes * (i % ringFrames), width * 2, width, height, decimate,
+                    outFused, ow);
+  }
+  fusedMs = (now_ms() - start) / frames;
+
+  /* bytes each path moves through memory, ignoring what stays in cache */
+  printf("%dx%d YUYV -> %dx%d grey, %d taps, %d threads, %d frames over %d distinct\n",
+         width, height, ow, oh, 2 * engine.radius + 1, engine.numThreads, frames, ringFrames);
+  printf("%-8s %10s %12s\n", "path", "ms/frame", "KB/frame");
+  printf("%-8s %10.3f %12.1f\n", "staged", stagedMs,
+         (frameBytes + 2.0 * width * height + 3.0 * ow * oh) / 1024.0);
+  printf("%-8s %10.3f %12.1f\n", "fused", fusedMs, (frameBytes + (double)ow * oh) / 1024.0);
+  printf("speedup %.2fx, %d of %d frames differ\n", stagedMs / fusedMs, mismatches, ringFrames);
+
+  blur_destroy(&engine);
+  free(ring);
+  free(grey);
+  free(small);
+  free(outStaged);
+  free(outFused);
+  return (mismatches == 0) ? 0 : 1;
+}
@@ -39,42 +39,101 @@
 #include <iomanip>  // for controlling float print precision
 #include <sstream>  // string to number conversion
 
+#include "blur.h"
+#include "changegate.h"
+#include "pyramidmat.h"
+#include "qos.h"
+#include "reorder.h"
+#include "farsource.h"
+#include "frametrace.h"
+#include "replaycapture.h"
+#include "rtstats.h"
+
 using namespace cv;
 using namespace std;
 
 /*---------------------------------------------------------------------------------*/
 /* MACROS / TYPES / CONST */
-#define NUM_THREADS         	        (2)
+#define MAX_WORKERS                   (8)
+#define NUM_THREADS                   (2 + MAX_WORKERS)
 #define TIMESPEC_TO_MSEC(time)	      ((((float)time.tv_sec) * 1.0e3) + (((float)time.tv_nsec) * 1.0e-6))
 #define CALC_DT_MSEC(newest, oldest)  (TIMESPEC_TO_MSEC(newest) - TIMESPEC_TO_MSEC(oldest))
-#define MAX_MSG_SIZE                  (sizeof(cv::Mat))
+#define MAX_MSG_SIZE                  (sizeof(frameMsg_t))
+#define MQ_DEPTH                      (10)
 #define ERROR                         (-1)
 #define READ_THEAD_NUM 			          (0)
-#define PROC_THEAD_NUM 			          (READ_THEAD_NUM + 1)
+#define RELEASE_THEAD_NUM             (READ_THEAD_NUM + 1)
+#define PROC_THEAD_NUM 			          (RELEASE_THEAD_NUM + 1)   /* first worker */
 #define MAX_IMG_ROWS                  (480)
 #define MAX_IMG_COLS                  (640)
 #define MAX_ITERATIONS                (31)
 #define FILTER_SIZE                   (31)
 #define FILTER_SIGMA                  (2.0)
+#define FILTER_3SIGMA_SIZE            (13)    /* 2 * ceil(3 * FILTER_SIGMA) + 1 */
+#define DEADLINE_MSEC                 (70.0f)
+#define NUM_QOS_LEVELS                (5)
+#define STATS_SOCK_PATH               "/tmp/prob5.stats"
+#define STATS_INTERVAL_MSEC           (1000)
+#define GATE_PARTIAL_FRACTION         (0.4)   /* more changed tiles: filter it all */
+#define ROB_MAX_LATENCY_MSEC          (4 * DEADLINE_MSEC)
 
 typedef enum {
   USE_GAUSSIAN_BLUR,
   USE_FILTER_2D,
-  USE_SEP_FILTER_2D
+  USE_SEP_FILTER_2D,
+  USE_BLUR_SEPARABLE,
+  USE_BLUR_IIR,
+  NUM_FILTER_TYPES
 } FilterType_e;
 
 typedef struct {
   int threadIdx;              /* thread id */
   int cameraIdx;              /* index of camera */
+  const char *replaySpec;     /* recording to replay instead, or NULL */
   char msgQueueName[64];      /* message queue */
   unsigned int decimateFactor;
   FilterType_e filterMethod;
+  int adaptive;               /* let the qos controller change the level */
+  int gate;                   /* skip unchanged frames and tiles */
+  int numWorkers;             /* procImgTask threads */
+  int blurThreads;            /* blur.c threads per worker */
+  double maxLatencyMs;        /* reorder buffer wait for a frame, 0 = forever */
+  robDropPolicy_e dropPolicy;
+  int lossless;               /* traced replay: block rather than drop frames */
 } threadParams_t;
 
+/* what goes through the queue; img is NULL to tell a worker to stop */
+typedef struct {
+  Mat *img;                   /* captured frame, the worker deletes it */
+  uint32_t seq;               /* reorder buffer sequence */
+  uint32_t frame;             /* replay release index, else frames read */
+  struct timespec captured;
+  struct timespec released;   /* replay release time, else captured */
+} frameMsg_t;
+
+/* a worker's output, released in capture order */
+typedef struct {
+  Mat img;
+  int method;                 /* level it was filtered at */
+  unsigned int decimate;
+  uint32_t frame;
+  struct timespec captured;
+  struct timespec released;
+} procResult_t;
+
 /*---------------------------------------------------------------------------------*/
 /* PRIVATE FUNCTIONS */
+static int build_qos_ladder(qosLevel_t *levels, FilterType_e filterMethod, unsigned int decimateFactor);
+static void filter_image(const Mat &src, Mat &dst, const qosLevel_t *level, blurEngine_t *engine,
+                         const Mat &kern1D, const Mat &kern2D);
+static void filter_tiles(const Mat &src, Mat &dst, const changeGate_t *gate, const qosLevel_t *level,
+                         blurEngine_t *engine, const Mat &kern1D, const Mat &kern2D);
+static void discard_result(void *result);
+static void print_usage(void);
+static void stop_workers(mqd_t msgQueue, int numWorkers);
 void *procImgTask(void *arg);
 void *readImgTask(void *arg);
+void *releaseImgTask(void *arg);
 
 int set_attr_policy(pthread_attr_t *attr, int policy, uint8_t priorityOffset);
 int set_main_policy(int policy, uint8_t priorityOffset);
@@ -83,7 +142,15 @@ void print_scheduler(void);
 /*---------------------------------------------------------------------------------*/
 /* GLOBAL VARIABLES */
 int gAbortTest = 0;
+int gWorkersStopped = 0;      /* the workers' stop messages are queued */
 const char *msgQueueName = "/image_mq";
+rtStats_t gFrameStats;
+int gCaptureStage;
+int gProcStage;
+int gReleaseStage;
+reorderBuf_t gReorder;
+frameTrace_t gTrace;
+qosController_t gQos;         /* one level for every worker */
 
 /*---------------------------------------------------------------------------------*/
 
@@ -96,13 +163,12 @@ int main(int argc, char *argv[])
   syslog(LOG_INFO, "..");
   syslog(LOG_INFO, "...");
   syslog(LOG_INFO, "logging started");
+  fa_register_source();
 
   if (argc < 3) {
     syslog(LOG_ERR, "incorrect number of arguments provided");
-    cout  << "incorrect number of arguments provided\n\n"
-          << "Usage: prob5 [decimation factor] [filter type]\n"
-          << "decimation factor[0 = original size, 1 = half size, 2 = quarter size]\n"
-          << "filter type [0 = gaussionBlur(), 1 = filter2D(), 2 = sepFilter2D()\n";
+    cout << "incorrect number of arguments provided\n\n";
+    print_usage();
     return -1;
   }
   
@@ -119,12 +185,13 @@ int main(int argc, char *argv[])
 	  
   struct mq_attr mq_attr;
   memset(&mq_attr, 0, sizeof(struct mq_attr));
-  mq_attr.mq_maxmsg = 10;
+  mq_attr.mq_maxmsg = MQ_DEPTH;
   mq_attr.mq_msgsize = MAX_MSG_SIZE;
   mq_attr.mq_flags = 0;
 
-  /* create queue here to allow main to do clean up */
-  mqd_t mymq = mq_open(msgQueueName, O_CREAT, S_IRWXU, &mq_attr);
+  /* create queue here to allow main to do clean up, and to stop the
+   * workers if readImgTask can't */
+  mqd_t mymq = mq_open(msgQueueName, O_CREAT | O_WRONLY, S_IRWXU, &mq_attr);
   if(mymq == (mqd_t)ERROR) {
     syslog(LOG_ERR, "couldn't create queue");
     return -1;
@@ -150,51 +217,160 @@ int main(int argc, char *argv[])
   strcpy(threadParams.msgQueueName, msgQueueName);
   if((threadParams.decimateFactor = atoi(argv[1])) > 2) {
     syslog(LOG_ERR, "invalid decimation factor provided");
-    cout  << "invalid decimation factor provided\n\n"
-          << "Usage: prob5 [decimation factor] [filter type]\n"
-          << "decimation factor[0 = original size, 1 = half size, 2 = quarter size]\n"
-          << "filter type [0 = gaussionBlur(), 1 = filter2D(), 2 = sepFilter2D()\n";
+    cout << "invalid decimation factor provided\n\n";
+    print_usage();
     return -1;
   } else {
     threadParams.decimateFactor = pow(2.0, threadParams.decimateFactor);
   }
-  if((threadParams.filterMethod = (FilterType_e)atoi(argv[2])) > 2) {
+  if((threadParams.filterMethod = (FilterType_e)atoi(argv[2])) >= NUM_FILTER_TYPES) {
     syslog(LOG_ERR, "invalid filter type provided");
-    cout  << "invalid filter type provided\n\n"
-          << "Usage: prob5 [decimation factor] [filter type]\n"
-          << "decimation factor[0 = original size, 1 = half size, 2 = quarter size]\n"
-          << "filter type [0 = gaussionBlur(), 1 = filter2D(), 2 = sepFilter2D()\n";
+    cout << "invalid filter type provided\n\n";
+    print_usage();
     return -1;
   }
 
+  threadParams.adaptive = (argc > 3) ? atoi(argv[3]) : 1;
+
   syslog(LOG_INFO, "decimation factor: %d", threadParams.decimateFactor);
   syslog(LOG_INFO, "filter type: %d", threadParams.filterMethod);
+  syslog(LOG_INFO, "adaptive: %d", threadParams.adaptive);
 
   threadParams.cameraIdx = 0;
-  threadParams.threadIdx = READ_THEAD_NUM;
-  if(pthread_create(&threads[READ_THEAD_NUM], &thread_attr, readImgTask, (void *)&threadParams) != 0) {
-    syslog(LOG_ERR, "couldn't create thread#%d", READ_THEAD_NUM);
+  threadParams.replaySpec = NULL;
+  if(argc > 4) {
+    if(fs_is_spec(argv[4])) {
+      threadParams.replaySpec = argv[4];
+    } else {
+      threadParams.cameraIdx = atoi(argv[4]);
+    }
+  }
+  threadParams.gate = (argc > 5) ? atoi(argv[5]) : 1;
+  syslog(LOG_INFO, "change gate: %d", threadParams.gate);
+  syslog(LOG_INFO, "source: %s", (threadParams.replaySpec != NULL) ? threadParams.replaySpec : "camera");
+
+  /* workers[:max latency msec[:newest|oldest]] */
+  threadParams.numWorkers = 1;
+  threadParams.maxLatencyMs = ROB_MAX_LATENCY_MSEC;
+  threadParams.dropPolicy = ROB_DROP_NEWEST;
+  if(argc > 6) {
+    char *opt = strchr(argv[6], ':');
+    threadParams.numWorkers = atoi(argv[6]);
+    if(opt != NULL) {
+      threadParams.maxLatencyMs = atof(opt + 1);
+      if((opt = strchr(opt + 1, ':')) != NULL) {
+        threadParams.dropPolicy = (strcmp(opt + 1, "oldest") == 0) ? ROB_DROP_OLDEST : ROB_DROP_NEWEST;
+      }
+    }
+    if(threadParams.numWorkers < 1) {
+      threadParams.numWorkers = 1;
+    } else if(threadParams.numWorkers > MAX_WORKERS) {
+      threadParams.numWorkers = MAX_WORKERS;
+    }
+  }
+  /* the workers share the cores; blur.c splits what each one gets */
+  threadParams.blurThreads = (int)sysconf(_SC_NPROCESSORS_ONLN) / threadParams.numWorkers;
+  if(threadParams.blurThreads < 1) {
+    threadParams.blurThreads = 1;
   }
+  syslog(LOG_INFO, "workers: %d, %d blur threads each, max latency %.1f msec, drop %s",
+         threadParams.numWorkers, threadParams.blurThreads, threadParams.maxLatencyMs,
+         (threadParams.dropPolicy == ROB_DROP_OLDEST) ? "oldest" : "newest");
 
-  threadParams.threadIdx = PROC_THEAD_NUM;
-  if(pthread_create(&threads[PROC_THEAD_NUM], &thread_attr, procImgTask, (void *)&threadParams) != 0) {
-    syslog(LOG_ERR, "couldn't create thread#%d", PROC_THEAD_NUM);
+  /*---------------------------------------*/
+  /* per-stage statistics; the frame period
+   * is nominally the processing deadline */
+  /*---------------------------------------*/
+  rtstats_init(&gFrameStats);
+  gCaptureStage = rtstats_add_stage(&gFrameStats, "capture", 0.0, 0.0);
+  gProcStage = rtstats_add_stage(&gFrameStats, "process", DEADLINE_MSEC, DEADLINE_MSEC);
+  gReleaseStage = rtstats_add_stage(&gFrameStats, "release", threadParams.maxLatencyMs, DEADLINE_MSEC);
+  if(rtstats_serve(&gFrameStats, STATS_SOCK_PATH, STATS_INTERVAL_MSEC) != 0) {
+    syslog(LOG_ERR, "couldn't serve statistics on %s, continuing without", STATS_SOCK_PATH);
+  }
+
+  /* per-frame latency and checksums, when a replay driver asks for them;
+   * a traced replay must give the same frames every run, so the reader
+   * waits for room instead of dropping and the reorder buffer waits for
+   * every frame */
+  if(ft_open(&gTrace, "prob5") < 0) {
+    return -1;
+  }
+  threadParams.lossless = (threadParams.replaySpec != NULL) && ft_enabled(&gTrace);
+  if(threadParams.lossless) {
+    threadParams.maxLatencyMs = 0.0;
+    syslog(LOG_INFO, "traced replay, no frames dropped");
+  }
+
+  /* quality ladder, shared by the workers so neighbouring frames are
+   * filtered alike; a fixed run is a ladder of one */
+  qosConfig_t qosConfig;
+  qosLevel_t qosLevels[NUM_QOS_LEVELS];
+  int bestLevel = build_qos_ladder(qosLevels, threadParams.filterMethod, threadParams.decimateFactor);
+  qos_default_config(&qosConfig, DEADLINE_MSEC);
+  if(threadParams.adaptive) {
+    qos_init(&gQos, &qosConfig, qosLevels, NUM_QOS_LEVELS, bestLevel);
+  } else {
+    qos_init(&gQos, &qosConfig, &qosLevels[bestLevel], 1, 0);
+  }
+
+  /* frames in flight: queued plus one in each worker */
+  if(rob_init(&gReorder, MQ_DEPTH + threadParams.numWorkers, threadParams.maxLatencyMs,
+              threadParams.dropPolicy, discard_result) != 0) {
+    syslog(LOG_ERR, "couldn't create reorder buffer");
+    return -1;
+  }
+
+  /* each thread gets its own copy of the parameters */
+  threadParams_t params[NUM_THREADS];
+  int numThreads = PROC_THEAD_NUM + threadParams.numWorkers;
+  for(int ind = 0; ind < numThreads; ++ind) {
+    params[ind] = threadParams;
+    params[ind].threadIdx = ind;
+    void *(*task)(void *) = (ind == READ_THEAD_NUM) ? readImgTask
+                            : ((ind == RELEASE_THEAD_NUM) ? releaseImgTask : procImgTask);
+    if(pthread_create(&threads[ind], &thread_attr, task, (void *)&params[ind]) != 0) {
+      syslog(LOG_ERR, "couldn't create thread#%d", ind);
+      threads[ind] = 0;
+    }
   }
 
   /*----------------------------------------------*/
   /* run main */
-  /* wait 10 sec kill threads */
+  /* wait 10 sec kill threads; a replay runs */
+  /* to the end of the recording instead */
   /*----------------------------------------------*/
-  sleep(10);
-  gAbortTest = 1;
+  if(threadParams.replaySpec == NULL) {
+    sleep(10);
+    gAbortTest = 1;
+  }
 
   /*----------------------------------------------*/
   /* exiting */
   /*----------------------------------------------*/
   syslog(LOG_INFO, "%s waiting on threads...", __func__);
-  for(uint8_t ind = 0; ind < NUM_THREADS; ++ind) {
-    pthread_join(threads[ind], NULL);
+  for(int ind = 0; ind < numThreads; ++ind) {
+    if((ind != RELEASE_THEAD_NUM) && (threads[ind] != 0)) {
+      pthread_join(threads[ind], NULL);
+    }
+    /* a reader that couldn't open the queue or never started left the
+     * workers waiting for it */
+    if((ind == READ_THEAD_NUM) && !gWorkersStopped) {
+      gAbortTest = 1;
+      stop_workers(mymq, threadParams.numWorkers);
+    }
+  }
+  /* nothing more will finish; release what did */
+  rob_close(&gReorder);
+  if(threads[RELEASE_THEAD_NUM] != 0) {
+    pthread_join(threads[RELEASE_THEAD_NUM], NULL);
   }
+  rob_destroy(&gReorder);
+  qos_log_stats(&gQos);
+  qos_destroy(&gQos);
+  ft_close(&gTrace);
+  rtstats_log(&gFrameStats);
+  rtstats_destroy(&gFrameStats);
   syslog(LOG_INFO, "%s exiting, stopping log", __func__);
   syslog(LOG_INFO, "...");
   syslog(LOG_INFO, "..");
@@ -204,14 +380,93 @@ int main(int argc, char *argv[])
   mq_close(mymq);
 }
 
+/* quality ladder, best first; sigma is scaled with the decimation so the
+ * blur covers the same part of the scene at every level. The cheaper rungs
+ * cut the kernel at 3 sigma, within 1 LSB of the full one; blur.c's IIR is
+ * not used for them, at these small sigmas it is off by up to 18 levels
+ * inside the frame and more at the borders */
+static int build_qos_ladder(qosLevel_t *levels, FilterType_e filterMethod, unsigned int decimateFactor)
+{
+  const qosLevel_t ladder[NUM_QOS_LEVELS] = {
+    {1, filterMethod, FILTER_SIZE},
+    {1, USE_BLUR_SEPARABLE, FILTER_3SIGMA_SIZE},
+    {2, filterMethod, (FILTER_SIZE / 2) | 1},
+    {2, USE_BLUR_SEPARABLE, (FILTER_3SIGMA_SIZE / 2) | 1},
+    {4, USE_BLUR_SEPARABLE, (FILTER_SIZE / 4) | 1}
+  };
+  int best = 0;
+
+  memcpy(levels, ladder, sizeof(ladder));
+  while((best < NUM_QOS_LEVELS - 1) && (levels[best].decimate < decimateFactor)) {
+    ++best;
+  }
+  return best;
+}
+
+static void filter_image(const Mat &src, Mat &dst, const qosLevel_t *level, blurEngine_t *engine,
+                         const Mat &kern1D, const Mat &kern2D)
+{
+  const double sigma = FILTER_SIGMA / level->decimate;
+
+  if(level->method == USE_GAUSSIAN_BLUR) {
+    GaussianBlur(src, dst, Size(level->ksize, level->ksize), sigma);
+  } else if (level->method == USE_FILTER_2D) {
+    filter2D(src, dst, CV_8U, kern2D);
+  } else if (level->method == USE_SEP_FILTER_2D) {
+    sepFilter2D(src, dst, CV_8U, kern1D, kern1D);
+  } else {
+    dst.create(src.size(), src.type());
+    blur_apply(engine, src.data, (int)src.step, dst.data, (int)dst.step,
+               src.cols, src.rows, src.channels());
+  }
+}
+
+/* refilter only the tiles the gate flagged; output within the kernel radius
+ * of a changed tile depends on it too, so each tile is rewritten with a band
+ * of that radius around it, filtered from input with a further band, and
+ * comes out as it would in a full-frame pass */
+static void filter_tiles(const Mat &src, Mat &dst, const changeGate_t *gate, const qosLevel_t *level,
+                         blurEngine_t *engine, const Mat &kern1D, const Mat &kern2D)
+{
+  const int margin = level->ksize / 2;
+  const Rect frame(0, 0, src.cols, src.rows);
+  Mat tileOut;
+  int x, y, w, h;
+
+  for(int tile = 0; tile < gate->numTiles; ++tile) {
+    if(!gate->changed[tile]) {
+      continue;
+    }
+    cg_tile_rect(gate, tile, &x, &y, &w, &h);
+    Rect affected = Rect(x - margin, y - margin, w + 2 * margin, h + 2 * margin) & frame;
+    Rect input = Rect(affected.x - margin, affected.y - margin, affected.width + 2 * margin,
+                      affected.height + 2 * margin) & frame;
+    filter_image(src(input), tileOut, level, engine, kern1D, kern2D);
+    tileOut(affected - input.tl()).copyTo(dst(affected));
+  }
+}
+
 void *procImgTask(void *arg)
 {
   Mat inputImg;
+  Mat workImg;
+  Mat outputImg;
+  blurEngine_t blurEngine;
+  Mat kern1D[NUM_QOS_LEVELS];
+  Mat kern2D[NUM_QOS_LEVELS];
+  const qosLevel_t *level;
+  int levelIdx, nextIdx;
   unsigned int prio;
   int nbytes;
   int id;
-  struct timespec prevTime, readTime, procTime;
+  struct timespec readTime, procTime;
+  frameMsg_t msg;
+  procResult_t *result;
   int cnt = 0;
+  changeGate_t gate;
+  pyramid_t *pyr;
+  int changed, pyrLevel;
+  unsigned int skipped = 0, partial = 0;
   
   /* get thread parameters */
   if(arg == NULL) {
@@ -228,55 +483,132 @@ void *procImgTask(void *arg)
     return NULL;
   }
 
-  Mat kern1D = getGaussianKernel(FILTER_SIZE, FILTER_SIGMA, CV_32F);
-  Mat kern2D = kern1D * kern1D.t();
+  /* the ladder is fixed once main set it up; only the level moves */
+  for(int ind = 0; ind < gQos.numLevels; ++ind) {
+    kern1D[ind] = getGaussianKernel(gQos.levels[ind].ksize, FILTER_SIGMA / gQos.levels[ind].decimate, CV_32F);
+    kern2D[ind] = kern1D[ind] * kern1D[ind].t();
+  }
+  levelIdx = qos_current(&gQos);
+  level = &gQos.levels[levelIdx];
+
+  /* blur.c workers inherit this thread's SCHED_FIFO priority */
+  if(blur_init(&blurEngine, level->ksize, FILTER_SIGMA / level->decimate,
+               (level->method == USE_BLUR_IIR) ? BLUR_IIR : BLUR_SEPARABLE, threadParams.blurThreads) != 0) {
+    syslog(LOG_ERR, "%s couldn't start blur engine", __func__);
+    mq_close(msgQueue);
+    return NULL;
+  }
+  syslog(LOG_INFO, "blur engine: %s, %d taps, %d threads", blur_method_name(blurEngine.method),
+         2 * blurEngine.radius + 1, blurEngine.numThreads);
+
+  memset(&gate, 0, sizeof(gate));
 
-  syslog(LOG_INFO, "%s started ...", __func__);
-  float cumTime = 0.0f;
-  float cumProcTime = 0.0f;
-  const float deadline_ms = 70.0f;
-  float maxJitter_ms = 0.0f;
-  float cumJitter_ms;
-  clock_gettime(CLOCK_MONOTONIC, &prevTime);
-  while(!gAbortTest) {
-    /* read oldest, highest priority msg from the message queue */
-    if(mq_receive(msgQueue, (char *)&inputImg, MAX_MSG_SIZE, &prio) < 0) {
+  syslog(LOG_INFO, "%s %d started ...", __func__, threadParams.threadIdx);
+  while(1) {
+    /* read oldest, highest priority msg from the message queue; the
+     * workers take turns, so neighbouring frames are filtered at once */
+    if(mq_receive(msgQueue, (char *)&msg, MAX_MSG_SIZE, &prio) < 0) {
       /* don't print if queue was empty */
       if(errno != EAGAIN) {
         syslog(LOG_ERR, "%s error with mq_receive, errno: %d [%s]", __func__, errno, strerror(errno));
       }
+    } else if(msg.img == NULL) {
+      break;                  /* readImgTask is done */
     } else {
-      /* process image */
+      inputImg = *msg.img;
+      delete msg.img;
+
+      /* the level any worker last picked */
+      nextIdx = qos_current(&gQos);
+      if(nextIdx != levelIdx) {
+        levelIdx = nextIdx;
+        level = &gQos.levels[levelIdx];
+        if((level->method == USE_BLUR_SEPARABLE) || (level->method == USE_BLUR_IIR)) {
+          blur_configure(&blurEngine, level->ksize, FILTER_SIGMA / level->decimate,
+                         (level->method == USE_BLUR_IIR) ? BLUR_IIR : BLUR_SEPARABLE);
+        }
+        /* the kept output was filtered at the old level */
+        cg_invalidate(&gate);
+      }
+
+      /* process image; decimate in software so the level can change
+       * every frame, then filter into a separate output. The frame's
+       * pyramid has the power-of-two sizes, built only as far as needed */
       clock_gettime(CLOCK_MONOTONIC, &procTime);
-      if(threadParams.filterMethod == USE_GAUSSIAN_BLUR) {
-        GaussianBlur(inputImg, inputImg, Size(FILTER_SIZE, FILTER_SIZE), FILTER_SIGMA);
-      } else if (threadParams.filterMethod == USE_FILTER_2D) {
-        filter2D(inputImg, inputImg, CV_8U, kern2D);
+      pyr = pyr_from_mat(inputImg, PYR_BOX);
+      pyrLevel = (pyr != NULL) ? pyr_find(pyr, inputImg.cols / level->decimate,
+                                          inputImg.rows / level->decimate) : -1;
+      workImg = (pyrLevel >= 0) ? pyr_mat(pyr, pyrLevel) : Mat();
+      if(workImg.empty()) {
+        resize(inputImg, workImg, Size(inputImg.cols / level->decimate, inputImg.rows / level->decimate),
+               0, 0, INTER_AREA);
+      }
+
+      /* a static scene needs no refiltering; a few changed tiles only those */
+      changed = -1;
+      if(threadParams.gate) {
+        if(!cg_matches(&gate, workImg.cols, workImg.rows, workImg.channels())) {
+          cg_destroy(&gate);
+          if(cg_init(&gate, workImg.cols, workImg.rows, workImg.channels(),
+                     CG_DEFAULT_TILE, CG_DEFAULT_THRESHOLD) != 0) {
+            syslog(LOG_ERR, "%s couldn't set up change gate, filtering every frame", __func__);
+            threadParams.gate = 0;
+          }
+        }
+        if(threadParams.gate) {
+          changed = cg_update(&gate, workImg.data, workImg.step);
+        }
+      }
+      bool reusable = (changed >= 0) && (outputImg.size() == workImg.size()) &&
+                      (outputImg.type() == workImg.type());
+      bool fullFrame = false;
+      if(reusable && (changed == 0)) {
+        ++skipped;
+      } else if(reusable && (changed <= GATE_PARTIAL_FRACTION * gate.numTiles)) {
+        filter_tiles(workImg, outputImg, &gate, level, &blurEngine, kern1D[levelIdx], kern2D[levelIdx]);
+        ++partial;
       } else {
-        sepFilter2D(inputImg, inputImg, CV_8U, kern1D, kern1D);
+        filter_image(workImg, outputImg, level, &blurEngine, kern1D[levelIdx], kern2D[levelIdx]);
+        fullFrame = true;
       }
       clock_gettime(CLOCK_MONOTONIC, &readTime);
-      if(cnt > 0) {
-        cumProcTime += CALC_DT_MSEC(readTime, procTime);
-        cumTime += CALC_DT_MSEC(readTime, prevTime);
-        cumJitter_ms += deadline_ms - CALC_DT_MSEC(readTime, prevTime);
-        if (CALC_DT_MSEC(readTime, prevTime) > deadline_ms) {
-          syslog(LOG_ERR, "deadline missed: %f", CALC_DT_MSEC(readTime, prevTime));
-        }
+      workImg.release();
+      if(pyr != NULL) {
+        pyr_unref(pyr);
+      }
+
+      /* hand a copy to the reorder buffer; outputImg stays ours, the
+       * change gate may reuse it for the next frame */
+      result = new procResult_t;
+      result->img = outputImg.clone();
+      result->method = level->method;
+      result->decimate = level->decimate;
+      result->frame = msg.frame;
+      result->captured = msg.captured;
+      result->released = msg.released;
+      inputImg.release();
+      rob_complete(&gReorder, msg.seq, result);
+
+      /* let the controller pick the level for the next frames; only a
+       * full-frame filter tells what the level costs, a reused frame or a
+       * few tiles would pull the average down and invite an upgrade the
+       * next full frame can't afford */
+      if(fullFrame) {
+        qos_update(&gQos, levelIdx, CALC_DT_MSEC(readTime, procTime));
       }
+      rtstats_record(&gFrameStats, gProcStage, &procTime, &readTime);
       ++cnt;
-      prevTime = readTime;
     }
   }
-  /* ignore first frame */
-  syslog(LOG_INFO, "avg frame time: %f msec",cumTime / (cnt - 1));
-  syslog(LOG_INFO, "avg proc time: %f msec", cumProcTime / (cnt - 1));
-  syslog(LOG_INFO, "avg jitter: %f msec", cumJitter_ms / (cnt - 1));
-  
-  /* save am image for comparison later */
-  char filename[80];
-  sprintf(filename,"filt%d_Size%d.jpg",threadParams.filterMethod, threadParams.decimateFactor);
-  imwrite(filename, inputImg);
+  if(threadParams.gate) {
+    syslog(LOG_INFO, "worker %d change gate: %u of %d frames reused, %u refiltered by tile, %.1f%% of tiles changed",
+           threadParams.threadIdx, skipped, cnt, partial,
+           (gate.tilesCompared > 0) ? 100.0 * gate.tilesChanged / gate.tilesCompared : 0.0);
+    cout << "worker " << threadParams.threadIdx << " change gate: " << skipped << " of " << cnt
+         << " frames reused, " << partial << " refiltered by tile" << endl;
+  }
+  cg_destroy(&gate);
+  blur_destroy(&blurEngine);
 
   syslog(LOG_INFO, "%s exiting", __func__);
   mq_close(msgQueue);
@@ -287,9 +619,13 @@ void *readImgTask(void*arg)
 {
   unsigned int cnt = 0;
   unsigned int prio = 30;
+  unsigned int refused = 0;
+  uint32_t frames = 0;
   Mat readImg;
+  frameMsg_t msg;
   struct timespec expireTime;
   struct timespec startTime;
+  struct timespec capTime;
 
   /* get thread parameters */
   if(arg == NULL) {
@@ -303,47 +639,195 @@ void *readImgTask(void*arg)
   if(msgQueue == -1) {
     syslog(LOG_ERR, "%s couldn't open queue", __func__);
     cout << __func__<< " couldn't open queue" << endl;
+    gAbortTest = 1;           /* main stops the workers instead */
     return NULL;
   }
 
   /* open camera stream */
-  VideoCapture cam;
-  if(!cam.open(threadParams.cameraIdx)) {
+  ReplayCapture cam;
+  bool opened = (threadParams.replaySpec != NULL) ? cam.open(String(threadParams.replaySpec))
+                                                  : cam.open(threadParams.cameraIdx);
+  if(!opened) {
     syslog(LOG_ERR, "couldn't open camera");
     cout << "couldn't open camera" << endl;
-    return NULL;
+    gAbortTest = 1;           /* still stop the workers below */
   } else {
-    cam.set(CAP_PROP_FRAME_WIDTH, 640 / threadParams.decimateFactor);
-    cam.set(CAP_PROP_FRAME_HEIGHT, 480 / threadParams.decimateFactor);
+    /* always capture full size; procImgTask decimates per its qos level */
+    cam.set(CAP_PROP_FRAME_WIDTH, MAX_IMG_COLS);
+    cam.set(CAP_PROP_FRAME_HEIGHT, MAX_IMG_ROWS);
     cout  << "cam size (HxW): " << cam.get(CAP_PROP_FRAME_WIDTH)
           << " x " << cam.get(CAP_PROP_FRAME_HEIGHT) << endl;
   }
 
   syslog(LOG_INFO, "%s started ...", __func__);
   clock_gettime(CLOCK_MONOTONIC, &startTime);
-  while((!gAbortTest) && (cnt < MAX_ITERATIONS)) {
+  while((!gAbortTest) && ((threadParams.replaySpec != NULL) || (cnt < MAX_ITERATIONS))) {
     /* read image from video */
+    clock_gettime(CLOCK_MONOTONIC, &capTime);
     cam >> readImg;
+    if(readImg.empty()) {
+      break;                  /* end of a replayed recording */
+    }
+    ++frames;
 
-    /* try to insert image but don't block if full
-     * so that we loop around and just get the newest */
+    /* a full reorder window under drop-newest refuses the frame */
     clock_gettime(CLOCK_MONOTONIC, &expireTime);
-    if(mq_timedsend(msgQueue, (const char *)&readImg, MAX_MSG_SIZE, prio, &expireTime) != 0) {
+    rtstats_record(&gFrameStats, gCaptureStage, &capTime, &expireTime);
+    if(threadParams.lossless) {
+      if(rob_admit_wait(&gReorder, &msg.seq) != 0) {
+        break;
+      }
+    } else if(rob_admit(&gReorder, &msg.seq) != 0) {
+      ++refused;
+      continue;
+    }
+
+    /* the worker gets its own reference; the next read then fills a new
+     * buffer instead of the one being filtered */
+    msg.img = new Mat(readImg);
+    msg.captured = capTime;
+    if(cam.replaying()) {
+      msg.frame = cam.lastFrame().sequence;
+      msg.released = cam.lastFrame().timestamp;
+    } else {
+      msg.frame = frames - 1;
+      msg.released = capTime;
+    }
+    readImg.release();
+
+    /* try to insert image but don't block if full
+     * so that we loop around and just get the newest;
+     * a traced replay waits instead */
+    int sent = threadParams.lossless ? mq_send(msgQueue, (const char *)&msg, MAX_MSG_SIZE, prio)
+                                     : mq_timedsend(msgQueue, (const char *)&msg, MAX_MSG_SIZE, prio, &expireTime);
+    if(sent != 0) {
       /* don't print if queue was empty */
       if(errno != ETIMEDOUT) {
         syslog(LOG_ERR, "%s error with mq_send, errno: %d [%s]", __func__, errno, strerror(errno));
       }
       cout << __func__ << " error with mq_send, errno: " << errno << " [" << strerror(errno) << "]" << endl;
+      delete msg.img;
+      rob_complete(&gReorder, msg.seq, NULL);
     } else {
       ++cnt;
     }
   }
   gAbortTest = 1;
+
+  stop_workers(msgQueue, threadParams.numWorkers);
+  if(refused > 0) {
+    syslog(LOG_INFO, "%s %u frames refused, reorder window full", __func__, refused);
+    cout << __func__ << " " << refused << " frames refused, reorder window full" << endl;
+  }
+  if(cam.dropped() > 0) {
+    syslog(LOG_INFO, "%s replay skipped %llu late frames", __func__, (unsigned long long)cam.dropped());
+    cout << __func__ << " replay skipped " << cam.dropped() << " late frames" << endl;
+  }
   syslog(LOG_INFO, "%s exiting", __func__);
   mq_close(msgQueue);
   return NULL;
 }
 
+/* takes results in capture order; the end-to-end latency and the deadline
+ * are measured here, where a frame is finally done */
+void *releaseImgTask(void *arg)
+{
+  procResult_t *result;
+  void *item;
+  uint32_t seq, expected = 0;
+  uint64_t gaps = 0;
+  Mat lastImg;
+  int lastMethod = 0;
+  unsigned int lastDecimate = 1;
+  struct timespec releaseTime, prevTime;
+  int cnt = 0;
+
+  if(arg == NULL) {
+    syslog(LOG_ERR, "invalid arg provided to %s", __func__);
+    return NULL;
+  }
+
+  syslog(LOG_INFO, "%s started ...", __func__);
+  const float deadline_ms = DEADLINE_MSEC;
+  while(rob_next(&gReorder, &seq, &item, NULL) == 1) {
+    result = (procResult_t *)item;
+    clock_gettime(CLOCK_MONOTONIC, &releaseTime);
+    rtstats_record(&gFrameStats, gReleaseStage, &result->captured, &releaseTime);
+    if(ft_enabled(&gTrace)) {
+      const Mat &out = result->img;
+      ft_record(&gTrace, result->frame, &result->released, &releaseTime,
+                ft_checksum_image(FT_CHECKSUM_INIT, out.data, out.rows, out.cols * out.elemSize(), out.step));
+    }
+    if(cnt > 0) {
+      if (CALC_DT_MSEC(releaseTime, prevTime) > deadline_ms) {
+        syslog(LOG_ERR, "deadline missed: %f", CALC_DT_MSEC(releaseTime, prevTime));
+      }
+    }
+    gaps += seq - expected;
+    expected = seq + 1;
+    ++cnt;
+    prevTime = releaseTime;
+
+    lastImg = result->img;
+    lastMethod = result->method;
+    lastDecimate = result->decimate;
+    delete result;
+  }
+
+  /* save am image for comparison later */
+  if(!lastImg.empty()) {
+    char filename[80];
+    sprintf(filename,"filt%d_Size%d.jpg", lastMethod, lastDecimate);
+    imwrite(filename, lastImg);
+  }
+  syslog(LOG_INFO, "%s: %d released in order, %llu skipped (%llu over latency or lost, %llu evicted), "
+         "%llu late results discarded", __func__, cnt, (unsigned long long)gaps,
+         (unsigned long long)gReorder.expired, (unsigned long long)gReorder.evicted,
+         (unsigned long long)gReorder.late);
+  cout << cnt << " frames released in order, " << gaps << " skipped, "
+       << gReorder.late << " late results discarded" << endl;
+  syslog(LOG_INFO, "%s exiting", __func__);
+  return NULL;
+}
+
+static void discard_result(void *result)
+{
+  delete (procResult_t *)result;
+}
+
+/* one stop per worker, behind the frames still queued */
+static void stop_workers(mqd_t msgQueue, int numWorkers)
+{
+  frameMsg_t msg;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.img = NULL;
+  for(int ind = 0; ind < numWorkers; ++ind) {
+    if(mq_send(msgQueue, (const char *)&msg, MAX_MSG_SIZE, 0) != 0) {
+      syslog(LOG_ERR, "%s couldn't stop a worker, errno: %d [%s]", __func__, errno, strerror(errno));
+    }
+  }
+  gWorkersStopped = 1;
+}
+
+static void print_usage(void)
+{
+  cout  << "Usage: prob5 [decimation factor] [filter type] [adaptive] [source] [gate] [workers]\n"
+          << "decimation factor[0 = original size, 1 = half size, 2 = quarter size]\n"
+          << "filter type [0 = gaussionBlur(), 1 = filter2D(), 2 = sepFilter2D(),\n"
+          << "             3 = blur.c separable, 4 = blur.c recursive (IIR)]\n"
+          << "adaptive [1 = trade resolution/filter for deadline (default), 0 = fixed]\n"
+          << "source [camera index (default 0) or a recording to replay at its frame rate,\n"
+          << "        e.g. pnm:rec/f%04d.ppm,fps=30, yuyv:cam.yuv,size=640x480,ts=t.txt or\n"
+          << "        far:run.far (capture -A); a recording plays to its end, and with\n"
+          << "        " FT_ENV_PATH "=file set every released frame is traced to file]\n"
+          << "gate [1 = refilter only changed tiles, reuse unchanged frames (default), 0 = every frame]\n"
+          << "workers [N[:max latency msec[:newest|oldest]]], frames filtered at once (default 1);\n"
+          << "        results leave in capture order, a frame is waited for at most max latency\n"
+          << "        (default " << ROB_MAX_LATENCY_MSEC << ", 0 = forever) and a full window drops the newest\n"
+          << "        (default) or oldest frame\n";
+}
+
 void print_scheduler(void)
 {
   switch (sched_getscheduler(getpid()))
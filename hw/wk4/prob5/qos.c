@@ -0,0 +1,174 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file qos.c
+ * @brief frame-deadline aware quality controller
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "qos.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define QOS_PROBE_FACTOR              (4)     /* retry a level that looked too slow */
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+
+void qos_default_config(qosConfig_t *config, float targetMs)
+{
+  config->targetMs = targetMs;
+  config->alpha = 0.25f;
+  config->highWater = 0.85f;
+  config->lowWater = 0.55f;
+  config->upgradeFrames = 15;
+  config->holdFrames = 3;
+}
+
+int qos_init(qosController_t *qos, const qosConfig_t *config,
+             const qosLevel_t *levels, int numLevels, int bestLevel)
+{
+  if((qos == NULL) || (config == NULL) || (levels == NULL) ||
+     (numLevels < 1) || (numLevels > QOS_MAX_LEVELS) ||
+     (bestLevel < 0) || (bestLevel >= numLevels)) {
+    return -1;
+  }
+
+  memset(qos, 0, sizeof(qosController_t));
+  qos->config = *config;
+  memcpy(qos->levels, levels, numLevels * sizeof(qosLevel_t));
+  qos->numLevels = numLevels;
+  qos->bestLevel = bestLevel;
+  qos->stats.level = bestLevel;
+  pthread_mutex_init(&qos->lock, NULL);
+  return 0;
+}
+
+const qosLevel_t *qos_level(qosController_t *qos)
+{
+  return &qos->levels[qos_current(qos)];
+}
+
+int qos_current(qosController_t *qos)
+{
+  int level;
+
+  pthread_mutex_lock(&qos->lock);
+  level = qos->stats.level;
+  pthread_mutex_unlock(&qos->lock);
+  return level;
+}
+
+int qos_update(qosController_t *qos, int ranAt, float procMs)
+{
+  const qosConfig_t *cfg = &qos->config;
+  qosStats_t *st = &qos->stats;
+  float *cost;
+  int level;
+
+  if((ranAt < 0) || (ranAt >= qos->numLevels)) {
+    return qos_current(qos);
+  }
+
+  pthread_mutex_lock(&qos->lock);
+  level = st->level;
+
+  /* a frame started before the last change says nothing about the
+   * current level; keep only its level's cost */
+  if(ranAt != level) {
+    cost = &st->levelCostMs[ranAt];
+    *cost = (*cost == 0.0f) ? procMs : (cfg->alpha * procMs + (1.0f - cfg->alpha) * *cost);
+    pthread_mutex_unlock(&qos->lock);
+    return level;
+  }
+
+  /* running averages, overall and for this level */
+  st->ewmaMs = (st->frames == 0) ? procMs : (cfg->alpha * procMs + (1.0f - cfg->alpha) * st->ewmaMs);
+  cost = &st->levelCostMs[level];
+  *cost = (*cost == 0.0f) ? procMs : (cfg->alpha * procMs + (1.0f - cfg->alpha) * *cost);
+  if(procMs > st->maxMs) {
+    st->maxMs = procMs;
+  }
+  ++st->frames;
+  ++st->framesAtLevel[level];
+  if(procMs > cfg->targetMs) {
+    ++st->misses;
+  }
+
+  if(qos->holdLeft > 0) {
+    --qos->holdLeft;
+  } else if((level < qos->numLevels - 1) &&
+            ((procMs > cfg->targetMs) || (st->ewmaMs > cfg->highWater * cfg->targetMs))) {
+    /* overloaded: give up quality now */
+    ++level;
+    ++st->downgrades;
+  } else if((level > qos->bestLevel) && (st->ewmaMs < cfg->lowWater * cfg->targetMs)) {
+    /* headroom: step up once it has lasted and the better level should fit;
+     * its cost may be stale from a busy spell, so probe it after a long calm */
+    ++qos->calmFrames;
+    if(((qos->calmFrames >= cfg->upgradeFrames) &&
+        (st->levelCostMs[level - 1] < cfg->highWater * cfg->targetMs)) ||
+       (qos->calmFrames >= QOS_PROBE_FACTOR * cfg->upgradeFrames)) {
+      --level;
+      ++st->upgrades;
+    }
+  } else {
+    qos->calmFrames = 0;
+  }
+
+  if(level != st->level) {
+    syslog(LOG_INFO, "qos: level %d -> %d (ewma %.1f msec, frame %.1f msec)",
+           st->level, level, st->ewmaMs, procMs);
+    st->level = level;
+    qos->calmFrames = 0;
+    qos->holdLeft = cfg->holdFrames;
+    /* judge the new level by its own frames, seeded with its past cost */
+    if(st->levelCostMs[level] != 0.0f) {
+      st->ewmaMs = st->levelCostMs[level];
+    }
+  }
+
+  pthread_mutex_unlock(&qos->lock);
+  return level;
+}
+
+void qos_get_stats(qosController_t *qos, qosStats_t *stats)
+{
+  pthread_mutex_lock(&qos->lock);
+  *stats = qos->stats;
+  pthread_mutex_unlock(&qos->lock);
+}
+
+void qos_log_stats(qosController_t *qos)
+{
+  qosStats_t st;
+  int ind;
+
+  qos_get_stats(qos, &st);
+  syslog(LOG_INFO, "qos: %llu frames, %llu misses, %u downgrades, %u upgrades, max %.1f msec",
+         (unsigned long long)st.frames, (unsigned long long)st.misses,
+         st.downgrades, st.upgrades, st.maxMs);
+  for(ind = 0; ind < qos->numLevels; ++ind) {
+    syslog(LOG_INFO, "qos: level %d (decimate %u, method %d, ksize %d): %llu frames, cost %.1f msec",
+           ind, qos->levels[ind].decimate, qos->levels[ind].method, qos->levels[ind].ksize,
+           (unsigned long long)st.framesAtLevel[ind], st.levelCostMs[ind]);
+  }
+}
+
+void qos_destroy(qosController_t *qos)
+{
+  pthread_mutex_destroy(&qos->lock);
+}
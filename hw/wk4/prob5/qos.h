@@ -0,0 +1,154 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file qos.h
+ * @brief frame-deadline aware quality controller
+ *
+ * The caller supplies a ladder of quality levels, best first (e.g. full
+ * resolution with a wide kernel) to cheapest last (quarter resolution, a
+ * short kernel), and reports each frame's processing time. The controller
+ * keeps an EWMA of the time and a separate EWMA of the cost measured at
+ * every level, and
+ *  - steps down one level at once on a deadline miss, or when the EWMA
+ *    crosses highWater * target
+ *  - steps up one level only after upgradeFrames calm frames below
+ *    lowWater * target, and only if the better level's last measured cost
+ *    fits under highWater * target (or after 4 * upgradeFrames, in case
+ *    that cost was measured during a busy spell)
+ *  - holds for holdFrames after any change so a level is measured before
+ *    it is judged
+ * so resolution is given up before frames are dropped, and the gap between
+ * the two water marks keeps it from oscillating.
+ *
+ * One controller serves every worker of a pipeline: each reads the current
+ * level before a frame and reports the frame with the level it ran at, so
+ * consecutive frames are filtered alike and every frame's timing counts.
+ *
+ ************************************************************************************
+ */
+
+#ifndef QOS_H
+#define QOS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QOS_MAX_LEVELS                (8)
+
+typedef struct {
+  unsigned int decimate;        /* 1, 2 or 4 */
+  int method;                   /* caller's filter method */
+  int ksize;                    /* kernel size at that resolution */
+} qosLevel_t;
+
+typedef struct {
+  float targetMs;               /* processing deadline */
+  float alpha;                  /* EWMA weight of the newest frame */
+  float highWater;              /* step down above highWater * target */
+  float lowWater;               /* step up below lowWater * target */
+  unsigned int upgradeFrames;   /* calm frames needed to step up */
+  unsigned int holdFrames;      /* frames to stay after any change */
+} qosConfig_t;
+
+typedef struct {
+  uint64_t frames;
+  uint64_t misses;              /* frames over targetMs */
+  uint32_t downgrades;
+  uint32_t upgrades;
+  int level;                    /* current level */
+  float ewmaMs;
+  float maxMs;
+  uint64_t framesAtLevel[QOS_MAX_LEVELS];
+  float levelCostMs[QOS_MAX_LEVELS];  /* EWMA per level, 0 = never run */
+} qosStats_t;
+
+typedef struct {
+  qosConfig_t config;
+  qosLevel_t levels[QOS_MAX_LEVELS];
+  int numLevels;
+  int bestLevel;                /* never step above this one */
+  unsigned int calmFrames;
+  unsigned int holdLeft;
+  qosStats_t stats;
+  pthread_mutex_t lock;         /* stats may be read from another thread */
+} qosController_t;
+
+/**
+ * @brief fill in defaults: alpha 0.25, water marks 0.85 / 0.55,
+ * 15 calm frames to step up, hold 3 frames
+ *
+ * @param config config to initialize
+ * @param targetMs processing deadline in msec
+ */
+void qos_default_config(qosConfig_t *config, float targetMs);
+
+/**
+ * @brief set up a controller
+ *
+ * @param qos controller to initialize
+ * @param config tuning, see qos_default_config()
+ * @param levels quality ladder, best first
+ * @param numLevels entries in levels (1..QOS_MAX_LEVELS)
+ * @param bestLevel starting level and the best one the controller may use
+ * @return int 0 on success, -1 on bad arguments
+ */
+int qos_init(qosController_t *qos, const qosConfig_t *config,
+             const qosLevel_t *levels, int numLevels, int bestLevel);
+
+/**
+ * @brief current quality level; safe from any thread
+ */
+const qosLevel_t *qos_level(qosController_t *qos);
+
+/**
+ * @brief index of the current quality level; safe from any thread
+ */
+int qos_current(qosController_t *qos);
+
+/**
+ * @brief report one frame's processing time and pick the next level; safe
+ * from any thread
+ *
+ * @param qos controller
+ * @param ranAt level the frame was processed at; if another frame has moved
+ *        the controller off it meanwhile, only that level's cost is updated
+ * @param procMs processing time of the frame just finished
+ * @return int level to use for the next frame
+ */
+int qos_update(qosController_t *qos, int ranAt, float procMs);
+
+/**
+ * @brief copy the statistics; safe from any thread
+ *
+ * @param qos controller
+ * @param stats destination
+ */
+void qos_get_stats(qosController_t *qos, qosStats_t *stats);
+
+/**
+ * @brief write the statistics to syslog
+ *
+ * @param qos controller
+ */
+void qos_log_stats(qosController_t *qos);
+
+/**
+ * @brief release the controller
+ */
+void qos_destroy(qosController_t *qos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QOS_H */
@@ -0,0 +1,249 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file reorder.c
+ * @brief puts frames finished by parallel workers back in capture order
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdlib.h>
+#include <string.h>
+
+#include "reorder.h"
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static void add_ms(struct timespec *ts, double ms)
+{
+  long long nsec = ts->tv_nsec + (long long)(ms * 1.0e6);
+
+  ts->tv_sec += (time_t)(nsec / 1000000000LL);
+  ts->tv_nsec = (long)(nsec % 1000000000LL);
+}
+
+static int reached(const struct timespec *now, const struct timespec *when)
+{
+  return (now->tv_sec > when->tv_sec) ||
+         ((now->tv_sec == when->tv_sec) && (now->tv_nsec >= when->tv_nsec));
+}
+
+/* the head moves on: a slot is free for rob_admit_wait() */
+static void advance_head(reorderBuf_t *rob)
+{
+  ++rob->head;
+  pthread_cond_broadcast(&rob->space);
+}
+
+static void drop_result(reorderBuf_t *rob, void *result)
+{
+  if((result != NULL) && (rob->discard != NULL)) {
+    rob->discard(result);
+  }
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int rob_init(reorderBuf_t *rob, unsigned int capacity, double maxLatencyMs,
+             robDropPolicy_e policy, void (*discard)(void *result))
+{
+  pthread_condattr_t attr;
+
+  memset(rob, 0, sizeof(*rob));
+  if(capacity == 0) {
+    return -1;
+  }
+  rob->slots = (robSlot_t *)calloc(capacity, sizeof(robSlot_t));
+  if(rob->slots == NULL) {
+    return -1;
+  }
+  rob->capacity = capacity;
+  rob->maxLatencyMs = maxLatencyMs;
+  rob->policy = policy;
+  rob->discard = discard;
+  pthread_mutex_init(&rob->lock, NULL);
+  /* latency is measured on the monotonic clock, so wait on it too */
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&rob->ready, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&rob->space, NULL);
+  return 0;
+}
+
+/* called locked; unlocks */
+static int admit_locked(reorderBuf_t *rob, uint32_t *seq)
+{
+  robSlot_t *slot;
+
+  if(rob->closed) {
+    pthread_mutex_unlock(&rob->lock);
+    return -1;
+  }
+  if(rob->tail - rob->head == rob->capacity) {
+    /* a finished head is about to be released, so it is not given up on
+     * even under ROB_DROP_OLDEST; the new frame is refused instead */
+    slot = &rob->slots[rob->head % rob->capacity];
+    if((rob->policy == ROB_DROP_NEWEST) || (slot->state == ROB_DONE)) {
+      ++rob->refused;
+      pthread_mutex_unlock(&rob->lock);
+      return -1;
+    }
+    /* the oldest slot is the one about to be reused; a result still on its
+     * way for it will not match the new sequence and is discarded */
+    ++rob->evicted;
+    advance_head(rob);
+    pthread_cond_broadcast(&rob->ready);
+  }
+
+  slot = &rob->slots[rob->tail % rob->capacity];
+  slot->seq = rob->tail;
+  slot->state = ROB_PENDING;
+  slot->result = NULL;
+  clock_gettime(CLOCK_MONOTONIC, &slot->admitted);
+  *seq = rob->tail++;
+  ++rob->admitted;
+  /* a consumer waiting on an empty window has no deadline yet; wake it to
+   * start timing this frame */
+  if(rob->tail - rob->head == 1) {
+    pthread_cond_broadcast(&rob->ready);
+  }
+  pthread_mutex_unlock(&rob->lock);
+  return 0;
+}
+
+int rob_admit(reorderBuf_t *rob, uint32_t *seq)
+{
+  pthread_mutex_lock(&rob->lock);
+  return admit_locked(rob, seq);
+}
+
+int rob_admit_wait(reorderBuf_t *rob, uint32_t *seq)
+{
+  pthread_mutex_lock(&rob->lock);
+  while(!rob->closed && (rob->tail - rob->head == rob->capacity)) {
+    pthread_cond_wait(&rob->space, &rob->lock);
+  }
+  return admit_locked(rob, seq);
+}
+
+void rob_complete(reorderBuf_t *rob, uint32_t seq, void *result)
+{
+  robSlot_t *slot;
+
+  pthread_mutex_lock(&rob->lock);
+  slot = &rob->slots[seq % rob->capacity];
+  if((slot->seq != seq) || (slot->state != ROB_PENDING)) {
+    ++rob->late;
+    pthread_mutex_unlock(&rob->lock);
+    drop_result(rob, result);
+    return;
+  }
+  if(result == NULL) {
+    slot->state = ROB_EXPIRED;
+    ++rob->expired;
+  } else {
+    slot->state = ROB_DONE;
+    slot->result = result;
+  }
+  if(seq == rob->head) {
+    pthread_cond_broadcast(&rob->ready);
+  }
+  pthread_mutex_unlock(&rob->lock);
+}
+
+int rob_next(reorderBuf_t *rob, uint32_t *seq, void **result, struct timespec *admitted)
+{
+  struct timespec now, deadline;
+  robSlot_t *slot;
+
+  pthread_mutex_lock(&rob->lock);
+  for(;;) {
+    if(rob->head == rob->tail) {
+      if(rob->closed) {
+        pthread_mutex_unlock(&rob->lock);
+        return 0;
+      }
+      pthread_cond_wait(&rob->ready, &rob->lock);
+      continue;
+    }
+
+    slot = &rob->slots[rob->head % rob->capacity];
+    if(slot->state == ROB_DONE) {
+      *seq = slot->seq;
+      *result = slot->result;
+      if(admitted != NULL) {
+        *admitted = slot->admitted;
+      }
+      slot->state = ROB_FREE;
+      slot->result = NULL;
+      advance_head(rob);
+      ++rob->released;
+      pthread_mutex_unlock(&rob->lock);
+      return 1;
+    }
+    if(slot->state != ROB_PENDING) {
+      advance_head(rob);
+      continue;
+    }
+
+    /* the head is still being worked on */
+    if(rob->closed) {
+      slot->state = ROB_EXPIRED;
+      ++rob->expired;
+      advance_head(rob);
+      continue;
+    }
+    if(rob->maxLatencyMs <= 0.0) {
+      pthread_cond_wait(&rob->ready, &rob->lock);
+      continue;
+    }
+    deadline = slot->admitted;
+    add_ms(&deadline, rob->maxLatencyMs);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(reached(&now, &deadline)) {
+      slot->state = ROB_EXPIRED;
+      ++rob->expired;
+      advance_head(rob);
+      continue;
+    }
+    pthread_cond_timedwait(&rob->ready, &rob->lock, &deadline);
+  }
+}
+
+void rob_close(reorderBuf_t *rob)
+{
+  pthread_mutex_lock(&rob->lock);
+  rob->closed = 1;
+  pthread_cond_broadcast(&rob->ready);
+  pthread_cond_broadcast(&rob->space);
+  pthread_mutex_unlock(&rob->lock);
+}
+
+void rob_destroy(reorderBuf_t *rob)
+{
+  uint32_t seq;
+
+  if(rob->slots == NULL) {
+    return;
+  }
+  for(seq = rob->head; seq != rob->tail; ++seq) {
+    robSlot_t *slot = &rob->slots[seq % rob->capacity];
+    if(slot->state == ROB_DONE) {
+      drop_result(rob, slot->result);
+    }
+  }
+  free(rob->slots);
+  rob->slots = NULL;
+  pthread_cond_destroy(&rob->ready);
+  pthread_cond_destroy(&rob->space);
+  pthread_mutex_destroy(&rob->lock);
+}
@@ -0,0 +1,147 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file reorder.h
+ * @brief puts frames finished by parallel workers back in capture order
+ *
+ * The capture side admits each frame, which gives it the next sequence
+ * number and a slot in a window of capacity frames. Workers complete frames
+ * in any order; the consumer takes results strictly in sequence. A frame
+ * still unfinished maxLatencyMs after admission is given up on, so one slow
+ * frame delays the ones behind it by at most that long; its result is
+ * discarded whenever it does turn up. When the window is full the drop
+ * policy decides between refusing the new frame and giving up on the
+ * oldest one; a finished oldest frame is released rather than given up on,
+ * so the new frame is refused then.
+ *
+ ************************************************************************************
+ */
+
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ROB_DROP_NEWEST,              /* window full: the new frame is refused */
+  ROB_DROP_OLDEST               /* window full: the oldest frame is given up on,
+                                 * unless finished, then as ROB_DROP_NEWEST */
+} robDropPolicy_e;
+
+typedef enum {
+  ROB_FREE,
+  ROB_PENDING,                  /* admitted, no result yet */
+  ROB_DONE,                     /* result waiting for its turn */
+  ROB_EXPIRED                   /* given up on; a late result is discarded */
+} robState_e;
+
+typedef struct {
+  uint32_t seq;
+  robState_e state;
+  struct timespec admitted;     /* CLOCK_MONOTONIC */
+  void *result;
+} robSlot_t;
+
+typedef struct {
+  robSlot_t *slots;
+  unsigned int capacity;
+  uint32_t head;                /* next sequence to release */
+  uint32_t tail;                /* next sequence to admit */
+  double maxLatencyMs;          /* 0 waits for every frame */
+  robDropPolicy_e policy;
+  void (*discard)(void *result);
+  int closed;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;         /* head finished, expired or closed */
+  pthread_cond_t space;         /* head moved on, or closed */
+
+  /* counters */
+  uint64_t admitted;
+  uint64_t released;
+  uint64_t refused;             /* window full, ROB_DROP_NEWEST or a finished head */
+  uint64_t evicted;             /* window full, ROB_DROP_OLDEST */
+  uint64_t expired;             /* over maxLatencyMs, or abandoned */
+  uint64_t late;                /* results that came after their frame expired */
+} reorderBuf_t;
+
+/**
+ * @brief set up an empty window
+ *
+ * @param rob buffer to initialize
+ * @param capacity frames in flight at most
+ * @param maxLatencyMs how long the head frame is waited for; 0 = forever
+ * @param policy what gives when the window is full
+ * @param discard frees a result the buffer drops (late, or evicted); may be NULL
+ * @return int 0 on success, -1 if out of memory or capacity is 0
+ */
+int rob_init(reorderBuf_t *rob, unsigned int capacity, double maxLatencyMs,
+             robDropPolicy_e policy, void (*discard)(void *result));
+
+/**
+ * @brief admit a frame; never blocks
+ *
+ * @param rob buffer
+ * @param seq set to the frame's sequence number
+ * @return int 0 if admitted, -1 if refused (window full under
+ *         ROB_DROP_NEWEST or with a finished oldest frame, or closed)
+ */
+int rob_admit(reorderBuf_t *rob, uint32_t *seq);
+
+/**
+ * @brief admit a frame, waiting for a slot while the window is full, so no
+ * frame is refused or evicted (lossless replays)
+ *
+ * @return int 0 if admitted, -1 if closed
+ */
+int rob_admit_wait(reorderBuf_t *rob, uint32_t *seq);
+
+/**
+ * @brief a frame is finished; any thread
+ *
+ * @param rob buffer
+ * @param seq the frame's sequence number
+ * @param result handed to the consumer in order; NULL if the frame was
+ *        abandoned and will produce nothing
+ */
+void rob_complete(reorderBuf_t *rob, uint32_t seq, void *result);
+
+/**
+ * @brief next result in capture order, waiting for it; frames that expire
+ * or are evicted meanwhile are skipped, so seq may jump
+ *
+ * @param rob buffer
+ * @param seq set to the frame's sequence number
+ * @param result set to the result
+ * @param admitted set to when the frame was admitted, may be NULL
+ * @return int 1 for a result, 0 once closed and drained
+ */
+int rob_next(reorderBuf_t *rob, uint32_t *seq, void **result, struct timespec *admitted);
+
+/**
+ * @brief no more admissions or completions; rob_next() releases what is
+ * finished and skips the rest
+ */
+void rob_close(reorderBuf_t *rob);
+
+/**
+ * @brief discard anything unreleased and free the window
+ */
+void rob_destroy(reorderBuf_t *rob);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REORDER_H */
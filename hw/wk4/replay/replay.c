@@ -0,0 +1,384 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file replay.c
+ * @brief pushes a recording through a pipeline and diffs its trace against
+ * an earlier build's
+ *
+ * The recording (a capture -A archive or any framesource.h spec) is released
+ * at its recorded inter-arrival times, or with -f as fast as the pipeline
+ * reads it, into prob5 or the descriptor matcher. The pipeline writes one
+ * line per output to the trace (frametrace.h): release index, latency and a
+ * checksum of the output. This prints the latency percentiles and, given a
+ * baseline trace, the frames whose output changed and how latency moved;
+ * it exits 1 when outputs differ, so two builds can be compared by running
+ * one with -o base.csv and the other with -b base.csv.
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "frametrace.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define SPEC_LEN                      (PATH_MAX + 16)
+#define MAX_ARGS                      (32)
+#define LINE_LEN                      (256)
+#define SHOW_MISMATCHES               (10)
+#define SOURCE_ARG                    "@"
+
+typedef struct {
+  const char *name;
+  const char *path;             /* relative to this program's directory */
+  const char *args;             /* SOURCE_ARG is replaced by the recording */
+} pipeline_t;
+
+/* settings whose output depends only on the frame itself, so checksums
+ * repeat: prob5 with fixed quality and no change gate (which would carry
+ * output over from earlier frames), one worker; traced, it drops nothing */
+static const pipeline_t pipelines[] = {
+  { "prob5",   "../prob5/prob5.elf", "1 3 0 " SOURCE_ARG " 0 1" },
+  { "matcher", "../prob4/descriptor_extractor_matcher",
+    "SIFT SIFT BruteForce CrossCheckFilter objects.db " SOURCE_ARG " 3 batch:/dev/null" },
+};
+#define NUM_PIPELINES                 ((int)(sizeof(pipelines) / sizeof(pipelines[0])))
+
+typedef struct {
+  uint32_t sequence;
+  double releaseMs;
+  double latencyMs;
+  uint64_t checksum;
+} traceRow_t;
+
+typedef struct {
+  traceRow_t *rows;
+  int count;
+} trace_t;
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static void usage(const char *name)
+{
+  int p;
+
+  printf("%s [-f] [-o trace.csv] [-b baseline.csv] pipeline recording [args]\n\n"
+         "Replays a recording into a pipeline and reports per-frame latency, and\n"
+         "with a baseline trace the frames whose output changed.\n"
+         "-f  release frames as fast as the pipeline reads them, not at the\n"
+         "    recorded times\n"
+         "-o  trace written (default replay-<pipeline>.csv)\n"
+         "-b  trace of an earlier run to compare against; exits 1 if any output\n"
+         "    differs, or with -f if a frame is missing\n"
+         "recording is a capture -A archive (.far) or a framesource.h spec such as\n"
+         "pnm:rec/f%%04d.ppm,fps=30. args replace the pipeline's default arguments,\n"
+         "with " SOURCE_ARG " where the recording goes. Pipelines:\n", name);
+  for(p = 0; p < NUM_PIPELINES; ++p) {
+    printf("  %-8s %s %s\n", pipelines[p].name, pipelines[p].path, pipelines[p].args);
+  }
+}
+
+static const pipeline_t *find_pipeline(const char *name)
+{
+  int p;
+
+  for(p = 0; p < NUM_PIPELINES; ++p) {
+    if(strcmp(pipelines[p].name, name) == 0) {
+      return &pipelines[p];
+    }
+  }
+  return NULL;
+}
+
+/* archives by name, anything else must already be a spec */
+static int make_spec(const char *recording, int fast, char *spec, size_t len)
+{
+  size_t n = strlen(recording);
+  int w;
+
+  if(strchr(recording, ':') != NULL) {
+    w = snprintf(spec, len, "%s%s", recording, fast ? ",fps=0" : "");
+  } else if((n > 4) && (strcmp(recording + n - 4, ".far") == 0)) {
+    w = snprintf(spec, len, "far:%s%s", recording, fast ? ",fps=0" : "");
+  } else {
+    fprintf(stderr, "%s is neither an archive (.far) nor a source spec\n", recording);
+    return -1;
+  }
+  return ((w < 0) || ((size_t)w >= len)) ? -1 : 0;
+}
+
+static int run_pipeline(const char *exe, char **args)
+{
+  pid_t pid;
+  int status;
+
+  if((pid = fork()) < 0) {
+    perror("fork");
+    return -1;
+  }
+  if(pid == 0) {
+    execv(exe, args);
+    perror(exe);
+    _exit(127);
+  }
+  if(waitpid(pid, &status, 0) < 0) {
+    perror("waitpid");
+    return -1;
+  }
+  if(WIFSIGNALED(status)) {
+    fprintf(stderr, "%s died with signal %d\n", exe, WTERMSIG(status));
+    return -1;
+  }
+  return WEXITSTATUS(status);
+}
+
+static int by_sequence(const void *a, const void *b)
+{
+  const traceRow_t *ra = (const traceRow_t *)a, *rb = (const traceRow_t *)b;
+  return (ra->sequence > rb->sequence) - (ra->sequence < rb->sequence);
+}
+
+static int by_latency(const void *a, const void *b)
+{
+  double la = *(const double *)a, lb = *(const double *)b;
+  return (la > lb) - (la < lb);
+}
+
+static int load_trace(const char *path, trace_t *trace)
+{
+  FILE *fp = fopen(path, "r");
+  char line[LINE_LEN];
+  int size = 0;
+
+  trace->rows = NULL;
+  trace->count = 0;
+  if(fp == NULL) {
+    perror(path);
+    return -1;
+  }
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    traceRow_t row;
+    if((line[0] == '#') || (strncmp(line, FT_HEADER, strlen(FT_HEADER)) == 0)) {
+      continue;
+    }
+    if(sscanf(line, "%" SCNu32 ",%lf,%lf,%" SCNx64, &row.sequence, &row.releaseMs,
+              &row.latencyMs, &row.checksum) != 4) {
+      continue;
+    }
+    if(trace->count == size) {
+      size = size ? 2 * size : 256;
+      trace->rows = (traceRow_t *)realloc(trace->rows, size * sizeof(traceRow_t));
+      if(trace->rows == NULL) {
+        fprintf(stderr, "out of memory\n");
+        fclose(fp);
+        return -1;
+      }
+    }
+    trace->rows[trace->count++] = row;
+  }
+  fclose(fp);
+  /* pipelines that finish frames out of order trace them that way */
+  qsort(trace->rows, trace->count, sizeof(traceRow_t), by_sequence);
+  return 0;
+}
+
+static double percentile(const double *sorted, int count, double pct)
+{
+  int i = (int)(pct / 100.0 * (count - 1) + 0.5);
+  return sorted[i];
+}
+
+/* latency sorted, for percentiles */
+static double *latencies(const trace_t *trace)
+{
+  double *lat = (double *)malloc((trace->count ? trace->count : 1) * sizeof(double));
+  int i;
+
+  if(lat == NULL) {
+    return NULL;
+  }
+  for(i = 0; i < trace->count; ++i) {
+    lat[i] = trace->rows[i].latencyMs;
+  }
+  qsort(lat, trace->count, sizeof(double), by_latency);
+  return lat;
+}
+
+static void summarize(const char *label, const trace_t *trace)
+{
+  double *lat = latencies(trace);
+  double sum = 0.0;
+  int i;
+
+  if((lat == NULL) || (trace->count == 0)) {
+    printf("%-9s no frames\n", label);
+    free(lat);
+    return;
+  }
+  for(i = 0; i < trace->count; ++i) {
+    sum += lat[i];
+  }
+  printf("%-9s %6d frames, latency msec avg %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f\n",
+         label, trace->count, sum / trace->count, percentile(lat, trace->count, 50.0),
+         percentile(lat, trace->count, 90.0), percentile(lat, trace->count, 99.0),
+         lat[trace->count - 1]);
+  free(lat);
+}
+
+/* frames on one side only and frames whose output differs */
+static int compare(const trace_t *run, const trace_t *base, int strict)
+{
+  double *runLat, *baseLat;
+  int r = 0, b = 0, missing = 0, extra = 0, changed = 0;
+
+  while((r < run->count) || (b < base->count)) {
+    if((b >= base->count) || ((r < run->count) && (run->rows[r].sequence < base->rows[b].sequence))) {
+      ++extra;
+      ++r;
+    } else if((r >= run->count) || (base->rows[b].sequence < run->rows[r].sequence)) {
+      ++missing;
+      ++b;
+    } else {
+      if(run->rows[r].checksum != base->rows[b].checksum) {
+        if(changed < SHOW_MISMATCHES) {
+          printf("frame %u: output %016" PRIx64 ", baseline %016" PRIx64 "\n", run->rows[r].sequence,
+                 run->rows[r].checksum, base->rows[b].checksum);
+        }
+        ++changed;
+      }
+      ++r;
+      ++b;
+    }
+  }
+
+  printf("%d frames changed output, %d missing, %d not in the baseline\n", changed, missing, extra);
+  runLat = latencies(run);
+  baseLat = latencies(base);
+  if((runLat != NULL) && (baseLat != NULL) && (run->count > 0) && (base->count > 0)) {
+    printf("latency p50 %+.3f msec, p99 %+.3f msec against the baseline\n",
+           percentile(runLat, run->count, 50.0) - percentile(baseLat, base->count, 50.0),
+           percentile(runLat, run->count, 99.0) - percentile(baseLat, base->count, 99.0));
+  }
+  free(runLat);
+  free(baseLat);
+
+  /* at recorded times a slow frame may be skipped, which is latency, not output */
+  return (changed > 0) || (strict && ((missing > 0) || (extra > 0)));
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int main(int argc, char *argv[])
+{
+  const char *tracePath = NULL, *basePath = NULL;
+  const pipeline_t *pipeline;
+  char spec[SPEC_LEN], exe[PATH_MAX], self[PATH_MAX], defaultTrace[PATH_MAX];
+  char defaults[LINE_LEN];
+  char *args[MAX_ARGS + 2];
+  trace_t run, base;
+  ssize_t len;
+  int fast = 0, nargs = 0, opt, i, rc;
+
+  while((opt = getopt(argc, argv, "fo:b:")) != -1) {
+    switch(opt) {
+    case 'f': fast = 1; break;
+    case 'o': tracePath = optarg; break;
+    case 'b': basePath = optarg; break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(argc - optind < 2) {
+    usage(argv[0]);
+    return -1;
+  }
+  if((pipeline = find_pipeline(argv[optind])) == NULL) {
+    fprintf(stderr, "no pipeline %s\n", argv[optind]);
+    usage(argv[0]);
+    return -1;
+  }
+  if(make_spec(argv[optind + 1], fast, spec, sizeof(spec)) != 0) {
+    return -1;
+  }
+  if(tracePath == NULL) {
+    snprintf(defaultTrace, sizeof(defaultTrace), "replay-%s.csv", pipeline->name);
+    tracePath = defaultTrace;
+  }
+
+  /* pipelines live next to this program's directory, wherever it is run from */
+  if((len = readlink("/proc/self/exe", self, sizeof(self) - 1)) < 0) {
+    perror("/proc/self/exe");
+    return -1;
+  }
+  self[len] = '\0';
+  snprintf(exe, sizeof(exe), "%s/%s", dirname(self), pipeline->path);
+
+  args[nargs++] = exe;
+  if(argc - optind > 2) {
+    for(i = optind + 2; (i < argc) && (nargs <= MAX_ARGS); ++i) {
+      args[nargs++] = (strcmp(argv[i], SOURCE_ARG) == 0) ? spec : argv[i];
+    }
+  } else {
+    char *tok;
+    strncpy(defaults, pipeline->args, sizeof(defaults) - 1);
+    defaults[sizeof(defaults) - 1] = '\0';
+    for(tok = strtok(defaults, " "); (tok != NULL) && (nargs <= MAX_ARGS); tok = strtok(NULL, " ")) {
+      args[nargs++] = (strcmp(tok, SOURCE_ARG) == 0) ? spec : tok;
+    }
+  }
+  args[nargs] = NULL;
+
+  printf("%s", exe);
+  for(i = 1; i < nargs; ++i) {
+    printf(" %s", args[i]);
+  }
+  printf("\n");
+  fflush(stdout);
+
+  if(setenv(FT_ENV_PATH, tracePath, 1) != 0) {
+    perror("setenv");
+    return -1;
+  }
+  if((rc = run_pipeline(exe, args)) != 0) {
+    fprintf(stderr, "%s failed (%d)\n", pipeline->name, rc);
+    return -1;
+  }
+  if(load_trace(tracePath, &run) != 0) {
+    return -1;
+  }
+  printf("trace in %s\n", tracePath);
+  summarize("run", &run);
+
+  rc = 0;
+  if(basePath != NULL) {
+    if(load_trace(basePath, &base) != 0) {
+      free(run.rows);
+      return -1;
+    }
+    summarize("baseline", &base);
+    rc = compare(&run, &base, fast);
+    printf("%s against %s\n", rc ? "FAIL" : "PASS", basePath);
+    free(base.rows);
+  }
+  free(run.rows);
+  return rc;
+}
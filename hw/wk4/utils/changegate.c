@@ -0,0 +1,170 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file changegate.c
+ * @brief tile change detection, so unchanged frames or tiles can skip processing
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdlib.h>
+#include <string.h>
+
+#include "changegate.h"
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+
+/* the compiler vectorizes this at -O3; big counts the samples more than
+ * localLimit apart */
+static uint32_t row_sad(const uint8_t *a, const uint8_t *b, int n, int localLimit, uint32_t *big)
+{
+  uint32_t sum = 0;
+  uint32_t over = 0;
+  int i;
+
+  for(i = 0; i < n; ++i) {
+    int d = (int)a[i] - (int)b[i];
+    d = (d < 0) ? -d : d;
+    sum += (uint32_t)d;
+    over += (uint32_t)(d > localLimit);
+  }
+  *big += over;
+  return sum;
+}
+
+/* compare the sampled rows of one tile, by the mean over the tile and by
+ * the samples that changed a lot; stops once over either limit */
+static int tile_changed(const changeGate_t *gate, int tile, const uint8_t *img, size_t step)
+{
+  int x, y, w, h, r, rows;
+  size_t refStep = (size_t)gate->width * gate->channels;
+  const int localLimit = (int)(CG_LOCAL_FACTOR * gate->threshold);
+  uint64_t sad = 0;
+  uint32_t big = 0;
+  uint64_t limit;
+
+  cg_tile_rect(gate, tile, &x, &y, &w, &h);
+  rows = (h + CG_ROW_STEP - 1 - (int)gate->phase) / CG_ROW_STEP;
+  if(rows <= 0) {
+    return 0;
+  }
+  limit = (uint64_t)(gate->threshold * rows * w * gate->channels);
+
+  for(r = y + (int)gate->phase; r < y + h; r += CG_ROW_STEP) {
+    sad += row_sad(img + r * step + (size_t)x * gate->channels,
+                   gate->ref + r * refStep + (size_t)x * gate->channels, w * gate->channels,
+                   localLimit, &big);
+    if((sad > limit) || (big >= CG_LOCAL_SAMPLES)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void copy_tile(changeGate_t *gate, int tile, const uint8_t *img, size_t step)
+{
+  int x, y, w, h, r;
+  size_t refStep = (size_t)gate->width * gate->channels;
+
+  cg_tile_rect(gate, tile, &x, &y, &w, &h);
+  for(r = y; r < y + h; ++r) {
+    memcpy(gate->ref + r * refStep + (size_t)x * gate->channels,
+           img + r * step + (size_t)x * gate->channels, (size_t)w * gate->channels);
+  }
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int cg_init(changeGate_t *gate, int width, int height, int channels, int tileSize, double threshold)
+{
+  memset(gate, 0, sizeof(*gate));
+  if((width <= 0) || (height <= 0) || (channels <= 0) || (tileSize <= 0)) {
+    return -1;
+  }
+  gate->width = width;
+  gate->height = height;
+  gate->channels = channels;
+  gate->tileSize = tileSize;
+  gate->tilesX = (width + tileSize - 1) / tileSize;
+  gate->tilesY = (height + tileSize - 1) / tileSize;
+  gate->numTiles = gate->tilesX * gate->tilesY;
+  gate->threshold = threshold;
+  gate->ref = (uint8_t *)malloc((size_t)width * height * channels);
+  gate->changed = (uint8_t *)malloc((size_t)gate->numTiles);
+  if((gate->ref == NULL) || (gate->changed == NULL)) {
+    cg_destroy(gate);
+    return -1;
+  }
+  return 0;
+}
+
+int cg_matches(const changeGate_t *gate, int width, int height, int channels)
+{
+  return (gate->ref != NULL) && (gate->width == width) && (gate->height == height) &&
+         (gate->channels == channels);
+}
+
+int cg_update(changeGate_t *gate, const uint8_t *img, size_t step)
+{
+  int tile;
+
+  ++gate->frames;
+  gate->numChanged = 0;
+
+  if(!gate->valid) {
+    for(tile = 0; tile < gate->numTiles; ++tile) {
+      copy_tile(gate, tile, img, step);
+      gate->changed[tile] = 1;
+    }
+    gate->valid = 1;
+    gate->numChanged = gate->numTiles;
+    return gate->numChanged;
+  }
+
+  for(tile = 0; tile < gate->numTiles; ++tile) {
+    gate->changed[tile] = (uint8_t)tile_changed(gate, tile, img, step);
+    if(gate->changed[tile]) {
+      copy_tile(gate, tile, img, step);
+      ++gate->numChanged;
+    }
+  }
+  gate->phase = (gate->phase + 1) % CG_ROW_STEP;
+
+  gate->tilesCompared += gate->numTiles;
+  gate->tilesChanged += gate->numChanged;
+  if(gate->numChanged == 0) {
+    ++gate->unchangedFrames;
+  }
+  return gate->numChanged;
+}
+
+void cg_invalidate(changeGate_t *gate)
+{
+  gate->valid = 0;
+}
+
+void cg_tile_rect(const changeGate_t *gate, int tile, int *x, int *y, int *w, int *h)
+{
+  *x = (tile % gate->tilesX) * gate->tileSize;
+  *y = (tile / gate->tilesX) * gate->tileSize;
+  *w = (*x + gate->tileSize <= gate->width) ? gate->tileSize : gate->width - *x;
+  *h = (*y + gate->tileSize <= gate->height) ? gate->tileSize : gate->height - *y;
+}
+
+void cg_destroy(changeGate_t *gate)
+{
+  free(gate->ref);
+  free(gate->changed);
+  gate->ref = NULL;
+  gate->changed = NULL;
+  gate->valid = 0;
+}
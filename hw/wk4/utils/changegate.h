@@ -0,0 +1,114 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file changegate.h
+ * @brief tile change detection, so unchanged frames or tiles can skip processing
+ *
+ * The frame is split into square tiles. Each update compares every
+ * CG_ROW_STEP-th row of a tile with the reference (what was last processed
+ * there) by sum of absolute differences; the row phase advances every frame,
+ * so a thin change is still seen within CG_ROW_STEP frames. A tile whose
+ * mean absolute difference is above the threshold is flagged as changed and
+ * its reference is replaced by the new content; unchanged tiles keep their
+ * old reference, so a slow drift is caught once it adds up. A small object
+ * barely moves a tile's mean, so a tile is also flagged when at least
+ * CG_LOCAL_SAMPLES compared samples each differ by more than
+ * CG_LOCAL_FACTOR * threshold (32 levels at the default), which isolated
+ * noisy pixels don't reach.
+ *
+ * The SAD loop vectorizes (psadbw on x86, uabal on ARM) when built with -O3,
+ * and a tile stops comparing as soon as it is over the limit, so the gate
+ * costs a fraction of a pass over the frame.
+ *
+ ************************************************************************************
+ */
+
+#ifndef CHANGEGATE_H
+#define CHANGEGATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CG_DEFAULT_TILE               (64)
+#define CG_DEFAULT_THRESHOLD          (4.0)   /* mean abs difference, levels */
+#define CG_ROW_STEP                   (4)     /* rows compared per update: 1 in 4 */
+#define CG_LOCAL_FACTOR               (8)     /* a sample this many thresholds off ... */
+#define CG_LOCAL_SAMPLES              (4)     /* ... this many times is a local change */
+
+typedef struct {
+  int width;
+  int height;
+  int channels;
+  int tileSize;
+  int tilesX;
+  int tilesY;
+  int numTiles;
+  double threshold;
+  uint8_t *ref;                 /* width * channels * height, last processed */
+  uint8_t *changed;             /* per tile, set by the last update */
+  int numChanged;
+  int valid;                    /* ref holds a frame */
+  unsigned int phase;           /* row offset of the next comparison */
+  uint64_t frames;
+  uint64_t unchangedFrames;
+  uint64_t tilesCompared;
+  uint64_t tilesChanged;
+} changeGate_t;
+
+/**
+ * @brief set up a gate for frames of one geometry
+ *
+ * @param gate gate to initialize
+ * @param width frame width, pixels
+ * @param height frame height, pixels
+ * @param channels bytes per pixel
+ * @param tileSize tile edge, pixels (CG_DEFAULT_TILE)
+ * @param threshold mean absolute difference per sample above which a tile
+ *        has changed (CG_DEFAULT_THRESHOLD); a bit above the sensor noise
+ * @return int 0 on success, -1 if out of memory or bad sizes
+ */
+int cg_init(changeGate_t *gate, int width, int height, int channels, int tileSize, double threshold);
+
+/**
+ * @brief does the gate handle frames of this geometry
+ */
+int cg_matches(const changeGate_t *gate, int width, int height, int channels);
+
+/**
+ * @brief compare a frame with the reference and flag its changed tiles
+ *
+ * @param gate gate
+ * @param img top-left pixel
+ * @param step bytes between rows
+ * @return int number of changed tiles; every tile for the first frame or
+ *         after cg_invalidate()
+ */
+int cg_update(changeGate_t *gate, const uint8_t *img, size_t step);
+
+/**
+ * @brief forget the reference, e.g. when the processing itself changes
+ */
+void cg_invalidate(changeGate_t *gate);
+
+/**
+ * @brief pixel rectangle of a tile; edge tiles may be smaller
+ */
+void cg_tile_rect(const changeGate_t *gate, int tile, int *x, int *y, int *w, int *h);
+
+void cg_destroy(changeGate_t *gate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CHANGEGATE_H */
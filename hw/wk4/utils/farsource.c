@@ -0,0 +1,139 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file farsource.c
+ * @brief far: replay specs, capture archives (framearchive.h) read through
+ * framesource
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "framesource.h"
+#include "framearchive.h"
+#include "farsource.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+typedef struct {
+  faReader_t *archive;
+  char path[FS_PATH_LEN];
+  int width;
+  int height;
+  fsFormat_e format;
+  fsFrame_t decoded;            /* data owned by the archive reader */
+} farSource_t;
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static void far_close(void *handle)
+{
+  farSource_t *far = (farSource_t *)handle;
+
+  fa_close_reader(far->archive);
+  free(far);
+}
+
+/* capture times and format from the record headers; nothing is decoded */
+static int far_index(farSource_t *far, double **ts, int *numTs)
+{
+  faRecord_t rec;
+  int cap = 0;
+  int r;
+
+  *ts = NULL;
+  *numTs = 0;
+  while((r = fa_skip(far->archive, &rec)) == 1) {
+    if(*numTs == 0) {
+      far->width = (int)rec.width;
+      far->height = (int)rec.height;
+      far->format = (fsFormat_e)rec.format;
+    }
+    if(*numTs == cap) {
+      cap = (cap == 0) ? 256 : 2 * cap;
+      double *grown = (double *)realloc(*ts, cap * sizeof(**ts));
+      if(grown == NULL) {
+        return -1;
+      }
+      *ts = grown;
+    }
+    (*ts)[(*numTs)++] = (double)rec.sec + (double)rec.nsec * 1e-9;
+  }
+  if((r < 0) || (*numTs == 0) || (fa_rewind(far->archive) != 0)) {
+    fprintf(stderr, "no frames in %s\n", far->path);
+    return -1;
+  }
+  return 0;
+}
+
+static void *far_open(const char *path, int *width, int *height, fsFormat_e *format,
+                      double **ts, int *numTs)
+{
+  farSource_t *far = (farSource_t *)calloc(1, sizeof(*far));
+
+  if(far == NULL) {
+    return NULL;
+  }
+  snprintf(far->path, sizeof(far->path), "%s", path);
+  if((far->archive = fa_open(path)) == NULL) {
+    free(far);
+    return NULL;
+  }
+  if(far_index(far, ts, numTs) != 0) {
+    free(*ts);
+    *ts = NULL;
+    far_close(far);
+    return NULL;
+  }
+  *width = far->width;
+  *height = far->height;
+  *format = far->format;
+  return far;
+}
+
+/* 1 frame read, 0 end of the archive, -1 error */
+static int far_read(void *handle, const uint8_t **data)
+{
+  farSource_t *far = (farSource_t *)handle;
+  int r = fa_read(far->archive, &far->decoded);
+
+  if(r != 1) {
+    if(r < 0) {
+      fprintf(stderr, "%s is corrupt\n", far->path);
+    }
+    return r;
+  }
+  if((far->decoded.width != far->width) || (far->decoded.height != far->height) ||
+     (far->decoded.format != far->format)) {
+    fprintf(stderr, "frame %u of %s differs from the first\n", far->decoded.sequence, far->path);
+    return -1;
+  }
+  *data = far->decoded.data;
+  return 1;
+}
+
+static int far_rewind(void *handle)
+{
+  return fa_rewind(((farSource_t *)handle)->archive);
+}
+
+static const fsReader_t farReader = {
+  "far:", far_open, far_read, far_rewind, far_close
+};
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int fa_register_source(void)
+{
+  return fs_register(&farReader);
+}
@@ -0,0 +1,39 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file farsource.h
+ * @brief far: replay specs, capture archives (framearchive.h) read through
+ * framesource
+ *
+ * Kept out of framesource.c so programs that replay only pnm: or yuyv:
+ * recordings do not link the archive codec.
+ *
+ ************************************************************************************
+ */
+
+#ifndef FARSOURCE_H
+#define FARSOURCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief make fs_is_spec() and fs_open() take far:FILE[,opts]; call once,
+ * before the first fs_open()
+ *
+ * @return int 0, -1 if framesource has no room for another reader
+ */
+int fa_register_source(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FARSOURCE_H */
@@ -0,0 +1,833 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file framearchive.c
+ * @brief losslessly compressed frame archive, encoded on a pool of threads
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "framearchive.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define TIMESPEC_TO_NSEC(time)        (((uint64_t)(time).tv_sec * 1000000000ULL) + (uint64_t)(time).tv_nsec)
+
+/* residual codes; the top two bits select the op */
+#define FA_OP_RUN                     (0x00)  /* 00nnnnnn: n + 1 zero residuals */
+#define FA_OP_PAIR                    (0x40)  /* 01aaabbb: two residuals in -4..3 */
+#define FA_OP_ONE                     (0x80)  /* 10dddddd: one residual in -32..31 */
+#define FA_OP_LIT                     (0xff)  /* 11111111 rrrrrrrr: any residual */
+#define FA_OP_MASK                    (0xc0)
+#define FA_MAX_RUN                    (64)
+
+typedef struct {
+  int offset;                   /* of the first sample in a row */
+  int step;                     /* bytes between samples */
+  int width;                    /* samples per row */
+} faPlane_t;
+
+typedef enum {
+  SLOT_FREE,
+  SLOT_QUEUED,                  /* copied in, waiting for a worker */
+  SLOT_DONE                     /* coded, waiting for the writer */
+} slotState_e;
+
+typedef struct {
+  uint8_t *raw;                 /* the frame as submitted */
+  size_t rawSize;
+  uint8_t *coded;
+  size_t codedSize;
+  size_t codedBytes;
+  faRecord_t rec;
+  int hasRef;                   /* delta against the previous slot */
+  slotState_e state;
+} faSlot_t;
+
+struct faWriter_s {
+  int fd;
+  int sync;
+  int keyInterval;
+  faSlot_t *slots;
+  unsigned int depth;
+  uint32_t head;                /* next to write */
+  uint32_t next;                /* next to encode */
+  uint32_t tail;                /* next to submit */
+  uint32_t sinceKey;
+  int haveLast;
+  uint32_t lastWidth;
+  uint32_t lastHeight;
+  uint32_t lastFormat;
+  int closing;
+  pthread_mutex_t lock;
+  pthread_cond_t work;          /* a slot was queued, or closing */
+  pthread_cond_t done;          /* a slot was coded, or closing */
+  pthread_cond_t space;         /* a slot was written */
+  pthread_t *workers;
+  int numWorkers;
+  pthread_t writerThread;
+  faStats_t stats;
+};
+
+struct faReader_s {
+  FILE *fp;
+  uint8_t *cur;
+  uint8_t *prev;
+  size_t frameSize;
+  uint8_t *coded;
+  size_t codedSize;
+  uint8_t *scratch;
+  size_t scratchSize;
+  int haveRef;
+  faRecord_t last;
+};
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static int plane_layout(uint32_t format, int width, faPlane_t planes[FA_MAX_PLANES])
+{
+  int i;
+
+  switch(format) {
+  case FS_GREY:
+    planes[0].offset = 0;
+    planes[0].step = 1;
+    planes[0].width = width;
+    return 1;
+  case FS_RGB24:
+    for(i = 0; i < 3; ++i) {
+      planes[i].offset = i;
+      planes[i].step = 3;
+      planes[i].width = width;
+    }
+    return 3;
+  case FS_YUYV:
+    planes[0].offset = 0;       /* Y0 Y1 */
+    planes[0].step = 2;
+    planes[0].width = width;
+    planes[1].offset = 1;       /* U */
+    planes[1].step = 4;
+    planes[1].width = width / 2;
+    planes[2].offset = 3;       /* V */
+    planes[2].step = 4;
+    planes[2].width = width / 2;
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+/* 0 for an unknown format or a YUYV frame of odd width */
+static size_t frame_bytes(uint32_t format, int width, int height)
+{
+  if((width <= 0) || (height <= 0)) {
+    return 0;
+  }
+  switch(format) {
+  case FS_GREY:  return (size_t)width * height;
+  case FS_RGB24: return (size_t)width * height * 3;
+  case FS_YUYV:  return (width & 1) ? 0 : (size_t)width * height * 2;
+  default:       return 0;
+  }
+}
+
+static int grow(uint8_t **buf, size_t *size, size_t need)
+{
+  uint8_t *mem;
+
+  if(*size >= need) {
+    return 0;
+  }
+  if((mem = (uint8_t *)realloc(*buf, need)) == NULL) {
+    return -1;
+  }
+  *buf = mem;
+  *size = need;
+  return 0;
+}
+
+static uint8_t med_predict(int a, int b, int c)
+{
+  int mx = (a > b) ? a : b;
+  int mn = (a > b) ? b : a;
+
+  if(c >= mx) {
+    return (uint8_t)mn;
+  }
+  if(c <= mn) {
+    return (uint8_t)mx;
+  }
+  return (uint8_t)(a + b - c);
+}
+
+/* plane residuals, row after row, from the previous frame or the neighbours */
+static void plane_residuals(const uint8_t *img, const uint8_t *ref, size_t rowBytes,
+                            const faPlane_t *plane, int height, uint8_t *res)
+{
+  const int step = plane->step;
+  const int width = plane->width;
+  int x, y;
+
+  for(y = 0; y < height; ++y) {
+    const uint8_t *row = img + (size_t)y * rowBytes + plane->offset;
+    const uint8_t *up = row - rowBytes;
+
+    if(ref != NULL) {
+      const uint8_t *refRow = ref + (size_t)y * rowBytes + plane->offset;
+      for(x = 0; x < width; ++x) {
+        res[x] = (uint8_t)(row[x * step] - refRow[x * step]);
+      }
+    } else if(y == 0) {
+      res[0] = row[0];
+      for(x = 1; x < width; ++x) {
+        res[x] = (uint8_t)(row[x * step] - row[(x - 1) * step]);
+      }
+    } else {
+      res[0] = (uint8_t)(row[0] - up[0]);
+      for(x = 1; x < width; ++x) {
+        res[x] = (uint8_t)(row[x * step] -
+                           med_predict(row[(x - 1) * step], up[x * step], up[(x - 1) * step]));
+      }
+    }
+    res += width;
+  }
+}
+
+/* the inverse of plane_residuals(), into img */
+static void plane_reconstruct(uint8_t *img, const uint8_t *ref, size_t rowBytes,
+                              const faPlane_t *plane, int height, const uint8_t *res)
+{
+  const int step = plane->step;
+  const int width = plane->width;
+  int x, y;
+
+  for(y = 0; y < height; ++y) {
+    uint8_t *row = img + (size_t)y * rowBytes + plane->offset;
+    const uint8_t *up = row - rowBytes;
+
+    if(ref != NULL) {
+      const uint8_t *refRow = ref + (size_t)y * rowBytes + plane->offset;
+      for(x = 0; x < width; ++x) {
+        row[x * step] = (uint8_t)(refRow[x * step] + res[x]);
+      }
+    } else if(y == 0) {
+      row[0] = res[0];
+      for(x = 1; x < width; ++x) {
+        row[x * step] = (uint8_t)(row[(x - 1) * step] + res[x]);
+      }
+    } else {
+      row[0] = (uint8_t)(up[0] + res[0]);
+      for(x = 1; x < width; ++x) {
+        row[x * step] = (uint8_t)(med_predict(row[(x - 1) * step], up[x * step], up[(x - 1) * step]) +
+                                  res[x]);
+      }
+    }
+    res += width;
+  }
+}
+
+static size_t tokenize(const uint8_t *res, size_t count, uint8_t *out)
+{
+  uint8_t *o = out;
+  size_t i = 0;
+  int run = 0;
+
+  while(i < count) {
+    int r = (int8_t)res[i];
+
+    if(r == 0) {
+      ++i;
+      if(++run == FA_MAX_RUN) {
+        *o++ = (uint8_t)(FA_OP_RUN | (run - 1));
+        run = 0;
+      }
+      continue;
+    }
+    if(run > 0) {
+      *o++ = (uint8_t)(FA_OP_RUN | (run - 1));
+      run = 0;
+    }
+    if((r >= -4) && (r <= 3) && (i + 1 < count)) {
+      int s = (int8_t)res[i + 1];
+      if((s >= -4) && (s <= 3)) {
+        *o++ = (uint8_t)(FA_OP_PAIR | ((r + 4) << 3) | (s + 4));
+        i += 2;
+        continue;
+      }
+    }
+    if((r >= -32) && (r <= 31)) {
+      *o++ = (uint8_t)(FA_OP_ONE | (r + 32));
+    } else {
+      *o++ = FA_OP_LIT;
+      *o++ = res[i];
+    }
+    ++i;
+  }
+  if(run > 0) {
+    *o++ = (uint8_t)(FA_OP_RUN | (run - 1));
+  }
+  return (size_t)(o - out);
+}
+
+/* -1 unless the codes make exactly count residuals */
+static int detokenize(const uint8_t *in, size_t bytes, uint8_t *res, size_t count)
+{
+  const uint8_t *end = in + bytes;
+  size_t i = 0;
+
+  while(in < end) {
+    uint8_t op = *in++;
+
+    if(op == FA_OP_LIT) {
+      if((in == end) || (i == count)) {
+        return -1;
+      }
+      res[i++] = *in++;
+      continue;
+    }
+    switch(op & FA_OP_MASK) {
+    case FA_OP_RUN: {
+      size_t n = (size_t)(op & 0x3f) + 1;
+      if(n > count - i) {
+        return -1;
+      }
+      memset(res + i, 0, n);
+      i += n;
+      break;
+    }
+    case FA_OP_PAIR:
+      if(count - i < 2) {
+        return -1;
+      }
+      res[i++] = (uint8_t)(((op >> 3) & 0x7) - 4);
+      res[i++] = (uint8_t)((op & 0x7) - 4);
+      break;
+    case FA_OP_ONE:
+      if(i == count) {
+        return -1;
+      }
+      res[i++] = (uint8_t)((op & 0x3f) - 32);
+      break;
+    default:
+      return -1;
+    }
+  }
+  return (i == count) ? 0 : -1;
+}
+
+static int decode_frame(const faRecord_t *rec, const uint8_t *coded, const uint8_t *ref,
+                        uint8_t *dst, uint8_t *scratch)
+{
+  faPlane_t planes[FA_MAX_PLANES];
+  size_t rowBytes = frame_bytes(rec->format, rec->width, 1);
+  int n = plane_layout(rec->format, rec->width, planes);
+  int p;
+
+  for(p = 0; p < n; ++p) {
+    size_t count = (size_t)planes[p].width * rec->height;
+    if(detokenize(coded, rec->planeBytes[p], scratch, count) != 0) {
+      return -1;
+    }
+    plane_reconstruct(dst, ref, rowBytes, &planes[p], rec->height, scratch);
+    coded += rec->planeBytes[p];
+  }
+  return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t bytes)
+{
+  const uint8_t *p = (const uint8_t *)buf;
+  ssize_t written;
+
+  while(bytes > 0) {
+    written = write(fd, p, bytes);
+    if(written < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += written;
+    bytes -= (size_t)written;
+  }
+  return 0;
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return TIMESPEC_TO_NSEC(ts);
+}
+
+static void *encode_worker(void *arg)
+{
+  faWriter_t *writer = (faWriter_t *)arg;
+  uint8_t *scratch = NULL;
+  size_t scratchSize = 0;
+  fsFrame_t frame;
+  faSlot_t *slot;
+  const uint8_t *ref;
+  uint64_t start;
+  uint32_t seq;
+
+  memset(&frame, 0, sizeof(frame));
+  pthread_mutex_lock(&writer->lock);
+  for(;;) {
+    while((writer->next == writer->tail) && !writer->closing) {
+      pthread_cond_wait(&writer->work, &writer->lock);
+    }
+    if(writer->next == writer->tail) {
+      break;
+    }
+    seq = writer->next++;
+    slot = &writer->slots[seq % writer->depth];
+    /* the previous slot is kept until this one is written */
+    ref = slot->hasRef ? writer->slots[(seq - 1) % writer->depth].raw : NULL;
+    pthread_mutex_unlock(&writer->lock);
+
+    start = now_ns();
+    frame.data = slot->raw;
+    frame.width = (int)slot->rec.width;
+    frame.height = (int)slot->rec.height;
+    frame.format = (fsFormat_e)slot->rec.format;
+    if(grow(&scratch, &scratchSize, (size_t)frame.width * frame.height) == 0) {
+      slot->codedBytes = fa_encode(&frame, ref, slot->coded, scratch, slot->rec.planeBytes);
+    } else {
+      slot->codedBytes = 0;     /* the writer skips it */
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stats.encodeNs += now_ns() - start;
+    slot->state = SLOT_DONE;
+    pthread_cond_signal(&writer->done);
+  }
+  pthread_mutex_unlock(&writer->lock);
+  free(scratch);
+  return NULL;
+}
+
+static void *write_worker(void *arg)
+{
+  faWriter_t *writer = (faWriter_t *)arg;
+  faSlot_t *slot;
+  uint64_t start, stored;
+  int broken = 0;
+  int err;
+
+  pthread_mutex_lock(&writer->lock);
+  for(;;) {
+    while((writer->head == writer->tail) ||
+          (writer->slots[writer->head % writer->depth].state != SLOT_DONE)) {
+      if(writer->closing && (writer->head == writer->tail)) {
+        pthread_mutex_unlock(&writer->lock);
+        return NULL;
+      }
+      pthread_cond_wait(&writer->done, &writer->lock);
+    }
+    slot = &writer->slots[writer->head % writer->depth];
+    err = writer->stats.writeError;
+    pthread_mutex_unlock(&writer->lock);
+
+    /* a frame that could not be coded leaves the deltas after it without a
+     * reference, so they are dropped up to the next key frame; after a write
+     * failure the rest are only drained, so the pool can stop */
+    if(slot->rec.flags & FA_KEY) {
+      broken = 0;
+    }
+    if(slot->codedBytes == 0) {
+      broken = 1;
+    }
+    start = now_ns();
+    stored = 0;
+    if((err == 0) && !broken) {
+      if((write_all(writer->fd, &slot->rec, sizeof(slot->rec)) != 0) ||
+         (write_all(writer->fd, slot->coded, slot->codedBytes) != 0) ||
+         (writer->sync && (fdatasync(writer->fd) != 0))) {
+        err = errno;
+      } else {
+        stored = sizeof(slot->rec) + slot->codedBytes;
+      }
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    if((err != 0) && (writer->stats.writeError == 0)) {
+      writer->stats.writeError = err;
+    }
+    writer->stats.writeNs += now_ns() - start;
+    writer->stats.storedBytes += stored;
+    slot->state = SLOT_FREE;
+    ++writer->head;
+    pthread_cond_broadcast(&writer->space);
+  }
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+size_t fa_bound(size_t bytes)
+{
+  /* a literal is two bytes, and a plane has no more samples than the frame has bytes */
+  return 2 * bytes;
+}
+
+size_t fa_encode(const fsFrame_t *frame, const uint8_t *ref, uint8_t *out, uint8_t *scratch,
+                 uint32_t planeBytes[FA_MAX_PLANES])
+{
+  faPlane_t planes[FA_MAX_PLANES];
+  size_t rowBytes = frame_bytes(frame->format, frame->width, 1);
+  int n = plane_layout(frame->format, frame->width, planes);
+  size_t total = 0;
+  int p;
+
+  for(p = 0; p < FA_MAX_PLANES; ++p) {
+    planeBytes[p] = 0;
+  }
+  for(p = 0; p < n; ++p) {
+    plane_residuals(frame->data, ref, rowBytes, &planes[p], frame->height, scratch);
+    planeBytes[p] = (uint32_t)tokenize(scratch, (size_t)planes[p].width * frame->height, out + total);
+    total += planeBytes[p];
+  }
+  return total;
+}
+
+faWriter_t *fa_create(const char *path, int workers, int depth, int keyInterval, int sync)
+{
+  faWriter_t *writer;
+  faFileHeader_t header;
+  int ind;
+
+  if(workers <= 0) {
+    workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(workers <= 0) {
+      workers = 1;
+    }
+  }
+  if(depth < 2) {
+    depth = 2;
+  }
+  if(keyInterval < 1) {
+    keyInterval = 1;
+  }
+
+  writer = (faWriter_t *)calloc(1, sizeof(*writer));
+  if(writer == NULL) {
+    return NULL;
+  }
+  writer->slots = (faSlot_t *)calloc(depth, sizeof(faSlot_t));
+  writer->workers = (pthread_t *)calloc(workers, sizeof(pthread_t));
+  if((writer->slots == NULL) || (writer->workers == NULL)) {
+    free(writer->slots);
+    free(writer->workers);
+    free(writer);
+    return NULL;
+  }
+  writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 00666);
+  header.magic = FA_FILE_MAGIC;
+  header.version = FA_VERSION;
+  if((writer->fd < 0) || (write_all(writer->fd, &header, sizeof(header)) != 0)) {
+    perror(path);
+    if(writer->fd >= 0) {
+      close(writer->fd);
+    }
+    free(writer->slots);
+    free(writer->workers);
+    free(writer);
+    return NULL;
+  }
+  writer->depth = (unsigned int)depth;
+  writer->keyInterval = keyInterval;
+  writer->sync = sync;
+  writer->stats.storedBytes = sizeof(header);
+
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->work, NULL);
+  pthread_cond_init(&writer->done, NULL);
+  pthread_cond_init(&writer->space, NULL);
+  for(ind = 0; ind < workers; ++ind) {
+    if(pthread_create(&writer->workers[ind], NULL, encode_worker, writer) != 0) {
+      break;
+    }
+  }
+  writer->numWorkers = ind;
+  if((ind == 0) || (pthread_create(&writer->writerThread, NULL, write_worker, writer) != 0)) {
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = 1;
+    pthread_cond_broadcast(&writer->work);
+    pthread_mutex_unlock(&writer->lock);
+    for(ind = 0; ind < writer->numWorkers; ++ind) {
+      pthread_join(writer->workers[ind], NULL);
+    }
+    close(writer->fd);
+    free(writer->slots);
+    free(writer->workers);
+    free(writer);
+    return NULL;
+  }
+  return writer;
+}
+
+int fa_submit(faWriter_t *writer, const fsFrame_t *frame, int block)
+{
+  size_t bytes = frame_bytes(frame->format, frame->width, frame->height);
+  /* with deltas the slot before head is still someone's reference */
+  unsigned int keep = (writer->keyInterval > 1) ? 1 : 0;
+  faSlot_t *slot;
+  int hasRef;
+
+  pthread_mutex_lock(&writer->lock);
+  if((bytes == 0) || (frame->bytes < bytes) || (writer->stats.writeError != 0)) {
+    ++writer->stats.refused;
+    pthread_mutex_unlock(&writer->lock);
+    return -1;
+  }
+  while(writer->tail - writer->head + 1 + keep > writer->depth) {
+    if(!block) {
+      ++writer->stats.refused;
+      pthread_mutex_unlock(&writer->lock);
+      return -1;
+    }
+    pthread_cond_wait(&writer->space, &writer->lock);
+  }
+  slot = &writer->slots[writer->tail % writer->depth];
+  hasRef = writer->haveLast && (writer->sinceKey < (uint32_t)writer->keyInterval) &&
+           (writer->lastWidth == (uint32_t)frame->width) &&
+           (writer->lastHeight == (uint32_t)frame->height) &&
+           (writer->lastFormat == (uint32_t)frame->format);
+  pthread_mutex_unlock(&writer->lock);
+
+  /* the slot is ours until it is queued; only one thread submits */
+  if((grow(&slot->raw, &slot->rawSize, bytes) != 0) ||
+     (grow(&slot->coded, &slot->codedSize, fa_bound(bytes)) != 0)) {
+    pthread_mutex_lock(&writer->lock);
+    ++writer->stats.refused;
+    pthread_mutex_unlock(&writer->lock);
+    return -1;
+  }
+  memcpy(slot->raw, frame->data, bytes);
+  memset(&slot->rec, 0, sizeof(slot->rec));
+  slot->rec.magic = FA_RECORD_MAGIC;
+  slot->rec.flags = hasRef ? 0 : FA_KEY;
+  slot->rec.sequence = frame->sequence;
+  slot->rec.format = (uint32_t)frame->format;
+  slot->rec.width = (uint32_t)frame->width;
+  slot->rec.height = (uint32_t)frame->height;
+  slot->rec.sec = (int64_t)frame->timestamp.tv_sec;
+  slot->rec.nsec = (int64_t)frame->timestamp.tv_nsec;
+  slot->hasRef = hasRef;
+
+  pthread_mutex_lock(&writer->lock);
+  slot->state = SLOT_QUEUED;
+  ++writer->tail;
+  ++writer->stats.frames;
+  writer->stats.rawBytes += bytes;
+  if(hasRef) {
+    ++writer->sinceKey;
+  } else {
+    ++writer->stats.keys;
+    writer->sinceKey = 1;
+  }
+  writer->haveLast = 1;
+  writer->lastWidth = (uint32_t)frame->width;
+  writer->lastHeight = (uint32_t)frame->height;
+  writer->lastFormat = (uint32_t)frame->format;
+  pthread_cond_signal(&writer->work);
+  pthread_mutex_unlock(&writer->lock);
+  return 0;
+}
+
+void fa_stats(faWriter_t *writer, faStats_t *stats)
+{
+  pthread_mutex_lock(&writer->lock);
+  *stats = writer->stats;
+  pthread_mutex_unlock(&writer->lock);
+}
+
+int fa_close(faWriter_t *writer, faStats_t *stats)
+{
+  unsigned int ind;
+  int rc;
+
+  pthread_mutex_lock(&writer->lock);
+  writer->closing = 1;
+  pthread_cond_broadcast(&writer->work);
+  pthread_cond_broadcast(&writer->done);
+  pthread_mutex_unlock(&writer->lock);
+  for(ind = 0; ind < (unsigned int)writer->numWorkers; ++ind) {
+    pthread_join(writer->workers[ind], NULL);
+  }
+  pthread_join(writer->writerThread, NULL);
+
+  if((close(writer->fd) != 0) && (writer->stats.writeError == 0)) {
+    writer->stats.writeError = errno;
+  }
+  rc = (writer->stats.writeError == 0) ? 0 : -1;
+  if(stats != NULL) {
+    *stats = writer->stats;
+  }
+
+  for(ind = 0; ind < writer->depth; ++ind) {
+    free(writer->slots[ind].raw);
+    free(writer->slots[ind].coded);
+  }
+  pthread_cond_destroy(&writer->space);
+  pthread_cond_destroy(&writer->done);
+  pthread_cond_destroy(&writer->work);
+  pthread_mutex_destroy(&writer->lock);
+  free(writer->slots);
+  free(writer->workers);
+  free(writer);
+  return rc;
+}
+
+faReader_t *fa_open(const char *path)
+{
+  faReader_t *reader;
+  faFileHeader_t header;
+  FILE *fp;
+
+  if((fp = fopen(path, "rb")) == NULL) {
+    perror(path);
+    return NULL;
+  }
+  if((fread(&header, sizeof(header), 1, fp) != 1) || (header.magic != FA_FILE_MAGIC) ||
+     (header.version != FA_VERSION)) {
+    fprintf(stderr, "%s is not a frame archive\n", path);
+    fclose(fp);
+    return NULL;
+  }
+  reader = (faReader_t *)calloc(1, sizeof(*reader));
+  if(reader == NULL) {
+    fclose(fp);
+    return NULL;
+  }
+  reader->fp = fp;
+  return reader;
+}
+
+/* 1 with a sane record header, 0 at the end, -1 if corrupt */
+static int read_record(faReader_t *reader, faRecord_t *rec, size_t *bytes, size_t *coded)
+{
+  int p;
+
+  if(fread(rec, sizeof(*rec), 1, reader->fp) != 1) {
+    return feof(reader->fp) ? 0 : -1;
+  }
+  *bytes = frame_bytes(rec->format, (int)rec->width, (int)rec->height);
+  if((rec->magic != FA_RECORD_MAGIC) || (*bytes == 0)) {
+    return -1;
+  }
+  *coded = 0;
+  for(p = 0; p < FA_MAX_PLANES; ++p) {
+    *coded += rec->planeBytes[p];
+  }
+  return (*coded <= fa_bound(*bytes)) ? 1 : -1;
+}
+
+int fa_read(faReader_t *reader, fsFrame_t *frame)
+{
+  faRecord_t rec;
+  size_t bytes, coded;
+  uint8_t *swap;
+  int r, delta;
+
+  if((r = read_record(reader, &rec, &bytes, &coded)) != 1) {
+    return r;
+  }
+  delta = !(rec.flags & FA_KEY);
+  if(delta && (!reader->haveRef || (rec.format != reader->last.format) ||
+               (rec.width != reader->last.width) || (rec.height != reader->last.height))) {
+    return -1;
+  }
+
+  if((grow(&reader->coded, &reader->codedSize, coded) != 0) ||
+     (grow(&reader->scratch, &reader->scratchSize, (size_t)rec.width * rec.height) != 0)) {
+    return -1;
+  }
+  if(reader->frameSize < bytes) {
+    free(reader->cur);
+    free(reader->prev);
+    reader->cur = (uint8_t *)malloc(bytes);
+    reader->prev = (uint8_t *)malloc(bytes);
+    reader->frameSize = ((reader->cur != NULL) && (reader->prev != NULL)) ? bytes : 0;
+    reader->haveRef = 0;
+    if(reader->frameSize == 0) {
+      return -1;
+    }
+  }
+  if(fread(reader->coded, 1, coded, reader->fp) != coded) {
+    return feof(reader->fp) ? 0 : -1;
+  }
+
+  /* the frame just returned is this one's reference */
+  swap = reader->prev;
+  reader->prev = reader->cur;
+  reader->cur = swap;
+  if(decode_frame(&rec, reader->coded, delta ? reader->prev : NULL, reader->cur, reader->scratch) != 0) {
+    reader->haveRef = 0;
+    return -1;
+  }
+  reader->haveRef = 1;
+  reader->last = rec;
+
+  frame->data = reader->cur;
+  frame->bytes = bytes;
+  frame->width = (int)rec.width;
+  frame->height = (int)rec.height;
+  frame->format = (fsFormat_e)rec.format;
+  frame->sequence = rec.sequence;
+  frame->timestamp.tv_sec = (time_t)rec.sec;
+  frame->timestamp.tv_nsec = (long)rec.nsec;
+  frame->lateNs = 0;
+  return 1;
+}
+
+int fa_skip(faReader_t *reader, faRecord_t *rec)
+{
+  size_t bytes, coded;
+  int r;
+
+  if((r = read_record(reader, rec, &bytes, &coded)) != 1) {
+    return r;
+  }
+  reader->haveRef = 0;
+  if(fseek(reader->fp, (long)coded, SEEK_CUR) != 0) {
+    return -1;
+  }
+  return 1;
+}
+
+int fa_rewind(faReader_t *reader)
+{
+  reader->haveRef = 0;
+  return fseek(reader->fp, (long)sizeof(faFileHeader_t), SEEK_SET);
+}
+
+void fa_close_reader(faReader_t *reader)
+{
+  if(reader == NULL) {
+    return;
+  }
+  fclose(reader->fp);
+  free(reader->cur);
+  free(reader->prev);
+  free(reader->coded);
+  free(reader->scratch);
+  free(reader);
+}
@@ -0,0 +1,178 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file framearchive.h
+ * @brief losslessly compressed frame archive, encoded on a pool of threads
+ *
+ * Instead of one raw PPM/PGM per frame, frames are appended to a single
+ * archive file. The captured bytes are stored, not the RGB conversion, so a
+ * YUYV frame keeps its 2 bytes per pixel and decodes back to the same
+ * pixels the dump would have written.
+ *
+ * Each plane (Y, or Y U V of YUYV, or R G B) is predicted and the residuals
+ * coded with a handful of byte codes in the spirit of QOI: runs of zero
+ * residual, two small residuals in one byte, one medium residual in one
+ * byte, or a literal. Key frames predict from the neighbours (LOCO-I median
+ * predictor); delta frames predict from the same pixel of the previous
+ * frame, which turns a still scene into runs. A key frame is written every
+ * keyInterval frames so damage or a seek never reaches back far.
+ *
+ * fa_submit() only copies the frame into a free slot; workers encode slots
+ * in any order and a writer thread appends them in submission order.
+ *
+ * Records are written in the host's byte order: the archive is meant to be
+ * read back on the machine that wrote it, or one like it.
+ *
+ ************************************************************************************
+ */
+
+#ifndef FRAMEARCHIVE_H
+#define FRAMEARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "framesource.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FA_FILE_MAGIC                 (0x43524146u)   /* "FARC" */
+#define FA_RECORD_MAGIC               (0x4d524646u)   /* "FFRM" */
+#define FA_VERSION                    (1)
+#define FA_MAX_PLANES                 (3)
+#define FA_KEY                        (0x1)           /* record flag: no reference */
+
+typedef struct {
+  uint32_t magic;               /* FA_FILE_MAGIC */
+  uint32_t version;
+} faFileHeader_t;
+
+typedef struct {
+  uint32_t magic;               /* FA_RECORD_MAGIC */
+  uint32_t flags;               /* FA_KEY */
+  uint32_t sequence;            /* the caller's frame number */
+  uint32_t format;              /* fsFormat_e */
+  uint32_t width;
+  uint32_t height;
+  int64_t sec;                  /* the caller's timestamp */
+  int64_t nsec;
+  uint32_t planeBytes[FA_MAX_PLANES];   /* coded size of each plane, in order */
+  uint32_t reserved;
+} faRecord_t;
+
+typedef struct {
+  uint64_t frames;              /* submitted */
+  uint64_t refused;             /* no free slot, not archived */
+  uint64_t keys;
+  uint64_t rawBytes;            /* of the frames as captured */
+  uint64_t storedBytes;         /* written, headers included */
+  uint64_t encodeNs;            /* summed over workers */
+  uint64_t writeNs;
+  int writeError;               /* errno of the first failed write, 0 if none */
+} faStats_t;
+
+typedef struct faWriter_s faWriter_t;
+typedef struct faReader_s faReader_t;
+
+/**
+ * @brief create (truncate) an archive and start its threads
+ *
+ * @param path archive file
+ * @param workers encoder threads, 0 = online CPUs
+ * @param depth frames buffered between submit and write, at least 2
+ * @param keyInterval a key frame every this many frames; 1 = key frames only
+ * @param sync fdatasync after every record
+ * @return faWriter_t* NULL if the file can not be created or out of memory
+ */
+faWriter_t *fa_create(const char *path, int workers, int depth, int keyInterval, int sync);
+
+/**
+ * @brief queue a frame for archiving; the data is copied
+ *
+ * @param writer archive
+ * @param frame data, size, format, sequence and timestamp are used
+ * @param block wait for a free slot rather than refuse the frame
+ * @return int 0 if queued, -1 if refused (no free slot, or the writer failed)
+ */
+int fa_submit(faWriter_t *writer, const fsFrame_t *frame, int block);
+
+/**
+ * @brief counters so far
+ */
+void fa_stats(faWriter_t *writer, faStats_t *stats);
+
+/**
+ * @brief write what is queued, stop the threads and close the file
+ *
+ * @param writer archive
+ * @param stats final counters, may be NULL
+ * @return int 0, or -1 if any write failed
+ */
+int fa_close(faWriter_t *writer, faStats_t *stats);
+
+/**
+ * @brief open an archive for reading
+ *
+ * @return faReader_t* NULL if missing or not an archive
+ */
+faReader_t *fa_open(const char *path);
+
+/**
+ * @brief decode the next frame
+ *
+ * @param reader archive
+ * @param frame filled in; data valid until the next fa_read, lateNs is 0
+ * @return int 1 with a frame, 0 at the end (a record cut short, as by a
+ *         crash mid write, is the end), -1 if corrupt
+ */
+int fa_read(faReader_t *reader, fsFrame_t *frame);
+
+/**
+ * @brief step over the next frame without decoding it, for an index; the
+ * frames after it up to the next key frame can not be decoded
+ *
+ * @param reader archive
+ * @param rec set to the frame's record
+ * @return int 1 with a record, 0 at the end, -1 if corrupt
+ */
+int fa_skip(faReader_t *reader, faRecord_t *rec);
+
+/**
+ * @brief back to the first frame
+ */
+int fa_rewind(faReader_t *reader);
+
+void fa_close_reader(faReader_t *reader);
+
+/**
+ * @brief encode one frame, for benchmarks; the archive does this per slot
+ *
+ * @param frame the frame
+ * @param ref previous frame, same size and format, or NULL for a key frame
+ * @param out at least fa_bound() bytes
+ * @param scratch at least width * height bytes
+ * @param planeBytes set to the coded size of each plane
+ * @return size_t coded bytes, planes back to back
+ */
+size_t fa_encode(const fsFrame_t *frame, const uint8_t *ref, uint8_t *out, uint8_t *scratch,
+                 uint32_t planeBytes[FA_MAX_PLANES]);
+
+/**
+ * @brief worst case fa_encode() size for a frame of bytes bytes
+ */
+size_t fa_bound(size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAMEARCHIVE_H */
@@ -0,0 +1,523 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file framesource.c
+ * @brief file-backed fake camera: replays recorded frames at an exact rate
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+#include "framesource.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define NSEC_PER_SEC                  (1000000000ULL)
+#define FS_SPEC_LEN                   (2 * FS_PATH_LEN)
+
+typedef enum {
+  FS_KIND_PNM,
+  FS_KIND_YUYV,
+  FS_KIND_READER                /* a registered fsReader_t */
+} fsKind_e;
+
+struct frameSource_s {
+  fsKind_e kind;
+  char path[FS_PATH_LEN];       /* pattern for pnm */
+  FILE *file;                   /* yuyv */
+  const fsReader_t *reader;     /* registered kinds */
+  void *handle;
+  const uint8_t *readerData;    /* the reader's frame, not in buf */
+  int width;
+  int height;
+  fsFormat_e format;
+  size_t frameBytes;
+  uint8_t *buf;
+  int pending;                  /* buf already holds the next frame */
+
+  double fps;                   /* 0 = unpaced, unless timestamps */
+  int haveFps;                  /* fps given in the spec */
+  double *ts;                   /* recorded timestamps, seconds */
+  int numTs;
+  int start;                    /* first pnm index */
+  int loops;                    /* 0 = forever */
+  int drop;
+
+  int loop;                     /* current pass through the sequence */
+  int pos;                      /* frame within the pass */
+  uint32_t sequence;            /* frames released so far */
+  uint64_t epochNs;             /* release time of frame 0, 0 until started */
+  uint64_t loopBaseNs;          /* timestamp mode: offset of this pass */
+  uint64_t dropped;
+};
+
+static const fsReader_t *readers[FS_MAX_READERS];
+static int numReaders;
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static uint64_t now_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+static void sleep_until(uint64_t whenNs)
+{
+  struct timespec when;
+
+  when.tv_sec = (time_t)(whenNs / NSEC_PER_SEC);
+  when.tv_nsec = (long)(whenNs % NSEC_PER_SEC);
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL) == EINTR) {
+  }
+}
+
+/* a span of recorded time; timestamps that run backwards give 0, not a
+ * wrapped unsigned sleep */
+static uint64_t span_ns(double seconds)
+{
+  return (seconds > 0.0) ? (uint64_t)llround(seconds * 1e9) : 0;
+}
+
+/* mean recorded frame interval, also the gap between passes */
+static double ts_interval(const frameSource_t *src)
+{
+  if(src->numTs < 2) {
+    return 1.0 / FS_DEFAULT_FPS;
+  }
+  return (src->ts[src->numTs - 1] - src->ts[0]) / (src->numTs - 1);
+}
+
+/* release time of the current frame relative to frame 0 */
+static uint64_t release_offset(const frameSource_t *src)
+{
+  if(src->ts != NULL) {
+    return src->loopBaseNs + span_ns(src->ts[src->pos] - src->ts[0]);
+  }
+  /* from the index, not accumulated, so there is no drift */
+  return (uint64_t)llround(src->sequence * 1e9 / src->fps);
+}
+
+/* gap to the next frame's release */
+static uint64_t release_interval(const frameSource_t *src)
+{
+  if(src->ts != NULL) {
+    if(src->pos + 1 < src->numTs) {
+      return span_ns(src->ts[src->pos + 1] - src->ts[src->pos]);
+    }
+    return span_ns(ts_interval(src));
+  }
+  return (uint64_t)llround(1e9 / src->fps);
+}
+
+static int load_timestamps(frameSource_t *src, const char *name)
+{
+  char line[128];
+  char *end;
+  double val;
+  int cap = 0;
+  FILE *fp = fopen(name, "r");
+
+  if(fp == NULL) {
+    fprintf(stderr, "can't open timestamps %s: %s\n", name, strerror(errno));
+    return -1;
+  }
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    val = strtod(line, &end);
+    if(end == line) {
+      continue;               /* header or blank */
+    }
+    if(src->numTs == cap) {
+      cap = (cap == 0) ? 256 : 2 * cap;
+      double *grown = (double *)realloc(src->ts, cap * sizeof(*src->ts));
+      if(grown == NULL) {
+        fclose(fp);
+        return -1;
+      }
+      src->ts = grown;
+    }
+    src->ts[src->numTs++] = val;
+  }
+  fclose(fp);
+  if(src->numTs == 0) {
+    fprintf(stderr, "no timestamps in %s\n", name);
+    return -1;
+  }
+  return 0;
+}
+
+/* next header number, skipping whitespace and comments */
+static int pnm_number(FILE *fp, int *val)
+{
+  int c;
+
+  for(;;) {
+    c = fgetc(fp);
+    if(c == '#') {
+      while((c != '\n') && (c != EOF)) {
+        c = fgetc(fp);
+      }
+    } else if(!isspace(c)) {
+      break;
+    }
+  }
+  if(!isdigit(c)) {
+    return -1;
+  }
+  *val = 0;
+  while(isdigit(c)) {
+    *val = *val * 10 + (c - '0');
+    c = fgetc(fp);
+  }
+  /* c is the single whitespace that ends the header */
+  return 0;
+}
+
+/* 1 frame read, 0 no such file, -1 error */
+static int read_pnm(frameSource_t *src, int index)
+{
+  char name[FS_PATH_LEN];
+  int width, height, maxval, magic;
+  fsFormat_e format;
+  size_t bytes;
+  FILE *fp;
+
+  snprintf(name, sizeof(name), src->path, index);
+  if((fp = fopen(name, "rb")) == NULL) {
+    return 0;
+  }
+  if((fgetc(fp) != 'P') || (((magic = fgetc(fp)) != '5') && (magic != '6')) ||
+     (pnm_number(fp, &width) != 0) || (pnm_number(fp, &height) != 0) ||
+     (pnm_number(fp, &maxval) != 0) || (maxval > 255)) {
+    fprintf(stderr, "%s is not an 8-bit binary PGM/PPM\n", name);
+    fclose(fp);
+    return -1;
+  }
+  format = (magic == '5') ? FS_GREY : FS_RGB24;
+  bytes = (size_t)width * height * ((format == FS_GREY) ? 1 : 3);
+
+  if(src->buf == NULL) {
+    src->width = width;
+    src->height = height;
+    src->format = format;
+    src->frameBytes = bytes;
+    if((src->buf = (uint8_t *)malloc(bytes)) == NULL) {
+      fclose(fp);
+      return -1;
+    }
+  } else if((width != src->width) || (height != src->height) || (format != src->format)) {
+    fprintf(stderr, "%s differs from the first frame\n", name);
+    fclose(fp);
+    return -1;
+  }
+
+  if(fread(src->buf, 1, bytes, fp) != bytes) {
+    fprintf(stderr, "%s is truncated\n", name);
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  return 1;
+}
+
+/* 1 frame read, 0 end of file, -1 error */
+static int read_yuyv(frameSource_t *src)
+{
+  size_t got = fread(src->buf, 1, src->frameBytes, src->file);
+
+  if(got == src->frameBytes) {
+    return 1;
+  }
+  if(ferror(src->file)) {
+    fprintf(stderr, "reading %s: %s\n", src->path, strerror(errno));
+    return -1;
+  }
+  return 0;                   /* a partial last frame ends the recording too */
+}
+
+static const fsReader_t *find_reader(const char *spec)
+{
+  int i;
+
+  for(i = 0; i < numReaders; ++i) {
+    if(strncmp(spec, readers[i]->prefix, strlen(readers[i]->prefix)) == 0) {
+      return readers[i];
+    }
+  }
+  return NULL;
+}
+
+/* the frame at pos of the current pass; wraps to the next pass at the end */
+static int read_next(frameSource_t *src)
+{
+  int r;
+
+  for(;;) {
+    if((src->ts != NULL) && (src->pos >= src->numTs)) {
+      r = 0;                  /* no timestamp, no frame */
+    } else if(src->kind == FS_KIND_PNM) {
+      r = read_pnm(src, src->start + src->pos);
+    } else if(src->kind == FS_KIND_READER) {
+      r = src->reader->read(src->handle, &src->readerData);
+    } else {
+      r = read_yuyv(src);
+    }
+    if((r != 0) || (src->pos == 0)) {
+      return r;
+    }
+
+    /* end of a pass */
+    if((src->loops != 0) && (src->loop + 1 >= src->loops)) {
+      return 0;
+    }
+    if(src->ts != NULL) {
+      src->loopBaseNs += span_ns(src->ts[src->pos - 1] - src->ts[0] + ts_interval(src));
+    }
+    ++src->loop;
+    src->pos = 0;
+    if(src->kind == FS_KIND_YUYV) {
+      rewind(src->file);
+    } else if((src->kind == FS_KIND_READER) && (src->reader->rewind(src->handle) != 0)) {
+      return -1;
+    }
+  }
+}
+
+static int parse_spec(frameSource_t *src, const char *spec)
+{
+  char copy[FS_SPEC_LEN];
+  char *save = NULL;
+  char *tok;
+  const char *body;
+
+  if(strncmp(spec, "pnm:", 4) == 0) {
+    src->kind = FS_KIND_PNM;
+    body = spec + 4;
+  } else if(strncmp(spec, "yuyv:", 5) == 0) {
+    src->kind = FS_KIND_YUYV;
+    body = spec + 5;
+  } else if((src->reader = find_reader(spec)) != NULL) {
+    src->kind = FS_KIND_READER;
+    body = spec + strlen(src->reader->prefix);
+  } else {
+    return -1;
+  }
+  snprintf(copy, sizeof(copy), "%s", body);
+
+  if((tok = strtok_r(copy, ",", &save)) == NULL) {
+    return -1;
+  }
+  snprintf(src->path, sizeof(src->path), "%s", tok);
+
+  while((tok = strtok_r(NULL, ",", &save)) != NULL) {
+    if(strncmp(tok, "fps=", 4) == 0) {
+      src->fps = atof(tok + 4);
+      src->haveFps = 1;
+    } else if(strncmp(tok, "ts=", 3) == 0) {
+      if(load_timestamps(src, tok + 3) != 0) {
+        return -1;
+      }
+    } else if(strncmp(tok, "size=", 5) == 0) {
+      if(sscanf(tok + 5, "%dx%d", &src->width, &src->height) != 2) {
+        return -1;
+      }
+    } else if(strncmp(tok, "start=", 6) == 0) {
+      src->start = atoi(tok + 6);
+    } else if(strncmp(tok, "loop=", 5) == 0) {
+      src->loops = atoi(tok + 5);
+    } else if(strcmp(tok, "drop") == 0) {
+      src->drop = 1;
+    } else {
+      fprintf(stderr, "unknown frame source option %s\n", tok);
+      return -1;
+    }
+  }
+
+  /* an explicit rate overrides the recorded one; a reader may have its own */
+  if(src->haveFps) {
+    free(src->ts);
+    src->ts = NULL;
+    src->numTs = 0;
+  } else if((src->ts == NULL) && (src->kind != FS_KIND_READER)) {
+    src->fps = FS_DEFAULT_FPS;
+  }
+  if((src->fps < 0.0) || (src->loops < 0)) {
+    return -1;
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int fs_is_spec(const char *spec)
+{
+  return (spec != NULL) && ((strncmp(spec, "pnm:", 4) == 0) || (strncmp(spec, "yuyv:", 5) == 0) ||
+                            (find_reader(spec) != NULL));
+}
+
+int fs_register(const fsReader_t *reader)
+{
+  if(find_reader(reader->prefix) == reader) {
+    return 0;
+  }
+  if(numReaders == FS_MAX_READERS) {
+    return -1;
+  }
+  readers[numReaders++] = reader;
+  return 0;
+}
+
+frameSource_t *fs_open(const char *spec)
+{
+  frameSource_t *src = (frameSource_t *)calloc(1, sizeof(*src));
+
+  if(src == NULL) {
+    return NULL;
+  }
+  src->loops = 1;
+  if(parse_spec(src, spec) != 0) {
+    fprintf(stderr, "bad frame source %s\n", spec);
+    fs_close(src);
+    return NULL;
+  }
+
+  if(src->kind == FS_KIND_YUYV) {
+    if((src->width <= 0) || (src->height <= 0) || (src->width & 1)) {
+      fprintf(stderr, "%s needs size=WxH with an even width\n", spec);
+      fs_close(src);
+      return NULL;
+    }
+    src->format = FS_YUYV;
+    src->frameBytes = (size_t)src->width * src->height * 2;
+    src->buf = (uint8_t *)malloc(src->frameBytes);
+    if((src->buf == NULL) || ((src->file = fopen(src->path, "rb")) == NULL)) {
+      fprintf(stderr, "can't open %s\n", src->path);
+      fs_close(src);
+      return NULL;
+    }
+  }
+
+  if(src->kind == FS_KIND_READER) {
+    double *recorded = NULL;
+    int numRecorded = 0;
+    if((src->handle = src->reader->open(src->path, &src->width, &src->height, &src->format,
+                                        &recorded, &numRecorded)) == NULL) {
+      fs_close(src);
+      return NULL;
+    }
+    /* a ts file stands in for the recorded times, fps for any */
+    if(src->haveFps || (src->ts != NULL) || (recorded == NULL)) {
+      free(recorded);
+      if(!src->haveFps && (src->ts == NULL)) {
+        src->fps = FS_DEFAULT_FPS;
+      }
+    } else {
+      src->ts = recorded;
+      src->numTs = numRecorded;
+    }
+    src->frameBytes = (src->format == FS_GREY) ? (size_t)src->width * src->height :
+                      (size_t)src->width * src->height * ((src->format == FS_RGB24) ? 3 : 2);
+  }
+
+  if(read_next(src) != 1) {
+    fprintf(stderr, "no first frame in %s\n", src->path);
+    fs_close(src);
+    return NULL;
+  }
+  src->pending = 1;
+  return src;
+}
+
+void fs_format(const frameSource_t *src, int *width, int *height, fsFormat_e *format)
+{
+  *width = src->width;
+  *height = src->height;
+  *format = src->format;
+}
+
+int fs_read(frameSource_t *src, fsFrame_t *frame)
+{
+  uint64_t release, now;
+  int r;
+
+  if(src->epochNs == 0) {
+    src->epochNs = now_ns();
+  }
+
+  for(;;) {
+    if(!src->pending && ((r = read_next(src)) != 1)) {
+      return r;
+    }
+    src->pending = 0;
+
+    if((src->fps == 0.0) && (src->ts == NULL)) {
+      release = now_ns();     /* unpaced: released when asked for */
+    } else {
+      release = src->epochNs + release_offset(src);
+      now = now_ns();
+      if(src->drop && (now > release + release_interval(src))) {
+        /* the next frame is already out; this one was overwritten */
+        ++src->dropped;
+        ++src->sequence;
+        ++src->pos;
+        continue;
+      }
+      if(now < release) {
+        sleep_until(release);
+      }
+    }
+    break;
+  }
+
+  now = now_ns();
+  frame->data = (src->kind == FS_KIND_READER) ? src->readerData : src->buf;
+  frame->bytes = src->frameBytes;
+  frame->width = src->width;
+  frame->height = src->height;
+  frame->format = src->format;
+  frame->sequence = src->sequence;
+  frame->timestamp.tv_sec = (time_t)(release / NSEC_PER_SEC);
+  frame->timestamp.tv_nsec = (long)(release % NSEC_PER_SEC);
+  frame->lateNs = (now > release) ? now - release : 0;
+
+  ++src->sequence;
+  ++src->pos;
+  return 1;
+}
+
+uint64_t fs_dropped(const frameSource_t *src)
+{
+  return src->dropped;
+}
+
+void fs_close(frameSource_t *src)
+{
+  if(src == NULL) {
+    return;
+  }
+  if(src->file != NULL) {
+    fclose(src->file);
+  }
+  if(src->handle != NULL) {
+    src->reader->close(src->handle);
+  }
+  free(src->buf);
+  free(src->ts);
+  free(src);
+}
@@ -0,0 +1,143 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file framesource.h
+ * @brief file-backed fake camera: replays recorded frames at an exact rate
+ *
+ * A source is opened from a spec string, so every program can take it from
+ * the same command line argument:
+ *   pnm:PATTERN[,opts]     binary PGM (P5) / PPM (P6) files, PATTERN is a
+ *                          printf pattern for the frame index, e.g.
+ *                          pnm:/data/test%08d.ppm
+ *   yuyv:FILE,size=WxH[,opts]
+ *                          raw YUYV 4:2:2 frames back to back
+ *   far:FILE[,opts]        a capture archive (framearchive.h), released with
+ *                          the spacing it was captured at unless fps or ts
+ *                          is given; fps=0 replays it as fast as possible.
+ *                          Available after fa_register_source() (farsource.h);
+ *                          kinds read by other modules are added with
+ *                          fs_register(), so framesource does not depend on them
+ * opts, comma separated:
+ *   fps=N      release rate; 0 = as fast as the reader takes them
+ *   ts=FILE    recorded timestamps, seconds, first field of each line; the
+ *              frames are released with the recorded spacing (default is
+ *              FS_DEFAULT_FPS when neither fps nor ts is given)
+ *   start=N    first index of a pnm pattern [0]
+ *   loop=N     play the sequence N times, 0 = forever [1]
+ *   drop       skip frames the reader is a whole interval late for, as a
+ *              camera overwriting its ring would, and count them
+ *
+ * Frame 0 is released by the first fs_read, not by fs_open, so setup between
+ * the two does not make the first frames late. Frame k is released at that
+ * first read + offset(k), offset from the rate or the timestamps, by sleeping
+ * to that absolute CLOCK_MONOTONIC time, so a slow reader never shifts the
+ * schedule of later frames and the timing is the same run to run. A recorded
+ * timestamp earlier than the one before it releases its frame at once rather
+ * than waiting out a negative gap. Each frame is read from disk before the
+ * sleep.
+ *
+ ************************************************************************************
+ */
+
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FS_DEFAULT_FPS                (30.0)
+#define FS_PATH_LEN                   (256)
+
+typedef enum {
+  FS_GREY,                      /* 1 byte per pixel */
+  FS_RGB24,                     /* 3 bytes per pixel, R first */
+  FS_YUYV                       /* 2 bytes per pixel, Y0 U Y1 V */
+} fsFormat_e;
+
+typedef struct {
+  const uint8_t *data;          /* valid until the next fs_read */
+  size_t bytes;
+  int width;
+  int height;
+  fsFormat_e format;
+  uint32_t sequence;            /* release index, skipped frames included */
+  struct timespec timestamp;    /* CLOCK_MONOTONIC release time */
+  uint64_t lateNs;              /* handed over this long after release */
+} fsFrame_t;
+
+typedef struct frameSource_s frameSource_t;
+
+#define FS_MAX_READERS                (4)
+
+/* a kind of recording read by another module, registered with fs_register() */
+typedef struct {
+  const char *prefix;           /* spec prefix, colon included, e.g. "far:" */
+  /* opens path and reports the format and, if it has them, the capture times
+   * (seconds, malloc'd, *ts NULL if none); NULL on error */
+  void *(*open)(const char *path, int *width, int *height, fsFormat_e *format,
+                double **ts, int *numTs);
+  /* next frame's pixels, valid until the next call: 1 frame, 0 end, -1 error */
+  int (*read)(void *handle, const uint8_t **data);
+  /* back to the first frame: 0 or -1 */
+  int (*rewind)(void *handle);
+  void (*close)(void *handle);
+} fsReader_t;
+
+/**
+ * @brief add a kind of recording; specs starting with its prefix are read
+ * with it. Not thread safe; call before the first fs_open().
+ *
+ * @param reader kept by reference
+ * @return int 0, or -1 if FS_MAX_READERS are registered
+ */
+int fs_register(const fsReader_t *reader);
+
+/**
+ * @brief is spec a replay spec (rather than a device or file for someone else)
+ */
+int fs_is_spec(const char *spec);
+
+/**
+ * @brief open a replay source; the first frame is read to learn the format
+ *
+ * @param spec see above
+ * @return frameSource_t* NULL on a bad spec or unreadable first frame
+ */
+frameSource_t *fs_open(const char *spec);
+
+/**
+ * @brief format of the frames fs_read will return
+ */
+void fs_format(const frameSource_t *src, int *width, int *height, fsFormat_e *format);
+
+/**
+ * @brief wait for the next frame's release time and return it
+ *
+ * @return int 1 with a frame, 0 at the end of the sequence, -1 on a read
+ *         error or a frame that differs in size or format from the first
+ */
+int fs_read(frameSource_t *src, fsFrame_t *frame);
+
+/**
+ * @brief frames skipped by the drop option so far
+ */
+uint64_t fs_dropped(const frameSource_t *src);
+
+void fs_close(frameSource_t *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAMESOURCE_H */
@@ -0,0 +1,102 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file frametrace.c
+ * @brief per-frame latency and output checksum, for diffing replays of a
+ * pipeline between builds
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "frametrace.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define FT_FNV_PRIME                  (0x100000001b3ULL)
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+static double diff_ms(const struct timespec *later, const struct timespec *earlier)
+{
+  return (double)(later->tv_sec - earlier->tv_sec) * 1.0e3 +
+         (double)(later->tv_nsec - earlier->tv_nsec) * 1.0e-6;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+int ft_open(frameTrace_t *trace, const char *pipeline)
+{
+  const char *path = getenv(FT_ENV_PATH);
+
+  memset(trace, 0, sizeof(*trace));
+  if((path == NULL) || (path[0] == '\0')) {
+    return 0;
+  }
+  if((trace->fp = fopen(path, "w")) == NULL) {
+    perror(path);
+    return -1;
+  }
+  pthread_mutex_init(&trace->lock, NULL);
+  fprintf(trace->fp, "# %s\n%s\n", pipeline, FT_HEADER);
+  return 1;
+}
+
+uint64_t ft_checksum(uint64_t sum, const void *data, size_t bytes)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  size_t i;
+
+  for(i = 0; i < bytes; ++i) {
+    sum = (sum ^ p[i]) * FT_FNV_PRIME;
+  }
+  return sum;
+}
+
+uint64_t ft_checksum_image(uint64_t sum, const uint8_t *data, int rows, size_t rowBytes, size_t step)
+{
+  int r;
+
+  for(r = 0; r < rows; ++r) {
+    sum = ft_checksum(sum, data + (size_t)r * step, rowBytes);
+  }
+  return sum;
+}
+
+void ft_record(frameTrace_t *trace, uint32_t sequence, const struct timespec *released,
+               const struct timespec *done, uint64_t checksum)
+{
+  if(trace->fp == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&trace->lock);
+  if(!trace->haveOrigin) {
+    trace->origin = *released;
+    trace->haveOrigin = 1;
+  }
+  fprintf(trace->fp, "%u,%.3f,%.3f,%016" PRIx64 "\n", sequence, diff_ms(released, &trace->origin),
+          diff_ms(done, released), checksum);
+  ++trace->frames;
+  pthread_mutex_unlock(&trace->lock);
+}
+
+void ft_close(frameTrace_t *trace)
+{
+  if(trace->fp == NULL) {
+    return;
+  }
+  fclose(trace->fp);
+  trace->fp = NULL;
+  pthread_mutex_destroy(&trace->lock);
+}
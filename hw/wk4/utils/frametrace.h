@@ -0,0 +1,95 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file frametrace.h
+ * @brief per-frame latency and output checksum, for diffing replays of a
+ * pipeline between builds
+ *
+ * A pipeline run on a replayed recording writes one CSV line per output:
+ *   sequence,release_ms,latency_ms,checksum
+ * sequence is the replay's release index (frames the pipeline skipped are
+ * missing), release_ms when the frame was released relative to the first
+ * one traced, latency_ms release to output and checksum a 64-bit FNV-1a
+ * over the output, in hex. The same recording through the same code gives
+ * the same sequences and checksums; latency is what changes with a build.
+ *
+ * The trace goes to the file named by FT_ENV_PATH, so a driver (replay/)
+ * can ask any pipeline for one without a command line option.
+ *
+ ************************************************************************************
+ */
+
+#ifndef FRAMETRACE_H
+#define FRAMETRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FT_ENV_PATH                   "FRAME_TRACE"
+#define FT_CHECKSUM_INIT              (0xcbf29ce484222325ULL)
+#define FT_HEADER                     "sequence,release_ms,latency_ms,checksum"
+
+typedef struct {
+  FILE *fp;                     /* NULL when not tracing */
+  pthread_mutex_t lock;         /* pipelines record from their own threads */
+  int haveOrigin;
+  struct timespec origin;       /* first release traced */
+  uint64_t frames;
+} frameTrace_t;
+
+/**
+ * @brief start a trace if FT_ENV_PATH names a file
+ *
+ * @param trace trace to set up
+ * @param pipeline written to a comment line first
+ * @return int 1 tracing, 0 not asked to, -1 the file can not be created
+ */
+int ft_open(frameTrace_t *trace, const char *pipeline);
+
+static inline int ft_enabled(const frameTrace_t *trace)
+{
+  return trace->fp != NULL;
+}
+
+/**
+ * @brief continue a checksum over bytes more of output
+ */
+uint64_t ft_checksum(uint64_t sum, const void *data, size_t bytes);
+
+/**
+ * @brief continue a checksum over an image, row by row so padding is left out
+ */
+uint64_t ft_checksum_image(uint64_t sum, const uint8_t *data, int rows, size_t rowBytes, size_t step);
+
+/**
+ * @brief one output; does nothing when not tracing
+ *
+ * @param trace trace
+ * @param sequence release index of the frame
+ * @param released when the frame was released, CLOCK_MONOTONIC
+ * @param done when the output was ready
+ * @param checksum of the output
+ */
+void ft_record(frameTrace_t *trace, uint32_t sequence, const struct timespec *released,
+               const struct timespec *done, uint64_t checksum);
+
+void ft_close(frameTrace_t *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAMETRACE_H */
@@ -0,0 +1,230 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file pyramid.c
+ * @brief shared, lazily built 1/2, 1/4 and 1/8 levels of a frame
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdlib.h>
+#include <string.h>
+
+#include "pyramid.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define GAUSS_PAD                     (2)     /* pixels of replicated edge per side */
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+
+/* the channel count is a constant at every call, so each case gets its own
+ * vectorized loop instead of one with a runtime stride */
+static inline __attribute__((always_inline))
+void box_row(const uint16_t *sum, uint8_t *dst, int outWidth, const int ch)
+{
+  int x, c;
+
+  for(x = 0; x < outWidth; ++x) {
+    for(c = 0; c < ch; ++c) {
+      dst[x * ch + c] = (uint8_t)((sum[2 * x * ch + c] + sum[(2 * x + 1) * ch + c] + 2) >> 2);
+    }
+  }
+}
+
+static inline __attribute__((always_inline))
+void gauss_row(const uint16_t *sum, uint8_t *dst, int outWidth, const int ch)
+{
+  int x, c;
+
+  for(x = 0; x < outWidth; ++x) {
+    for(c = 0; c < ch; ++c) {
+      const uint16_t *s = sum + 2 * x * ch + c;
+      dst[x * ch + c] = (uint8_t)((s[-2 * ch] + 4 * (s[-ch] + s[ch]) + 6 * s[0] + s[2 * ch] + 128) >> 8);
+    }
+  }
+}
+
+static void downsample_box(const pyrLevel_t *src, pyrLevel_t *dst, uint8_t *out, int ch, uint16_t *sum)
+{
+  const int n = 2 * dst->width * ch;
+  int y, i;
+
+  for(y = 0; y < dst->height; ++y) {
+    const uint8_t *r0 = src->data + (size_t)(2 * y) * src->step;
+    const uint8_t *r1 = r0 + src->step;
+    uint8_t *row = out + (size_t)y * dst->step;
+
+    for(i = 0; i < n; ++i) {
+      sum[i] = (uint16_t)(r0[i] + r1[i]);
+    }
+    switch(ch) {
+    case 1:  box_row(sum, row, dst->width, 1);  break;
+    case 3:  box_row(sum, row, dst->width, 3);  break;
+    default: box_row(sum, row, dst->width, ch); break;
+    }
+  }
+}
+
+static void downsample_gauss(const pyrLevel_t *src, pyrLevel_t *dst, uint8_t *out, int ch, uint16_t *sum)
+{
+  const int n = src->width * ch;
+  const int pad = GAUSS_PAD * ch;
+  uint16_t *mid = sum + pad;
+  const uint8_t *r[5];
+  int y, i, k;
+
+  for(y = 0; y < dst->height; ++y) {
+    uint8_t *row = out + (size_t)y * dst->step;
+
+    for(k = 0; k < 5; ++k) {
+      int sy = 2 * y + k - 2;
+      sy = (sy < 0) ? 0 : ((sy >= src->height) ? src->height - 1 : sy);
+      r[k] = src->data + (size_t)sy * src->step;
+    }
+    for(i = 0; i < n; ++i) {
+      mid[i] = (uint16_t)(r[0][i] + 4 * (r[1][i] + r[3][i]) + 6 * r[2][i] + r[4][i]);
+    }
+    for(i = 0; i < pad; ++i) {
+      sum[i] = mid[i % ch];
+      mid[n + i] = mid[n - ch + i % ch];
+    }
+    switch(ch) {
+    case 1:  gauss_row(mid, row, dst->width, 1);  break;
+    case 3:  gauss_row(mid, row, dst->width, 3);  break;
+    default: gauss_row(mid, row, dst->width, ch); break;
+    }
+  }
+}
+
+/* lock held; the level above is built */
+static int build_level(pyramid_t *pyr, int level)
+{
+  const pyrLevel_t *src = &pyr->levels[level - 1];
+  pyrLevel_t *dst = &pyr->levels[level];
+  uint8_t *out;
+  uint16_t *sum;
+
+  out = (uint8_t *)malloc(dst->step * dst->height);
+  sum = (uint16_t *)malloc(sizeof(uint16_t) * (src->width + 2 * GAUSS_PAD) * pyr->channels);
+  if((out == NULL) || (sum == NULL)) {
+    free(out);
+    free(sum);
+    return -1;
+  }
+  if(pyr->filter == PYR_GAUSSIAN) {
+    downsample_gauss(src, dst, out, pyr->channels, sum);
+  } else {
+    downsample_box(src, dst, out, pyr->channels, sum);
+  }
+  free(sum);
+  dst->data = out;
+  return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+pyramid_t *pyr_create(const uint8_t *data, int width, int height, int channels, size_t step,
+                      pyrFilter_e filter, void (*release)(void *arg), void *arg)
+{
+  pyramid_t *pyr;
+  int level;
+
+  if((data == NULL) || (width <= 0) || (height <= 0) || (channels <= 0)) {
+    return NULL;
+  }
+  pyr = (pyramid_t *)calloc(1, sizeof(pyramid_t));
+  if(pyr == NULL) {
+    return NULL;
+  }
+  pyr->levels[0].data = data;
+  pyr->levels[0].width = width;
+  pyr->levels[0].height = height;
+  pyr->levels[0].step = step;
+  pyr->numLevels = 1;
+  for(level = 1; level < PYR_MAX_LEVELS; ++level) {
+    if(((width >> level) < 1) || ((height >> level) < 1)) {
+      break;
+    }
+    pyr->levels[level].width = width >> level;
+    pyr->levels[level].height = height >> level;
+    pyr->levels[level].step = (size_t)(width >> level) * channels;
+    pyr->numLevels = level + 1;
+  }
+  pyr->channels = channels;
+  pyr->built = 1;
+  pyr->filter = filter;
+  pyr->refs = 1;
+  pyr->release = release;
+  pyr->releaseArg = arg;
+  pthread_mutex_init(&pyr->lock, NULL);
+  return pyr;
+}
+
+const pyrLevel_t *pyr_level(pyramid_t *pyr, int level)
+{
+  const pyrLevel_t *result = NULL;
+
+  if((level < 0) || (level >= pyr->numLevels)) {
+    return NULL;
+  }
+  if(level < __atomic_load_n(&pyr->built, __ATOMIC_ACQUIRE)) {
+    return &pyr->levels[level];
+  }
+
+  pthread_mutex_lock(&pyr->lock);
+  while(pyr->built <= level) {
+    if(build_level(pyr, pyr->built) != 0) {
+      break;
+    }
+    __atomic_store_n(&pyr->built, pyr->built + 1, __ATOMIC_RELEASE);
+  }
+  if(level < pyr->built) {
+    result = &pyr->levels[level];
+  }
+  pthread_mutex_unlock(&pyr->lock);
+  return result;
+}
+
+int pyr_find(const pyramid_t *pyr, int width, int height)
+{
+  int level;
+
+  for(level = 0; level < pyr->numLevels; ++level) {
+    if((pyr->levels[level].width == width) && (pyr->levels[level].height == height)) {
+      return level;
+    }
+  }
+  return -1;
+}
+
+void pyr_ref(pyramid_t *pyr)
+{
+  __atomic_add_fetch(&pyr->refs, 1, __ATOMIC_RELAXED);
+}
+
+void pyr_unref(pyramid_t *pyr)
+{
+  int level;
+
+  if(__atomic_sub_fetch(&pyr->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+  for(level = 1; level < pyr->built; ++level) {
+    free((void *)pyr->levels[level].data);
+  }
+  pthread_mutex_destroy(&pyr->lock);
+  if(pyr->release != NULL) {
+    pyr->release(pyr->releaseArg);
+  }
+  free(pyr);
+}
@@ -0,0 +1,112 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file pyramid.h
+ * @brief shared, lazily built 1/2, 1/4 and 1/8 levels of a frame
+ *
+ * A pyramid wraps one captured frame (level 0, not copied) and builds the
+ * smaller levels the first time someone asks for them, each from the one
+ * above it, so every consumer of the frame shares one set of levels instead
+ * of resizing on its own. Levels are read only once built. The pyramid is
+ * reference counted; the last pyr_unref() frees the levels and hands the
+ * frame back through the release callback.
+ *
+ * Downsampling is a 2x2 box average or the 5-tap [1 4 6 4 1] Gaussian of
+ * cv::pyrDown (edges replicated), done as a vertical pass into a 16-bit row
+ * and a horizontal pass; both loops vectorize when built with -O3.
+ *
+ ************************************************************************************
+ */
+
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PYR_MAX_LEVELS                (4)     /* full, 1/2, 1/4, 1/8 */
+
+typedef enum {
+  PYR_BOX,                      /* 2x2 average, like INTER_AREA */
+  PYR_GAUSSIAN                  /* 5x5 binomial, like pyrDown */
+} pyrFilter_e;
+
+typedef struct {
+  const uint8_t *data;          /* NULL until built */
+  int width;
+  int height;
+  size_t step;                  /* bytes between rows */
+} pyrLevel_t;
+
+typedef struct {
+  pyrLevel_t levels[PYR_MAX_LEVELS];
+  int channels;
+  int numLevels;                /* levels the frame is big enough for */
+  int built;                    /* levels ready, atomic */
+  pyrFilter_e filter;
+  int refs;                     /* atomic */
+  pthread_mutex_t lock;         /* serializes building */
+  void (*release)(void *arg);
+  void *releaseArg;
+} pyramid_t;
+
+/**
+ * @brief wrap a frame; the caller holds the only reference
+ *
+ * @param data top-left pixel of the frame, 8 bits per channel
+ * @param width frame width, pixels
+ * @param height frame height, pixels
+ * @param channels bytes per pixel
+ * @param step bytes between rows
+ * @param filter downsampling filter
+ * @param release called with arg once the last reference is gone, or NULL
+ * @param arg passed to release
+ * @return pyramid_t* the pyramid, NULL if out of memory or bad sizes; the
+ *         frame then still belongs to the caller
+ */
+pyramid_t *pyr_create(const uint8_t *data, int width, int height, int channels, size_t step,
+                      pyrFilter_e filter, void (*release)(void *arg), void *arg);
+
+/**
+ * @brief a level, building it (and those above it) on first use; any thread
+ *
+ * @param pyr pyramid
+ * @param level 0 for the frame, 1 for 1/2 size and so on
+ * @return const pyrLevel_t* the level, NULL if out of range or memory;
+ *         valid while the caller holds a reference
+ */
+const pyrLevel_t *pyr_level(pyramid_t *pyr, int level);
+
+/**
+ * @brief which level has this size, without building anything
+ *
+ * @return int the level, -1 if none
+ */
+int pyr_find(const pyramid_t *pyr, int width, int height);
+
+/**
+ * @brief one more consumer; any thread
+ */
+void pyr_ref(pyramid_t *pyr);
+
+/**
+ * @brief consumer done; the last one frees the pyramid. Any thread
+ */
+void pyr_unref(pyramid_t *pyr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYRAMID_H */
@@ -0,0 +1,60 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file pyramidmat.h
+ * @brief pyramid.h levels as cv::Mat headers
+ *
+ * pyr_from_mat() builds a pyramid over a captured cv::Mat, keeping a
+ * reference to its data, and pyr_mat() returns a level as a Mat header onto
+ * the pyramid's memory; no pixels are copied either way. The header must
+ * not be written to and is valid only while a pyramid reference is held.
+ * Read the next frame into a fresh Mat, not the one the pyramid was built
+ * from: a capture reuses a buffer of the same size even if it is shared.
+ *
+ ************************************************************************************
+ */
+
+#ifndef PYRAMIDMAT_H
+#define PYRAMIDMAT_H
+
+#include "opencv2/core.hpp"
+
+#include "pyramid.h"
+
+static inline void pyr_release_mat(void *arg)
+{
+    delete (cv::Mat *)arg;
+}
+
+/* NULL for an empty or not 8-bit frame */
+static inline pyramid_t *pyr_from_mat(const cv::Mat& img, pyrFilter_e filter)
+{
+    if(img.empty() || (img.depth() != CV_8U)) {
+        return NULL;
+    }
+    cv::Mat *keep = new cv::Mat(img);
+    pyramid_t *pyr = pyr_create(img.data, img.cols, img.rows, img.channels(), img.step,
+                                filter, pyr_release_mat, keep);
+    if(pyr == NULL) {
+        delete keep;
+    }
+    return pyr;
+}
+
+/* empty if the level can not be had */
+static inline cv::Mat pyr_mat(pyramid_t *pyr, int level)
+{
+    const pyrLevel_t *l = pyr_level(pyr, level);
+    if(l == NULL) {
+        return cv::Mat();
+    }
+    return cv::Mat(l->height, l->width, CV_MAKETYPE(CV_8U, pyr->channels), (void *)l->data, l->step);
+}
+
+#endif /* PYRAMIDMAT_H */
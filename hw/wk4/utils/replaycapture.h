@@ -0,0 +1,165 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file replaycapture.h
+ * @brief cv::VideoCapture that can also replay a framesource.h spec
+ *
+ * open() with a replay spec (pnm:... or yuyv:...) plays the recording at its
+ * recorded or configured rate; anything else goes to VideoCapture as
+ * before. Frames come out as 8-bit BGR like a camera's, through the usual
+ * read() / operator>>, so code that takes a VideoCapture& runs unchanged on
+ * a machine without a camera.
+ *
+ ************************************************************************************
+ */
+
+#ifndef REPLAYCAPTURE_H
+#define REPLAYCAPTURE_H
+
+#include <stdint.h>
+
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/videoio.hpp"
+
+#include "framesource.h"
+
+class ReplayCapture : public cv::VideoCapture
+{
+public:
+    ReplayCapture() : src(NULL), haveFrame(false)
+    {
+    }
+
+    virtual ~ReplayCapture()
+    {
+        release();
+    }
+
+    bool open(int index, int apiPreference = cv::CAP_ANY)
+    {
+        release();
+        return cv::VideoCapture::open(index, apiPreference);
+    }
+
+    bool open(const cv::String& spec, int apiPreference = cv::CAP_ANY)
+    {
+        release();
+        if(!fs_is_spec(spec.c_str())) {
+            return cv::VideoCapture::open(spec, apiPreference);
+        }
+        src = fs_open(spec.c_str());
+        return src != NULL;
+    }
+
+    virtual bool isOpened() const
+    {
+        return (src != NULL) || cv::VideoCapture::isOpened();
+    }
+
+    virtual void release()
+    {
+        if(src != NULL) {
+            fs_close(src);
+            src = NULL;
+        }
+        haveFrame = false;
+        cv::VideoCapture::release();
+    }
+
+    /* waits for the next release time */
+    virtual bool grab()
+    {
+        if(src == NULL) {
+            return cv::VideoCapture::grab();
+        }
+        haveFrame = (fs_read(src, &frame) == 1);
+        return haveFrame;
+    }
+
+    virtual bool retrieve(cv::OutputArray image, int flag = 0)
+    {
+        if(src == NULL) {
+            return cv::VideoCapture::retrieve(image, flag);
+        }
+        if(!haveFrame) {
+            image.release();
+            return false;
+        }
+        void *data = (void *)frame.data;
+        switch(frame.format) {
+        case FS_GREY:
+            cv::cvtColor(cv::Mat(frame.height, frame.width, CV_8UC1, data), image, cv::COLOR_GRAY2BGR);
+            break;
+        case FS_RGB24:
+            cv::cvtColor(cv::Mat(frame.height, frame.width, CV_8UC3, data), image, cv::COLOR_RGB2BGR);
+            break;
+        case FS_YUYV:
+            cv::cvtColor(cv::Mat(frame.height, frame.width, CV_8UC2, data), image, cv::COLOR_YUV2BGR_YUYV);
+            break;
+        }
+        return true;
+    }
+
+    virtual bool read(cv::OutputArray image)
+    {
+        if(src == NULL) {
+            return cv::VideoCapture::read(image);
+        }
+        if(!grab()) {
+            image.release();
+            return false;
+        }
+        return retrieve(image);
+    }
+
+    virtual cv::VideoCapture& operator>>(cv::Mat& image)
+    {
+        if(src == NULL) {
+            return cv::VideoCapture::operator>>(image);
+        }
+        read(image);
+        return *this;
+    }
+
+    /* a recording's size is fixed; only the position can be asked for */
+    virtual bool set(int propId, double value)
+    {
+        return (src == NULL) ? cv::VideoCapture::set(propId, value) : false;
+    }
+
+    virtual double get(int propId) const
+    {
+        if(src == NULL) {
+            return cv::VideoCapture::get(propId);
+        }
+        int width, height;
+        fsFormat_e format;
+        fs_format(src, &width, &height, &format);
+        switch(propId) {
+        case cv::CAP_PROP_FRAME_WIDTH:  return width;
+        case cv::CAP_PROP_FRAME_HEIGHT: return height;
+        case cv::CAP_PROP_POS_FRAMES:   return haveFrame ? frame.sequence + 1 : 0;
+        default:                        return 0;
+        }
+    }
+
+    bool replaying() const { return src != NULL; }
+
+    /* release time, sequence and lateness of the last frame read */
+    const fsFrame_t& lastFrame() const { return frame; }
+
+    uint64_t dropped() const { return (src != NULL) ? fs_dropped(src) : 0; }
+
+private:
+    frameSource_t *src;
+    fsFrame_t frame;
+    bool haveFrame;
+};
+
+#endif /* REPLAYCAPTURE_H */
@@ -0,0 +1,426 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file rtstats.c
+ * @brief per-stage latency, deadline and jitter statistics for frame pipelines
+ *
+ ************************************************************************************
+ */
+
+/*---------------------------------------------------------------------------------*/
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "rtstats.h"
+
+/*---------------------------------------------------------------------------------*/
+/* MACROS / TYPES / CONST */
+#define NSEC_PER_SEC                  (1000000000ULL)
+#define NSEC_PER_MSEC                 (1.0e6)
+#define RTSTATS_BACKLOG               (4)
+#define RTSTATS_POLL_MSEC             (100)   /* how soon destroy is noticed */
+
+#define LOAD(ptr)                     __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define ADD(ptr, val)                 __atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+#define SWAP(ptr, val)                __atomic_exchange_n((ptr), (val), __ATOMIC_RELAXED)
+
+/*---------------------------------------------------------------------------------*/
+/* PRIVATE FUNCTIONS */
+
+static int bucket_index(uint64_t val)
+{
+  int msb, shift;
+
+  if(val < RTSTATS_SUB) {
+    return (int)val;
+  }
+  msb = 63 - __builtin_clzll(val);
+  if(msb > RTSTATS_MAX_LOG2) {
+    return RTSTATS_BUCKETS - 1;
+  }
+  shift = msb - RTSTATS_SUB_BITS;
+  return (shift + 1) * RTSTATS_SUB + (int)((val >> shift) - RTSTATS_SUB);
+}
+
+/* middle of the range a bucket covers */
+static uint64_t bucket_value(int idx)
+{
+  int shift;
+
+  if(idx < RTSTATS_SUB) {
+    return (uint64_t)idx;
+  }
+  shift = idx / RTSTATS_SUB - 1;
+  return ((uint64_t)(RTSTATS_SUB + idx % RTSTATS_SUB) << shift) + ((1ULL << shift) >> 1);
+}
+
+static void update_max(uint64_t *max, uint64_t val)
+{
+  uint64_t cur = LOAD(max);
+
+  while((val > cur) &&
+        !__atomic_compare_exchange_n(max, &cur, val, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+/* copy a histogram; returns the number of samples in the copy */
+static uint64_t hist_copy(const rtHist_t *hist, uint64_t *dst)
+{
+  uint64_t total = 0;
+  int ind;
+
+  for(ind = 0; ind < RTSTATS_BUCKETS; ++ind) {
+    dst[ind] = LOAD(&hist->bucket[ind]);
+    total += dst[ind];
+  }
+  return total;
+}
+
+/* value at a quantile of a copied histogram, never above max */
+static uint64_t hist_quantile(const uint64_t *bucket, uint64_t total, double quantile, uint64_t max)
+{
+  uint64_t rank, seen = 0;
+  int ind;
+
+  if(total == 0) {
+    return 0;
+  }
+  rank = (uint64_t)(quantile * (double)total + 0.5);
+  if(rank < 1) {
+    rank = 1;
+  } else if(rank > total) {
+    rank = total;
+  }
+  for(ind = 0; ind < RTSTATS_BUCKETS; ++ind) {
+    seen += bucket[ind];
+    if(seen >= rank) {
+      break;
+    }
+  }
+  if(ind == RTSTATS_BUCKETS) {
+    return max;
+  }
+  return (bucket_value(ind) < max) ? bucket_value(ind) : max;
+}
+
+static void close_client(rtStats_t *stats, int idx)
+{
+  close(stats->clientFd[idx]);
+  stats->clientFd[idx] = -1;
+}
+
+static void send_snapshot(rtStats_t *stats, int idx, const char *text, size_t len)
+{
+  if(send(stats->clientFd[idx], text, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len) {
+    /* gone, or too slow to keep up; either way stop feeding it */
+    close_client(stats, idx);
+  }
+}
+
+static void *serve_task(void *arg)
+{
+  rtStats_t *stats = (rtStats_t *)arg;
+  struct pollfd fds[1 + RTSTATS_MAX_CLIENTS];
+  char text[RTSTATS_TEXT_LEN];
+  struct timespec now;
+  uint64_t nextNs, nowNs;
+  int len, ind, nfds, timeoutMs;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  nextNs = rtstats_ts_to_ns(&now) + stats->intervalMs * 1000000ULL;
+  while(__atomic_load_n(&stats->running, __ATOMIC_ACQUIRE)) {
+    /* listen socket plus clients, only to notice hang-ups */
+    fds[0].fd = stats->listenFd;
+    fds[0].events = POLLIN;
+    nfds = 1;
+    for(ind = 0; ind < RTSTATS_MAX_CLIENTS; ++ind) {
+      fds[nfds].fd = stats->clientFd[ind];
+      fds[nfds].events = POLLIN;
+      fds[nfds].revents = 0;
+      ++nfds;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    nowNs = rtstats_ts_to_ns(&now);
+    timeoutMs = (nextNs > nowNs) ? (int)((nextNs - nowNs) / 1000000ULL) + 1 : 0;
+    if(timeoutMs > RTSTATS_POLL_MSEC) {
+      timeoutMs = RTSTATS_POLL_MSEC;
+    }
+    if(poll(fds, nfds, timeoutMs) < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      syslog(LOG_ERR, "%s poll failed, errno: %d [%s]", __func__, errno, strerror(errno));
+      break;
+    }
+
+    /* clients only listen; any input or hang-up ends them */
+    for(ind = 0; ind < RTSTATS_MAX_CLIENTS; ++ind) {
+      if((stats->clientFd[ind] >= 0) && (fds[1 + ind].revents != 0)) {
+        close_client(stats, ind);
+      }
+    }
+
+    /* new client gets a snapshot right away */
+    if(fds[0].revents & POLLIN) {
+      int fd = accept(stats->listenFd, NULL, NULL);
+      if(fd >= 0) {
+        for(ind = 0; (ind < RTSTATS_MAX_CLIENTS) && (stats->clientFd[ind] >= 0); ++ind) {
+        }
+        if(ind == RTSTATS_MAX_CLIENTS) {
+          close(fd);
+        } else {
+          stats->clientFd[ind] = fd;
+          len = rtstats_format(stats, text, sizeof(text));
+          send_snapshot(stats, ind, text, len);
+        }
+      }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    nowNs = rtstats_ts_to_ns(&now);
+    if(nowNs >= nextNs) {
+      nextNs += stats->intervalMs * 1000000ULL;
+      if(nextNs <= nowNs) {
+        nextNs = nowNs + stats->intervalMs * 1000000ULL;
+      }
+      len = rtstats_format(stats, text, sizeof(text));
+      for(ind = 0; ind < RTSTATS_MAX_CLIENTS; ++ind) {
+        if(stats->clientFd[ind] >= 0) {
+          send_snapshot(stats, ind, text, len);
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS */
+
+void rtstats_init(rtStats_t *stats)
+{
+  int ind;
+
+  memset(stats, 0, sizeof(rtStats_t));
+  stats->listenFd = -1;
+  for(ind = 0; ind < RTSTATS_MAX_CLIENTS; ++ind) {
+    stats->clientFd[ind] = -1;
+  }
+}
+
+int rtstats_add_stage(rtStats_t *stats, const char *name, double deadlineMs, double periodMs)
+{
+  rtStage_t *stage;
+
+  if(stats->numStages >= RTSTATS_MAX_STAGES) {
+    return -1;
+  }
+  stage = &stats->stages[stats->numStages];
+  memset(stage, 0, sizeof(rtStage_t));
+  snprintf(stage->name, sizeof(stage->name), "%s", name);
+  stage->deadlineNs = (deadlineMs > 0.0) ? (uint64_t)(deadlineMs * NSEC_PER_MSEC) : 0;
+  stage->periodNs = (periodMs > 0.0) ? (uint64_t)(periodMs * NSEC_PER_MSEC) : 0;
+  return stats->numStages++;
+}
+
+uint64_t rtstats_ts_to_ns(const struct timespec *ts)
+{
+  return (uint64_t)ts->tv_sec * NSEC_PER_SEC + (uint64_t)ts->tv_nsec;
+}
+
+void rtstats_record(rtStats_t *stats, int stage, const struct timespec *start, const struct timespec *end)
+{
+  rtstats_record_ns(stats, stage, rtstats_ts_to_ns(start), rtstats_ts_to_ns(end));
+}
+
+void rtstats_record_ns(rtStats_t *stats, int stage, uint64_t startNs, uint64_t endNs)
+{
+  rtStage_t *st = &stats->stages[stage];
+  uint64_t latency = (endNs > startNs) ? endNs - startNs : 0;
+  uint64_t prevEnd, interval, ref, dev;
+
+  ADD(&st->latency.bucket[bucket_index(latency)], 1);
+  ADD(&st->sumNs, latency);
+  update_max(&st->maxNs, latency);
+  if((st->deadlineNs != 0) && (latency > st->deadlineNs)) {
+    ADD(&st->misses, 1);
+  }
+
+  /* jitter needs two arrivals, or three without a nominal period; with
+   * several writers an out-of-order end time is simply skipped */
+  prevEnd = SWAP(&st->lastEndNs, endNs);
+  if((prevEnd != 0) && (endNs > prevEnd)) {
+    interval = endNs - prevEnd;
+    ref = (st->periodNs != 0) ? st->periodNs : SWAP(&st->lastIntervalNs, interval);
+    if(ref != 0) {
+      dev = (interval > ref) ? interval - ref : ref - interval;
+      ADD(&st->jitter.bucket[bucket_index(dev)], 1);
+      update_max(&st->maxJitterNs, dev);
+    }
+  }
+
+  /* last, so a snapshot never sees more frames than histogram samples */
+  ADD(&st->count, 1);
+}
+
+int rtstats_snapshot(rtStats_t *stats, int stage, rtStageSnap_t *snap)
+{
+  uint64_t bucket[RTSTATS_BUCKETS];
+  rtStage_t *st;
+  uint64_t total, max;
+
+  if((stage < 0) || (stage >= stats->numStages)) {
+    return -1;
+  }
+  st = &stats->stages[stage];
+  memset(snap, 0, sizeof(rtStageSnap_t));
+  memcpy(snap->name, st->name, sizeof(snap->name));
+  snap->count = LOAD(&st->count);
+  snap->misses = LOAD(&st->misses);
+  if(snap->count != 0) {
+    snap->meanMs = (double)LOAD(&st->sumNs) / (double)snap->count / NSEC_PER_MSEC;
+  }
+
+  max = LOAD(&st->maxNs);
+  total = hist_copy(&st->latency, bucket);
+  snap->p50Ms = hist_quantile(bucket, total, 0.50, max) / NSEC_PER_MSEC;
+  snap->p90Ms = hist_quantile(bucket, total, 0.90, max) / NSEC_PER_MSEC;
+  snap->p99Ms = hist_quantile(bucket, total, 0.99, max) / NSEC_PER_MSEC;
+  snap->p999Ms = hist_quantile(bucket, total, 0.999, max) / NSEC_PER_MSEC;
+  snap->maxMs = max / NSEC_PER_MSEC;
+
+  max = LOAD(&st->maxJitterNs);
+  total = hist_copy(&st->jitter, bucket);
+  snap->jitterP99Ms = hist_quantile(bucket, total, 0.99, max) / NSEC_PER_MSEC;
+  snap->jitterMaxMs = max / NSEC_PER_MSEC;
+  return 0;
+}
+
+double rtstats_percentile_ms(rtStats_t *stats, int stage, double quantile)
+{
+  uint64_t bucket[RTSTATS_BUCKETS];
+  rtStage_t *st;
+  uint64_t total;
+
+  if((stage < 0) || (stage >= stats->numStages)) {
+    return 0.0;
+  }
+  st = &stats->stages[stage];
+  total = hist_copy(&st->latency, bucket);
+  return hist_quantile(bucket, total, quantile, LOAD(&st->maxNs)) / NSEC_PER_MSEC;
+}
+
+int rtstats_format(rtStats_t *stats, char *buf, size_t len)
+{
+  rtStageSnap_t snap;
+  size_t used = 0;
+  int ind, cnt;
+
+  buf[0] = '\0';
+  for(ind = 0; ind < stats->numStages; ++ind) {
+    rtstats_snapshot(stats, ind, &snap);
+    cnt = snprintf(buf + used, len - used,
+                   "%s n=%llu miss=%llu mean=%.3f p50=%.3f p90=%.3f p99=%.3f p99.9=%.3f "
+                   "max=%.3f jitter_p99=%.3f jitter_max=%.3f msec\n",
+                   snap.name, (unsigned long long)snap.count, (unsigned long long)snap.misses,
+                   snap.meanMs, snap.p50Ms, snap.p90Ms, snap.p99Ms, snap.p999Ms,
+                   snap.maxMs, snap.jitterP99Ms, snap.jitterMaxMs);
+    if((cnt < 0) || ((size_t)cnt >= len - used)) {
+      break;
+    }
+    used += cnt;
+  }
+  return (int)used;
+}
+
+int rtstats_serve(rtStats_t *stats, const char *sockPath, unsigned int intervalMs)
+{
+  struct sockaddr_un addr;
+
+  if((sockPath == NULL) || (strlen(sockPath) >= sizeof(addr.sun_path)) || (intervalMs == 0)) {
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, sockPath);
+  unlink(sockPath);
+  stats->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if(stats->listenFd < 0) {
+    syslog(LOG_ERR, "%s couldn't create socket, errno: %d [%s]", __func__, errno, strerror(errno));
+    return -1;
+  }
+  if((bind(stats->listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+     (listen(stats->listenFd, RTSTATS_BACKLOG) != 0)) {
+    syslog(LOG_ERR, "%s couldn't listen on %s, errno: %d [%s]", __func__, sockPath, errno, strerror(errno));
+    close(stats->listenFd);
+    stats->listenFd = -1;
+    return -1;
+  }
+  strcpy(stats->sockPath, sockPath);
+  stats->intervalMs = intervalMs;
+
+  /* plain priority; the server must never compete with the pipeline */
+  stats->running = 1;
+  if(pthread_create(&stats->thread, NULL, serve_task, stats) != 0) {
+    syslog(LOG_ERR, "%s couldn't create thread", __func__);
+    stats->running = 0;
+    close(stats->listenFd);
+    stats->listenFd = -1;
+    unlink(sockPath);
+    return -1;
+  }
+  syslog(LOG_INFO, "rtstats: serving snapshots on %s every %u msec", sockPath, intervalMs);
+  return 0;
+}
+
+void rtstats_log(rtStats_t *stats)
+{
+  rtStageSnap_t snap;
+  int ind;
+
+  for(ind = 0; ind < stats->numStages; ++ind) {
+    rtstats_snapshot(stats, ind, &snap);
+    syslog(LOG_INFO, "rtstats: %s: %llu frames, %llu deadline misses",
+           snap.name, (unsigned long long)snap.count, (unsigned long long)snap.misses);
+    syslog(LOG_INFO, "rtstats: %s: mean %.3f p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f msec",
+           snap.name, snap.meanMs, snap.p50Ms, snap.p90Ms, snap.p99Ms, snap.p999Ms, snap.maxMs);
+    syslog(LOG_INFO, "rtstats: %s: jitter p99 %.3f max %.3f msec",
+           snap.name, snap.jitterP99Ms, snap.jitterMaxMs);
+  }
+}
+
+void rtstats_destroy(rtStats_t *stats)
+{
+  int ind;
+
+  if(stats->running) {
+    __atomic_store_n(&stats->running, 0, __ATOMIC_RELEASE);
+    pthread_join(stats->thread, NULL);
+  }
+  for(ind = 0; ind < RTSTATS_MAX_CLIENTS; ++ind) {
+    if(stats->clientFd[ind] >= 0) {
+      close_client(stats, ind);
+    }
+  }
+  if(stats->listenFd >= 0) {
+    close(stats->listenFd);
+    stats->listenFd = -1;
+    unlink(stats->sockPath);
+  }
+}
@@ -0,0 +1,200 @@
+/***********************************************************************************
+ * @author Joshua Malburg
+ * joshua.malburg@colorado.edu
+ * Real-time Embedded Systems
+ * ECEN5623 - Sam Siewert
+ * @date 12Jul2020
+ * Ubuntu 18.04 LTS and Jetbot
+ ************************************************************************************
+ *
+ * @file rtstats.h
+ * @brief per-stage latency, deadline and jitter statistics for frame pipelines
+ *
+ * Each pipeline stage records (start, end) timestamps per frame. A stage keeps
+ *  - a log-linear (HDR style) histogram of latency, end - start: 32 linear
+ *    sub-buckets per power of two, so any percentile is within 1/64 of the
+ *    true value from 1 nsec up to ~2 min
+ *  - exact count, max, sum and deadline misses (latency > deadline)
+ *  - a histogram of inter-arrival jitter: |interval - period| between
+ *    successive end times, or |interval - previous interval| when the stage
+ *    has no nominal period
+ *
+ * Recording is a handful of relaxed atomic adds, no locks and no system
+ * calls, so it can run in SCHED_FIFO threads and from several threads on the
+ * same stage. Snapshots read the counters with atomic loads while recording
+ * goes on; a snapshot may be a frame behind in some fields but never blocks
+ * or disturbs the writers.
+ *
+ * rtstats_serve() starts a thread that streams a text snapshot of every stage
+ * to clients of a Unix socket once per interval, e.g.
+ *   socat - UNIX-CONNECT:/tmp/prob5.stats
+ *
+ ************************************************************************************
+ */
+
+#ifndef RTSTATS_H
+#define RTSTATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTSTATS_MAX_STAGES            (8)
+#define RTSTATS_NAME_LEN              (24)
+#define RTSTATS_SUB_BITS              (5)
+#define RTSTATS_SUB                   (1 << RTSTATS_SUB_BITS)
+#define RTSTATS_MAX_LOG2              (36)    /* values clamp at ~2^37 nsec */
+#define RTSTATS_BUCKETS               ((RTSTATS_MAX_LOG2 - RTSTATS_SUB_BITS + 2) * RTSTATS_SUB)
+#define RTSTATS_MAX_CLIENTS           (4)
+#define RTSTATS_TEXT_LEN              (256 * RTSTATS_MAX_STAGES)
+
+typedef struct {
+  uint64_t bucket[RTSTATS_BUCKETS];
+} rtHist_t;
+
+typedef struct {
+  char name[RTSTATS_NAME_LEN];
+  uint64_t deadlineNs;          /* 0 = no deadline */
+  uint64_t periodNs;            /* 0 = jitter against the previous interval */
+
+  /* written with relaxed atomics by the recording threads */
+  uint64_t count;
+  uint64_t misses;
+  uint64_t sumNs;
+  uint64_t maxNs;
+  uint64_t maxJitterNs;
+  uint64_t lastEndNs;
+  uint64_t lastIntervalNs;
+  rtHist_t latency;
+  rtHist_t jitter;
+} rtStage_t;
+
+typedef struct {
+  char name[RTSTATS_NAME_LEN];
+  uint64_t count;
+  uint64_t misses;
+  double meanMs;
+  double p50Ms;
+  double p90Ms;
+  double p99Ms;
+  double p999Ms;
+  double maxMs;
+  double jitterP99Ms;
+  double jitterMaxMs;
+} rtStageSnap_t;
+
+typedef struct {
+  rtStage_t stages[RTSTATS_MAX_STAGES];
+  int numStages;
+
+  /* snapshot server */
+  int listenFd;
+  int clientFd[RTSTATS_MAX_CLIENTS];
+  unsigned int intervalMs;
+  char sockPath[108];
+  pthread_t thread;
+  int running;
+} rtStats_t;
+
+/**
+ * @brief clear a statistics set; no stages, no server
+ *
+ * @param stats set to initialize
+ */
+void rtstats_init(rtStats_t *stats);
+
+/**
+ * @brief add a pipeline stage; call before recording starts
+ *
+ * @param stats statistics set
+ * @param name stage name used in reports
+ * @param deadlineMs latencies above this count as misses; 0 = none
+ * @param periodMs nominal time between frames; 0 = unknown
+ * @return int stage index, -1 if the set is full
+ */
+int rtstats_add_stage(rtStats_t *stats, const char *name, double deadlineMs, double periodMs);
+
+/**
+ * @brief record one frame through a stage; lock-free, any thread
+ *
+ * @param stats statistics set
+ * @param stage index from rtstats_add_stage()
+ * @param start stage entry time (CLOCK_MONOTONIC)
+ * @param end stage exit time (CLOCK_MONOTONIC)
+ */
+void rtstats_record(rtStats_t *stats, int stage, const struct timespec *start, const struct timespec *end);
+
+/**
+ * @brief rtstats_record() with times already in nsec
+ */
+void rtstats_record_ns(rtStats_t *stats, int stage, uint64_t startNs, uint64_t endNs);
+
+/**
+ * @brief convert a timespec to nsec
+ */
+uint64_t rtstats_ts_to_ns(const struct timespec *ts);
+
+/**
+ * @brief summarize a stage; lock-free, any thread
+ *
+ * @param stats statistics set
+ * @param stage stage index
+ * @param snap destination
+ * @return int 0 on success, -1 on a bad stage index
+ */
+int rtstats_snapshot(rtStats_t *stats, int stage, rtStageSnap_t *snap);
+
+/**
+ * @brief value below which a fraction of the stage's latencies fall
+ *
+ * @param stats statistics set
+ * @param stage stage index
+ * @param quantile 0.0 .. 1.0
+ * @return double latency in msec, 0 with no samples
+ */
+double rtstats_percentile_ms(rtStats_t *stats, int stage, double quantile);
+
+/**
+ * @brief one line per stage of text, as sent to socket clients
+ *
+ * @param stats statistics set
+ * @param buf destination
+ * @param len size of buf
+ * @return int characters written, excluding the terminator
+ */
+int rtstats_format(rtStats_t *stats, char *buf, size_t len);
+
+/**
+ * @brief stream snapshots to clients of a Unix socket from a new thread
+ *
+ * @param stats statistics set, stages already added
+ * @param sockPath socket path, replaced if it exists
+ * @param intervalMs time between snapshots
+ * @return int 0 on success, -1 on socket or thread failure
+ */
+int rtstats_serve(rtStats_t *stats, const char *sockPath, unsigned int intervalMs);
+
+/**
+ * @brief write every stage's summary to syslog
+ *
+ * @param stats statistics set
+ */
+void rtstats_log(rtStats_t *stats);
+
+/**
+ * @brief stop the server, if any, and remove its socket
+ *
+ * @param stats statistics set
+ */
+void rtstats_destroy(rtStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTSTATS_H */